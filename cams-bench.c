@@ -0,0 +1,652 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <eccodes.h>
+#include <jansson.h>
+
+#include "src/download.h"
+#include "src/arena.h"
+#include "src/sort.h"
+#include "src/gributils.h"
+#include "src/fieldcache.h"
+
+#ifdef DEBUG
+#define NO_GETOPT_ERROR_OUTPUT 0
+#else
+#define NO_GETOPT_ERROR_OUTPUT 1
+#endif // DEBUG
+
+#define FORCE_VERSION "69.420"
+
+#define DEFAULT_SEED 20030101
+#define DEFAULT_REPETITIONS 10
+#define PI 3.14159265358979323846
+
+/**
+ * @brief State shared by all benchmarks
+ */
+struct BENCH {
+    uint64_t seed;          ///< seed from which every benchmark derives its synthetic inputs
+    int repetitions;        ///< number of timed repetitions of every benchmark
+    int n_threads;          ///< number of threads used by the multithreaded decoding benchmarks
+    const char *grib_file;  ///< if not NULL, GRIB file decoded instead of synthetic messages
+    char work_dir[NPOW12];  ///< temporary directory holding synthetic input files
+    double *ns;             ///< wall clock time of every repetition in nanoseconds
+    json_t *results;        ///< array of benchmark results
+};
+
+static void print_usage(void) {
+    printf(
+        "Usage: cams-bench [-h|--help] [-v|--version] [-i|--purpose] [-o|--output] [-r|--repetitions] [-s|--seed] "
+        "[-j|--threads] [-g|--grib]\n\n"
+        "[-h|--help]\t\tprint this help page and exit\n"
+        "[-v|--version]\t\tprint version\n"
+        "[-i|--purpose]\t\tshow program's purpose\n\n"
+        "Optional arguments:\n"
+        "<-o|--output>\t\tFile to write results to as JSON. Default: standard output\n"
+        "<-r|--repetitions>\tNumber of timed repetitions of every benchmark. Default: 10\n"
+        "<-s|--seed>\t\tSeed of the synthetic inputs. Default: 20030101\n"
+        "<-j|--threads>\t\tNumber of threads used by multithreaded decoding benchmarks. Default: number of CPUs\n"
+        "<-g|--grib>\t\tGRIB file to decode instead of synthetic messages\n");
+}
+
+static void print_purpose(void) {
+    printf("Benchmark parsing, request assembly, download buffering and decoding on synthetic inputs\n");
+}
+
+static void print_version(void) {
+    printf("FORCE version is: %s\n", FORCE_VERSION);
+}
+
+/**
+ * @brief Next value of a splitmix64 generator.
+ */
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += UINT64_C(0x9E3779B97F4A7C15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Uniformly distributed random number in [lo, hi).
+ */
+static double uniform(uint64_t *state, double lo, double hi) {
+    return lo + (hi - lo) * ((double) (next_random(state) >> 11) * 0x1.0p-53);
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Summarize the timings in `bench->ns` and append them to the results.
+ * @details Throughput is given for the median repetition, which is less sensitive to outliers than the mean.
+ */
+static void record(struct BENCH *bench, const char *name, size_t items, size_t bytes) {
+    double sum = 0.0;
+
+    qsort(bench->ns, bench->repetitions, sizeof(double), compare_double);
+    for (int r = 0; r < bench->repetitions; r++)
+        sum += bench->ns[r];
+
+    double min = bench->ns[0];
+    double median = bench->repetitions % 2 ? bench->ns[bench->repetitions / 2]
+                                           : 0.5 * (bench->ns[bench->repetitions / 2 - 1] +
+                                                    bench->ns[bench->repetitions / 2]);
+    double mean = sum / bench->repetitions;
+    double seconds = median > 0.0 ? median * 1e-9 : 1e-9;
+
+    json_t *result = json_pack("{s:s, s:i, s:I, s:I, s:f, s:f, s:f, s:f, s:f}",
+                               "name", name, "repetitions", bench->repetitions,
+                               "items", (json_int_t) items, "bytes", (json_int_t) bytes,
+                               "min_ns", min, "median_ns", median, "mean_ns", mean,
+                               "items_per_second", (double) items / seconds,
+                               "bytes_per_second", (double) bytes / seconds);
+
+    if (result == NULL || json_array_append_new(bench->results, result)) {
+        fprintf(stderr, "Error: Failed to append result of benchmark %s\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "%-40s %14.0f ns (median of %d)\n", name, median, bench->repetitions);
+}
+
+static void bench_parse_coordinate_file(struct BENCH *bench) {
+    static const size_t sizes[] = {100, 1000, 4000};
+    uint64_t state = bench->seed;
+    char path[NPOW12 + NPOW6], name[NPOW8];
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        snprintf(path, sizeof(path), "%s/coordinates-%zu.txt", bench->work_dir, sizes[s]);
+
+        FILE *f = fopen(path, "wt");
+        if (f == NULL) {
+            fprintf(stderr, "Error: Could not open file %s\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        // WRS-2 centers over central Europe
+        for (size_t i = 0; i < sizes[s]; i++)
+            fprintf(f, "%.6f %.6f\n", uniform(&state, 5.0, 15.5), uniform(&state, 47.0, 55.0));
+
+        size_t bytes = (size_t) ftell(f);
+        fclose(f);
+
+        for (int r = 0; r < bench->repetitions; r++) {
+            double *lon, *lat;
+            double start = now_ns();
+            parse_coordinate_file(path, &lon, &lat);
+            bench->ns[r] = now_ns() - start;
+            free(lon);
+            free(lat);
+        }
+
+        snprintf(name, sizeof(name), "parse_coordinate_file/%zu", sizes[s]);
+        record(bench, name, sizes[s], bytes);
+        unlink(path);
+    }
+}
+
+static void bench_sort_double(struct BENCH *bench) {
+    static const size_t sizes[] = {100, 1000, 4000};
+    uint64_t state = bench->seed;
+    char name[NPOW8];
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        double *input = malloc(sizes[s] * sizeof(double));
+        double *array = malloc(sizes[s] * sizeof(double));
+
+        if (input == NULL || array == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for arrays to sort\n");
+            exit(EXIT_FAILURE);
+        }
+
+        for (size_t i = 0; i < sizes[s]; i++)
+            input[i] = uniform(&state, -180.0, 180.0);
+
+        for (int r = 0; r < bench->repetitions; r++) {
+            memcpy(array, input, sizes[s] * sizeof(double));
+            double start = now_ns();
+            sort_double(array, sizes[s], bubble);
+            bench->ns[r] = now_ns() - start;
+        }
+
+        snprintf(name, sizeof(name), "sort_double/bubble/%zu", sizes[s]);
+        record(bench, name, sizes[s], sizes[s] * sizeof(double));
+
+        free(input);
+        free(array);
+    }
+}
+
+static void bench_assemble_request(struct BENCH *bench) {
+    const size_t calls = 1000;
+    struct PRODUCT_REQUEST reanalysis = {
+        .product = PRODUCT_CAMS_REPROCESSED,
+        .bbox = {.area_subset = 1, .north = 61, .east = 28, .south = 41, .west = -7},
+        .variable = "total_aerosol_optical_depth_469nm",
+        .dates = {.start = {.tm_year = 103, .tm_mon = 0, .tm_mday = 1},
+                  .end = {.tm_year = 122, .tm_mon = 11, .tm_mday = 31}},
+        .format = "grib",
+        .time_length = 8,
+        .time = {SENSING_TIME_00, SENSING_TIME_03, SENSING_TIME_06, SENSING_TIME_09, SENSING_TIME_12,
+                 SENSING_TIME_15, SENSING_TIME_18, SENSING_TIME_21},
+        .leadtime_length = 1
+    };
+    struct PRODUCT_REQUEST forecast = reanalysis;
+
+    forecast.product = PRODUCT_CAMS_COMPOSITION_FORECAST;
+    forecast.time_length = 1;
+    forecast.leadtime_length = 120;
+    for (int i = 0; i < 120; i++)
+        forecast.leadtime_hour[i] = i;
+
+    const struct PRODUCT_REQUEST *requests[] = {&reanalysis, &forecast};
+    const char *names[] = {"assemble_request/reanalysis", "assemble_request/forecast"};
+
+    struct ARENA arena;
+    arena_init(&arena, NPOW14);
+
+    for (size_t k = 0; k < 2; k++) {
+        size_t bytes = 0;
+
+        for (int r = 0; r < bench->repetitions; r++) {
+            bytes = 0;
+            double start = now_ns();
+            for (size_t c = 0; c < calls; c++) {
+                bytes += strlen(assemble_request(requests[k], &arena));
+                arena_reset(&arena);
+            }
+            bench->ns[r] = now_ns() - start;
+        }
+
+        record(bench, names[k], calls, bytes);
+    }
+
+    arena_free(&arena);
+}
+
+/**
+ * @brief Hand a payload to a cURL write callback in chunks, as cURL does while receiving a response.
+ */
+static void bench_write_callback(struct BENCH *bench, const char *name,
+                                 size_t (*callback)(char *, size_t, size_t, void *), char *payload, size_t length,
+                                 size_t chunk) {
+    char full_name[NPOW8];
+
+    for (int r = 0; r < bench->repetitions; r++) {
+        struct CURL_DATA data = {0};
+        double start = now_ns();
+        for (size_t offset = 0; offset < length; offset += chunk)
+            callback(payload + offset, 1, length - offset < chunk ? length - offset : chunk, &data);
+        bench->ns[r] = now_ns() - start;
+        free(data.data);
+    }
+
+    snprintf(full_name, sizeof(full_name), "%s/%zu", name, chunk);
+    record(bench, full_name, (length + chunk - 1) / chunk, length);
+}
+
+static void bench_write_curl(struct BENCH *bench) {
+    // cURL hands at most CURL_MAX_WRITE_SIZE (16 KiB) to a write callback at once
+    static const size_t chunks[] = {NPOW10, NPOW14};
+    const size_t length = NPOW24;
+    uint64_t state = bench->seed;
+
+    char *payload = malloc(length);
+    if (payload == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for payload\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < length; i++)
+        payload[i] = (char) (' ' + next_random(&state) % 95);
+
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        bench_write_callback(bench, "write_curl_string", write_curl_string, payload, length, chunks[c]);
+        bench_write_callback(bench, "write_curl_generic", write_curl_generic, payload, length, chunks[c]);
+    }
+
+    free(payload);
+}
+
+static void bench_parse_product_status(struct BENCH *bench) {
+    const size_t calls = 1000;
+    static const char *names[] = {"parse_product_status/queued", "parse_product_status/completed"};
+    static const char *bodies[] = {
+        "{\"state\": \"queued\", \"request_id\": \"a3a00819-ee46-470c-9403-bd842b20828a\", "
+        "\"specific_metadata_json\": {\"top_request_origin\": \"api\"}}",
+        "{\"state\": \"completed\", \"request_id\": \"a3a00819-ee46-470c-9403-bd842b20828a\", "
+        "\"location\": \"https://download-0000-ads-clone.copernicus-climate.eu/cache-compute-0000/cache/data0/"
+        "adaptor.mars.internal-1682585725.0681317-9181-12-fe1c1646-57d5-431a-b7cf-913ea09f554f.grib\", "
+        "\"content_length\": 2155863600, \"content_type\": \"application/x-grib\", "
+        "\"result_provided_by\": \"d447a679-22bf-4a39-95be-39c5280c6772\", "
+        "\"specific_metadata_json\": {\"top_request_origin\": \"api\"}}"
+    };
+
+    struct ARENA arena;
+    arena_init(&arena, NPOW14);
+
+    for (size_t k = 0; k < 2; k++) {
+        struct PRODUCT_RESPONSE response = {.arena = &arena};
+
+        for (int r = 0; r < bench->repetitions; r++) {
+            double start = now_ns();
+            for (size_t c = 0; c < calls; c++)
+                parse_product_status(bodies[k], &response);
+            bench->ns[r] = now_ns() - start;
+        }
+
+        record(bench, names[k], calls, calls * strlen(bodies[k]));
+        arena_reset(&arena);
+    }
+
+    arena_free(&arena);
+}
+
+static void bench_all_unique(struct BENCH *bench) {
+    // model base times and lead time hours of a request, all unique, i.e. the worst case
+    static const size_t sizes[] = {8, 120};
+    const size_t calls = 10000;
+    uint64_t state = bench->seed;
+    volatile int sink = 0;
+    char name[NPOW8];
+    int arr[120];
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (size_t i = 0; i < sizes[s]; i++)
+            arr[i] = (int) i;
+        for (size_t i = sizes[s] - 1; i > 0; i--) {
+            size_t j = next_random(&state) % (i + 1);
+            int tmp = arr[i];
+            arr[i] = arr[j];
+            arr[j] = tmp;
+        }
+
+        for (int r = 0; r < bench->repetitions; r++) {
+            double start = now_ns();
+            for (size_t c = 0; c < calls; c++)
+                sink += all_unique(arr, sizes[s]);
+            bench->ns[r] = now_ns() - start;
+        }
+
+        snprintf(name, sizeof(name), "all_unique/%zu", sizes[s]);
+        record(bench, name, calls, calls * sizes[s] * sizeof(int));
+    }
+}
+
+static void check_codes(int err, const char *key) {
+    if (err != CODES_SUCCESS) {
+        fprintf(stderr, "Error: Failed to encode %s of synthetic message: %s\n", key, codes_get_error_message(err));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Write four days of three-hourly fields on the 0.75 degree grid of the CAMS reanalysis to `path`.
+ * @details Values are a smooth field resembling aerosol optical depth plus noise, packed with 16 bits per value like
+ * the data served by the ADS.
+ */
+static void write_synthetic_grib(struct BENCH *bench, const char *path) {
+    const long ni = 480, nj = 241;
+    uint64_t state = bench->seed;
+
+    codes_handle *h = codes_grib_handle_new_from_samples(NULL, "regular_ll_sfc_grib2");
+    double *values = malloc(ni * nj * sizeof(double));
+    FILE *f = fopen(path, "wb");
+
+    if (h == NULL || values == NULL || f == NULL) {
+        fprintf(stderr, "Error: Failed to set up synthetic GRIB file %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    check_codes(codes_set_long(h, "paramId", 210207), "paramId");
+    check_codes(codes_set_long(h, "Ni", ni), "Ni");
+    check_codes(codes_set_long(h, "Nj", nj), "Nj");
+    check_codes(codes_set_double(h, "latitudeOfFirstGridPointInDegrees", 90.0), "latitudeOfFirstGridPointInDegrees");
+    check_codes(codes_set_double(h, "longitudeOfFirstGridPointInDegrees", 0.0), "longitudeOfFirstGridPointInDegrees");
+    check_codes(codes_set_double(h, "latitudeOfLastGridPointInDegrees", -90.0), "latitudeOfLastGridPointInDegrees");
+    check_codes(codes_set_double(h, "longitudeOfLastGridPointInDegrees", 359.25), "longitudeOfLastGridPointInDegrees");
+    check_codes(codes_set_double(h, "iDirectionIncrementInDegrees", 0.75), "iDirectionIncrementInDegrees");
+    check_codes(codes_set_double(h, "jDirectionIncrementInDegrees", 0.75), "jDirectionIncrementInDegrees");
+    check_codes(codes_set_long(h, "bitsPerValue", 16), "bitsPerValue");
+
+    for (long day = 1; day <= 4; day++) {
+        for (long hour = 0; hour < 24; hour += 3) {
+            check_codes(codes_set_long(h, "dataDate", 20030100 + day), "dataDate");
+            check_codes(codes_set_long(h, "dataTime", hour * 100), "dataTime");
+
+            double phase = (double) (day * 24 + hour) * PI / 48.0;
+            for (long j = 0; j < nj; j++) {
+                double lat = (90.0 - 0.75 * (double) j) * PI / 180.0;
+                for (long i = 0; i < ni; i++) {
+                    double lon = 0.75 * (double) i * PI / 180.0;
+                    values[j * ni + i] = 0.15 + 0.1 * cos(lat) * sin(2.0 * lon + phase) +
+                                         uniform(&state, 0.0, 0.02);
+                }
+            }
+            check_codes(codes_set_double_array(h, "values", values, ni * nj), "values");
+
+            const void *message;
+            size_t length;
+            check_codes(codes_get_message(h, &message, &length), "message");
+            if (fwrite(message, 1, length, f) != length) {
+                fprintf(stderr, "Error: Failed to write synthetic GRIB file %s\n", path);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    fclose(f);
+    free(values);
+    codes_handle_delete(h);
+}
+
+static void discard_field(const struct GRIB_FIELD *field __attribute__((unused)),
+                          int worker __attribute__((unused)), void *user __attribute__((unused))) {}
+
+static void bench_decode_file(struct BENCH *bench, const char *name, const char *path,
+                              const struct DECODE_OPTIONS *options) {
+    struct DECODE_STATS stats = {0};
+    char full_name[NPOW8];
+
+    for (int r = 0; r < bench->repetitions; r++) {
+        double start = now_ns();
+        grib_data_from_file(path, options, discard_field, NULL, &stats);
+        bench->ns[r] = now_ns() - start;
+    }
+
+    snprintf(full_name, sizeof(full_name), "%s/%d", name, options->n_threads);
+    record(bench, full_name, stats.messages, stats.bytes);
+}
+
+static void bench_decode(struct BENCH *bench) {
+    char path[NPOW12 + NPOW6], cache_dir[NPOW12 + NPOW6], name[NPOW8];
+    struct DECODE_STATS stats = {0};
+    const char *fname = bench->grib_file;
+
+    if (fname == NULL) {
+        snprintf(path, sizeof(path), "%s/synthetic.grib", bench->work_dir);
+        write_synthetic_grib(bench, path);
+        fname = path;
+    }
+
+    FILE *f = fopen(fname, "rb");
+    struct stat st;
+    if (f == NULL || fstat(fileno(f), &st) != 0) {
+        fprintf(stderr, "Error: Could not open file %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t length = (size_t) st.st_size;
+    unsigned char *buffer = malloc(length);
+    if (buffer == NULL || fread(buffer, 1, length, f) != length) {
+        fprintf(stderr, "Error: Failed to read %s into memory\n", fname);
+        exit(EXIT_FAILURE);
+    }
+    fclose(f);
+
+    int threads[] = {1, bench->n_threads};
+    size_t n_configurations = bench->n_threads > 1 ? 2 : 1;
+
+    for (size_t t = 0; t < n_configurations; t++) {
+        struct DECODE_OPTIONS options = {.n_threads = threads[t]};
+
+        for (int r = 0; r < bench->repetitions; r++) {
+            double start = now_ns();
+            grib_data_from_memory(buffer, length, &options, discard_field, NULL, &stats);
+            bench->ns[r] = now_ns() - start;
+        }
+
+        snprintf(name, sizeof(name), "grib_data_from_memory/%d", threads[t]);
+        record(bench, name, stats.messages, stats.bytes);
+
+        bench_decode_file(bench, "grib_data_from_file", fname, &options);
+    }
+    free(buffer);
+
+    snprintf(cache_dir, sizeof(cache_dir), "%s/cache", bench->work_dir);
+    if (mkdir(cache_dir, 0700) != 0) {
+        fprintf(stderr, "Error: Could not create directory %s\n", cache_dir);
+        exit(EXIT_FAILURE);
+    }
+
+    static const char *dtypes[] = {"float32", "float16", "int16"};
+    for (size_t d = 0; d < sizeof(dtypes) / sizeof(dtypes[0]); d++) {
+        struct DECODE_OPTIONS options = {
+            .n_threads = bench->n_threads, .cache_dir = cache_dir, .cache_dtype = field_cache_dtype(dtypes[d])
+        };
+
+        // build the cache outside of the timed runs
+        grib_data_from_file(fname, &options, discard_field, NULL, NULL);
+
+        snprintf(name, sizeof(name), "field_cache/%s", dtypes[d]);
+        bench_decode_file(bench, name, fname, &options);
+    }
+
+    if (bench->grib_file == NULL)
+        unlink(path);
+}
+
+/**
+ * @brief Delete all entries of a directory which holds no subdirectories and the directory itself.
+ */
+static void remove_directory(const char *dname) {
+    char path[NPOW12 + NPOW8];
+    struct dirent *entry;
+    DIR *dir = opendir(dname);
+
+    if (dir == NULL)
+        return;
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dname, entry->d_name);
+        unlink(path);
+    }
+
+    closedir(dir);
+    rmdir(dname);
+}
+
+static int parse_positive(const char *arg, const char *what, long max) {
+    char *end;
+    long val = strtol(arg, &end, 10);
+
+    if (*end != '\0' || val < 1 || val > max) {
+        fprintf(stderr, "ERROR: %s must be an integer between 1 and %ld, got \"%s\"\n", what, max, arg);
+        exit(EXIT_FAILURE);
+    }
+
+    return (int) val;
+}
+
+int main(int argc, char *argv[]) {
+    struct BENCH bench = {.seed = DEFAULT_SEED, .repetitions = DEFAULT_REPETITIONS};
+    const char *output = NULL;
+
+    int optid, long_index = 0;
+    opterr = NO_GETOPT_ERROR_OUTPUT ? 0 : 1;
+
+    static struct option long_options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"purpose", no_argument, NULL, 'i'},
+        {"version", no_argument, NULL, 'v'},
+        {"output", required_argument, NULL, 'o'},
+        {"repetitions", required_argument, NULL, 'r'},
+        {"seed", required_argument, NULL, 's'},
+        {"threads", required_argument, NULL, 'j'},
+        {"grib", required_argument, NULL, 'g'},
+        {0, 0, 0, 0}
+    };
+
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    bench.n_threads = n_cpus > 0 ? (int) n_cpus : 1;
+
+    while ((optid = getopt_long(argc, argv, ":hivo:r:s:j:g:", long_options, &long_index)) != -1) {
+        switch (optid) {
+            case 'h':
+                print_usage();
+                exit(EXIT_SUCCESS);
+            case 'i':
+                print_purpose();
+                exit(EXIT_SUCCESS);
+            case 'v':
+                print_version();
+                exit(EXIT_SUCCESS);
+            case 'o':
+                output = optarg;
+                break;
+            case 'r':
+                bench.repetitions = parse_positive(optarg, "Number of repetitions", 100000);
+                break;
+            case 's': {
+                char *end;
+                bench.seed = strtoull(optarg, &end, 10);
+                if (*end != '\0') {
+                    fprintf(stderr, "ERROR: Seed must be an unsigned integer, got \"%s\"\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+            }
+                break;
+            case 'j':
+                bench.n_threads = parse_positive(optarg, "Number of threads", 1024);
+                break;
+            case 'g':
+                bench.grib_file = optarg;
+                break;
+            case '?':
+                fprintf(stderr, "ERROR parsing option %c\n", optopt);
+                break;
+            default:
+                fprintf(stderr, "ERROR: Unreachable!\n");
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    const char *tmp = getenv("TMPDIR");
+    snprintf(bench.work_dir, sizeof(bench.work_dir), "%s/cams-bench-XXXXXX", tmp ? tmp : "/tmp");
+    if (mkdtemp(bench.work_dir) == NULL) {
+        fprintf(stderr, "ERROR: Could not create temporary directory %s\n", bench.work_dir);
+        exit(EXIT_FAILURE);
+    }
+
+    bench.ns = malloc(bench.repetitions * sizeof(double));
+    bench.results = json_array();
+    if (bench.ns == NULL || bench.results == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for results\n");
+        exit(EXIT_FAILURE);
+    }
+
+    bench_parse_coordinate_file(&bench);
+    bench_sort_double(&bench);
+    bench_assemble_request(&bench);
+    bench_write_curl(&bench);
+    bench_parse_product_status(&bench);
+    bench_all_unique(&bench);
+    bench_decode(&bench);
+
+    char cache_dir[NPOW12 + NPOW6];
+    snprintf(cache_dir, sizeof(cache_dir), "%s/cache", bench.work_dir);
+    remove_directory(cache_dir);
+    remove_directory(bench.work_dir);
+
+    json_t *root = json_pack("{s:s, s:s, s:I, s:i, s:i, s:o}", "version", FORCE_VERSION, "compiler", __VERSION__,
+                             "seed", (json_int_t) bench.seed, "repetitions", bench.repetitions,
+                             "threads", bench.n_threads, "results", bench.results);
+    if (root == NULL) {
+        fprintf(stderr, "ERROR: Failed to assemble JSON results\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int status = output ? json_dump_file(root, output, JSON_INDENT(2)) : json_dumpf(root, stdout, JSON_INDENT(2));
+    if (status != 0) {
+        fprintf(stderr, "ERROR: Failed to write results to %s\n", output ? output : "standard output");
+        exit(EXIT_FAILURE);
+    }
+    if (output == NULL)
+        printf("\n");
+
+    json_decref(root);
+    free(bench.ns);
+
+    return 0;
+}
@@ -0,0 +1,812 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <curl/curl.h>
+#include <jansson.h>
+
+#include "src/download.h"
+#include "src/arena.h"
+#include "src/broker.h"
+#include "src/trace.h"
+
+#ifdef DEBUG
+#define NO_GETOPT_ERROR_OUTPUT 0
+#else
+#define NO_GETOPT_ERROR_OUTPUT 1
+#endif // DEBUG
+
+#define FORCE_VERSION "Test, Test!"
+
+enum {
+    MAX_CONNECTIONS = 256,
+    MAX_ACCOUNTS = 16,
+    RATE_WINDOW = 60        ///< seconds over which the request rate of an account is limited
+};
+
+/**
+ * @brief ADS account requests are submitted with
+ */
+struct ACCOUNT {
+    struct CLIENT client;
+    const char *authentication;     ///< path of the credential file, NULL for the one named by ADSAUTH
+    unsigned int running;           ///< jobs of this account in flight at the ADS
+    time_t *submissions;            ///< times of the last `rate` submissions, a ring buffer
+    size_t oldest;                  ///< position of the oldest submission in the ring buffer
+};
+
+/**
+ * @brief Product request shared by all connections which sent the same request while it was pending or in flight
+ */
+struct JOB {
+    char dataset[NPOW6];
+    enum BROKER_PRIORITY priority;  ///< most urgent class of all requests merged into the job
+    char *body;                 ///< request in canonical form, compared to find identical requests
+    char path[NPOW12];          ///< spool file the product is downloaded to
+    unsigned long number;       ///< consecutive number, used for logging and the spool file name
+    int running;                ///< set once a thread was started for the job
+    int done;                   ///< set once the thread finished
+    int failed;
+    char reason[NPOW8];         ///< reason reported to waiters if the job failed
+    size_t bytes;
+    int file_fd;                ///< read-only descriptor of the spool file, passed to every waiter
+    size_t waiters;             ///< connections waiting for the job or holding its result
+    struct BROKER *broker;
+    struct ACCOUNT *account;    ///< account the job was submitted with, once it is running
+    struct JOB *next;
+};
+
+/**
+ * @brief Connection of a worker
+ */
+struct CONNECTION {
+    int fd;
+    char line[BROKER_LINE_SIZE];    ///< request received so far
+    size_t length;
+    struct JOB *job;                ///< job the connection waits for or holds the result of
+};
+
+struct BROKER {
+    struct CLIENT client;                   ///< template for the clients of all accounts
+    struct ACCOUNT accounts[MAX_ACCOUNTS];
+    size_t n_accounts;
+    const char *spool_directory;
+    unsigned int max_jobs;                  ///< maximum number of jobs in flight at the ADS per account
+    unsigned int rate;                      ///< maximum number of submissions per account and minute, 0 for no limit
+    unsigned int reserved;                  ///< slots per account bulk jobs leave free for more urgent ones
+    unsigned long jobs_created;
+    struct JOB *jobs;                       ///< all jobs in the order of their arrival
+    int notify[2];                          ///< finished jobs are reported to the event loop through this pipe
+    pthread_mutex_t status_lock;            ///< serializes checks of the ADS status, which share a cache file
+};
+
+static volatile sig_atomic_t stop = 0;
+
+static void print_usage(void) {
+    printf(
+        "Usage: cams-broker [-h|--help] [-v|--version] [-i|--purpose] "
+        "<-a|--authentication> <-S|--socket> <-o|--spool> <-j|--jobs> <-r|--rate> <-R|--reserve> <-k|--cache> "
+        "<--status-ttl>\n\n"
+        "[-h|--help]\t\tprint this help page and exit\n"
+        "[-v|--version]\t\tprint version\n"
+        "[-i|--purpose]\t\tshow program's purpose\n\n"
+        "Optional arguments:\n"
+        "<-a|--authentication>\tPath to API authentication file. Can be given multiple times to spread requests over several accounts. Default: file named by ADSAUTH\n"
+        "<-S|--socket>\t\tPath of the Unix socket to listen on. Default: $CAMS_BROKER_SOCKET or " BROKER_DEFAULT_SOCKET "\n"
+        "<-o|--spool>\t\tDirectory products are downloaded to. Should be on the file system of the workers' output directories, so that products can be hardlinked. Default: .\n"
+        "<-j|--jobs>\t\tMaximum number of requests in flight at the ADS per account. Default: 4\n"
+        "<-r|--rate>\t\tMaximum number of requests submitted per account and minute. Default: no limit\n"
+        "<-R|--reserve>\t\tSlots per account bulk requests leave free for urgent and normal ones; at least one slot remains usable by bulk requests. Default: 1\n"
+        "<-k|--cache>\t\tDirectory in which the result of the ADS status check is cached. Default: no cache\n"
+        "<--status-ttl>\t\tSeconds a cached ADS status is used without asking the server. Default: 300\n");
+}
+
+static void print_version(void) {
+    printf("FORCE version: %s\n", FORCE_VERSION);
+}
+
+static void print_purpose(void) {
+    printf("Download ECMWF CAMS data on behalf of local workers, merging identical requests\n");
+}
+
+static void handle_signal(int signal) {
+    (void) signal;
+    stop = 1;
+}
+
+static void fail_job(struct JOB *job, const char *reason) {
+    job->failed = 1;
+    snprintf(job->reason, NPOW8, "%s", reason);
+}
+
+/**
+ * @brief Submit a job to the ADS, wait for it to complete and download the product into the spool directory. Runs in
+ * a thread of its own and reports back through the notification pipe of the broker.
+ */
+static void *run_job(void *arg) {
+    struct JOB *job = (struct JOB *) arg;
+    struct BROKER *broker = job->broker;
+    struct CLIENT client = job->account->client;
+    struct ARENA arena;
+    char part[NPOW12 + NPOW4];
+
+    TRACE_BEGIN(job_span, "broker_job");
+
+    arena_init(&arena, NPOW14);
+
+    CURL *handle = curl_easy_init();
+
+    if (!handle) {
+        fail_job(job, "Failed to perform curl_easy_init");
+        goto notify;
+    }
+
+    pthread_mutex_lock(&broker->status_lock);
+    ADS_STATUS ads_status = check_ads_status(&handle, &client);
+    pthread_mutex_unlock(&broker->status_lock);
+
+    if (ads_status != ADS_STATUS_OK) {
+        fail_job(job, ads_status == ADS_STATUS_WARNING ? "Encountered warning with ADS" :
+                      "Could not determine the status of the ADS");
+        goto cleanup;
+    }
+
+    struct PRODUCT_RESPONSE response = ads_submit_request(job->dataset, job->body, &handle, &client, &arena);
+
+    while (response.state != PRODUCT_STATUS_COMPLETED && response.state != PRODUCT_STATUS_FAILED &&
+           response.state != PRODUCT_STATUS_INVALID && client.retries < client.max_retries) {
+        unsigned int remaining = client.max_sleep;
+        while ((remaining = sleep(remaining)) > 0);
+
+        ads_check_product_state(&response, &handle, &client);
+
+        client.retries++;
+    }
+
+    if (response.state != PRODUCT_STATUS_COMPLETED) {
+        fail_job(job, response.state == PRODUCT_STATUS_FAILED ? "Product request failed" :
+                      response.state == PRODUCT_STATUS_INVALID ? "Encountered unknown product status" :
+                      "Exceed maximum number of retries");
+        goto cleanup;
+    }
+
+    // the spool file only appears under its final name once it is complete
+    snprintf(part, sizeof(part), "%s.part", job->path);
+
+    if (ads_download_product(&response, &handle, &client, part) != 0 || rename(part, job->path) != 0) {
+        unlink(part);
+        fail_job(job, "Failed to download file");
+        goto cleanup;
+    }
+
+    job->bytes = response.length;
+
+    if (client.delete)
+        ads_delete_product_request(&response, &handle, &client);
+
+    cleanup:
+    curl_easy_cleanup(handle);
+
+    notify:
+    arena_free(&arena);
+    TRACE_END(job_span);
+
+    while (write(broker->notify[1], &job, sizeof(job)) < 0 && errno == EINTR);
+
+    return NULL;
+}
+
+/**
+ * @brief Whether an account may submit a job of the given priority now.
+ * @param wait Lowered to the milliseconds until the rate limit admits another submission, if that holds it back
+ */
+static int account_admits(const struct BROKER *broker, const struct ACCOUNT *account, enum BROKER_PRIORITY priority,
+                          time_t now, long *wait) {
+    // bulk jobs leave slots free, so that urgent requests arriving while they run are submitted right away
+    unsigned int slots = priority == BROKER_PRIORITY_BULK ? broker->max_jobs - broker->reserved : broker->max_jobs;
+
+    if (account->running >= slots)
+        return 0;
+
+    if (broker->rate && account->submissions[account->oldest] != 0 &&
+        now - account->submissions[account->oldest] < RATE_WINDOW) {
+        long remaining = (long) (RATE_WINDOW - (now - account->submissions[account->oldest])) * 1000;
+        if (*wait < 0 || remaining < *wait)
+            *wait = remaining;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Start pending jobs, the most urgent first and among equally urgent ones the oldest, on the account with the
+ * fewest jobs in flight. Scheduling stops at the first job no account admits, so less urgent jobs are held back
+ * while a more urgent one waits for a slot or for the rate limit.
+ * @return Milliseconds until the rate limit admits the job scheduling stopped at, -1 if no timer is needed
+ */
+static long schedule_jobs(struct BROKER *broker) {
+    time_t now = time(NULL);
+    long wait = -1;
+
+    for (;;) {
+        struct JOB *next = NULL;
+        struct ACCOUNT *account = NULL;
+        pthread_t thread;
+
+        for (struct JOB *job = broker->jobs; job; job = job->next) {
+            if (!job->running && (next == NULL || job->priority < next->priority))
+                next = job;
+        }
+
+        if (next == NULL)
+            break;
+
+        for (size_t i = 0; i < broker->n_accounts; i++) {
+            struct ACCOUNT *candidate = &broker->accounts[i];
+            if (account_admits(broker, candidate, next->priority, now, &wait) &&
+                (account == NULL || candidate->running < account->running))
+                account = candidate;
+        }
+
+        if (account == NULL)
+            break;
+
+        next->running = 1;
+        next->account = account;
+        account->running++;
+
+        if (broker->rate) {
+            account->submissions[account->oldest] = now;
+            account->oldest = (account->oldest + 1) % broker->rate;
+        }
+
+        if (pthread_create(&thread, NULL, run_job, next) != 0) {
+            fprintf(stderr, "Error: Failed to start thread for job %lu\n", next->number);
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(thread);
+
+        printf("Job %lu: submitted %s %s request with account %zu\n", next->number,
+               broker_priority_name(next->priority), next->dataset, (size_t) (account - broker->accounts));
+    }
+
+    return wait;
+}
+
+static void remove_job(struct BROKER *broker, struct JOB *job) {
+    for (struct JOB **j = &broker->jobs; *j; j = &(*j)->next) {
+        if (*j == job) {
+            *j = job->next;
+            break;
+        }
+    }
+
+    if (job->file_fd >= 0)
+        close(job->file_fd);
+    if (job->done && !job->failed)
+        unlink(job->path);
+
+    free(job->body);
+    free(job);
+}
+
+/**
+ * @brief Send the result of a finished job to a waiting connection.
+ * @return Zero if the connection holds the result, non-zero if it was answered for good
+ */
+static int answer(struct CONNECTION *connection, struct JOB *job) {
+    char line[NPOW12 + NPOW8];
+
+    if (job->failed) {
+        snprintf(line, sizeof(line), "FAILED %s\n", job->reason);
+        broker_send_line(connection->fd, line, -1);
+        return 1;
+    }
+
+    snprintf(line, sizeof(line), "DONE %zu %s\n", job->bytes, job->path);
+
+    return broker_send_line(connection->fd, line, job->file_fd);
+}
+
+static void close_connection(struct BROKER *broker, struct CONNECTION **connections, size_t i) {
+    struct CONNECTION *connection = connections[i];
+    struct JOB *job = connection->job;
+
+    close(connection->fd);
+    free(connection);
+    connections[i] = NULL;
+
+    if (job == NULL || --job->waiters > 0)
+        return;
+
+    // a job nobody waits for any more is dropped, unless it is in flight already
+    if (!job->running || job->done)
+        remove_job(broker, job);
+}
+
+/**
+ * @brief Normalize a request body, so that requests differing only in formatting or key order are identical.
+ * @return Canonical body, NULL if `body` is not a JSON object
+ */
+static char *canonical_body(const char *body) {
+    const size_t flags = JSON_COMPACT | JSON_ENSURE_ASCII | JSON_SORT_KEYS;
+    json_error_t error;
+    json_t *root = json_loads(body, 0, &error);
+    char *canonical = NULL;
+
+    if (root && json_is_object(root))
+        canonical = json_dumps(root, flags);
+
+    json_decref(root);
+
+    return canonical;
+}
+
+/**
+ * @brief Handle a complete request line of a connection.
+ * @return Zero if the connection waits for or holds a result, non-zero if it should be closed
+ */
+static int handle_request(struct BROKER *broker, struct CONNECTION *connection) {
+    char dataset[NPOW6], name[NPOW4];
+    int offset = 0, consumed = 0;
+    enum BROKER_PRIORITY priority = BROKER_PRIORITY_NORMAL;
+
+    if (sscanf(connection->line, "FETCH %63s %n", dataset, &offset) != 1 || offset == 0 ||
+        (strcmp(dataset, product_dataset(PRODUCT_CAMS_REPROCESSED)) != 0 &&
+         strcmp(dataset, product_dataset(PRODUCT_CAMS_COMPOSITION_FORECAST)) != 0)) {
+        broker_send_line(connection->fd, "FAILED Malformed request or unknown dataset\n", -1);
+        return 1;
+    }
+
+    // the priority is optional, a body always starts with a brace
+    char *rest = connection->line + offset;
+
+    if (*rest != '{' && sscanf(rest, "%15s %n", name, &consumed) == 1 && consumed > 0) {
+        int parsed = broker_priority_from_name(name);
+
+        if (parsed < 0) {
+            broker_send_line(connection->fd, "FAILED Unknown priority\n", -1);
+            return 1;
+        }
+        priority = (enum BROKER_PRIORITY) parsed;
+        rest += consumed;
+    }
+
+    char *body = canonical_body(rest);
+
+    if (body == NULL) {
+        broker_send_line(connection->fd, "FAILED Request body is not a JSON object\n", -1);
+        return 1;
+    }
+
+    struct JOB *job = broker->jobs;
+
+    while (job && (job->failed || strcmp(job->dataset, dataset) != 0 || strcmp(job->body, body) != 0))
+        job = job->next;
+
+    if (job) {
+        free(body);
+        printf("Job %lu: merged identical %s request\n", job->number, broker_priority_name(priority));
+
+        if (priority < job->priority && !job->running) {
+            job->priority = priority;
+            printf("Job %lu: raised to %s\n", job->number, broker_priority_name(priority));
+        }
+    } else {
+        if ((job = calloc(1, sizeof(struct JOB))) == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for job\n");
+            exit(EXIT_FAILURE);
+        }
+
+        snprintf(job->dataset, NPOW6, "%s", dataset);
+        job->priority = priority;
+        job->body = body;
+        job->number = ++broker->jobs_created;
+        job->file_fd = -1;
+        job->broker = broker;
+
+        if (snprintf(job->path, NPOW12, "%s/cams-broker-%ld-%lu", broker->spool_directory, (long) getpid(),
+                     job->number) >= NPOW12) {
+            fprintf(stderr, "Error: Path of spool file is too long\n");
+            exit(EXIT_FAILURE);
+        }
+
+        struct JOB **tail = &broker->jobs;
+        while (*tail)
+            tail = &(*tail)->next;
+        *tail = job;
+    }
+
+    connection->job = job;
+    job->waiters++;
+
+    // identical requests arriving after the download finished share its result while it is held by anyone
+    if (job->done && answer(connection, job) != 0)
+        return 1;
+
+    return 0;
+}
+
+/**
+ * @brief Read from a connection and handle its request once the line is complete.
+ * @return Zero if the connection stays open, non-zero if it should be closed
+ */
+static int read_connection(struct BROKER *broker, struct CONNECTION *connection) {
+    ssize_t n = read(connection->fd, connection->line + connection->length,
+                     BROKER_LINE_SIZE - 1 - connection->length);
+
+    if (n < 0 && errno == EINTR)
+        return 0;
+
+    // after its request, a worker only closes the connection, any other input ends it as well
+    if (n <= 0 || connection->job)
+        return 1;
+
+    connection->length += (size_t) n;
+    connection->line[connection->length] = '\0';
+
+    char *newline = strchr(connection->line, '\n');
+
+    if (newline == NULL) {
+        if (connection->length == BROKER_LINE_SIZE - 1) {
+            broker_send_line(connection->fd, "FAILED Request too long\n", -1);
+            return 1;
+        }
+        return 0;
+    }
+
+    *newline = '\0';
+
+    return handle_request(broker, connection);
+}
+
+/**
+ * @brief Hand the result of a finished job to everyone waiting for it.
+ */
+static void finish_job(struct BROKER *broker, struct JOB *job, struct CONNECTION **connections) {
+    job->done = 1;
+    job->account->running--;
+
+    if (!job->failed && (job->file_fd = open(job->path, O_RDONLY)) < 0)
+        fail_job(job, "Failed to open downloaded file");
+
+    printf("Job %lu: %s%s, %zu waiting\n", job->number, job->failed ? "failed: " : "finished",
+           job->failed ? job->reason : "", job->waiters);
+
+    // failed jobs are answered for good, successful ones are kept while anyone still holds their result
+    for (size_t i = 0; i < MAX_CONNECTIONS; i++) {
+        if (connections[i] && connections[i]->job == job && answer(connections[i], job) != 0) {
+            connections[i]->job = NULL;
+            job->waiters--;
+            close_connection(broker, connections, i);
+        }
+    }
+
+    if (job->waiters == 0)
+        remove_job(broker, job);
+}
+
+static int listen_on(const char *socket_path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    int fd;
+
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Path of broker socket %s is too long\n", socket_path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(address.sun_path, socket_path);
+
+    // a socket nobody listens on is a leftover of a broker which did not shut down cleanly
+    if ((fd = broker_connect(socket_path)) >= 0) {
+        fprintf(stderr, "Error: Another broker is listening on %s\n", socket_path);
+        exit(EXIT_FAILURE);
+    }
+    unlink(socket_path);
+
+    // jobs run with the ADS credentials of the broker, so only its owner may connect
+    mode_t mask = umask(S_IRWXG | S_IRWXO);
+    int bound = (fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0 &&
+                bind(fd, (struct sockaddr *) &address, sizeof(address)) == 0;
+    umask(mask);
+
+    if (!bound || listen(fd, MAX_CONNECTIONS) != 0) {
+        fprintf(stderr, "Error: Failed to listen on %s: %s\n", socket_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    char error_string[NPOW16];
+    int optid;
+    int option_index = 0;
+    const char *socket_path = getenv("CAMS_BROKER_SOCKET");
+
+    opterr = NO_GETOPT_ERROR_OUTPUT ? 0 : 1;
+
+    static struct BROKER broker = {
+        .client = {
+            .timeout = 1800,
+            .max_retries = 10,
+            .max_sleep = 60,
+            .wait_until_complete = 1,
+            .status_ttl = 300
+        },
+        .spool_directory = ".",
+        .max_jobs = 4,
+        .reserved = 1
+    };
+
+    static struct option long_options[] = {
+        {"help",           no_argument,       NULL, 'h'},
+        {"version",        no_argument,       NULL, 'v'},
+        {"purpose",        no_argument,       NULL, 'i'},
+        {"authentication", required_argument, NULL, 'a'},
+        {"socket",         required_argument, NULL, 'S'},
+        {"spool",          required_argument, NULL, 'o'},
+        {"jobs",           required_argument, NULL, 'j'},
+        {"rate",           required_argument, NULL, 'r'},
+        {"reserve",        required_argument, NULL, 'R'},
+        {"cache",          required_argument, NULL, 'k'},
+        {"status-ttl",     required_argument, NULL, '5'},
+        {0,                0,                 0,    0}
+    };
+
+    while ((optid = getopt_long_only(argc, argv, "+:hvia:S:o:j:r:R:k:5:", long_options, &option_index)) != -1) {
+        switch (optid) {
+            case 0:
+                break;
+            case 'h':
+                print_usage();
+                exit(EXIT_SUCCESS);
+            case 'v':
+                print_version();
+                exit(EXIT_SUCCESS);
+            case 'i':
+                print_purpose();
+                exit(EXIT_SUCCESS);
+            case 'a':
+                if (broker.n_accounts == MAX_ACCOUNTS) {
+                    fprintf(stderr, "ERROR: At most %d accounts are supported\n", MAX_ACCOUNTS);
+                    exit(EXIT_FAILURE);
+                }
+                broker.accounts[broker.n_accounts++].authentication = optarg;
+                break;
+            case 'S':
+                socket_path = optarg;
+                break;
+            case 'o':
+                broker.spool_directory = optarg;
+                break;
+            case 'j': {
+                char *end;
+                long val = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || val < 1 || val > NPOW8) {
+                    fprintf(stderr, "ERROR: Invalid number of jobs \"%s\", expected 1 to %d\n", optarg, NPOW8);
+                    exit(EXIT_FAILURE);
+                }
+                broker.max_jobs = (unsigned int) val;
+            }
+                break;
+            case 'r':
+            case 'R': {
+                char *end;
+                long val = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || val < 0 || val > NPOW10) {
+                    fprintf(stderr, "ERROR: Invalid %s \"%s\", expected 0 to %d\n",
+                            optid == 'r' ? "rate" : "number of reserved slots", optarg, NPOW10);
+                    exit(EXIT_FAILURE);
+                }
+                if (optid == 'r')
+                    broker.rate = (unsigned int) val;
+                else
+                    broker.reserved = (unsigned int) val;
+            }
+                break;
+            case 'k':
+                broker.client.cache_dir = optarg;
+                break;
+            case '5': {
+                char *end;
+                long val = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || val < 0 || val > NPOW30) {
+                    fprintf(stderr, "ERROR: Invalid status TTL \"%s\", expected a non-negative number of seconds\n",
+                            optarg);
+                    exit(EXIT_FAILURE);
+                }
+                broker.client.status_ttl = (unsigned int) val;
+            }
+                break;
+            case ':':
+                fprintf(stderr, "Error: expected option for argument -%c/-%s is missing\n", optopt,
+                        reverse_code_optopt(error_string, optopt));
+                exit(EXIT_FAILURE);
+            case '?': // fall through
+            default:
+                fprintf(stderr, "Error: got unexpected argument \"%c\"\n\n", optopt);
+                print_usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (socket_path == NULL)
+        socket_path = BROKER_DEFAULT_SOCKET;
+
+    // without any credential file, the one named by ADSAUTH is used
+    if (broker.n_accounts == 0)
+        broker.n_accounts = 1;
+
+    for (size_t i = 0; i < broker.n_accounts; i++) {
+        const char *authentication = broker.accounts[i].authentication;
+        if (authentication && validate_file(authentication, F_OK | R_OK) == false) {
+            fprintf(stderr, "Error: Credential file %s either does not exist, or is not accessible.\n",
+                    authentication);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // bulk jobs can always use at least one slot
+    if (broker.reserved >= broker.max_jobs)
+        broker.reserved = broker.max_jobs - 1;
+
+    if (validate_directory(broker.spool_directory) == false ||
+        (broker.client.cache_dir && validate_directory(broker.client.cache_dir) == false)) {
+        fprintf(stderr, "Error: Spool or cache directory either do not exist, or are not accessible.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct ARENA config_arena;
+    arena_init(&config_arena, NPOW10);
+
+    // workers would resolve a relative spool path against their own working directory
+    if (broker.spool_directory[0] != '/') {
+        char cwd[NPOW12];
+
+        if (getcwd(cwd, NPOW12) == NULL) {
+            fprintf(stderr, "Error: Failed to resolve spool directory %s\n", broker.spool_directory);
+            exit(EXIT_FAILURE);
+        }
+        broker.spool_directory = arena_sprintf(&config_arena, "%s/%s", cwd, broker.spool_directory);
+    }
+
+    for (size_t i = 0; i < broker.n_accounts; i++) {
+        struct ACCOUNT *account = &broker.accounts[i];
+        struct API_AUTHENTICATION api_authentication = {0};
+        struct OPTIONS options = {
+            .use_custom_authentication = account->authentication != NULL,
+            .authentication = account->authentication
+        };
+
+        if (init_api_authentication(&api_authentication, &options, &config_arena) != 0) {
+            fprintf(stderr, "Error: Failed to load API configuration from file\n");
+            exit(EXIT_FAILURE);
+        }
+
+        account->client = broker.client;
+        account->client.auth = api_authentication;
+
+        if (broker.rate && (account->submissions = calloc(broker.rate, sizeof(time_t))) == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for rate limit\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != 0) {
+        fprintf(stderr, "Error: Failed to set up curl\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pipe(broker.notify) != 0) {
+        fprintf(stderr, "Error: Failed to create notification pipe\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&broker.status_lock, NULL);
+
+    struct sigaction action = {.sa_handler = handle_signal};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+
+    int listen_fd = listen_on(socket_path);
+
+    static struct CONNECTION *connections[MAX_CONNECTIONS];
+    struct pollfd fds[MAX_CONNECTIONS + 2];
+
+    printf("Listening on %s\n", socket_path);
+    fflush(stdout);
+
+    while (!stop) {
+        nfds_t n = 0;
+        size_t slot[MAX_CONNECTIONS];
+
+        // jobs held back by the rate limit are reconsidered once it admits them
+        long timeout = schedule_jobs(&broker);
+        fflush(stdout);
+
+        fds[n++] = (struct pollfd) {.fd = broker.notify[0], .events = POLLIN};
+        fds[n++] = (struct pollfd) {.fd = listen_fd, .events = POLLIN};
+        for (size_t i = 0; i < MAX_CONNECTIONS; i++) {
+            if (connections[i]) {
+                slot[n - 2] = i;
+                fds[n++] = (struct pollfd) {.fd = connections[i]->fd, .events = POLLIN};
+            }
+        }
+
+        if (poll(fds, n, timeout < 0 ? -1 : (int) timeout) < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Error: poll failed: %s\n", strerror(errno));
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            struct JOB *job;
+            if (read(broker.notify[0], &job, sizeof(job)) == sizeof(job))
+                finish_job(&broker, job, connections);
+        }
+
+        for (nfds_t f = 2; f < n; f++) {
+            size_t i = slot[f - 2];
+            if (connections[i] && connections[i]->fd == fds[f].fd && fds[f].revents &&
+                read_connection(&broker, connections[i]) != 0)
+                close_connection(&broker, connections, i);
+        }
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept(listen_fd, NULL, NULL);
+            size_t i = 0;
+
+            while (i < MAX_CONNECTIONS && connections[i])
+                i++;
+
+            if (fd >= 0 && i == MAX_CONNECTIONS) {
+                broker_send_line(fd, "FAILED Too many connections\n", -1);
+                close(fd);
+            } else if (fd >= 0) {
+                if ((connections[i] = calloc(1, sizeof(struct CONNECTION))) == NULL) {
+                    fprintf(stderr, "Error: Failed to allocate memory for connection\n");
+                    exit(EXIT_FAILURE);
+                }
+                connections[i]->fd = fd;
+            }
+        }
+
+        fflush(stdout);
+    }
+
+    // jobs in flight are abandoned, their threads end with the process
+    printf("Shutting down\n");
+
+    close(listen_fd);
+    unlink(socket_path);
+
+    for (size_t i = 0; i < MAX_CONNECTIONS; i++) {
+        if (connections[i]) {
+            close(connections[i]->fd);
+            free(connections[i]);
+        }
+    }
+
+    for (size_t i = 0; i < broker.n_accounts; i++)
+        free(broker.accounts[i].submissions);
+
+    arena_free(&config_arena);
+
+    return 0;
+}
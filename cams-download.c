@@ -12,6 +12,9 @@
 #include <curl/curl.h>
 #include <assert.h>
 #include "src/download.h"
+#include "src/arena.h"
+#include "src/broker.h"
+#include "src/trace.h"
 
 #define DEBUG
 
@@ -21,6 +24,41 @@
 #define NO_GETOPT_ERROR_OUTPUT 1
 #endif // DEBUG
 
+#define FORCE_VERSION "Test, Test!"
+
+static void print_usage(void) {
+    printf(
+        "Usage: cams-download [-h|--help] [-v|--version] [-i|--purpose] "
+        "[-o|--output_directory] <-c|--coordinates> <-f|--format> <-k|--cache> <--status-ttl> <-b|--broker> <-P|--priority> <--start> <--end> <-t|--daily_tables> <-s|--climatology> <-a|--authentication>\n\n"
+        "[-h|--help]\t\tprint this help page and exit\n"
+        "[-v|--version]\t\tprint version\n"
+        "[-i|--purpose]\t\tshow program's purpose\n"
+        "[-o|--output_directory]\t...\n\n"
+        "Optional arguments:\n"
+        "<-c|--coordinates>\tPath to file with WRS2 center coordinates, if subset of area is to be queried. Otherwise the entire model area is requested.\n"
+        "<--start>\t\tStart date. Default: 2003-01-01.\n"
+        "<--end>\t\t\tStart date. Default: 2003-01-01.\n"
+        "<--product>\t\tProduct type to query. Currently, only REPROCESSED and FORECAST are implemented. Default is REPROCESSED\n"
+        "<--time>\t\tModel times. Comma-separated list; valid range from 0 to 21 in steps of 3. Default: 0\n"
+        "<--lead-time-hour>\tLeadtime. Comma-separated list; valid range from 0 to 120. Default: 0\n"
+        "<-f|--format>\t\tFile format to request, either grib or netcdf. Default: grib\n"
+        "<-k|--cache>\t\tDirectory in which the result of the ADS status check is cached. Default: no cache\n"
+        "<--status-ttl>\t\tSeconds a cached ADS status is used without asking the server. Default: 300\n"
+        "<-b|--broker>\t\tPath of the socket of a cams-broker which fetches the product instead. Default: download directly\n"
+        "<-P|--priority>\t\tPriority class of the request at the broker: urgent, normal or bulk. Default: normal\n"
+        "<-t|--daily_tables>\tbuild daily tables? Default: false\n"
+        "<-s|--climatology>\tbuild climatology? Default: false\n"
+        "<-a|--authentication>\toptional...\n");
+}
+
+static void print_version(void) {
+    printf("FORCE version: %s\n", FORCE_VERSION);
+}
+
+static void print_purpose(void) {
+    printf("Download ECMWF CAMS data from the Atmosphere Data Store\n");
+}
+
 int main(int argc, char *argv[]) {
     char error_string[NPOW16];
 
@@ -39,8 +77,10 @@ int main(int argc, char *argv[]) {
 
     opterr = NO_GETOPT_ERROR_OUTPUT ? 0 : 1;
 
-    static struct OPTIONS options = {0};
+    static struct OPTIONS options = {.output_directory = ""};
     bool use_area_subset = false;
+    const char *broker_socket = NULL;
+    enum BROKER_PRIORITY broker_priority = BROKER_PRIORITY_NORMAL;
 
     static struct API_AUTHENTICATION api_authentication = {0};
 
@@ -59,7 +99,9 @@ int main(int argc, char *argv[]) {
         .metadata = NULL,
         .forget = 0,
         .retries = 0,
-        .curl_handle = NULL
+        .curl_handle = NULL,
+        .cache_dir = NULL,
+        .status_ttl = 300
     };
 
     static struct PRODUCT_REQUEST request = {0};
@@ -89,11 +131,16 @@ int main(int argc, char *argv[]) {
         {"time",             required_argument, NULL, '3'},
         {"lead-time-hour",   required_argument, NULL, '4'},
         {"output_directory", required_argument, NULL, 'o'},
+        {"format",           required_argument, NULL, 'f'},
+        {"cache",            required_argument, NULL, 'k'},
+        {"status-ttl",       required_argument, NULL, '5'},
+        {"broker",           required_argument, NULL, 'b'},
+        {"priority",         required_argument, NULL, 'P'},
         {0,                  0,                 0,    0}
     };
 
     // TODO why can I remove a letter from shortopts and still match the short version?
-    while ((optid = getopt_long_only(argc, argv, "+:hvia:c:o:012:3:4:", long_options, &option_index)) != -1) {
+    while ((optid = getopt_long_only(argc, argv, "+:hvia:c:o:f:k:b:P:012:3:4:5:", long_options, &option_index)) != -1) {
         switch (optid) {
             case 0: // getopt_long returns `val` if flag == NULL; otherwise 0 (in which case it stores val in flag)
                 break;
@@ -112,7 +159,7 @@ int main(int argc, char *argv[]) {
                     fprintf(stderr, "You shouldn't be able to reach this code!!\n");
                 }
                 options.use_custom_authentication = 1;
-                strncpy(options.authentication, optarg, NPOW16);
+                options.authentication = optarg;
                 break;
             case 'c':
                 if (optarg == 0) {
@@ -120,14 +167,47 @@ int main(int argc, char *argv[]) {
                     fprintf(stderr, "You shouldn't be able to reach this code!!\n");
                 }
                 use_area_subset = true;
-                strncpy(options.coordinates, optarg, NPOW16);
+                options.coordinates = optarg;
                 break;
             case 'o':
                 if (optarg == 0) {
                     // if text is present, optarg points to it; otherwise it is set to 0
                     fprintf(stderr, "You shouldn't be able to reach this code!!\n");
                 }
-                strncpy(options.output_directory, optarg, NPOW16);
+                options.output_directory = optarg;
+                break;
+            case 'f':
+                if (strcmp(optarg, "grib") != 0 && strcmp(optarg, "netcdf") != 0) {
+                    fprintf(stderr, "ERROR: Unknown format \"%s\", expected grib or netcdf\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                request.format = optarg;
+                break;
+            case 'k':
+                client.cache_dir = optarg;
+                break;
+            case 'b':
+                broker_socket = optarg;
+                break;
+            case 'P': {
+                int priority = broker_priority_from_name(optarg);
+                if (priority < 0) {
+                    fprintf(stderr, "ERROR: Unknown priority \"%s\", expected urgent, normal or bulk\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                broker_priority = (enum BROKER_PRIORITY) priority;
+            }
+                break;
+            case '5': {
+                char *end;
+                long val = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || val < 0 || val > UINT_MAX) {
+                    fprintf(stderr, "ERROR: Invalid status TTL \"%s\", expected a non-negative number of seconds\n",
+                            optarg);
+                    exit(EXIT_FAILURE);
+                }
+                client.status_ttl = (unsigned int) val;
+            }
                 break;
             case '0': {
                 int failed_attempts = 0;
@@ -240,8 +320,9 @@ int main(int argc, char *argv[]) {
 
     if ((options.use_custom_authentication && validate_file(options.authentication, F_OK | R_OK) == false) ||
         (use_area_subset && validate_file(options.coordinates, F_OK | R_OK) == false) ||
-        validate_directory(options.output_directory) == false) {
-        fprintf(stderr, "Error: Credential file, coordinate file or output directory either do not "
+        validate_directory(options.output_directory) == false ||
+        (client.cache_dir && validate_directory(client.cache_dir) == false)) {
+        fprintf(stderr, "Error: Credential file, coordinate file, output or cache directory either do not "
                         "exist, or are not accessible.\n");
         exit(EXIT_FAILURE);
     }
@@ -256,12 +337,10 @@ int main(int argc, char *argv[]) {
         request.leadtime_length++;
     }
 
-    if (init_api_authentication(&api_authentication, &options) != 0) {
-        fprintf(stderr, "Error: Failed to load API configuration from file\n");
-        exit(EXIT_FAILURE);
-    }
-
-    client.auth = api_authentication;
+    // configuration lives as long as the program, everything belonging to the product request in its own arena
+    struct ARENA config_arena, request_arena;
+    arena_init(&config_arena, NPOW10);
+    arena_init(&request_arena, NPOW14);
 
     if (use_area_subset) {
         double *longitude, *latitude;
@@ -278,6 +357,27 @@ int main(int argc, char *argv[]) {
         request.bbox.area_subset = 0;
     }
 
+    // the broker owns credentials and curl handles, identical requests of other workers are merged with this one
+    if (broker_socket) {
+        const char *body = assemble_request(&request, &request_arena);
+        const char *download_path = assemble_download_path(&request, &options, &request_arena);
+
+        int broker_status = broker_fetch(broker_socket, product_dataset(request.product), body, broker_priority,
+                                         download_path);
+
+        arena_free(&request_arena);
+        arena_free(&config_arena);
+
+        return broker_status ? EXIT_FAILURE : 0;
+    }
+
+    if (init_api_authentication(&api_authentication, &options, &config_arena) != 0) {
+        fprintf(stderr, "Error: Failed to load API configuration from file\n");
+        exit(EXIT_FAILURE);
+    }
+
+    client.auth = api_authentication;
+
     curl = curl_global_init(CURL_GLOBAL_DEFAULT);
 
     if (curl != 0) {
@@ -292,7 +392,11 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    if (check_ads_status(&handle, &client) == ADS_STATUS_WARNING) {
+    TRACE_BEGIN(status_span, "check_ads_status");
+    ADS_STATUS ads_status = check_ads_status(&handle, &client);
+    TRACE_END(status_span);
+
+    if (ads_status == ADS_STATUS_WARNING) {
         fprintf(stderr,
                 "Error: Encountered warning with ADS. Please visit %s/%s.\n",
                 client.auth.base_url,
@@ -300,13 +404,21 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    struct PRODUCT_RESPONSE product_response = ads_request_product(&request, &handle, &client);
+    if (ads_status == ADS_STATUS_ERROR) {
+        fprintf(stderr, "Error: Could not determine the status of the ADS\n");
+        exit(EXIT_FAILURE);
+    }
+
+    TRACE_BEGIN(request_span, "ads_request_product");
+    struct PRODUCT_RESPONSE product_response = ads_request_product(&request, &handle, &client, &request_arena);
+    TRACE_END(request_span);
 
     if (product_response.state == PRODUCT_STATUS_INVALID) {
         fprintf(stderr, "Error: Encountered unknown product status in response to POST request\n");
         exit(EXIT_FAILURE);
     }
 
+    TRACE_BEGIN(poll_span, "poll_product_state");
     while (product_response.state != PRODUCT_STATUS_COMPLETED && product_response.state != PRODUCT_STATUS_FAILED &&
            product_response.state != PRODUCT_STATUS_INVALID && client.retries < client.max_retries) {
         printf("Product request in preparation. Try %d/%d. Next request will be made in %d seconds.\n",
@@ -317,10 +429,13 @@ int main(int argc, char *argv[]) {
             exit(EXIT_FAILURE);
         }
 
+        TRACE_BEGIN(check_span, "ads_check_product_state");
         ads_check_product_state(&product_response, &handle, &client);
+        TRACE_END(check_span);
 
         client.retries++;
     }
+    TRACE_END(poll_span);
 
     if (client.retries == client.max_retries && product_response.state != PRODUCT_STATUS_FAILED) {
         fprintf(stderr, "Error: Exceed maximum number of retries. Product request unsuccessful.\n"
@@ -333,26 +448,34 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    const char *download_path = assemble_download_path(&request, &options);
+    if (product_response.state == PRODUCT_STATUS_INVALID) {
+        fprintf(stderr, "Error: Encountered unknown product status while polling\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const char *download_path = assemble_download_path(&request, &options, &request_arena);
 
-    if (ads_download_product(&product_response, &handle, &client, download_path)) {
+    TRACE_BEGIN(download_span, "ads_download_product");
+    int download_status = ads_download_product(&product_response, &handle, &client, download_path);
+    TRACE_END(download_span);
+
+    if (download_status) {
         fprintf(stderr, "Error: Failed to download file\n");
         exit(EXIT_FAILURE);
     }
 
     if (client.delete) {
+        TRACE_BEGIN(delete_span, "ads_delete_product_request");
         int deletion_status __attribute__((unused)) = ads_delete_product_request(&product_response, &handle, &client);
+        TRACE_END(delete_span);
     }
 
-    free(product_response.location);
-    free(product_response.id);
-
-    free((char *) download_path);
+    arena_free(&request_arena);
 
     curl_easy_cleanup(handle);
     curl_global_cleanup();
 
-    free_api_authentication(&api_authentication);
+    arena_free(&config_arena);
 
     return 0;
 }
@@ -0,0 +1,592 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "src/trace.h"
+
+#ifdef DEBUG
+#define NO_GETOPT_ERROR_OUTPUT 0
+#else
+#define NO_GETOPT_ERROR_OUTPUT 1
+#endif // DEBUG
+
+#define FORCE_VERSION "Test, Test!"
+
+enum {
+    PATH_SIZE = 4096,
+    MAX_ARGUMENTS = 256     ///< maximum number of arguments passed through to cams-download or cams-process
+};
+
+/**
+ * @brief Date range downloaded by one invocation of cams-download and processed by one invocation of cams-process
+ */
+struct CHUNK {
+    struct tm start;
+    struct tm end;
+    char directory[PATH_SIZE];  ///< directory the chunk is downloaded to, including the trailing separator
+    off_t bytes;                ///< size of the downloaded files
+};
+
+/**
+ * @brief Bounded queue between the download thread and the processing main thread
+ * @details Chunks are downloaded and processed in order, so the queue is described by the number of chunks downloaded
+ * and processed so far. Chunk `i` may only be downloaded once at most `depth` chunks precede it which are not
+ * processed yet and the raw files of those chunks, plus the largest chunk seen so far as estimate of chunk `i`, fit
+ * into the disk limit. The chunk being processed always counts, its files are removed only after processing.
+ */
+struct PIPELINE {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    struct CHUNK *chunks;
+    size_t n_chunks;
+    size_t downloaded;          ///< chunks downloaded so far
+    size_t processed;           ///< chunks processed so far
+    size_t depth;               ///< maximum number of chunks downloaded ahead of the one being processed
+    off_t disk_limit;           ///< maximum size of downloaded but unprocessed chunks in bytes, 0 for no limit
+    off_t queued_bytes;         ///< size of downloaded but unprocessed chunks
+    off_t largest;              ///< size of the largest chunk downloaded so far
+    int download_done;          ///< set once the download thread returned
+    int failed;                 ///< set once a download or processing step failed; no new chunk is started
+    const char *download_program;
+    const char *process_program;
+    char **download_args;
+    int n_download_args;
+    char **process_args;
+    int n_process_args;
+    const char *out_dir;
+};
+
+static void print_usage(void) {
+    printf(
+        "Usage: cams-pipeline <-h|--help> <-v|--version> <-i|--purpose> <--start> <--end> <-n|--chunk_days> "
+        "<-q|--queue> <-D|--disk_limit> <-K|--keep> raw_dir out_dir [-- download_args... [-- process_args...]]\n"
+        "\nOptional arguments:\n"
+        "<-h|--help>\tprint this help and exit\n"
+        "<-v|--version>\tprint FORCE version and exit\n"
+        "<-i|--purpose>\tprint program's purpose and exit\n"
+        "<--start>\tStart date as YYYY-MM-DD. Default: 2003-01-01\n"
+        "<--end>\t\tEnd date as YYYY-MM-DD. Default: 2003-01-01\n"
+        "<-n|--chunk_days>\tNumber of days downloaded and processed at once. Default: one calendar month\n"
+        "<-q|--queue>\tNumber of chunks downloaded ahead of the one being processed. Default: 1\n"
+        "<-D|--disk_limit>\tMaximum size in MB of downloaded chunks waiting for or in processing; the next download "
+        "is held back while it would be exceeded. Default: no limit\n"
+        "<-K|--keep>\tKeep downloaded chunks after processing. Default: remove them\n"
+        "\nMandatory positional arguments:\n"
+        "raw_dir\t\t\tDirectory in which every chunk is downloaded to a subdirectory of its own\n"
+        "out_dir\t\t\tDirectory passed to cams-process as output directory\n"
+        "download_args\t\tArguments passed to every invocation of cams-download, besides --start, --end and -o\n"
+        "process_args\t\tArguments passed to every invocation of cams-process, besides in_file and out_dir\n"
+        );
+}
+
+static void print_purpose(void) {
+    printf("Download and process ECMWF CAMS data chunk by chunk, downloading the next chunk while the current one is "
+           "processed\n");
+}
+
+static void print_version(void) {
+    printf("FORCE version: %s\n", FORCE_VERSION);
+}
+
+/**
+ * @brief Parse a date given as YYYY-MM-DD to noon of that day, so that adding days is unaffected by DST changes
+ */
+static int parse_date(const char *string, struct tm *date) {
+    int year, month, day, consumed = 0;
+
+    if (sscanf(string, "%d-%d-%d%n", &year, &month, &day, &consumed) != 3 || string[consumed] != '\0' ||
+        month < 1 || month > 12 || day < 1 || day > 31)
+        return 1;
+
+    *date = (struct tm) {.tm_year = year - 1900, .tm_mon = month - 1, .tm_mday = day, .tm_hour = 12, .tm_isdst = -1};
+
+    return mktime(date) == (time_t) -1;
+}
+
+static int compare_dates(const struct tm *a, const struct tm *b) {
+    if (a->tm_year != b->tm_year)
+        return a->tm_year < b->tm_year ? -1 : 1;
+    if (a->tm_mon != b->tm_mon)
+        return a->tm_mon < b->tm_mon ? -1 : 1;
+    if (a->tm_mday != b->tm_mday)
+        return a->tm_mday < b->tm_mday ? -1 : 1;
+    return 0;
+}
+
+static struct tm add_days(struct tm date, int days) {
+    date.tm_mday += days;
+    date.tm_isdst = -1;
+    mktime(&date);
+
+    return date;
+}
+
+/**
+ * @brief Split the range from `start` to `end` into chunks of `chunk_days` days, or calendar months if zero
+ */
+static struct CHUNK *split_chunks(struct tm start, struct tm end, int chunk_days, const char *raw_dir,
+                                  size_t *n_chunks) {
+    struct CHUNK *chunks = NULL;
+    size_t capacity = 0;
+
+    *n_chunks = 0;
+
+    while (compare_dates(&start, &end) <= 0) {
+        struct tm last;
+
+        if (chunk_days > 0) {
+            last = add_days(start, chunk_days - 1);
+        } else {
+            // day 0 of the following month is the last day of this one
+            last = start;
+            last.tm_mon++;
+            last.tm_mday = 0;
+            last.tm_isdst = -1;
+            mktime(&last);
+        }
+
+        if (compare_dates(&last, &end) > 0)
+            last = end;
+
+        if (*n_chunks == capacity) {
+            capacity = capacity ? 2 * capacity : 16;
+            if ((chunks = realloc(chunks, capacity * sizeof(struct CHUNK))) == NULL) {
+                fprintf(stderr, "ERROR: Failed to allocate memory for chunks\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        struct CHUNK *chunk = &chunks[(*n_chunks)++];
+        char start_d[16], end_d[16];
+
+        *chunk = (struct CHUNK) {.start = start, .end = last};
+        strftime(start_d, sizeof(start_d), "%Y%m%d", &start);
+        strftime(end_d, sizeof(end_d), "%Y%m%d", &last);
+
+        if (snprintf(chunk->directory, PATH_SIZE, "%s/%s-%s/", raw_dir, start_d, end_d) >= PATH_SIZE) {
+            fprintf(stderr, "ERROR: Path of raw directory %s is too long\n", raw_dir);
+            exit(EXIT_FAILURE);
+        }
+
+        start = add_days(last, 1);
+    }
+
+    return chunks;
+}
+
+/**
+ * @brief Run a program with arguments `fixed` followed by `extra` and wait for it
+ * @return Zero if the program exited successfully
+ */
+static int run_program(const char *program, char **fixed, int n_fixed, char **extra, int n_extra) {
+    char *argv[2 * MAX_ARGUMENTS + 2];
+    int argc = 0;
+
+    argv[argc++] = (char *) program;
+    for (int i = 0; i < n_fixed; i++)
+        argv[argc++] = fixed[i];
+    for (int i = 0; i < n_extra; i++)
+        argv[argc++] = extra[i];
+    argv[argc] = NULL;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        fprintf(stderr, "ERROR: Failed to start %s: %s\n", program, strerror(errno));
+        return 1;
+    }
+
+    if (pid == 0) {
+        execvp(program, argv);
+        fprintf(stderr, "ERROR: Failed to execute %s: %s\n", program, strerror(errno));
+        _exit(127);
+    }
+
+    int status;
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "ERROR: Failed to wait for %s: %s\n", program, strerror(errno));
+            return 1;
+        }
+    }
+
+    return !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/**
+ * @brief Sum of the sizes of all regular files in a directory
+ */
+static off_t directory_size(const char *directory) {
+    char path[PATH_SIZE];
+    struct dirent *entry;
+    struct stat sb;
+    off_t bytes = 0;
+    DIR *dir = opendir(directory);
+
+    if (dir == NULL)
+        return 0;
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (snprintf(path, PATH_SIZE, "%s%s", directory, entry->d_name) < PATH_SIZE && stat(path, &sb) == 0 &&
+            S_ISREG(sb.st_mode))
+            bytes += sb.st_size;
+    }
+
+    closedir(dir);
+
+    return bytes;
+}
+
+/**
+ * @brief Remove a chunk directory and the files downloaded to it
+ */
+static void remove_chunk(const struct CHUNK *chunk) {
+    char path[PATH_SIZE];
+    struct dirent *entry;
+    DIR *dir = opendir(chunk->directory);
+
+    if (dir == NULL)
+        return;
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        if (snprintf(path, PATH_SIZE, "%s%s", chunk->directory, entry->d_name) < PATH_SIZE && unlink(path) != 0)
+            fprintf(stderr, "Warning: Failed to remove %s: %s\n", path, strerror(errno));
+    }
+
+    closedir(dir);
+
+    if (rmdir(chunk->directory) != 0)
+        fprintf(stderr, "Warning: Failed to remove %s: %s\n", chunk->directory, strerror(errno));
+}
+
+static double elapsed_seconds(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+/**
+ * @brief Whether chunk `i` may be downloaded now, see `PIPELINE`; the caller holds the mutex
+ */
+static int may_download(const struct PIPELINE *pipeline, size_t i) {
+    size_t ahead = i - pipeline->processed;
+
+    if (ahead > pipeline->depth)
+        return 0;
+
+    // without any chunk on disk, the next one is fetched even if it alone exceeds the limit
+    return ahead == 0 || pipeline->disk_limit == 0 ||
+           pipeline->queued_bytes + pipeline->largest <= pipeline->disk_limit;
+}
+
+/**
+ * @brief Download all chunks in order, running ahead of processing as far as the queue and the disk limit allow
+ */
+static void *download_chunks(void *arg) {
+    struct PIPELINE *pipeline = arg;
+
+    for (size_t i = 0; i < pipeline->n_chunks; i++) {
+        struct CHUNK *chunk = &pipeline->chunks[i];
+
+        pthread_mutex_lock(&pipeline->mutex);
+        while (!pipeline->failed && !may_download(pipeline, i))
+            pthread_cond_wait(&pipeline->changed, &pipeline->mutex);
+        int stop = pipeline->failed;
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        if (stop)
+            break;
+
+        char start_d[16], end_d[16];
+        strftime(start_d, sizeof(start_d), "%Y-%m-%d", &chunk->start);
+        strftime(end_d, sizeof(end_d), "%Y-%m-%d", &chunk->end);
+
+        char *fixed[] = {"--start", start_d, "--end", end_d, "-o", chunk->directory};
+        struct timespec started;
+        int status;
+
+        clock_gettime(CLOCK_MONOTONIC, &started);
+        printf("Downloading chunk %zu/%zu (%s to %s)\n", i + 1, pipeline->n_chunks, start_d, end_d);
+
+        if (mkdir(chunk->directory, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "ERROR: Failed to create %s: %s\n", chunk->directory, strerror(errno));
+            status = 1;
+        } else {
+            TRACE_BEGIN(span, "download_chunk");
+            status = run_program(pipeline->download_program, pipeline->download_args, pipeline->n_download_args,
+                                 fixed, 6);
+            TRACE_END(span);
+        }
+
+        if (status != 0) {
+            fprintf(stderr, "ERROR: Download of chunk %s to %s failed\n", start_d, end_d);
+            pthread_mutex_lock(&pipeline->mutex);
+            pipeline->failed = 1;
+            pthread_cond_broadcast(&pipeline->changed);
+            pthread_mutex_unlock(&pipeline->mutex);
+            break;
+        }
+
+        chunk->bytes = directory_size(chunk->directory);
+        printf("Downloaded chunk %zu/%zu, %.2lf MB in %.1lf s\n", i + 1, pipeline->n_chunks,
+               (double) chunk->bytes * 0.000001, elapsed_seconds(&started));
+
+        pthread_mutex_lock(&pipeline->mutex);
+        pipeline->queued_bytes += chunk->bytes;
+        if (chunk->bytes > pipeline->largest)
+            pipeline->largest = chunk->bytes;
+        pipeline->downloaded = i + 1;
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->mutex);
+    }
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->download_done = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    return NULL;
+}
+
+/**
+ * @brief Process chunks as they become available until all are done or a step failed
+ */
+static void process_chunks(struct PIPELINE *pipeline, int keep) {
+    for (size_t i = 0; i < pipeline->n_chunks; i++) {
+        struct CHUNK *chunk = &pipeline->chunks[i];
+
+        pthread_mutex_lock(&pipeline->mutex);
+        while (pipeline->downloaded <= i && !pipeline->failed && !pipeline->download_done)
+            pthread_cond_wait(&pipeline->changed, &pipeline->mutex);
+        // chunks downloaded before a download failed are still processed
+        int available = pipeline->downloaded > i;
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        if (!available)
+            break;
+
+        char *fixed[] = {chunk->directory, (char *) pipeline->out_dir};
+        struct timespec started;
+
+        clock_gettime(CLOCK_MONOTONIC, &started);
+        printf("Processing chunk %zu/%zu\n", i + 1, pipeline->n_chunks);
+
+        TRACE_BEGIN(span, "process_chunk");
+        int status = run_program(pipeline->process_program, pipeline->process_args, pipeline->n_process_args, fixed,
+                                 2);
+        TRACE_END(span);
+
+        if (status != 0) {
+            fprintf(stderr, "ERROR: Processing of %s failed, it is kept for inspection\n", chunk->directory);
+            pthread_mutex_lock(&pipeline->mutex);
+            pipeline->failed = 1;
+            pthread_cond_broadcast(&pipeline->changed);
+            pthread_mutex_unlock(&pipeline->mutex);
+            break;
+        }
+
+        printf("Processed chunk %zu/%zu in %.1lf s\n", i + 1, pipeline->n_chunks, elapsed_seconds(&started));
+
+        if (!keep)
+            remove_chunk(chunk);
+
+        pthread_mutex_lock(&pipeline->mutex);
+        pipeline->queued_bytes -= chunk->bytes;
+        pipeline->processed = i + 1;
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->mutex);
+    }
+}
+
+/**
+ * @brief Path of a sibling program of this one if it was started with a path, otherwise its name to look up in PATH
+ */
+static const char *sibling_program(const char *self, const char *name, char *buffer) {
+    const char *separator = strrchr(self, '/');
+
+    if (separator == NULL)
+        return name;
+
+    if (snprintf(buffer, PATH_SIZE, "%.*s/%s", (int) (separator - self), self, name) >= PATH_SIZE) {
+        fprintf(stderr, "ERROR: Path of %s is too long\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    return buffer;
+}
+
+int main(int argc, char *argv[]) {
+    int optid, long_index = 0;
+    opterr = NO_GETOPT_ERROR_OUTPUT ? 0 : 1;
+
+    struct tm start, end;
+    int chunk_days = 0, keep = 0;
+    long depth = 1, disk_limit = 0;
+
+    parse_date("2003-01-01", &start);
+    parse_date("2003-01-01", &end);
+
+    static struct option long_options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"purpose", no_argument, NULL, 'i'},
+        {"version", no_argument, NULL, 'v'},
+        {"start", required_argument, NULL, '0'},
+        {"end", required_argument, NULL, '1'},
+        {"chunk_days", required_argument, NULL, 'n'},
+        {"queue", required_argument, NULL, 'q'},
+        {"disk_limit", required_argument, NULL, 'D'},
+        {"keep", no_argument, NULL, 'K'},
+        {0, 0, 0, 0}
+    };
+
+    while ((optid = getopt_long(argc, argv, "+:hivn:q:D:K0:1:", long_options, &long_index)) != -1) {
+        switch (optid) {
+            case 'h':
+                print_usage();
+                exit(EXIT_SUCCESS);
+            case 'i':
+                print_purpose();
+                exit(EXIT_SUCCESS);
+            case 'v':
+                print_version();
+                exit(EXIT_SUCCESS);
+            case '0':
+            case '1':
+                if (parse_date(optarg, optid == '0' ? &start : &end) != 0) {
+                    fprintf(stderr, "ERROR: Failed to parse date \"%s\", expected YYYY-MM-DD\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'n':
+            case 'q':
+            case 'D': {
+                char *end_ptr;
+                long val = strtol(optarg, &end_ptr, 10);
+                long min = optid == 'q' ? 0 : 1, max = optid == 'D' ? 1L << 30 : 3660;
+                if (*end_ptr != '\0' || val < min || val > max) {
+                    fprintf(stderr, "ERROR: Value of -%c must be an integer between %ld and %ld, got \"%s\"\n",
+                            optid, min, max, optarg);
+                    exit(EXIT_FAILURE);
+                }
+                if (optid == 'n')
+                    chunk_days = (int) val;
+                else if (optid == 'q')
+                    depth = val;
+                else
+                    disk_limit = val;
+            }
+                break;
+            case 'K':
+                keep = 1;
+                break;
+            case ':':
+                fprintf(stderr, "ERROR: Option -%c requires an argument\n", optopt);
+                exit(EXIT_FAILURE);
+            case '?':
+            default:
+                fprintf(stderr, "ERROR: Unknown option -%c\n\n", optopt);
+                print_usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc - optind < 2) {
+        fprintf(stderr, "ERROR: Either raw_dir, out_dir or both not specified after arguments\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const char *raw_dir = argv[optind++];
+    const char *out_dir = argv[optind++];
+
+    // everything after the first separator goes to cams-download, after the second one to cams-process
+    char **sections[2] = {NULL, NULL};
+    int lengths[2] = {0, 0}, section = -1;
+
+    for (; optind < argc; optind++) {
+        if (strcmp(argv[optind], "--") == 0 && section < 1) {
+            section++;
+            sections[section] = argv + optind + 1;
+            continue;
+        }
+        if (section < 0) {
+            fprintf(stderr, "ERROR: Unexpected argument \"%s\", arguments of cams-download and cams-process follow "
+                            "after --\n", argv[optind]);
+            exit(EXIT_FAILURE);
+        }
+        if (++lengths[section] > MAX_ARGUMENTS) {
+            fprintf(stderr, "ERROR: At most %d arguments can be passed on\n", MAX_ARGUMENTS);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (compare_dates(&start, &end) > 0) {
+        fprintf(stderr, "ERROR: Start date is more recent than end date\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat sb;
+    if (stat(raw_dir, &sb) != 0 || !S_ISDIR(sb.st_mode) || stat(out_dir, &sb) != 0 || !S_ISDIR(sb.st_mode)) {
+        fprintf(stderr, "ERROR: raw_dir and out_dir need to exist before program invocation\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char download_path[PATH_SIZE], process_path[PATH_SIZE];
+
+    static struct PIPELINE pipeline = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .changed = PTHREAD_COND_INITIALIZER
+    };
+
+    pipeline.chunks = split_chunks(start, end, chunk_days, raw_dir, &pipeline.n_chunks);
+    pipeline.depth = (size_t) depth;
+    pipeline.disk_limit = (off_t) disk_limit << 20;
+    pipeline.download_program = sibling_program(argv[0], "cams-download", download_path);
+    pipeline.process_program = sibling_program(argv[0], "cams-process", process_path);
+    pipeline.download_args = sections[0];
+    pipeline.n_download_args = lengths[0];
+    pipeline.process_args = sections[1];
+    pipeline.n_process_args = lengths[1];
+    pipeline.out_dir = out_dir;
+
+    pthread_t downloader;
+    struct timespec started;
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    if (pthread_create(&downloader, NULL, download_chunks, &pipeline) != 0) {
+        fprintf(stderr, "ERROR: Failed to start download thread\n");
+        exit(EXIT_FAILURE);
+    }
+
+    process_chunks(&pipeline, keep);
+
+    // a failed processing step stops the downloader before its next chunk, the running download is finished
+    pthread_join(downloader, NULL);
+
+    printf("Processed %zu of %zu chunks in %.1lf s\n", pipeline.processed, pipeline.n_chunks,
+           elapsed_seconds(&started));
+
+    int failed = pipeline.failed;
+
+    free(pipeline.chunks);
+
+    return failed ? EXIT_FAILURE : 0;
+}
@@ -1,9 +1,22 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <eccodes.h>
 #include <getopt.h>
-//#include <gdal/gdal.h>
 
 #include "src/gributils.h"
+#include "src/interpolate.h"
+#include "src/climatology.h"
+#include "src/fieldcache.h"
+#include "src/gribindex.h"
+#include "src/gridshm.h"
+#include "src/trace.h"
+#include "src/warpmap.h"
 
 #ifdef DEBUG
 #define NO_GETOPT_ERROR_OUTPUT 0
@@ -11,11 +24,149 @@
 #define NO_GETOPT_ERROR_OUTPUT 1
 #endif // DEBUG
 
+#define FORCE_VERSION "69.420"
+
+static void append_input(struct PROCESS_OPTIONS *options, size_t *capacity, char *path) {
+    if (options->n_files == *capacity) {
+        *capacity = *capacity ? 2 * *capacity : 16;
+        if ((options->in_files = realloc(options->in_files, *capacity * sizeof(char *))) == NULL) {
+            fprintf(stderr, "ERROR: Failed to allocate memory for input files\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    options->in_files[options->n_files++] = path;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+static int has_suffix(const char *name, size_t length, const char *suffix) {
+    size_t n = strlen(suffix);
+
+    return length > n && strcmp(name + length - n, suffix) == 0;
+}
+
+/**
+ * @brief Add a file, or all regular files of a directory sorted by name, to the inputs. Hidden files, field caches and
+ * GRIB indices are skipped.
+ */
+static void add_input(struct PROCESS_OPTIONS *options, size_t *capacity, char *path) {
+    struct stat sb;
+    struct dirent *entry;
+    size_t first = options->n_files;
+
+    if (stat(path, &sb) != 0) {
+        fprintf(stderr, "ERROR: Input %s does not exist\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!S_ISDIR(sb.st_mode)) {
+        append_input(options, capacity, path);
+        return;
+    }
+
+    DIR *dir = opendir(path);
+
+    if (dir == NULL) {
+        fprintf(stderr, "ERROR: Could not open directory %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        char *file;
+
+        if (entry->d_name[0] == '.' || has_suffix(entry->d_name, length, FIELD_CACHE_SUFFIX) ||
+            has_suffix(entry->d_name, length, GRIB_INDEX_SUFFIX))
+            continue;
+
+        if ((file = malloc(strlen(path) + length + 2)) == NULL) {
+            fprintf(stderr, "ERROR: Failed to allocate memory for input files\n");
+            exit(EXIT_FAILURE);
+        }
+
+        sprintf(file, "%s/%s", path, entry->d_name);
+
+        if (stat(file, &sb) != 0 || !S_ISREG(sb.st_mode)) {
+            free(file);
+            continue;
+        }
+
+        append_input(options, capacity, file);
+    }
+
+    closedir(dir);
+
+    // readdir returns entries in no particular order, but results must not depend on it
+    qsort(options->in_files + first, options->n_files - first, sizeof(char *), compare_paths);
+}
+
+/**
+ * @brief Name of the shared-memory cache of decoded grids, taken from $CAMS_SHM_NAME if set.
+ */
+static const char *shm_name(void) {
+    const char *name = getenv("CAMS_SHM_NAME");
+
+    return name ? name : GRID_SHM_DEFAULT_NAME;
+}
+
+static void print_usage(void) {
+    printf(
+        "Usage: cams-process <-h|--help> <-v|--version> <-i|--purpose> "
+        "<-t|--daily_tables> <-c|--climatology> <-g|--gtiff> <-j|--threads> <-b|--benchmark> <-C|--coordinates> <-k|--cache> <-Q|--cache_type> <-M|--shared_memory> <-R|--remove_shared_memory> <-N|--no_index> <-q|--queries> <-l|--linear_time> <-T|--acquisitions> <-x|--tiles> <-r|--resolution> in_file... out_dir\n"
+        "\nOptional arguments:\n"
+        "<-h|--help>\tprint this help and exit\n"
+        "<-v|--version>\tprint FORCE version and exit\n"
+        "<-i|--purpose>\tprint program's purpose and exit\n"
+        "<-t|--daily_tables>\tBuild daily tables? Default if not specified: false\n"
+        "<-c|--climatology>\tBuild climatology? Resumed from out_dir/climatology.state if present. Default if not specified: false\n"
+        "<-g|--gtiff>\tConvert each step from the input files to GTiff? Default if not specified: false\n"
+        "<-j|--threads>\tNumber of threads used for decoding. Default: number of online processors\n"
+        "<-b|--benchmark>\tOnly decode the input files and report the throughput, with -C also that of point extraction. Default if not specified: false\n"
+        "<-C|--coordinates>\tPath to file with WRS2 center coordinates at which tables are built. Required for daily tables\n"
+        "<-k|--cache>\tDirectory in which decoded fields are cached. Later runs read the cache instead of decoding the input file\n"
+        "<-Q|--cache_type>\tStorage type of new caches: float32, float16 or int16 (scaled per field). Default: float32\n"
+        "<-M|--shared_memory>\tShare decoded grids with concurrent cams-process runs through shared memory of at most this many MB (segment $CAMS_SHM_NAME or " GRID_SHM_DEFAULT_NAME "). Default: not shared\n"
+        "<-R|--remove_shared_memory>\tRemove the shared-memory cache (segment $CAMS_SHM_NAME or " GRID_SHM_DEFAULT_NAME ") and all grids in it, then exit. in_file and out_dir are not needed\n"
+        "<-N|--no_index>\tRead GRIB files without their index (in_file" GRIB_INDEX_SUFFIX "), neither using nor writing it. Default: the index is used and written if missing\n"
+        "<-q|--queries>\tPath to file with lon, lat, date and time per line. Answers are written to out_dir/point_queries.txt\n"
+        "<-l|--linear_time>\tInterpolate queries linearly in time between the enclosing fields instead of taking the nearest. Default if not specified: false\n"
+        "<-T|--acquisitions>\tPath to file with date and time per line. Fields are interpolated linearly in time and written as GTiff, times outside of the fields are skipped\n"
+        "<-x|--tiles>\tPath to FORCE tile allow-list. Each step is reprojected to these tiles of the datacube defined by out_dir/" DATACUBE_DEFINITION " and written as GTiff. Warp maps are kept in the cache directory (-k), without it they are computed in every run\n"
+        "<-r|--resolution>\tPixel size of the datacube tiles in projection units. Required for --tiles\n"
+        "\nMandatory positional arguments:\n"
+        "in_file\t\t\tAbsolut path to file or directory to process. Can be given multiple times; the messages of all files are decoded by one pool of threads\n"
+        "out_dir\t\t\tAbsolut path to directory in which results are stored. Needs to exist before program invocation\n"
+        );
+}
+
+static void print_purpose(void) {
+    printf("Process downloaded ECMWF data (CAMS EC4) to daily tables, climatology, GTiff or FORCE datacube tiles\n");
+}
+
+static void print_version(void) {
+    printf("FORCE version is: %s\n", FORCE_VERSION);
+}
+
+/**
+ * @brief Long name of the option reported by getopt as `val`
+ */
+static const char *long_option_name(const struct option *long_options, int val) {
+    for (; long_options->name != NULL; long_options++) {
+        if (long_options->flag == NULL && long_options->val == val)
+            return long_options->name;
+    }
+
+    return "";
+}
+
 int main(int argc, char *argv[]) {
     static struct PROCESS_OPTIONS options = {0};
 
     int optid, long_index = 0;
-    opterr = NO_GETOPT_ERROR_OUTPUT;
+    opterr = NO_GETOPT_ERROR_OUTPUT ? 0 : 1;
 
     static struct option long_options[] = {
         {"help", no_argument, NULL, 'h'},
@@ -24,10 +175,26 @@ int main(int argc, char *argv[]) {
         {"daily_tables", no_argument, &options.daily_tables, 1},
         {"climatology", no_argument, &options.climatology, 1},
         {"gtiff", no_argument, &options.convert_to_tiff, 1},
+        {"benchmark", no_argument, &options.benchmark, 1},
+        {"threads", required_argument, NULL, 'j'},
+        {"coordinates", required_argument, NULL, 'C'},
+        {"cache", required_argument, NULL, 'k'},
+        {"cache_type", required_argument, NULL, 'Q'},
+        {"shared_memory", required_argument, NULL, 'M'},
+        {"remove_shared_memory", no_argument, &options.remove_shm, 1},
+        {"no_index", no_argument, &options.no_index, 1},
+        {"queries", required_argument, NULL, 'q'},
+        {"linear_time", no_argument, &options.linear_time, 1},
+        {"acquisitions", required_argument, NULL, 'T'},
+        {"tiles", required_argument, NULL, 'x'},
+        {"resolution", required_argument, NULL, 'r'},
         {0, 0, 0, 0}
     };
 
-    while ((optid = getopt_long(argc, argv, "+:hivtcg", long_options, &long_index)) != -1) {
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    options.n_threads = n_cpus > 0 ? (int) n_cpus : 1;
+
+    while ((optid = getopt_long(argc, argv, "+:hivtcgblRNj:C:k:Q:M:q:T:x:r:", long_options, &long_index)) != -1) {
         switch (optid) {
             case 'h':
                 print_usage();
@@ -38,11 +205,87 @@ int main(int argc, char *argv[]) {
             case 'v':
                 print_version();
                 exit(EXIT_SUCCESS);
-            case 't': // fallthrough
-            case 'c': // fallthrough
-            case 'g': // fallthrough
+            case 't':
+                options.daily_tables = 1;
+                break;
+            case 'c':
+                options.climatology = 1;
+                break;
+            case 'g':
+                options.convert_to_tiff = 1;
+                break;
+            case 'b':
+                options.benchmark = 1;
+                break;
+            case 'j': {
+                char *end;
+                long val = strtol(optarg, &end, 10);
+                if (*end != '\0' || val < 1 || val > 1024) {
+                    fprintf(stderr, "ERROR: Number of threads must be an integer between 1 and 1024, got \"%s\"\n",
+                            optarg);
+                    exit(EXIT_FAILURE);
+                }
+                options.n_threads = (int) val;
+            }
+                break;
+            case 'C':
+                options.coordinates = optarg;
+                break;
+            case 'k':
+                options.cache_dir = optarg;
+                break;
+            case 'Q':
+                if ((options.cache_dtype = field_cache_dtype(optarg)) < 0) {
+                    fprintf(stderr, "ERROR: Unknown cache type \"%s\", expected float32, float16 or int16\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'M': {
+                char *end;
+                long val = strtol(optarg, &end, 10);
+                if (*end != '\0' || val < 1 || val > 1048576) {
+                    fprintf(stderr, "ERROR: Shared memory budget must be between 1 and 1048576 MB, got \"%s\"\n",
+                            optarg);
+                    exit(EXIT_FAILURE);
+                }
+                options.shm_budget = (size_t) val << 20;
+            }
+                break;
+            case 'R':
+                options.remove_shm = 1;
+                break;
+            case 'N':
+                options.no_index = 1;
+                break;
+            case 'q':
+                options.queries = optarg;
+                break;
+            case 'l':
+                options.linear_time = 1;
+                break;
+            case 'T':
+                options.acquisitions = optarg;
+                break;
+            case 'x':
+                options.tiles = optarg;
+                break;
+            case 'r': {
+                char *end;
+                double val = strtod(optarg, &end);
+                if (*end != '\0' || !(val > 0.0)) {
+                    fprintf(stderr, "ERROR: Resolution must be a positive number, got \"%s\"\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                options.resolution = val;
+            }
+                break;
             case 0:
                 break;
+            case ':':
+                fprintf(stderr, "ERROR: Option -%c/--%s requires an argument\n\n", optopt,
+                        long_option_name(long_options, optopt));
+                print_usage();
+                exit(EXIT_FAILURE);
             case '?':
                 fprintf(stderr, "ERROR parsing option %c\n", optopt);
                 break;
@@ -52,25 +295,130 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    if (optind < argc) {
-        options.in_file = argv[optind++];
+    // removing the cache needs neither inputs nor an output directory
+    if (options.remove_shm) {
+        if (grid_shm_remove(shm_name()) != 0) {
+            fprintf(stderr, "ERROR: There is no shared grid cache %s\n", shm_name());
+            exit(EXIT_FAILURE);
+        }
+        printf("Removed shared grid cache %s\n", shm_name());
+        return 0;
+    }
+
+    if (argc - optind >= 2) {
+        size_t capacity = 0;
+
+        // everything but the last positional argument is an input
+        for (; optind < argc - 1; optind++)
+            add_input(&options, &capacity, argv[optind]);
         options.out_dir = argv[optind];
     } else {
         fprintf(stderr, "ERROR: Either in_file, out_dir or both not specified after arguments\n");
         exit(EXIT_FAILURE);
     }
 
-    if (options.daily_tables) {
+    if (options.n_files == 0) {
+        fprintf(stderr, "ERROR: No input files found\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const char *const *in_files = (const char *const *) options.in_files;
+
+    struct DECODE_OPTIONS decode_options = {
+        .n_threads = options.n_threads, .cache_dir = options.cache_dir, .cache_dtype = options.cache_dtype,
+        .index = !options.no_index
+    };
 
+    // without the shared-memory cache, every process decodes on its own
+    static struct GRID_SHM shared = {0};
+    if (options.shm_budget) {
+        if (grid_shm_open(&shared, shm_name(), options.shm_budget) == 0)
+            decode_options.shared = &shared;
     }
 
-    if (options.climatology) {
+    if (options.benchmark) {
+        TRACE_BEGIN(span, "benchmark");
+        struct DECODE_STATS stats = {0};
+        grib_data_from_files(in_files, options.n_files, &decode_options, NULL, NULL, &stats);
+        print_decode_stats(&stats);
+
+        if (options.coordinates) {
+            struct POINTS points = read_points(options.coordinates);
+            benchmark_point_extraction(in_files, options.n_files, &points, &decode_options);
+            free_points(&points);
+        }
+        TRACE_END(span);
+
+        grid_shm_close(&shared);
 
+        return 0;
+    }
+
+    if ((options.daily_tables || options.climatology) && options.coordinates == NULL) {
+        fprintf(stderr, "ERROR: Building daily tables or a climatology requires a coordinate file (-C|--coordinates)\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (options.tiles && options.resolution <= 0.0) {
+        fprintf(stderr, "ERROR: Reprojecting to datacube tiles requires a resolution (-r|--resolution)\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct POINTS points = {0};
+
+    if (options.coordinates)
+        points = read_points(options.coordinates);
+
+    if (options.daily_tables) {
+        TRACE_BEGIN(span, "build_daily_tables");
+        build_daily_tables(in_files, options.n_files, options.out_dir, &points, &decode_options);
+        TRACE_END(span);
+    }
+
+    if (options.climatology) {
+        TRACE_BEGIN(span, "build_climatology");
+        build_climatology(in_files, options.n_files, options.out_dir, &points, &decode_options);
+        TRACE_END(span);
     }
 
     if (options.convert_to_tiff) {
+        // GDAL's compression threads share the processors with the workers writing steps in parallel
+        int compression_threads = n_cpus > options.n_threads ? (int) n_cpus / options.n_threads : 1;
+        TRACE_BEGIN(span, "export_data_to_gtiff");
+        export_data_to_gtiff(in_files, options.n_files, options.out_dir, &decode_options, compression_threads);
+        TRACE_END(span);
+    }
 
+    if (options.tiles) {
+        // every worker resamples and writes the steps it decoded, as for the plain GTiff export
+        int compression_threads = n_cpus > options.n_threads ? (int) n_cpus / options.n_threads : 1;
+        TRACE_BEGIN(span, "export_datacube_tiles");
+        // warp maps are only kept with a cache directory, the datacube itself holds nothing but tiles
+        export_datacube_tiles(in_files, options.n_files, options.out_dir, options.tiles, options.resolution,
+                              options.cache_dir, &decode_options, compression_threads);
+        TRACE_END(span);
     }
 
+    if (options.queries) {
+        TRACE_BEGIN(span, "answer_query_file");
+        answer_query_file(in_files, options.n_files, options.queries, options.out_dir, options.linear_time,
+                          &decode_options);
+        TRACE_END(span);
+    }
+
+    if (options.acquisitions) {
+        // interpolated fields are written one after the other, so all processors compress
+        int compression_threads = n_cpus > 1 ? (int) n_cpus : 1;
+        TRACE_BEGIN(span, "export_gtiff_at_times");
+        export_gtiff_at_times(in_files, options.n_files, options.acquisitions, options.out_dir, &decode_options,
+                              compression_threads);
+        TRACE_END(span);
+    }
+
+    if (options.coordinates)
+        free_points(&points);
+
+    grid_shm_close(&shared);
+
     return 0;
 }
@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "arena.h"
+
+struct ARENA_BLOCK {
+    struct ARENA_BLOCK *next;   ///< previously filled block
+    size_t size;                ///< usable size in bytes
+    size_t used;                ///< bytes handed out
+    max_align_t data[];
+};
+
+void arena_init(struct ARENA *arena, size_t block_size) {
+    arena->head = NULL;
+    arena->block_size = block_size;
+}
+
+static struct ARENA_BLOCK *new_block(size_t size) {
+    struct ARENA_BLOCK *block = malloc(sizeof(struct ARENA_BLOCK) + size);
+
+    if (block == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for arena block of %zu bytes\n", size);
+        exit(EXIT_FAILURE);
+    }
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
+
+void *arena_alloc(struct ARENA *arena, size_t size) {
+    const size_t align = _Alignof(max_align_t);
+    struct ARENA_BLOCK *block = arena->head;
+
+    size = size ? (size + align - 1) & ~(align - 1) : align;
+
+    if (block == NULL || block->size - block->used < size) {
+        if (size > arena->block_size) {
+            // oversized allocations get a block of their own behind the head, which keeps its remaining space
+            block = new_block(size);
+            if (arena->head) {
+                block->next = arena->head->next;
+                arena->head->next = block;
+            } else {
+                arena->head = block;
+            }
+        } else {
+            block = new_block(arena->block_size);
+            block->next = arena->head;
+            arena->head = block;
+        }
+    }
+
+    void *p = (char *) block->data + block->used;
+    block->used += size;
+
+    return p;
+}
+
+char *arena_strndup(struct ARENA *arena, const char *s, size_t n) {
+    size_t length = strnlen(s, n);
+    char *copy = arena_alloc(arena, length + 1);
+
+    memcpy(copy, s, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+char *arena_strdup(struct ARENA *arena, const char *s) {
+    return arena_strndup(arena, s, strlen(s));
+}
+
+char *arena_sprintf(struct ARENA *arena, const char *fmt, ...) {
+    va_list args, copy;
+    int length;
+
+    va_start(args, fmt);
+    va_copy(copy, args);
+
+    if ((length = vsnprintf(NULL, 0, fmt, copy)) < 0) {
+        fprintf(stderr, "Error: Failed to format string with format \"%s\"\n", fmt);
+        exit(EXIT_FAILURE);
+    }
+    va_end(copy);
+
+    char *s = arena_alloc(arena, (size_t) length + 1);
+    vsnprintf(s, (size_t) length + 1, fmt, args);
+    va_end(args);
+
+    return s;
+}
+
+void arena_reset(struct ARENA *arena) {
+    if (arena->head == NULL)
+        return;
+
+    struct ARENA_BLOCK *block = arena->head->next;
+    while (block) {
+        struct ARENA_BLOCK *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->head->next = NULL;
+    arena->head->used = 0;
+}
+
+void arena_free(struct ARENA *arena) {
+    struct ARENA_BLOCK *block = arena->head;
+
+    while (block) {
+        struct ARENA_BLOCK *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->head = NULL;
+}
@@ -0,0 +1,79 @@
+#ifndef CAMS_ARENA_H
+#define CAMS_ARENA_H
+
+#include <stddef.h>
+
+/**
+ * @brief Region of memory from which short-lived allocations are carved and released all at once
+ * @details Allocations are served from blocks of `block_size` bytes which are allocated on demand; requests larger
+ * than a block get a block of their own. Nothing is released individually, `arena_reset` rewinds the arena for the
+ * next request cycle and `arena_free` releases all blocks.
+ * @author Florian Katerndahl
+ */
+struct ARENA {
+    struct ARENA_BLOCK *head;   ///< block allocations are served from, linked to all previously filled blocks
+    size_t block_size;          ///< usable size of a regular block in bytes
+};
+
+/**
+ * @brief Initialize an empty arena; no memory is allocated until the first allocation
+ * @param arena Arena to initialize
+ * @param block_size Usable size of a regular block in bytes
+ * @author Florian Katerndahl
+ */
+void arena_init(struct ARENA *arena, size_t block_size);
+
+/**
+ * @brief Allocate `size` bytes aligned for any type
+ * @param arena Arena to allocate from
+ * @param size Number of bytes
+ * @return Pointer to uninitialized memory, valid until the arena is reset or freed
+ * @note Terminates the program if no memory could be allocated.
+ * @author Florian Katerndahl
+ */
+void *arena_alloc(struct ARENA *arena, size_t size);
+
+/**
+ * @brief Copy the first `n` bytes of `s`, or less if `s` is shorter, into a null-terminated string
+ * @param arena Arena to allocate from
+ * @param s String to copy
+ * @param n Maximum number of bytes to copy
+ * @return Copy of `s` sized to its content
+ * @author Florian Katerndahl
+ */
+char *arena_strndup(struct ARENA *arena, const char *s, size_t n);
+
+/**
+ * @brief Copy a null-terminated string
+ * @param arena Arena to allocate from
+ * @param s String to copy
+ * @return Copy of `s` sized to its content
+ * @author Florian Katerndahl
+ */
+char *arena_strdup(struct ARENA *arena, const char *s);
+
+/**
+ * @brief Format a string like `snprintf` into a buffer of exactly the required size
+ * @param arena Arena to allocate from
+ * @param fmt Format string
+ * @return Formatted string
+ * @note Terminates the program if formatting fails.
+ * @author Florian Katerndahl
+ */
+char *arena_sprintf(struct ARENA *arena, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Release all allocations at once, but keep the current block for reuse
+ * @param arena Arena to reset
+ * @author Florian Katerndahl
+ */
+void arena_reset(struct ARENA *arena);
+
+/**
+ * @brief Release all blocks of the arena
+ * @param arena Arena to free; it can be used again afterwards
+ * @author Florian Katerndahl
+ */
+void arena_free(struct ARENA *arena);
+
+#endif //CAMS_ARENA_H
@@ -0,0 +1,215 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "broker.h"
+
+int broker_connect(const char *socket_path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Path of broker socket %s is too long\n", socket_path);
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int broker_send_line(int fd, const char *line, int file_fd) {
+    size_t length = strlen(line);
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control = {0};
+    struct iovec iov = {.iov_base = (void *) line, .iov_len = length};
+    struct msghdr message = {.msg_iov = &iov, .msg_iovlen = 1};
+
+    if (file_fd >= 0) {
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &file_fd, sizeof(int));
+    }
+
+    // the descriptor travels with the first chunk, anything the socket did not take is sent without it
+    while (iov.iov_len > 0) {
+        ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+
+        iov.iov_base = (char *) iov.iov_base + sent;
+        iov.iov_len -= (size_t) sent;
+        message.msg_control = NULL;
+        message.msg_controllen = 0;
+    }
+
+    return 0;
+}
+
+ssize_t broker_receive_line(int fd, char *line, size_t size, int *file_fd) {
+    size_t length = 0;
+
+    *file_fd = -1;
+
+    // reading byte by byte never consumes anything beyond the line, nor a descriptor belonging to the next one
+    while (length + 1 < size) {
+        union {
+            struct cmsghdr header;
+            char buffer[CMSG_SPACE(sizeof(int))];
+        } control;
+        struct iovec iov = {.iov_base = line + length, .iov_len = 1};
+        struct msghdr message = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buffer,
+                                 .msg_controllen = sizeof(control.buffer)};
+
+        ssize_t received = recvmsg(fd, &message, 0);
+
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            break;
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && *file_fd < 0)
+                memcpy(file_fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+
+        if (line[length] == '\n') {
+            line[length] = '\0';
+            return (ssize_t) length;
+        }
+
+        length++;
+    }
+
+    if (*file_fd >= 0)
+        close(*file_fd);
+    *file_fd = -1;
+
+    return -1;
+}
+
+static const char *const priority_names[BROKER_PRIORITIES] = {"urgent", "normal", "bulk"};
+
+const char *broker_priority_name(enum BROKER_PRIORITY priority) {
+    return priority_names[priority];
+}
+
+int broker_priority_from_name(const char *name) {
+    for (int i = 0; i < BROKER_PRIORITIES; i++) {
+        if (strcmp(name, priority_names[i]) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Copy the whole file behind `in` to a new file at `destination`.
+ */
+static int copy_file(int in, const char *destination) {
+    char buffer[65536];
+    ssize_t n;
+    int out = open(destination, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (out < 0)
+        return 1;
+
+    if (lseek(in, 0, SEEK_SET) != 0) {
+        close(out);
+        return 1;
+    }
+
+    while ((n = read(in, buffer, sizeof(buffer))) != 0) {
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 || write(out, buffer, (size_t) n) != n) {
+            close(out);
+            unlink(destination);
+            return 1;
+        }
+    }
+
+    return close(out) != 0;
+}
+
+int broker_fetch(const char *socket_path, const char *dataset, const char *body, enum BROKER_PRIORITY priority,
+                 const char *destination) {
+    char line[BROKER_LINE_SIZE];
+    int file_fd;
+    int fd = broker_connect(socket_path);
+
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to connect to broker at %s\n", socket_path);
+        return 1;
+    }
+
+    if (snprintf(line, BROKER_LINE_SIZE, "FETCH %s %s %s\n", dataset, broker_priority_name(priority), body) >=
+        BROKER_LINE_SIZE) {
+        fprintf(stderr, "Error: Request is too long to be sent to the broker\n");
+        close(fd);
+        return 1;
+    }
+
+    if (broker_send_line(fd, line, -1) != 0 || broker_receive_line(fd, line, BROKER_LINE_SIZE, &file_fd) < 0) {
+        fprintf(stderr, "Error: Lost connection to broker at %s\n", socket_path);
+        close(fd);
+        return 1;
+    }
+
+    if (strncmp(line, "FAILED ", 7) == 0) {
+        fprintf(stderr, "Error: Broker failed to fetch product: %s\n", line + 7);
+        close(fd);
+        return 1;
+    }
+
+    unsigned long long bytes;
+    int offset = 0;
+
+    if (sscanf(line, "DONE %llu %n", &bytes, &offset) != 1 || offset == 0 || file_fd < 0) {
+        fprintf(stderr, "Error: Unexpected answer from broker: %s\n", line);
+        if (file_fd >= 0)
+            close(file_fd);
+        close(fd);
+        return 1;
+    }
+
+    // the broker keeps the spool file until all waiters disconnected, so the connection stays open until it is linked
+    int status = 0;
+
+    unlink(destination);
+    if (link(line + offset, destination) != 0 && (status = copy_file(file_fd, destination)) != 0)
+        fprintf(stderr, "Error: Failed to place product from broker at %s\n", destination);
+    else
+        printf("Received %.2lf MB from broker\n", (double) bytes * 0.000001);
+
+    close(file_fd);
+    close(fd);
+
+    return status;
+}
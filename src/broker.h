@@ -0,0 +1,89 @@
+#ifndef CAMS_BROKER_H
+#define CAMS_BROKER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+enum {
+    BROKER_LINE_SIZE = 32768    ///< maximum length of a protocol line, including the newline
+};
+
+/**
+ * @brief Priority class of a request, in decreasing order of urgency
+ */
+enum BROKER_PRIORITY {
+    BROKER_PRIORITY_URGENT = 0,     ///< latency-sensitive requests, e.g. of near-real-time runs
+    BROKER_PRIORITY_NORMAL = 1,
+    BROKER_PRIORITY_BULK = 2,       ///< backfills; held back while requests of a higher class are pending
+    BROKER_PRIORITIES = 3
+};
+
+/**
+ * @brief Default path of the broker socket, used if neither an option nor `CAMS_BROKER_SOCKET` names another one
+ */
+#define BROKER_DEFAULT_SOCKET "/tmp/cams-broker.sock"
+
+/**
+ * @brief Connect to a broker listening on a Unix socket
+ * @param socket_path Path of the socket
+ * @return Connected socket, -1 on failure
+ * @author Florian Katerndahl
+ */
+int broker_connect(const char *socket_path);
+
+/**
+ * @brief Name of a priority class as used in the protocol and on the command line
+ * @param priority Priority class
+ * @return Name of the class
+ * @author Florian Katerndahl
+ */
+const char *broker_priority_name(enum BROKER_PRIORITY priority);
+
+/**
+ * @brief Parse the name of a priority class
+ * @param name One of `urgent`, `normal` or `bulk`
+ * @return Priority class, -1 if the name is unknown
+ * @author Florian Katerndahl
+ */
+int broker_priority_from_name(const char *name);
+
+/**
+ * @brief Let the broker fetch a product and place it at `destination`
+ * @details The request is sent as one line `FETCH <dataset> <priority> <body>`; the priority may be omitted, in which
+ * case it is normal. The call blocks until the broker answers with
+ * `DONE <bytes> <path>`, accompanied by a read-only descriptor of the downloaded file, or `FAILED <reason>`. The file
+ * is hardlinked to `destination`; if that is not possible, e.g. because the spool directory of the broker lies on
+ * another file system, it is copied from the descriptor instead.
+ * @param socket_path Path of the broker socket
+ * @param dataset Name of the ADS dataset, see `product_dataset`
+ * @param body Request in the JSON form produced by `assemble_request`
+ * @param priority Priority class of the request; merged requests are scheduled with the most urgent class among them
+ * @param destination Path the product is written to
+ * @return Zero on success, non-zero if the broker could not be reached or the request failed
+ * @author Florian Katerndahl
+ */
+int broker_fetch(const char *socket_path, const char *dataset, const char *body, enum BROKER_PRIORITY priority,
+                 const char *destination);
+
+/**
+ * @brief Send one protocol line, optionally passing a file descriptor along with it
+ * @param fd Connected socket
+ * @param line Null-terminated line including the trailing newline
+ * @param file_fd Descriptor to pass, -1 for none
+ * @return Zero on success, non-zero on failure
+ * @author Florian Katerndahl
+ */
+int broker_send_line(int fd, const char *line, int file_fd);
+
+/**
+ * @brief Receive one protocol line and a file descriptor passed along with it
+ * @param fd Connected socket
+ * @param line Buffer of `size` bytes receiving the null-terminated line without the newline
+ * @param size Size of `line`
+ * @param file_fd Set to the received descriptor, -1 if there was none
+ * @return Length of the line, -1 on failure or if the peer closed the connection early
+ * @author Florian Katerndahl
+ */
+ssize_t broker_receive_line(int fd, char *line, size_t size, int *file_fd);
+
+#endif //CAMS_BROKER_H
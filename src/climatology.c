@@ -0,0 +1,709 @@
+#define _XOPEN_SOURCE 700 // POSIX.1-2008 plus realpath
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <libgen.h>
+#include <sys/stat.h>
+
+#include "climatology.h"
+#include "hash.h"
+#include "interpolate.h"
+
+/// first day of each month in a leap year
+static const int month_offset[13] = {0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366};
+
+int day_of_year(long date) {
+    long month = (date / 100) % 100;
+    long day = date % 100;
+
+    if (month < 1 || month > 12 || day < 1 || day > month_offset[month] - month_offset[month - 1]) {
+        fprintf(stderr, "Error: Invalid date %ld\n", date);
+        exit(EXIT_FAILURE);
+    }
+
+    return month_offset[month - 1] + (int) day - 1;
+}
+
+/**
+ * @brief Inverse of `day_of_year`
+ * @return Date as MMDD, i.e. a date in year zero
+ */
+static long day_of_year_to_date(int doy) {
+    int month = 1;
+
+    while (doy >= month_offset[month])
+        month++;
+
+    return month * 100 + (doy - month_offset[month - 1] + 1);
+}
+
+void climatology_init(struct CLIMATOLOGY *clim, int n_threads) {
+    memset(clim, 0, sizeof(struct CLIMATOLOGY));
+
+    for (int d = 0; d < CLIMATOLOGY_DAYS; d++)
+        pthread_mutex_init(&clim->day_lock[d], NULL);
+    pthread_mutex_init(&clim->lock, NULL);
+
+    clim->n_partials = n_threads > 0 ? n_threads : 1;
+
+    if ((clim->partials = calloc(clim->n_partials, sizeof(struct CLIMATOLOGY_PARTIAL))) == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for climatology accumulators\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < clim->n_partials; i++)
+        clim->partials[i].doy = -1;
+}
+
+/**
+ * @brief Set grid and parameter of the climatology from its first field, or check that `field` matches them.
+ */
+static void climatology_check_field(struct CLIMATOLOGY *clim, const struct GRIB_FIELD *field) {
+    pthread_mutex_lock(&clim->lock);
+
+    if (!clim->initialized) {
+        clim->grid = field->grid;
+        clim->n_cells = (size_t) field->grid.ni * (size_t) field->grid.nj;
+        clim->param = field->param;
+        memcpy(clim->short_name, field->short_name, sizeof(clim->short_name));
+        clim->initialized = 1;
+    } else if (!grid_equal(&clim->grid, &field->grid) || clim->param != field->param) {
+        fprintf(stderr, "Error: Message %zu differs in grid or parameter from the climatology. Only a single "
+                        "parameter on a single grid can be accumulated.\n", field->index);
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_unlock(&clim->lock);
+}
+
+/**
+ * @brief Merge a partial accumulator into the shared statistics of its day of year with the pairwise update of
+ * Chan et al. and reset it.
+ */
+static void climatology_flush(struct CLIMATOLOGY *clim, struct CLIMATOLOGY_PARTIAL *partial) {
+    int d = partial->doy;
+
+    if (d < 0)
+        return;
+
+    pthread_mutex_lock(&clim->day_lock[d]);
+
+    if (clim->count[d] == NULL) {
+        clim->count[d] = calloc(clim->n_cells, sizeof(uint32_t));
+        clim->mean[d] = calloc(clim->n_cells, sizeof(double));
+        clim->m2[d] = calloc(clim->n_cells, sizeof(double));
+
+        if (clim->count[d] == NULL || clim->mean[d] == NULL || clim->m2[d] == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for climatology\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    uint32_t *restrict count = clim->count[d];
+    double *restrict mean = clim->mean[d];
+    double *restrict m2 = clim->m2[d];
+
+    for (size_t c = 0; c < clim->n_cells; c++) {
+        if (partial->count[c] == 0)
+            continue;
+
+        double na = (double) count[c], nb = (double) partial->count[c], n = na + nb;
+        double delta = partial->mean[c] - mean[c];
+
+        mean[c] += delta * nb / n;
+        m2[c] += partial->m2[c] + delta * delta * na * nb / n;
+        count[c] += partial->count[c];
+    }
+
+    pthread_mutex_unlock(&clim->day_lock[d]);
+
+    memset(partial->count, 0, clim->n_cells * sizeof(uint32_t));
+    memset(partial->mean, 0, clim->n_cells * sizeof(double));
+    memset(partial->m2, 0, clim->n_cells * sizeof(double));
+    partial->doy = -1;
+}
+
+static void climatology_consumer(const struct GRIB_FIELD *field, int worker, void *user) {
+    struct CLIMATOLOGY *clim = (struct CLIMATOLOGY *) user;
+    struct CLIMATOLOGY_PARTIAL *partial = &clim->partials[worker];
+    int doy = day_of_year(field->date);
+
+    climatology_check_field(clim, field);
+
+    if (partial->count == NULL) {
+        partial->count = calloc(clim->n_cells, sizeof(uint32_t));
+        partial->mean = calloc(clim->n_cells, sizeof(double));
+        partial->m2 = calloc(clim->n_cells, sizeof(double));
+
+        if (partial->count == NULL || partial->mean == NULL || partial->m2 == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for climatology accumulator\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // messages arrive roughly in chronological order, so a worker rarely switches between days
+    if (partial->doy != doy) {
+        climatology_flush(clim, partial);
+        partial->doy = doy;
+    }
+
+    uint32_t *restrict count = partial->count;
+    double *restrict mean = partial->mean;
+    double *restrict m2 = partial->m2;
+    const float *restrict values = field->values;
+
+    for (size_t c = 0; c < clim->n_cells; c++) {
+        if (isnan(values[c]))
+            continue;
+
+        double x = (double) values[c];
+        double delta = x - mean[c];
+        count[c]++;
+        mean[c] += delta / (double) count[c];
+        m2[c] += delta * (x - mean[c]);
+    }
+}
+
+static size_t field_hash(const struct CLIMATOLOGY_FIELD *field) {
+    uint64_t key = (uint64_t) field->date * 10000 + (uint64_t) field->time;
+
+    return (size_t) ((key * 0x9e3779b97f4a7c15ULL ^ (uint64_t) field->param * 0xc2b2ae3d27d4eb4fULL) >> 17);
+}
+
+/**
+ * @brief Add a message to the set of folded messages, growing it to keep at least half of the slots free.
+ * @return 1 if the message was added, 0 if it was part of the set already
+ */
+static int climatology_add_field(struct CLIMATOLOGY *clim, struct CLIMATOLOGY_FIELD field) {
+    if (2 * (clim->n_fields + 1) > clim->field_capacity) {
+        size_t capacity = clim->field_capacity ? 2 * clim->field_capacity : 1024;
+        struct CLIMATOLOGY_FIELD *old = clim->fields;
+        size_t old_capacity = clim->field_capacity;
+
+        if ((clim->fields = calloc(capacity, sizeof(struct CLIMATOLOGY_FIELD))) == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for climatology messages\n");
+            exit(EXIT_FAILURE);
+        }
+
+        clim->field_capacity = capacity;
+        clim->n_fields = 0;
+
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old[i].date != 0)
+                climatology_add_field(clim, old[i]);
+        }
+
+        free(old);
+    }
+
+    size_t slot = field_hash(&field) & (clim->field_capacity - 1);
+
+    for (; clim->fields[slot].date != 0; slot = (slot + 1) & (clim->field_capacity - 1)) {
+        const struct CLIMATOLOGY_FIELD *present = &clim->fields[slot];
+
+        if (present->date == field.date && present->time == field.time && present->param == field.param)
+            return 0;
+    }
+
+    clim->fields[slot] = field;
+    clim->n_fields++;
+
+    return 1;
+}
+
+/**
+ * @brief Accept messages which are not part of the climatology yet, and record them as part of it.
+ * @details The decoding engine calls filters once per message and never concurrently, so the set needs no lock.
+ */
+static int climatology_filter(const struct GRIB_FIELD *field, void *user) {
+    struct CLIMATOLOGY *clim = (struct CLIMATOLOGY *) user;
+    struct CLIMATOLOGY_FIELD key = {.date = field->date, .time = field->time, .param = field->param};
+
+    if (climatology_add_field(clim, key))
+        return 1;
+
+    clim->n_skipped++;
+
+    return 0;
+}
+
+void climatology_accumulate(const char *const *fnames, size_t n_files, struct CLIMATOLOGY *clim,
+                            const struct DECODE_OPTIONS *options) {
+    struct DECODE_OPTIONS selected = *options;
+
+    if (options->n_threads > clim->n_partials) {
+        fprintf(stderr, "Error: Climatology was initialized for %d threads, but %d were requested\n",
+                clim->n_partials, options->n_threads);
+        exit(EXIT_FAILURE);
+    }
+
+    selected.filter = climatology_filter;
+    selected.filter_user = clim;
+    grib_data_from_files(fnames, n_files, &selected, climatology_consumer, clim, NULL);
+
+    for (int i = 0; i < clim->n_partials; i++) {
+        if (clim->partials[i].count != NULL)
+            climatology_flush(clim, &clim->partials[i]);
+    }
+}
+
+/**
+ * @brief Fixed-size header of a state file
+ */
+struct CLIMATOLOGY_STATE_HEADER {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    int64_t param;
+    char short_name[16];
+    int64_t ni;
+    int64_t nj;
+    double lon_first;
+    double lat_first;
+    double d_lon;
+    double d_lat;
+    uint64_t n_sources;
+    uint64_t n_days;
+    uint64_t n_legacy_sources;  ///< since version 3
+    uint64_t n_fields;          ///< since version 3
+};
+
+static const char state_magic[8] = {'C', 'A', 'M', 'S', 'C', 'L', 'I', 'M'};
+
+static const char *source_name(const char *fname, char *buffer, size_t size) {
+    strncpy(buffer, fname, size - 1);
+    buffer[size - 1] = '\0';
+    return basename(buffer);
+}
+
+static uint64_t source_size(const char *fname) {
+    struct stat sb;
+
+    if (stat(fname, &sb) != 0) {
+        fprintf(stderr, "Error: Could not stat file %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    return (uint64_t) sb.st_size;
+}
+
+/**
+ * @brief FNV-1a hash of the canonical path of a file, which tells files of the same name in different directories
+ * apart.
+ */
+static uint64_t source_path_hash(const char *fname) {
+    char *canonical = realpath(fname, NULL);
+
+    if (canonical == NULL) {
+        fprintf(stderr, "Error: Could not resolve path of file %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t hash = fnv1a(FNV1A_OFFSET_BASIS, canonical, strlen(canonical));
+
+    free(canonical);
+
+    // 0 marks sources of old state files, which only know name and size
+    return hash ? hash : 1;
+}
+
+int climatology_has_source(const struct CLIMATOLOGY *clim, const char *fname) {
+    char buffer[4096];
+    const char *name = source_name(fname, buffer, sizeof(buffer));
+    uint64_t size = source_size(fname), path_hash = source_path_hash(fname);
+
+    for (size_t i = 0; i < clim->n_legacy_sources; i++) {
+        const struct CLIMATOLOGY_SOURCE *source = &clim->sources[i];
+
+        if (source->size != size)
+            continue;
+        if (source->path_hash == path_hash || (source->path_hash == 0 && strcmp(source->name, name) == 0))
+            return 1;
+    }
+
+    return 0;
+}
+
+void climatology_add_source(struct CLIMATOLOGY *clim, const char *fname) {
+    char buffer[4096];
+    uint64_t size = source_size(fname), path_hash = source_path_hash(fname);
+
+    for (size_t i = 0; i < clim->n_sources; i++) {
+        if (clim->sources[i].size == size && clim->sources[i].path_hash == path_hash)
+            return;
+    }
+
+    struct CLIMATOLOGY_SOURCE *sources = realloc(clim->sources, (clim->n_sources + 1) * sizeof(struct CLIMATOLOGY_SOURCE));
+
+    if (sources == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for climatology sources\n");
+        exit(EXIT_FAILURE);
+    }
+
+    clim->sources = sources;
+    memset(&clim->sources[clim->n_sources], 0, sizeof(struct CLIMATOLOGY_SOURCE));
+    strncpy(clim->sources[clim->n_sources].name, source_name(fname, buffer, sizeof(buffer)),
+            sizeof(clim->sources[clim->n_sources].name) - 1);
+    clim->sources[clim->n_sources].size = size;
+    clim->sources[clim->n_sources].path_hash = path_hash;
+    clim->n_sources++;
+}
+
+static void read_exactly(void *dest, size_t size, size_t n, FILE *f, const char *fname) {
+    if (fread(dest, size, n, f) != n) {
+        fprintf(stderr, "Error: State file %s is truncated\n", fname);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Read `n` single precision values, as written by state files before version 4, into `dest`.
+ */
+static void read_widened(double *dest, size_t n, FILE *f, const char *fname) {
+    float *narrow = malloc(n * sizeof(float));
+
+    if (narrow == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for climatology\n");
+        exit(EXIT_FAILURE);
+    }
+
+    read_exactly(narrow, sizeof(float), n, f, fname);
+
+    for (size_t i = 0; i < n; i++)
+        dest[i] = (double) narrow[i];
+
+    free(narrow);
+}
+
+static void write_exactly(const void *src, size_t size, size_t n, FILE *f, const char *fname) {
+    if (fwrite(src, size, n, f) != n) {
+        fprintf(stderr, "Error: Could not write state file %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int climatology_load_state(struct CLIMATOLOGY *clim, const char *fname) {
+    struct CLIMATOLOGY_STATE_HEADER header;
+
+    FILE *f = fopen(fname, "rb");
+
+    if (f == NULL)
+        return 1;
+
+    // the header of versions 1 and 2 ends before the message count
+    read_exactly(&header, offsetof(struct CLIMATOLOGY_STATE_HEADER, n_legacy_sources), 1, f, fname);
+
+    if (memcmp(header.magic, state_magic, sizeof(state_magic)) != 0 || header.version < 1 || header.version > 4 ||
+        header.byte_order != 0x01020304) {
+        fprintf(stderr, "Error: %s is not a climatology state file written on this machine\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    if (header.version >= 3) {
+        read_exactly(&header.n_legacy_sources, sizeof(header) - offsetof(struct CLIMATOLOGY_STATE_HEADER,
+                                                                         n_legacy_sources), 1, f, fname);
+    } else {
+        header.n_legacy_sources = header.n_sources;
+        header.n_fields = 0;
+    }
+
+    if (header.n_legacy_sources > header.n_sources) {
+        fprintf(stderr, "Error: State file %s is corrupt\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    clim->initialized = 1;
+    clim->param = (long) header.param;
+    memcpy(clim->short_name, header.short_name, sizeof(clim->short_name));
+    clim->short_name[sizeof(clim->short_name) - 1] = '\0';
+    clim->grid = (struct GRID) {
+        .ni = (long) header.ni, .nj = (long) header.nj,
+        .lon_first = header.lon_first, .lat_first = header.lat_first,
+        .d_lon = header.d_lon, .d_lat = header.d_lat
+    };
+    clim->n_cells = (size_t) header.ni * (size_t) header.nj;
+
+    clim->n_sources = (size_t) header.n_sources;
+    if ((clim->sources = calloc(clim->n_sources + 1, sizeof(struct CLIMATOLOGY_SOURCE))) == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for climatology sources\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // version 1 recorded sources by name and size only, so they keep being matched by name
+    for (size_t i = 0; i < clim->n_sources; i++) {
+        if (header.version == 1) {
+            read_exactly(clim->sources[i].name, sizeof(clim->sources[i].name), 1, f, fname);
+            read_exactly(&clim->sources[i].size, sizeof(clim->sources[i].size), 1, f, fname);
+            clim->sources[i].name[sizeof(clim->sources[i].name) - 1] = '\0';
+        } else {
+            read_exactly(&clim->sources[i], sizeof(struct CLIMATOLOGY_SOURCE), 1, f, fname);
+        }
+    }
+
+    clim->n_legacy_sources = (size_t) header.n_legacy_sources;
+
+    for (uint64_t i = 0; i < header.n_fields; i++) {
+        struct CLIMATOLOGY_FIELD field;
+
+        read_exactly(&field, sizeof(field), 1, f, fname);
+
+        if (field.date == 0) {
+            fprintf(stderr, "Error: State file %s is corrupt\n", fname);
+            exit(EXIT_FAILURE);
+        }
+
+        climatology_add_field(clim, field);
+    }
+
+    for (uint64_t i = 0; i < header.n_days; i++) {
+        uint32_t d;
+
+        read_exactly(&d, sizeof(d), 1, f, fname);
+
+        if (d >= CLIMATOLOGY_DAYS || clim->count[d] != NULL) {
+            fprintf(stderr, "Error: State file %s is corrupt\n", fname);
+            exit(EXIT_FAILURE);
+        }
+
+        clim->count[d] = malloc(clim->n_cells * sizeof(uint32_t));
+        clim->mean[d] = malloc(clim->n_cells * sizeof(double));
+        clim->m2[d] = malloc(clim->n_cells * sizeof(double));
+
+        if (clim->count[d] == NULL || clim->mean[d] == NULL || clim->m2[d] == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for climatology\n");
+            exit(EXIT_FAILURE);
+        }
+
+        read_exactly(clim->count[d], sizeof(uint32_t), clim->n_cells, f, fname);
+
+        if (header.version >= 4) {
+            read_exactly(clim->mean[d], sizeof(double), clim->n_cells, f, fname);
+            read_exactly(clim->m2[d], sizeof(double), clim->n_cells, f, fname);
+        } else {
+            read_widened(clim->mean[d], clim->n_cells, f, fname);
+            read_widened(clim->m2[d], clim->n_cells, f, fname);
+        }
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+void climatology_save_state(const struct CLIMATOLOGY *clim, const char *fname) {
+    struct CLIMATOLOGY_STATE_HEADER header = {0};
+    char tmp[4096];
+
+    if (!clim->initialized)
+        return;
+
+    memcpy(header.magic, state_magic, sizeof(state_magic));
+    header.version = 4;
+    header.byte_order = 0x01020304;
+    header.param = clim->param;
+    memcpy(header.short_name, clim->short_name, sizeof(header.short_name));
+    header.ni = clim->grid.ni;
+    header.nj = clim->grid.nj;
+    header.lon_first = clim->grid.lon_first;
+    header.lat_first = clim->grid.lat_first;
+    header.d_lon = clim->grid.d_lon;
+    header.d_lat = clim->grid.d_lat;
+    header.n_sources = clim->n_sources;
+    header.n_legacy_sources = clim->n_legacy_sources;
+    header.n_fields = clim->n_fields;
+
+    for (int d = 0; d < CLIMATOLOGY_DAYS; d++)
+        header.n_days += clim->count[d] != NULL;
+
+    int status = snprintf(tmp, sizeof(tmp), "%s.tmp", fname);
+
+    if (status < 0 || (size_t) status >= sizeof(tmp)) {
+        fprintf(stderr, "Error: Failed to construct path of state file\n");
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *f = fopen(tmp, "wb");
+
+    if (f == NULL) {
+        fprintf(stderr, "Error: Could not open file %s.\n", tmp);
+        exit(EXIT_FAILURE);
+    }
+
+    write_exactly(&header, sizeof(header), 1, f, tmp);
+    write_exactly(clim->sources, sizeof(struct CLIMATOLOGY_SOURCE), clim->n_sources, f, tmp);
+
+    for (size_t i = 0; i < clim->field_capacity; i++) {
+        if (clim->fields[i].date != 0)
+            write_exactly(&clim->fields[i], sizeof(struct CLIMATOLOGY_FIELD), 1, f, tmp);
+    }
+
+    for (uint32_t d = 0; d < CLIMATOLOGY_DAYS; d++) {
+        if (clim->count[d] == NULL)
+            continue;
+
+        write_exactly(&d, sizeof(d), 1, f, tmp);
+        write_exactly(clim->count[d], sizeof(uint32_t), clim->n_cells, f, tmp);
+        write_exactly(clim->mean[d], sizeof(double), clim->n_cells, f, tmp);
+        write_exactly(clim->m2[d], sizeof(double), clim->n_cells, f, tmp);
+    }
+
+    if (fclose(f) != 0 || rename(tmp, fname) != 0) {
+        fprintf(stderr, "Error: Could not write state file %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void climatology_write_tables(const struct CLIMATOLOGY *clim, const char *out_dir, const struct POINTS *points) {
+    struct POINT_WEIGHTS weights;
+    float *mean, *sd, *count, *point_mean, *point_sd, *point_count;
+    char path[4096];
+    size_t n_tables = 0;
+
+    if (!clim->initialized) {
+        fprintf(stderr, "Warning: Climatology is empty, no tables are written\n");
+        return;
+    }
+
+    compute_point_weights(&clim->grid, points, &weights);
+
+    mean = malloc(clim->n_cells * sizeof(float));
+    sd = malloc(clim->n_cells * sizeof(float));
+    count = malloc(clim->n_cells * sizeof(float));
+    point_mean = malloc(points->n * sizeof(float));
+    point_sd = malloc(points->n * sizeof(float));
+    point_count = malloc(points->n * sizeof(float));
+
+    if (!mean || !sd || !count || !point_mean || !point_sd || !point_count) {
+        fprintf(stderr, "Error: Failed to allocate memory for climatology tables\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int d = 0; d < CLIMATOLOGY_DAYS; d++) {
+        if (clim->count[d] == NULL)
+            continue;
+
+        for (size_t c = 0; c < clim->n_cells; c++) {
+            uint32_t n = clim->count[d][c];
+            // statistics are accumulated in double precision and only narrowed for interpolation
+            mean[c] = n ? (float) clim->mean[d][c] : NAN;
+            sd[c] = n > 1 ? (float) sqrt(clim->m2[d][c] / (double) (n - 1)) : (n ? 0.0f : NAN);
+            count[c] = (float) n;
+        }
+
+        gather_points(mean, &weights, point_mean);
+        gather_points(sd, &weights, point_sd);
+        gather_points(count, &weights, point_count);
+
+        table_path(path, sizeof(path), out_dir, clim->short_name, day_of_year_to_date(d));
+
+        FILE *f = fopen(path, "wt");
+
+        if (f == NULL) {
+            fprintf(stderr, "Error: Could not open file %s.\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        for (size_t p = 0; p < points->n; p++) {
+            if (isnan(point_mean[p]))
+                fprintf(f, "%.4f %.4f %.6f %.6f %d\n", points->lon[p], points->lat[p], 9999.0, 9999.0, 0);
+            else
+                fprintf(f, "%.4f %.4f %.6f %.6f %.0f\n", points->lon[p], points->lat[p],
+                        (double) point_mean[p], (double) point_sd[p], (double) point_count[p]);
+        }
+
+        if (fclose(f) != 0) {
+            fprintf(stderr, "Error: Could not write table %s.\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        n_tables++;
+    }
+
+    printf("Wrote %zu climatology tables for %zu points\n", n_tables, points->n);
+
+    free(mean);
+    free(sd);
+    free(count);
+    free(point_mean);
+    free(point_sd);
+    free(point_count);
+    free_point_weights(&weights);
+}
+
+void climatology_free(struct CLIMATOLOGY *clim) {
+    for (int d = 0; d < CLIMATOLOGY_DAYS; d++) {
+        free(clim->count[d]);
+        free(clim->mean[d]);
+        free(clim->m2[d]);
+        pthread_mutex_destroy(&clim->day_lock[d]);
+    }
+
+    for (int i = 0; i < clim->n_partials; i++) {
+        free(clim->partials[i].count);
+        free(clim->partials[i].mean);
+        free(clim->partials[i].m2);
+    }
+
+    free(clim->partials);
+    free(clim->sources);
+    free(clim->fields);
+    pthread_mutex_destroy(&clim->lock);
+}
+
+void build_climatology(const char *const *fnames, size_t n_files, const char *out_dir, const struct POINTS *points,
+                       const struct DECODE_OPTIONS *options) {
+    struct CLIMATOLOGY clim;
+    char state[4096];
+    size_t n_new = 0;
+
+    int status = snprintf(state, sizeof(state), "%s/%s", out_dir, CLIMATOLOGY_STATE_FILE);
+
+    if (status < 0 || (size_t) status >= sizeof(state)) {
+        fprintf(stderr, "Error: Failed to construct path of state file\n");
+        exit(EXIT_FAILURE);
+    }
+
+    climatology_init(&clim, options->n_threads);
+
+    if (climatology_load_state(&clim, state) == 0)
+        printf("Resuming climatology from %s with %zu input files\n", state, clim.n_sources);
+
+    const char **fresh = malloc((n_files + 1) * sizeof(char *));
+
+    if (fresh == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for input files\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // messages already folded in are skipped while decoding; only files of legacy state files are skipped as a whole
+    for (size_t f = 0; f < n_files; f++) {
+        if (climatology_has_source(&clim, fnames[f])) {
+            printf("%s is already part of the climatology, skipping it\n", fnames[f]);
+            continue;
+        }
+
+        fresh[n_new++] = fnames[f];
+    }
+
+    size_t n_fields = clim.n_fields;
+
+    if (n_new)
+        climatology_accumulate(fresh, n_new, &clim, options);
+
+    if (clim.n_skipped)
+        printf("Skipped %zu messages which are already part of the climatology\n", clim.n_skipped);
+
+    if (clim.n_fields > n_fields) {
+        for (size_t f = 0; f < n_new; f++)
+            climatology_add_source(&clim, fresh[f]);
+        climatology_save_state(&clim, state);
+    }
+
+    free(fresh);
+
+    climatology_write_tables(&clim, out_dir, points);
+    climatology_free(&clim);
+}
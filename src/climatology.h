@@ -0,0 +1,180 @@
+#ifndef CAMS_CLIMATOLOGY_H
+#define CAMS_CLIMATOLOGY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "gributils.h"
+
+#define CLIMATOLOGY_DAYS 366
+#define CLIMATOLOGY_STATE_FILE "climatology.state"
+
+/**
+ * @brief Welford accumulator of a single day of year on the worker which is currently filling it
+ * @author Florian Katerndahl
+ */
+struct CLIMATOLOGY_PARTIAL {
+    int doy;                ///< day of year currently accumulated, -1 if empty
+    uint32_t *count;        ///< number of valid values per cell
+    double *mean;           ///< running mean per cell
+    double *m2;             ///< running sum of squared deviations from the mean per cell
+};
+
+/**
+ * @brief Input file already folded into a climatology, identified by its canonical path and size
+ * @details Sources are a record of the files a climatology was built from. Only those of state files which predate
+ * `CLIMATOLOGY_FIELD` decide which data is folded in, see `climatology_has_source`.
+ * @author Florian Katerndahl
+ */
+struct CLIMATOLOGY_SOURCE {
+    char name[256];         ///< file name without directory, for display
+    uint64_t size;          ///< file size in bytes
+    uint64_t path_hash;     ///< FNV-1a hash of the canonical path; 0 for sources recorded by version 1 state files
+};
+
+/**
+ * @brief Message folded into a climatology, identified by its content rather than the file holding it
+ * @author Florian Katerndahl
+ */
+struct CLIMATOLOGY_FIELD {
+    int64_t date;           ///< validity date as YYYYMMDD, 0 for an empty slot
+    int64_t time;           ///< validity time as HHMM
+    int64_t param;          ///< ecCodes paramId
+};
+
+/**
+ * @brief Per-cell and per-day-of-year statistics of a single parameter
+ * @details Memory is bounded by the grid size times 366 days plus one partial accumulator per worker, independent of
+ * the number of years processed. Days of year are counted in a leap year, i.e. the 29th of February has its own slot
+ * and the 1st of March always maps to the same slot. Blocks of days never seen are not allocated.
+ * @author Florian Katerndahl
+ */
+struct CLIMATOLOGY {
+    int initialized;                            ///< set once the grid is known
+    struct GRID grid;                           ///< grid of all accumulated fields
+    size_t n_cells;                             ///< number of cells of `grid`
+    long param;                                 ///< ecCodes paramId of all accumulated fields
+    char short_name[16];                        ///< ecCodes shortName of all accumulated fields
+    uint32_t *count[CLIMATOLOGY_DAYS];          ///< number of values per day of year and cell
+    double *mean[CLIMATOLOGY_DAYS];             ///< mean per day of year and cell
+    double *m2[CLIMATOLOGY_DAYS];               ///< sum of squared deviations per day of year and cell
+    pthread_mutex_t day_lock[CLIMATOLOGY_DAYS]; ///< guards merging into a single day of year
+    pthread_mutex_t lock;                       ///< guards initialization
+    int n_partials;                             ///< number of per-worker accumulators
+    struct CLIMATOLOGY_PARTIAL *partials;       ///< per-worker accumulators
+    size_t n_sources;                           ///< number of input files folded into the climatology
+    size_t n_legacy_sources;                    ///< leading sources loaded from a state file without messages
+    struct CLIMATOLOGY_SOURCE *sources;         ///< input files folded into the climatology
+    size_t n_fields;                            ///< number of messages folded into the climatology
+    size_t field_capacity;                      ///< number of slots of `fields`, zero or a power of two
+    struct CLIMATOLOGY_FIELD *fields;           ///< open-addressing hash set of the messages folded in
+    size_t n_skipped;                           ///< messages skipped by `climatology_accumulate` as folded in before
+};
+
+/**
+ * @brief Map a date to its day of year in a leap year
+ * @param date Date as YYYYMMDD
+ * @return Zero-based day of year between 0 and 365
+ * @author Florian Katerndahl
+ */
+int day_of_year(long date);
+
+/**
+ * @brief Initialize an empty climatology
+ * @param clim Climatology to initialize
+ * @param n_threads Number of workers accumulating into `clim`
+ * @author Florian Katerndahl
+ */
+void climatology_init(struct CLIMATOLOGY *clim, int n_threads);
+
+/**
+ * @brief Fold all messages of a set of GRIB files into the climatology in a single pass
+ * @details Each worker accumulates the messages it decodes into its own partial accumulator with Welford's method. A
+ * partial is merged into the shared statistics once the worker encounters a different day of year, and at the end of
+ * the run. Messages whose validity date, time and parameter were folded in before, by this or an earlier run, are
+ * skipped without decoding and counted in `clim->n_skipped`, so data which is renamed, moved, re-downloaded or passed
+ * twice is counted once.
+ * @param fnames Paths to GRIB files
+ * @param n_files Number of files
+ * @param clim Climatology to update
+ * @param options Options of the decoding engine; `n_threads` must not exceed the number passed to
+ * `climatology_init`. Its filter is replaced by the one skipping messages folded in before.
+ * @author Florian Katerndahl
+ */
+void climatology_accumulate(const char *const *fnames, size_t n_files, struct CLIMATOLOGY *clim,
+                            const struct DECODE_OPTIONS *options);
+
+/**
+ * @brief Check if an input file was folded into the climatology by a run whose state file did not record messages
+ * @details Such files are only known by name or canonical path and size, and are skipped as a whole. Everything folded
+ * in since is identified by its messages, see `climatology_accumulate`.
+ * @param clim Climatology
+ * @param fname Path to input file
+ * @return 1 if the same file was folded in by a legacy run, 0 otherwise
+ * @author Florian Katerndahl
+ */
+int climatology_has_source(const struct CLIMATOLOGY *clim, const char *fname);
+
+/**
+ * @brief Record an input file as folded into the climatology
+ * @details A file with the same canonical path and size as one recorded before is not recorded again.
+ * @param clim Climatology
+ * @param fname Path to input file
+ * @author Florian Katerndahl
+ */
+void climatology_add_source(struct CLIMATOLOGY *clim, const char *fname);
+
+/**
+ * @brief Load accumulator state written by `climatology_save_state` into an initialized, empty climatology
+ * @param clim Climatology
+ * @param fname Path to state file
+ * @return 0 if the state was loaded, 1 if `fname` does not exist
+ * @author Florian Katerndahl
+ */
+int climatology_load_state(struct CLIMATOLOGY *clim, const char *fname);
+
+/**
+ * @brief Persist the accumulator state of a climatology in a compact binary file
+ * @details The file starts with a header holding grid, parameter, the list of folded input files and the set of folded
+ * messages, followed by count, mean and sum of squared deviations of every day of year which holds data. Values are stored in the byte order
+ * of the machine; a state written on a machine of different byte order is rejected. The file is replaced atomically.
+ * @param clim Climatology
+ * @param fname Path to state file
+ * @author Florian Katerndahl
+ */
+void climatology_save_state(const struct CLIMATOLOGY *clim, const char *fname);
+
+/**
+ * @brief Write one table per day of year holding mean, standard deviation and number of observations at each point
+ * @details Tables are named `<SHORTNAME>_0000-MM-DD.txt`. Points without observations are set to 9999.
+ * @param clim Climatology
+ * @param out_dir Directory to write tables to
+ * @param points Locations at which statistics are extracted
+ * @author Florian Katerndahl
+ */
+void climatology_write_tables(const struct CLIMATOLOGY *clim, const char *out_dir, const struct POINTS *points);
+
+/**
+ * @brief Free all memory held by `clim`
+ * @param clim Climatology
+ * @author Florian Katerndahl
+ */
+void climatology_free(struct CLIMATOLOGY *clim);
+
+/**
+ * @brief Build a climatology from a set of GRIB files and write its tables
+ * @details If `out_dir` holds a state file from an earlier run, the climatology is resumed from it and only messages
+ * which are not part of the climatology yet are folded in, all of them in a single pass. The updated state is written
+ * back to `out_dir`.
+ * @param fnames Paths to GRIB files
+ * @param n_files Number of files
+ * @param out_dir Directory to write tables to
+ * @param points Locations at which statistics are extracted
+ * @param options Options of the decoding engine
+ * @author Florian Katerndahl
+ */
+void build_climatology(const char *const *fnames, size_t n_files, const char *out_dir, const struct POINTS *points,
+                       const struct DECODE_OPTIONS *options);
+
+#endif //CAMS_CLIMATOLOGY_H
@@ -17,37 +17,12 @@
 #include <jansson.h>
 #include "download.h"
 #include "sort.h"
-
-void print_usage(void) {
-    printf(
-        "Usage: cams-download [-h|--help] [-v|--version] [-i|--purpose] "
-        "[-o|--output_directory] <-c|--coordinates> <--start> <--end> <-t|--daily_tables> <-s|--climatology> <-a|--authentication>\n\n"
-        "[-h|--help]\t\tprint this help page and exit\n"
-        "[-v|--version]\t\tprint version\n"
-        "[-i|--purpose]\t\tshow program's purpose\n"
-        "[-o|--output_directory]\t...\n\n"
-        "Optional arguments:\n"
-        "<-c|--coordinates>\tPath to file with WRS2 center coordinates, if subset of area is to be queried. Otherwise the entire model area is requested.\n"
-        "<--start>\t\tStart date. Default: 2003-01-01.\n"
-        "<--end>\t\t\tStart date. Default: 2003-01-01.\n"
-        "<--product>\t\tProduct type to query. Currently, only REPROCESSED and FORECAST are implemented. Default is REPROCESSED\n"
-        "<--time>\t\tModel times. Comma-separated list; valid range from 0 to 21 in steps of 3. Default: 0\n"
-        "<--lead-time-hour>\tLeadtime. Comma-separated list; valid range from 0 to 120. Default: 0\n"
-        "<-t|--daily_tables>\tbuild daily tables? Default: false\n"
-        "<-s|--climatology>\tbuild climatology? Default: false\n"
-        "<-a|--authentication>\toptional...\n");
-}
-
-void print_version(void) {
-    printf("FORCE version: %s\n", FORCE_VERSION);
-}
-
-void print_purpose(void) {
-    printf("Download ECMWF CAMS data from the Atmosphere Data Store\n");
-}
+#include "arena.h"
+#include "statusparser.h"
 
 
-void parse_authentication(FILE *api_authentication_file, struct API_AUTHENTICATION *api_authentication) {
+void parse_authentication(FILE *api_authentication_file, struct API_AUTHENTICATION *api_authentication,
+                          struct ARENA *arena) {
     char line[NPOW8];
     char *separator;
     char *needle_p;
@@ -61,9 +36,7 @@ void parse_authentication(FILE *api_authentication_file, struct API_AUTHENTICATI
 
             needle_p++;
 
-            api_authentication->base_url = calloc(NPOW16, sizeof(char));
-
-            strncpy(api_authentication->base_url, needle_p, NPOW16); // automatically zero terminated because of calloc
+            api_authentication->base_url = arena_strdup(arena, needle_p);
         } else if ((needle_p = strstr(line, "key")) != NULL) {
             line[strlen(line) - 1] = '\0';
 
@@ -71,20 +44,15 @@ void parse_authentication(FILE *api_authentication_file, struct API_AUTHENTICATI
 
             needle_p++;
 
-            api_authentication->user = calloc(NPOW8, sizeof(char));
-
-            api_authentication->secret = calloc(NPOW12, sizeof(char));
-
             separator = index(needle_p, ':');
 
-            assert(separator - needle_p < (NPOW8 - 1));
+            assert(separator != NULL);
 
-            strncpy(api_authentication->user, needle_p,
-                    separator - needle_p); // automatically zero terminated because of calloc
+            api_authentication->user = arena_strndup(arena, needle_p, separator - needle_p);
 
             separator++;
 
-            strncpy(api_authentication->secret, separator, NPOW12); // automatically zero terminated because of calloc
+            api_authentication->secret = arena_strdup(arena, separator);
         } else if ((needle_p = strstr(line, "verify")) != NULL) {
             while (*needle_p != ' ') needle_p++;
 
@@ -98,7 +66,7 @@ void parse_authentication(FILE *api_authentication_file, struct API_AUTHENTICATI
     }
 }
 
-struct BOUNDING_BOX parse_coordinate_file(char *coordinate_file, double **lon, double **lat) {
+struct BOUNDING_BOX parse_coordinate_file(const char *coordinate_file, double **lon, double **lat) {
     // TODO I'd like to try implementing some sorting algorithm, which ISN'T the Bubblesort!
     // TODO currently, this returns the bbox of center coordinates; However, I want the bbox of the WRS-2 tiles whose
     //  center coordinates were given.
@@ -166,7 +134,8 @@ PRODUCT_TYPE product_string_to_type(const char *str) {
     exit(EXIT_FAILURE);
 }
 
-int init_api_authentication(struct API_AUTHENTICATION *api_authentication, const struct OPTIONS *options) {
+int init_api_authentication(struct API_AUTHENTICATION *api_authentication, const struct OPTIONS *options,
+                            struct ARENA *arena) {
     FILE *fp;
     char *ads_env;
 
@@ -184,19 +153,13 @@ int init_api_authentication(struct API_AUTHENTICATION *api_authentication, const
     if (fp == NULL)
         return 1;
 
-    parse_authentication(fp, api_authentication);
+    parse_authentication(fp, api_authentication, arena);
 
     fclose(fp);
 
     return 0;
 }
 
-void free_api_authentication(const struct API_AUTHENTICATION *api_authentication) {
-    free(api_authentication->base_url);
-    free(api_authentication->user);
-    free(api_authentication->secret);
-}
-
 const char *reverse_code_optopt(const char *dest, int optopt) {
     switch (optopt) {
         case 'h':
@@ -217,12 +180,39 @@ const char *reverse_code_optopt(const char *dest, int optopt) {
         case 'o':
             dest = "output_directory";
             break;
+        case 'f':
+            dest = "format";
+            break;
         case '0':
             dest = "start";
             break;
         case '1':
             dest = "end";
             break;
+        case 'k':
+            dest = "cache";
+            break;
+        case '5':
+            dest = "status-ttl";
+            break;
+        case 'b':
+            dest = "broker";
+            break;
+        case 'S':
+            dest = "socket";
+            break;
+        case 'j':
+            dest = "jobs";
+            break;
+        case 'P':
+            dest = "priority";
+            break;
+        case 'r':
+            dest = "rate";
+            break;
+        case 'R':
+            dest = "reserve";
+            break;
         default:
             exit(129);
     }
@@ -286,44 +276,179 @@ void init_curl_handle(CURL **handle, const struct CLIENT *client) {
     curl_easy_setopt(*handle, CURLOPT_FAILONERROR, 1L);
 
     curl_easy_setopt(*handle, CURLOPT_TIMEOUT, (long) client->timeout);
+
+    // timeouts must not be implemented with signals, handles may be used by several threads of a process
+    curl_easy_setopt(*handle, CURLOPT_NOSIGNAL, 1L);
 }
 
-ADS_STATUS check_ads_status(CURL **handle, const struct CLIENT *client) {
-    ADS_STATUS return_val;
-    char url[NPOW6];
-    int url_status;
+/**
+ * @brief Copy the value of the header `name` into `dest` if `line` holds that header.
+ * @details Values which do not fit into `dest` are ignored, so that no truncated validator is ever sent.
+ */
+static void copy_header_value(const char *line, size_t length, const char *name, char *dest, size_t size) {
+    size_t name_length = strlen(name);
 
-    struct ADS_STATUS_RESPONSE ads_status_response = {0};
+    if (length <= name_length || strncasecmp(line, name, name_length) != 0)
+        return;
 
-    json_t *root;
-    json_error_t error;
-    json_t *warning;
+    line += name_length;
+    length -= name_length;
 
-    if ((url_status = snprintf(url, NPOW6, "%s/%s", client->auth.base_url, "status.json")) >= NPOW6 ||
-        url_status < 0) {
-        fprintf(stderr, "Error: Failed to create url for ADS status check.\n");
-        exit(EXIT_FAILURE);
+    while (length > 0 && (*line == ' ' || *line == '\t')) {
+        line++;
+        length--;
     }
 
-    init_curl_handle(handle, client);
+    while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == '\n' || line[length - 1] == ' '))
+        length--;
 
-    curl_easy_setopt(*handle, CURLOPT_URL, url);
+    if (length == 0 || length >= size)
+        return;
 
-    curl_easy_setopt(*handle, CURLOPT_WRITEFUNCTION, write_curl_string);
+    memcpy(dest, line, length);
+    dest[length] = '\0';
+}
 
-    curl_easy_setopt(*handle, CURLOPT_WRITEDATA, (void *) &ads_status_response);
+/**
+ * @brief Function passed to CURLOPT_HEADERFUNCTION to collect the validators of a response.
+ */
+static size_t write_curl_header(char *buffer, size_t size, size_t n, void *data_container_p) {
+    struct HTTP_VALIDATORS *validators = (struct HTTP_VALIDATORS *) data_container_p;
+    size_t length = size * n;
+
+    // every status line starts the headers of a new response, e.g. after a redirect
+    if (length >= 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        validators->etag[0] = '\0';
+        validators->last_modified[0] = '\0';
+        return length;
+    }
 
-    CURLcode res = curl_easy_perform(*handle);
-    interpret_curl_result(res, 0);
+    copy_header_value(buffer, length, "ETag:", validators->etag, sizeof(validators->etag));
+    copy_header_value(buffer, length, "Last-Modified:", validators->last_modified, sizeof(validators->last_modified));
+
+    return length;
+}
+
+/**
+ * @brief Build the headers making a request conditional on the validators of an earlier response.
+ * @return Header list to pass to CURLOPT_HTTPHEADER, NULL if there are no validators
+ */
+static struct curl_slist *conditional_headers(const struct HTTP_VALIDATORS *validators) {
+    char header[NPOW8 + NPOW4];
+    struct curl_slist *list = NULL;
+
+    if (validators->etag[0]) {
+        snprintf(header, sizeof(header), "If-None-Match: %s", validators->etag);
+        list = curl_slist_append(list, header);
+    }
+
+    if (validators->last_modified[0]) {
+        snprintf(header, sizeof(header), "If-Modified-Since: %s", validators->last_modified);
+        list = curl_slist_append(list, header);
+    }
+
+    return list;
+}
+
+/**
+ * @brief Keep the validators of `received` which are set, leaving the others as they were.
+ */
+static void update_validators(struct HTTP_VALIDATORS *validators, const struct HTTP_VALIDATORS *received) {
+    if (received->etag[0])
+        memcpy(validators->etag, received->etag, sizeof(validators->etag));
+    if (received->last_modified[0])
+        memcpy(validators->last_modified, received->last_modified, sizeof(validators->last_modified));
+}
+
+/**
+ * @brief Result of the last ADS status check, as stored in the cache directory
+ */
+struct STATUS_CACHE {
+    char url[NPOW8];
+    time_t fetched;         ///< time at which the result was last confirmed by the server
+    ADS_STATUS status;
+    struct HTTP_VALIDATORS validators;
+};
+
+/**
+ * @brief Read a cached ADS status.
+ * @return Zero if the cache exists and belongs to `url`, non-zero otherwise
+ */
+static int read_status_cache(const char *path, const char *url, struct STATUS_CACHE *cache) {
+    char line[NPOW10];
+    long long fetched = -1;
+    int status = -1;
+    FILE *f = fopen(path, "rt");
+
+    if (f == NULL)
+        return 1;
 
-    // TODO some memory corruption happening? Writing further than needed/allowed?
-    //ads_status_response.curl_string.data[ads_status_response.curl_string.length - 1] = '\0';
+    while (fgets(line, NPOW10, f) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+
+        if (strncmp(line, "url ", 4) == 0)
+            snprintf(cache->url, sizeof(cache->url), "%s", line + 4);
+        else if (strncmp(line, "fetched ", 8) == 0)
+            fetched = strtoll(line + 8, NULL, 10);
+        else if (strncmp(line, "status ", 7) == 0)
+            status = (int) strtol(line + 7, NULL, 10);
+        else if (strncmp(line, "etag ", 5) == 0)
+            snprintf(cache->validators.etag, sizeof(cache->validators.etag), "%s", line + 5);
+        else if (strncmp(line, "last_modified ", 14) == 0)
+            snprintf(cache->validators.last_modified, sizeof(cache->validators.last_modified), "%s", line + 14);
+    }
+
+    fclose(f);
+
+    if (strcmp(cache->url, url) != 0 || fetched < 0 || (status != ADS_STATUS_OK && status != ADS_STATUS_WARNING))
+        return 1;
+
+    cache->fetched = (time_t) fetched;
+    cache->status = (ADS_STATUS) status;
 
-    root = json_loads(ads_status_response.curl_string.data, 0, &error);
+    return 0;
+}
+
+/**
+ * @brief Write the ADS status to the cache; the file is replaced atomically, so concurrent runs never read a partial
+ * cache. Failures are reported, but not fatal.
+ */
+static void write_status_cache(const char *path, const struct STATUS_CACHE *cache) {
+    char tmp[NPOW12 + NPOW4];
+    FILE *f;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long) getpid()) >= (int) sizeof(tmp) ||
+        (f = fopen(tmp, "wt")) == NULL) {
+        fprintf(stderr, "Warning: Failed to write ADS status cache %s\n", path);
+        return;
+    }
+
+    fprintf(f, "url %s\nfetched %lld\nstatus %d\n", cache->url, (long long) cache->fetched, (int) cache->status);
+    if (cache->validators.etag[0])
+        fprintf(f, "etag %s\n", cache->validators.etag);
+    if (cache->validators.last_modified[0])
+        fprintf(f, "last_modified %s\n", cache->validators.last_modified);
+
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        fprintf(stderr, "Warning: Failed to write ADS status cache %s\n", path);
+        unlink(tmp);
+    }
+}
+
+/**
+ * @brief Interpret the body of `status.json`.
+ */
+static ADS_STATUS parse_ads_status(const char *body) {
+    ADS_STATUS return_val = ADS_STATUS_OK;
+    json_t *root;
+    json_error_t error;
+    json_t *warning;
+
+    root = json_loads(body, 0, &error);
 
     if (!root) {
         fprintf(stderr, "Error: Failed to parse JSON response on line %d: %s.\n", error.line, error.text);
-        exit(EXIT_FAILURE);
+        return ADS_STATUS_ERROR;
     }
 
     if (json_is_object(root)) {
@@ -332,7 +457,7 @@ ADS_STATUS check_ads_status(CURL **handle, const struct CLIENT *client) {
         if (!json_is_array(warning)) {
             fprintf(stderr, "Error: Expected a JSON array. Got passed other data structure.\n");
             json_decref(root);
-            exit(EXIT_FAILURE);
+            return ADS_STATUS_ERROR;
         }
 
         if (warning != NULL && json_array_size(warning) != 0)
@@ -341,11 +466,85 @@ ADS_STATUS check_ads_status(CURL **handle, const struct CLIENT *client) {
 
     json_decref(root);
 
-    free(ads_status_response.curl_string.data);
+    return return_val;
+}
+
+ADS_STATUS check_ads_status(CURL **handle, const struct CLIENT *client) {
+    ADS_STATUS return_val;
+    char url[NPOW6];
+    char cache_path[NPOW12];
+    int url_status;
+    int cached = 0;
+    long http_code = 0;
+
+    struct ADS_STATUS_RESPONSE ads_status_response = {0};
+    struct STATUS_CACHE cache = {0};
+    struct HTTP_VALIDATORS received = {0};
+    struct curl_slist *headers = NULL;
+
+    if ((url_status = snprintf(url, NPOW6, "%s/%s", client->auth.base_url, "status.json")) >= NPOW6 ||
+        url_status < 0) {
+        fprintf(stderr, "Error: Failed to create url for ADS status check.\n");
+        return ADS_STATUS_ERROR;
+    }
+
+    if (client->cache_dir) {
+        if (snprintf(cache_path, NPOW12, "%s/ads-status.txt", client->cache_dir) >= NPOW12) {
+            fprintf(stderr, "Error: Path of ADS status cache is too long.\n");
+            return ADS_STATUS_ERROR;
+        }
+
+        cached = read_status_cache(cache_path, url, &cache) == 0;
+
+        // within its TTL, the cached result is used without asking the server
+        if (cached && difftime(time(NULL), cache.fetched) < (double) client->status_ttl)
+            return cache.status;
+
+        if (cached && (headers = conditional_headers(&cache.validators)) == NULL)
+            cached = 0;
+    }
+
+    init_curl_handle(handle, client);
+
+    curl_easy_setopt(*handle, CURLOPT_URL, url);
+
+    curl_easy_setopt(*handle, CURLOPT_WRITEFUNCTION, write_curl_string);
+
+    curl_easy_setopt(*handle, CURLOPT_WRITEDATA, (void *) &ads_status_response);
+
+    curl_easy_setopt(*handle, CURLOPT_HEADERFUNCTION, write_curl_header);
+
+    curl_easy_setopt(*handle, CURLOPT_HEADERDATA, (void *) &received);
+
+    if (headers)
+        curl_easy_setopt(*handle, CURLOPT_HTTPHEADER, headers);
+
+    CURLcode res = curl_easy_perform(*handle);
+    interpret_curl_result(res, 0);
+
+    curl_easy_getinfo(*handle, CURLINFO_RESPONSE_CODE, &http_code);
 
     curl_easy_reset(*handle);
+    curl_slist_free_all(headers);
 
-    return return_val ? return_val : ADS_STATUS_OK;
+    // 304 Not Modified: the cached result is still valid
+    if (cached && http_code == 304)
+        return_val = cache.status;
+    else
+        return_val = parse_ads_status(ads_status_response.curl_string.data);
+
+    free(ads_status_response.curl_string.data);
+
+    // an unreadable response says nothing about the ADS and is asked again next time
+    if (client->cache_dir && return_val != ADS_STATUS_ERROR) {
+        snprintf(cache.url, sizeof(cache.url), "%s", url);
+        cache.fetched = time(NULL);
+        cache.status = return_val;
+        update_validators(&cache.validators, &received);
+        write_status_cache(cache_path, &cache);
+    }
+
+    return return_val;
 }
 
 size_t write_curl_string(char *message, size_t size, size_t nmemb, void *data_container_p) {
@@ -452,7 +651,7 @@ int all_unique(int *arr, size_t s) {
     return 1;
 }
 
-const char *assemble_request(const struct PRODUCT_REQUEST *request) {
+const char *assemble_request(const struct PRODUCT_REQUEST *request, struct ARENA *arena) {
     json_t *json_request;
 
     if ((json_request = json_object()) == NULL) {
@@ -572,27 +771,25 @@ const char *assemble_request(const struct PRODUCT_REQUEST *request) {
         }
     }
 
-    char *req = json_dumps(json_request, JSON_COMPACT | JSON_ENSURE_ASCII | JSON_SORT_KEYS);
+    const size_t flags = JSON_COMPACT | JSON_ENSURE_ASCII | JSON_SORT_KEYS;
+    size_t req_length = json_dumpb(json_request, NULL, 0, flags);
 
-    if (req == NULL) {
-        fprintf(stderr, "Error: Failed to allocate memory for request string.\n");
+    if (req_length == 0) {
+        fprintf(stderr, "Error: Failed to serialize request.\n");
         exit(EXIT_FAILURE);
     }
 
+    char *req = arena_alloc(arena, req_length + 1);
+    json_dumpb(json_request, req, req_length, flags);
+    req[req_length] = '\0';
+
     json_decref(json_request);
 
     return req;
 }
 
-const char *assemble_download_path(const struct PRODUCT_REQUEST *request, const struct OPTIONS *options) {
-    char *req = calloc(NPOW22, sizeof(char));
-    int req_status;
-
-    if (req == NULL) {
-        fprintf(stderr, "Error: Failed to allocate memory for download path string.\n");
-        exit(EXIT_FAILURE);
-    }
-
+const char *assemble_download_path(const struct PRODUCT_REQUEST *request, const struct OPTIONS *options,
+                                   struct ARENA *arena) {
     char start_d[NPOW4], end_d[NPOW4];
 
     if (strftime(start_d, NPOW4, "%Y%m%d", &request->dates.start) == 0) {
@@ -605,45 +802,50 @@ const char *assemble_download_path(const struct PRODUCT_REQUEST *request, const
         exit(EXIT_FAILURE);
     }
 
-    if ((req_status = snprintf(req, NPOW22, "%s%s_%s%s.%s",
-                 options->output_directory, request->variable,
-                 start_d, end_d, request->format)) >= NPOW22 || req_status < 0) {
-        fprintf(stderr, "ERROR: Failed to construct output file name\n");
-        exit(EXIT_FAILURE);
+    // netCDF files get their usual extension, so that other tools recognize them
+    const char *extension = strcmp(request->format, "netcdf") == 0 ? "nc" : request->format;
+
+    return arena_sprintf(arena, "%s%s_%s%s.%s", options->output_directory, request->variable, start_d, end_d,
+                         extension);
+}
+
+const char *product_dataset(PRODUCT_TYPE product) {
+    switch (product) {
+        case PRODUCT_CAMS_REPROCESSED:
+            return "cams-global-reanalysis-eac4";
+        case PRODUCT_CAMS_COMPOSITION_FORECAST:
+            return "cams-global-atmospheric-composition-forecasts";
+        default:
+            return NULL;
     }
+}
 
-    return req;
+struct PRODUCT_RESPONSE
+ads_request_product(const struct PRODUCT_REQUEST *request, CURL **handle, const struct CLIENT *client,
+                    struct ARENA *arena) {
+    return ads_submit_request(product_dataset(request->product), assemble_request(request, arena), handle, client,
+                              arena);
 }
 
 struct PRODUCT_RESPONSE
-ads_request_product(const struct PRODUCT_REQUEST *request, CURL **handle, const struct CLIENT *client) {
-    char *product_name;
+ads_submit_request(const char *dataset, const char *body, CURL **handle, const struct CLIENT *client,
+                   struct ARENA *arena) {
     char url[NPOW12];
     int url_status;
 
     struct ADS_STATUS_RESPONSE ads_retrieve_response = {0};
     struct PRODUCT_RESPONSE request_response = {0};
     request_response.state = PRODUCT_STATUS_INVALID;
+    request_response.arena = arena;
 
     json_t *root, *state, *request_id, *location, *content_length;
     json_error_t error;
     json_t *warning;
 
-    switch (request->product) {
-        case PRODUCT_CAMS_REPROCESSED:
-            product_name = "cams-global-reanalysis-eac4";
-            break;
-        case PRODUCT_CAMS_COMPOSITION_FORECAST:
-            product_name = "cams-global-atmospheric-composition-forecasts";
-            break;
-        default:
-            break;
-    }
-
-    if ((url_status = snprintf(url, NPOW12, "%s/resources/%s", client->auth.base_url, product_name)) >= NPOW12 ||
+    if ((url_status = snprintf(url, NPOW12, "%s/resources/%s", client->auth.base_url, dataset)) >= NPOW12 ||
         url_status < 0) {
         fprintf(stderr, "Error: Failed to assemble request url\n");
-        exit(EXIT_FAILURE);
+        return request_response;
     }
 
     init_curl_handle(handle, client);
@@ -659,8 +861,7 @@ ads_request_product(const struct PRODUCT_REQUEST *request, CURL **handle, const
     list = curl_slist_append(list, "Content-Type: application/json");
     curl_easy_setopt(*handle, CURLOPT_HTTPHEADER, list);
 
-    const char *d = assemble_request(request);
-    curl_easy_setopt(*handle, CURLOPT_POSTFIELDS, d);
+    curl_easy_setopt(*handle, CURLOPT_POSTFIELDS, body);
 
     CURLcode res = curl_easy_perform(*handle);
     interpret_curl_result(res, 0);
@@ -679,9 +880,10 @@ ads_request_product(const struct PRODUCT_REQUEST *request, CURL **handle, const
      *   }
      * }
      */
-    if (!(root = json_loads(ads_retrieve_response.curl_string.data, 0, &error))) {
+    if (!(root = json_loads(ads_retrieve_response.curl_string.data ? ads_retrieve_response.curl_string.data : "", 0,
+                            &error))) {
         fprintf(stderr, "Error: Failed to parse JSON response on line %d: %s.\n", error.line, error.text);
-        exit(EXIT_FAILURE);
+        goto cleanup;
     }
 
     if (!json_is_object(root)) {
@@ -699,12 +901,9 @@ ads_request_product(const struct PRODUCT_REQUEST *request, CURL **handle, const
     request_id = json_object_get(root, "request_id");
     if (!json_is_string(request_id)) {
         fprintf(stderr, "Error: Could not get request_id from JSON message.\n");
-        goto cleanup;
+        goto invalid;
     }
-    // TODO check result of malloc and strcpy!!!
-    // TODO is +1 needed? IDK
-    request_response.id = calloc(json_string_length(request_id) + 1, sizeof(char));
-    strcpy(request_response.id, json_string_value(request_id));
+    request_response.id = arena_strndup(arena, json_string_value(request_id), json_string_length(request_id));
 
     if (request_response.state != PRODUCT_STATUS_COMPLETED)
         goto cleanup;
@@ -712,13 +911,13 @@ ads_request_product(const struct PRODUCT_REQUEST *request, CURL **handle, const
     location = json_object_get(root, "location");
     if (!json_is_string(location)) {
         fprintf(stderr, "Error: Could not get file location from JSON message.\n");
-        goto cleanup;
+        goto invalid;
     }
 
     content_length = json_object_get(root, "content_length");
     if (!json_is_integer(content_length)) {
         fprintf(stderr, "Error: Could not get content length from JSON message.\n");
-        goto cleanup;
+        goto invalid;
     }
 /*
     content_type = json_object_get(root, "content_type");
@@ -728,16 +927,17 @@ ads_request_product(const struct PRODUCT_REQUEST *request, CURL **handle, const
     }
 */
 
-    // TODO check result of malloc and strcpy!!!
-    // TODO is +1 needed? IDK
-    request_response.location = calloc(json_string_length(location) + 1, sizeof(char));
-    strcpy(request_response.location, json_string_value(location));
+    request_response.location = arena_strndup(arena, json_string_value(location), json_string_length(location));
     request_response.length = json_integer_value(content_length);
+    goto cleanup;
+
+    // the state alone must not announce a product which can't be fetched
+    invalid:
+    request_response.state = PRODUCT_STATUS_INVALID;
 
     cleanup:
     json_decref(root);
     free(ads_retrieve_response.curl_string.data);
-    free((char *) d);
     curl_easy_reset(*handle);
     curl_slist_free_all(list);
 
@@ -757,76 +957,157 @@ PRODUCT_STATUS convert_to_product_status(const char *status) {
     return PRODUCT_STATUS_INVALID;
 }
 
-int ads_download_product(struct PRODUCT_RESPONSE *response, CURL **handle, struct CLIENT *client, const char *fp) {
+/**
+ * @brief Download buffer which is sized once with the content length announced by the ADS.
+ */
+struct CURL_PRODUCT_BUFFER {
+    struct CURL_DATA data;
+    size_t capacity;
+};
+
+/**
+ * @brief Write callback for product downloads into a buffer which was sized beforehand. Only falls back to growing
+ * the buffer if the server sends more bytes than announced.
+ */
+static size_t write_curl_product(char *message, size_t size, size_t n, void *data_container_p) {
+    size_t message_length = size * n;
+
+    struct CURL_PRODUCT_BUFFER *buffer = (struct CURL_PRODUCT_BUFFER *) data_container_p;
+
+    if (buffer->data.length + message_length > buffer->capacity) {
+        size_t capacity = (buffer->data.length + message_length) * 2;
+        char *new_data_p = realloc(buffer->data.data, capacity);
+
+        if (new_data_p == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for CURL write-back.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        buffer->data.data = new_data_p;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(&(buffer->data.data[buffer->data.length]), message, message_length);
+
+    buffer->data.length += message_length;
+
+    return message_length;
+}
+
+int ads_download_product_to_memory(struct PRODUCT_RESPONSE *response, CURL **handle, struct CLIENT *client,
+                                   struct CURL_DATA *data) {
+    struct CURL_PRODUCT_BUFFER buffer = {0};
+
     printf("Downloading %.2lf MB from %s\n", ((double) response->length) * 0.000001, response->location);
 
-    struct CURL_DATA data_product = {0};
+    if (response->length > 0) {
+        if ((buffer.data.data = malloc(response->length)) == NULL) {
+            fprintf(stderr, "Error: Failed to allocate %zu bytes for product download.\n", response->length);
+            return 1;
+        }
+        buffer.capacity = response->length;
+    }
 
     init_curl_handle(handle, client);
 
     curl_easy_setopt(*handle, CURLOPT_URL, response->location);
-    curl_easy_setopt(*handle, CURLOPT_WRITEFUNCTION, &write_curl_generic);
-    curl_easy_setopt(*handle, CURLOPT_WRITEDATA, (void *) &data_product);
+    curl_easy_setopt(*handle, CURLOPT_WRITEFUNCTION, &write_curl_product);
+    curl_easy_setopt(*handle, CURLOPT_WRITEDATA, (void *) &buffer);
 
     CURLcode res = curl_easy_perform(*handle);
     interpret_curl_result(res, 0);
 
     curl_easy_reset(*handle);
 
-    if (data_product.length != response->length) {
+    if (buffer.data.length != response->length) {
         fprintf(stderr, "Error: Received different amount of bytes from than promised."
                         "Expected %ld, got %ld\n",
-                response->length, data_product.length);
-        exit(EXIT_FAILURE); // TODO could be made a return with some exit code instead (need to free resources first)
+                response->length, buffer.data.length);
+        free(buffer.data.data);
+        return 1;
     }
 
+    *data = buffer.data;
+
+    return 0;
+}
+
+int ads_download_product(struct PRODUCT_RESPONSE *response, CURL **handle, struct CLIENT *client, const char *fp) {
+    struct CURL_DATA data_product = {0};
+
+    if (ads_download_product_to_memory(response, handle, client, &data_product))
+        return 1;
+
     FILE *f = fopen(fp, "wb");
 
     if (f == NULL) {
         fprintf(stderr, "Error: Could not open file %s.\n", fp);
-        exit(EXIT_FAILURE); // TODO could be made a return with some exit code instead (need to free resources first)
+        free(data_product.data);
+        return 1;
     }
 
-    if (fwrite(data_product.data, sizeof(char), data_product.length, f) != data_product.length * sizeof(char)) {
-        fprintf(stderr, "Error: Could not write entire data stream to file.\n");
-        exit(EXIT_FAILURE); // TODO could be made a return with some exit code instead (need to free resources first)
-    }
+    int written = fwrite(data_product.data, sizeof(char), data_product.length, f) == data_product.length;
 
     free(data_product.data);
-    fclose(f);
+
+    if (fclose(f) != 0 || !written) {
+        fprintf(stderr, "Error: Could not write entire data stream to file.\n");
+        return 1;
+    }
 
     return 0;
 }
 
-void ads_check_product_state(struct PRODUCT_RESPONSE *response, CURL **handle, struct CLIENT *client) {
-    struct CURL_DATA status_response = {0};
-    char url[NPOW8];
-    int url_status;
+/**
+ * @brief Body of a task status response, parsed while it arrives and kept in case jansson has to parse it
+ */
+struct STATUS_POLL {
+    struct STATUS_PARSER parser;
+    struct CURL_DATA body;
+};
 
-    if ((url_status = snprintf(url, NPOW8, "%s/tasks/%s", client->auth.base_url, response->id)) >= NPOW8 ||
-        url_status < 0) {
-        fprintf(stderr, "Error: Failed to assemble request url\n");
-        exit(EXIT_FAILURE);
-    }
+static size_t write_curl_status(char *message, size_t size, size_t nmemb, void *data_container_p) {
+    struct STATUS_POLL *poll = (struct STATUS_POLL *) data_container_p;
 
-    init_curl_handle(handle, client);
+    status_parser_feed(&poll->parser, message, size * nmemb);
 
-    curl_easy_setopt(*handle, CURLOPT_URL, url);
-    curl_easy_setopt(*handle, CURLOPT_WRITEFUNCTION, &write_curl_string);
-    curl_easy_setopt(*handle, CURLOPT_WRITEDATA, (void *) &status_response);
+    return write_curl_string(message, size, nmemb, &poll->body);
+}
 
-    CURLcode res = curl_easy_perform(*handle);
-    interpret_curl_result(res, 0);
+/**
+ * @brief Update a product response from the members extracted by a status parser.
+ * @return Zero on success, non-zero if the response has to be parsed with jansson instead.
+ */
+static int apply_product_status(const struct STATUS_PARSER *parser, struct PRODUCT_RESPONSE *response) {
+    if (!status_parser_finished(parser) || !parser->has_state)
+        return 1;
 
-    curl_easy_reset(*handle); // returned JSON identical to initial request
+    PRODUCT_STATUS state = convert_to_product_status(parser->state);
+
+    if (state == PRODUCT_STATUS_COMPLETED && !(parser->has_location && parser->has_content_length))
+        return 1;
+
+    response->state = state;
+
+    if (state != PRODUCT_STATUS_COMPLETED)
+        return 0;
+
+    response->length = parser->content_length;
 
+    if (response->location == NULL || strcmp(response->location, parser->location) != 0)
+        response->location = arena_strndup(response->arena, parser->location, parser->location_length);
+
+    return 0;
+}
+
+static void parse_product_status_json(const char *body, struct PRODUCT_RESPONSE *response) {
     json_t *root, *state, *location, *content_length;
     json_error_t error;
-    json_t *warning;
 
-    if (!(root = json_loads(status_response.data, 0, &error))) {
+    if (!(root = json_loads(body, 0, &error))) {
         fprintf(stderr, "Error: Failed to parse JSON response on line %d: %s.\n", error.line, error.text);
-        exit(EXIT_FAILURE);
+        response->state = PRODUCT_STATUS_INVALID;
+        return;
     }
 
     if (!json_is_object(root)) {
@@ -847,38 +1128,89 @@ void ads_check_product_state(struct PRODUCT_RESPONSE *response, CURL **handle, s
     location = json_object_get(root, "location");
     if (!json_is_string(location)) {
         fprintf(stderr, "Error: Could not get file location from JSON message.\n");
-        goto cleanup;
+        goto invalid;
     }
 
     content_length = json_object_get(root, "content_length");
     if (!json_is_integer(content_length)) {
         fprintf(stderr, "Error: Could not get content length from JSON message.\n");
-        goto cleanup;
+        goto invalid;
     }
 
     response->length = json_integer_value(content_length);
 
-    size_t curr_buff_size = response->location == NULL ? 0 : strlen(response->location);
-    size_t file_location_size = strlen(json_string_value(location));
+    // the location is only set once the product is completed, so it is copied at most once per request cycle
+    if (response->location == NULL || strcmp(response->location, json_string_value(location)) != 0)
+        response->location = arena_strndup(response->arena, json_string_value(location), json_string_length(location));
+    goto cleanup;
 
-    if (curr_buff_size < file_location_size) {
-        response->location = realloc(response->location, sizeof(char) * (file_location_size + 1));
+    invalid:
+    response->state = PRODUCT_STATUS_INVALID;
 
-        if (response->location == NULL) {
-            fprintf(stderr, "Error: Failed to allocate memory for download path on server.\n");
-            exit(EXIT_FAILURE);
-        }
+    cleanup:
+    json_decref(root);
+}
+
+
+void parse_product_status(const char *body, struct PRODUCT_RESPONSE *response) {
+    struct STATUS_PARSER parser;
+
+    status_parser_init(&parser);
+    status_parser_feed(&parser, body, strlen(body));
+
+    if (apply_product_status(&parser, response))
+        parse_product_status_json(body, response);
+}
+
+void ads_check_product_state(struct PRODUCT_RESPONSE *response, CURL **handle, struct CLIENT *client) {
+    struct STATUS_POLL status_response = {0};
+    struct HTTP_VALIDATORS received = {0};
+    long http_code = 0;
+    char url[NPOW8];
+    int url_status;
+
+    if ((url_status = snprintf(url, NPOW8, "%s/tasks/%s", client->auth.base_url, response->id)) >= NPOW8 ||
+        url_status < 0) {
+        fprintf(stderr, "Error: Failed to assemble request url\n");
+        response->state = PRODUCT_STATUS_INVALID;
+        return;
     }
 
-    // checking return value of strcpy in this way doesn't make sense - right?
-    if (strcpy(response->location, json_string_value(location)) == NULL) {
-        fprintf(stderr, "ERROR: Strcpy returned null value\n");
-        goto cleanup;
+    init_curl_handle(handle, client);
+
+    curl_easy_setopt(*handle, CURLOPT_URL, url);
+    curl_easy_setopt(*handle, CURLOPT_WRITEFUNCTION, &write_curl_status);
+    curl_easy_setopt(*handle, CURLOPT_WRITEDATA, (void *) &status_response);
+    curl_easy_setopt(*handle, CURLOPT_HEADERFUNCTION, write_curl_header);
+    curl_easy_setopt(*handle, CURLOPT_HEADERDATA, (void *) &received);
+
+    // if the server sent validators for an earlier poll, an unchanged task is answered with 304 and no body
+    struct curl_slist *headers = conditional_headers(&response->validators);
+    if (headers)
+        curl_easy_setopt(*handle, CURLOPT_HTTPHEADER, headers);
+
+    status_parser_init(&status_response.parser);
+
+    CURLcode res = curl_easy_perform(*handle);
+    interpret_curl_result(res, 0);
+
+    curl_easy_getinfo(*handle, CURLINFO_RESPONSE_CODE, &http_code);
+
+    curl_easy_reset(*handle); // returned JSON identical to initial request
+    curl_slist_free_all(headers);
+
+    if (headers && http_code == 304) {
+        free(status_response.body.data);
+        return;
     }
 
-    cleanup:
-    json_decref(root);
-    free(status_response.data);
+    update_validators(&response->validators, &received);
+
+    // members were extracted while the body arrived; jansson only parses responses the status parser rejected
+    if (apply_product_status(&status_response.parser, response))
+        parse_product_status_json(status_response.body.data ? status_response.body.data : "", response);
+
+    free(status_response.body.data);
 }
 
 int ads_delete_product_request(struct PRODUCT_RESPONSE *response, CURL **handle, struct CLIENT *client) {
@@ -888,7 +1220,7 @@ int ads_delete_product_request(struct PRODUCT_RESPONSE *response, CURL **handle,
     if ((url_status = snprintf(url, NPOW8, "%s/tasks/%s", client->auth.base_url, response->id)) >= NPOW8 ||
         url_status < 0) {
         fprintf(stderr, "Error: Failed to assemble URL to delete product from ADS.\n");
-        exit(EXIT_FAILURE);
+        return 1;
     }
 
     init_curl_handle(handle, client);
@@ -901,5 +1233,5 @@ int ads_delete_product_request(struct PRODUCT_RESPONSE *response, CURL **handle,
 
     curl_easy_reset(*handle);
 
-    return 0;
+    return res != CURLE_OK;
 }
@@ -10,7 +10,7 @@
 #include <curl/curl.h>
 #include <jansson.h>
 
-#define FORCE_VERSION "Test, Test!"
+struct ARENA;
 
 typedef enum {
     PRODUCT_STATUS_COMPLETED = 0,
@@ -22,7 +22,8 @@ typedef enum {
 
 typedef enum {
     ADS_STATUS_OK = 0,
-    ADS_STATUS_WARNING = 1
+    ADS_STATUS_WARNING = 1,
+    ADS_STATUS_ERROR = 2
 } ADS_STATUS;
 
 typedef enum {
@@ -73,9 +74,9 @@ struct DATE_RANGE {
  */
 struct OPTIONS {
     int use_custom_authentication;
-    char authentication[NPOW16];
-    char coordinates[NPOW16];
-    char output_directory[NPOW16];
+    const char *authentication;     ///< path to authentication file
+    const char *coordinates;        ///< path to file with WRS-2 center coordinates
+    const char *output_directory;   ///< directory downloads are written to, including the trailing separator
 };
 
 /**
@@ -123,6 +124,8 @@ struct CLIENT {
     int forget __attribute__((unused));
     unsigned int retries;
     CURL **curl_handle;
+    const char *cache_dir;                                      ///< directory of the ADS status cache, NULL to disable
+    unsigned int status_ttl;                                    ///< seconds a cached ADS status is used unchecked
 };
 
 /**
@@ -159,39 +162,33 @@ struct PRODUCT_REQUEST {
     int leadtime_hour[120];
 };
 
+/**
+ * @brief Validators of an HTTP response which make later requests for the same resource conditional
+ * @author Florian Katerndahl
+ */
+struct HTTP_VALIDATORS {
+    char etag[NPOW8];           ///< value of the ETag header, empty if none was sent
+    char last_modified[NPOW6];  ///< value of the Last-Modified header, empty if none was sent
+};
+
 struct PRODUCT_RESPONSE {
     PRODUCT_STATUS state;
     char *id;
     char *location;
     size_t length;
-
+    struct ARENA *arena;                ///< arena of the request cycle backing `id` and `location`
+    struct HTTP_VALIDATORS validators;  ///< validators of the last task status response
 };
 
-/**
- * @brief Print the usage of the `download-cams` program
- * @author Florian Katerndahl
- */
-void print_usage(void);
-
-/**
- * @brief Print the version of FORCE
- * @author Florian Katerndahl
- */
-void print_version(void);
-
-/**
- * @brief Print the program's purpose
- * @author Florian Katerndahl
- */
-void print_purpose(void);
-
 /**
  * @brief Parse API authentication file and save its result into `api_authentication`
  * @param api_authentication_file File handle to authentication file
  * @param api_authentication struct containing the fields extracted from `api_authentication_file`
+ * @param arena Arena backing the extracted strings
  * @author Florian Katerndahl
  */
-void parse_authentication(FILE *api_authentication_file, struct API_AUTHENTICATION *api_authentication);
+void parse_authentication(FILE *api_authentication_file, struct API_AUTHENTICATION *api_authentication,
+                          struct ARENA *arena);
 
 /**
  * @brief Read the file holding center coordinates of all WRS-2 tiles the AOI contains. Find the bounding box (in
@@ -205,7 +202,7 @@ void parse_authentication(FILE *api_authentication_file, struct API_AUTHENTICATI
  * (negative values for West/South). Any other column is ignored.
  * @author Florian Katerndahl
  */
-struct BOUNDING_BOX parse_coordinate_file(char *coordinate_file, double **lon, double **lat);
+struct BOUNDING_BOX parse_coordinate_file(const char *coordinate_file, double **lon, double **lat);
 
 /**
  * @brief Convert string representation of product to integer representation of type PRODUCT_TYPE
@@ -220,18 +217,13 @@ PRODUCT_TYPE product_string_to_type(const char *str);
  * the environment variable `ADSAUTH`.
  * @param api_authentication struct holding fields from API authentication file. To be populated
  * @param options struct containing parsed command-line arguments; used to decide from where to retrieve authentication file.
+ * @param arena Arena backing the strings of `api_authentication`
  * @return Zero on success
  * @warning Implementation does not allow non-zero exit codes!
  * @author Florian Katerndahl
  */
-int init_api_authentication(struct API_AUTHENTICATION *api_authentication, const struct OPTIONS *options);
-
-/**
- * @brief Free allocated strings in struct `API_AUTHENTICATION`
- * @param api_authentication Pointer to struct `API_AUTHENTICATION`
- * @author Florian Katerndahl
- */
-void free_api_authentication(const struct API_AUTHENTICATION *api_authentication);
+int init_api_authentication(struct API_AUTHENTICATION *api_authentication, const struct OPTIONS *options,
+                            struct ARENA *arena);
 
 /**
  * @brief Given the optopt code, which ist set be getopt, return a pointer to the string (i.e. long) version of that argument.
@@ -281,8 +273,14 @@ void init_curl_handle(CURL **handle, const struct CLIENT *client);
 
 /**
  * @brief Check the status of the Atmospheric Data Store
+ * @details If `client->cache_dir` is set, the result is cached in `ads-status.txt` within it. For `client->status_ttl`
+ * seconds after the server last confirmed it, the cached result is returned without a request. Afterwards, the request
+ * is made conditional on the ETag and Last-Modified headers of the cached response, so an unchanged status costs a
+ * round trip without body.
  * @param handle Curl handle
- * @return ADS_STATUS_OK if no warnings are reported, ADS_STATUS_WARNING otherwise
+ * @param client Client struct
+ * @return ADS_STATUS_OK if no warnings are reported, ADS_STATUS_WARNING if there are, ADS_STATUS_ERROR if the status
+ * could not be determined
  * @author Florian Katerndahl
  */
 ADS_STATUS check_ads_status(CURL **handle, const struct CLIENT *client);
@@ -340,35 +338,61 @@ int all_unique(int *arr, size_t s);
 /**
  * @brief Construct a string in JSON format which can is passed onto CURL for a product POST request.
  * @param request Pointer to request struct
- * @return A pointer to the JSON formatted string. The caller is responsible for freeing the string after usage!
+ * @param arena Arena of the request cycle
+ * @return A pointer to the JSON formatted string, allocated from `arena`
  * @note The CDS-API allows for multiple model base times, this current implementation only allows for a single base
  * time per request.
- * @warning The caller is responsible for freeing the string after usage!
  * @author Florian Katerndahl
  */
-const char *assemble_request(const struct PRODUCT_REQUEST *request);
+const char *assemble_request(const struct PRODUCT_REQUEST *request, struct ARENA *arena);
 
 /**
  * @brief Given a download directory and the request parameters, generate a suitable download path.
  * @param request Pointer to request struct
  * @param options Pointer to options struct
- * @return A pointer to the formatted download path
- * @warning The caller is responsible for freeing the string after usage!
+ * @param arena Arena of the request cycle
+ * @return A pointer to the formatted download path, allocated from `arena`
  * @author Florian Katerndahl
  */
-const char *assemble_download_path(const struct PRODUCT_REQUEST *request, const struct OPTIONS *options);
+const char *assemble_download_path(const struct PRODUCT_REQUEST *request, const struct OPTIONS *options,
+                                   struct ARENA *arena);
+
+/**
+ * @brief Name of the ADS dataset a product is requested from
+ * @param product Product type
+ * @return Dataset name as used in the resource url, NULL for unknown products
+ * @author Florian Katerndahl
+ */
+const char *product_dataset(PRODUCT_TYPE product);
 
 /**
  * @brief Post product request to ADS-API
  * @param request Request struct containing query options, representing JSON being sent to ADS
  * @param handle cURL handle
  * @param client Client struct
+ * @param arena Arena of the request cycle, backing the request body and the strings of the response
  * @return Response struct containing a selection of JSON response fields
  * @note Currently, only 'cams-global-reanalysis-eac4' is implemented.
  * @author Florian Katerndahl
  */
 struct PRODUCT_RESPONSE
-ads_request_product(const struct PRODUCT_REQUEST *request, CURL **handle, const struct CLIENT *client);
+ads_request_product(const struct PRODUCT_REQUEST *request, CURL **handle, const struct CLIENT *client,
+                    struct ARENA *arena);
+
+/**
+ * @brief Post an already assembled product request to ADS-API
+ * @param dataset Name of the dataset, see `product_dataset`
+ * @param body Request in the JSON form produced by `assemble_request`
+ * @param handle cURL handle
+ * @param client Client struct
+ * @param arena Arena of the request cycle, backing the strings of the response
+ * @return Response struct containing a selection of JSON response fields. Its state is PRODUCT_STATUS_INVALID if
+ * the response could not be read.
+ * @author Florian Katerndahl
+ */
+struct PRODUCT_RESPONSE
+ads_submit_request(const char *dataset, const char *body, CURL **handle, const struct CLIENT *client,
+                   struct ARENA *arena);
 
 /**
  * @brief Check if a given date range conforms to semantic meaning.
@@ -392,14 +416,41 @@ PRODUCT_STATUS convert_to_product_status(const char *status);
  * @param handle cURL handle
  * @param client Client struct
  * @param fp Character string, representing absolute file path where to save file
- * @return Integer-encoded status. Zero on success
- * @warning Only a zero exit code is currently possible
+ * @return Integer-encoded status. Zero on success, non-zero if the product could not be downloaded or written
  * @author Florian Katerndahl
  */
 int ads_download_product(struct PRODUCT_RESPONSE *response, CURL **handle, struct CLIENT *client, const char *fp);
 
+/**
+ * @brief Download a finished product into memory instead of writing it to disk
+ * @param response Response struct
+ * @param handle cURL handle
+ * @param client Client struct
+ * @param data Struct into which the product is written. `data->data` is allocated once with the content length
+ * announced by the ADS and must be freed by the caller.
+ * @return Integer-encoded status. Zero on success, non-zero if fewer or more bytes than announced were received
+ * @note Combined with `grib_data_from_memory`, a product can be decoded without a round trip to disk.
+ * @author Florian Katerndahl
+ */
+int ads_download_product_to_memory(struct PRODUCT_RESPONSE *response, CURL **handle, struct CLIENT *client,
+                                   struct CURL_DATA *data);
+
+/**
+ * @brief Update a product response from the body of a task status response of the ADS API
+ * @details The state is always updated. Location and content length are only updated once the product is completed.
+ * Responses which can't be read, or announce a completed product without its location, set PRODUCT_STATUS_INVALID.
+ * The members are extracted by a streaming parser without building a JSON tree; responses it does not understand are
+ * parsed with jansson.
+ * @param body Null-terminated JSON body of the response
+ * @param response Response struct; a new location is allocated from `response->arena`
+ * @author Florian Katerndahl
+ */
+void parse_product_status(const char *body, struct PRODUCT_RESPONSE *response);
+
 /**
  * @brief Query the ADS API to check for the product status
+ * @details Polls are conditional on the validators of the previous poll of the same task, if the server sent any. An
+ * answer of 304 Not Modified leaves `response` unchanged, an unreadable answer sets PRODUCT_STATUS_INVALID.
  * @param response Response struct
  * @param handle cURL handle
  * @param client Client struct
@@ -413,7 +464,6 @@ void ads_check_product_state(struct PRODUCT_RESPONSE *response, CURL **handle, s
  * @param handle cURL handle
  * @param client Client struct
  * @return Integer-encoded status. Zero on success
- * @note Implementation does not allow for non-zero exit code!
  * @author Florian Katerndahl
  */
 int ads_delete_product_request(struct PRODUCT_RESPONSE *response, CURL **handle, struct CLIENT *client);
@@ -0,0 +1,475 @@
+#define _XOPEN_SOURCE 700 // POSIX.1-2008 plus realpath
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include "fieldcache.h"
+#include "hash.h"
+#include "interpolate.h"
+
+static const char cache_magic[8] = {'C', 'A', 'M', 'S', 'F', 'L', 'D', 'S'};
+
+enum {
+    CACHE_PAGE = 4096,
+    CACHE_CHUNK_TARGET = 16777216 ///< chunks hold as many fields as fit into 16 MB, but at least one
+};
+
+static uint64_t align_to_page(uint64_t n) {
+    return (n + CACHE_PAGE - 1) / CACHE_PAGE * CACHE_PAGE;
+}
+
+static uint16_t float_to_half(float value) {
+    uint32_t x;
+
+    memcpy(&x, &value, sizeof(x));
+
+    uint32_t sign = (x >> 16) & 0x8000, magnitude = x & 0x7fffffff;
+
+    if (magnitude > 0x7f800000)
+        return (uint16_t) (sign | 0x7e00);
+    // 65520 and above round to infinity
+    if (magnitude >= 0x477ff000)
+        return (uint16_t) (sign | 0x7c00);
+    // 2^-25 and below round to zero
+    if (magnitude <= 0x33000000)
+        return (uint16_t) sign;
+
+    uint32_t exponent = magnitude >> 23, mantissa = (magnitude & 0x7fffff) | 0x800000, half, rest, tie;
+
+    if (exponent < 113) {
+        // subnormal half, counted in steps of 2^-24
+        uint32_t shift = 126 - exponent;
+        half = mantissa >> shift;
+        rest = mantissa & ((1u << shift) - 1);
+        tie = 1u << (shift - 1);
+    } else {
+        half = ((exponent - 112) << 10) | ((magnitude & 0x7fffff) >> 13);
+        rest = magnitude & 0x1fff;
+        tie = 0x1000;
+    }
+
+    // round to nearest even, a carry into the exponent yields the correct result
+    if (rest > tie || (rest == tie && (half & 1)))
+        half++;
+
+    return (uint16_t) (sign | half);
+}
+
+static float half_to_float(uint16_t half) {
+    uint32_t sign = (uint32_t) (half & 0x8000) << 16, exponent = (half >> 10) & 0x1f, mantissa = half & 0x3ff, x;
+    float value;
+
+    if (exponent == 0) {
+        value = (float) mantissa * 5.9604644775390625e-8f;
+        return sign ? -value : value;
+    }
+
+    if (exponent == 31)
+        x = sign | 0x7f800000 | (mantissa << 13);
+    else
+        x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+    memcpy(&value, &x, sizeof(value));
+
+    return value;
+}
+
+void quantize_float16(const float *values, size_t n, uint16_t *out) {
+    size_t i = 0;
+
+#ifdef __F16C__
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128((__m128i *) (out + i), _mm256_cvtps_ph(_mm256_loadu_ps(values + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+
+    for (; i < n; i++)
+        out[i] = float_to_half(values[i]);
+}
+
+void dequantize_float16(const uint16_t *values, size_t n, float *out) {
+    size_t i = 0;
+
+#ifdef __F16C__
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) (values + i))));
+#endif
+
+    for (; i < n; i++)
+        out[i] = half_to_float(values[i]);
+}
+
+void quantize_int16(const float *values, size_t n, int16_t *out, double *scale, double *offset) {
+    float min = INFINITY, max = -INFINITY;
+
+    for (size_t i = 0; i < n; i++) {
+        if (values[i] < min) min = values[i];
+        if (values[i] > max) max = values[i];
+    }
+
+    // fields without valid values or with a single value still get a usable scale
+    *offset = min <= max ? (double) min : 0.0;
+    *scale = min < max ? ((double) max - (double) min) / 65534.0 : 1.0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (isnan(values[i]))
+            out[i] = INT16_MIN;
+        else
+            out[i] = (int16_t) (lround(((double) values[i] - *offset) / *scale) - 32767);
+    }
+}
+
+void dequantize_int16(const int16_t *values, size_t n, double scale, double offset, float *out) {
+    for (size_t i = 0; i < n; i++)
+        out[i] = values[i] == INT16_MIN ? NAN : (float) ((double) (values[i] + 32767) * scale + offset);
+}
+
+int field_cache_dtype(const char *name) {
+    if (strcmp(name, "float32") == 0)
+        return FIELD_CACHE_FLOAT32;
+    if (strcmp(name, "float16") == 0)
+        return FIELD_CACHE_FLOAT16;
+    if (strcmp(name, "int16") == 0)
+        return FIELD_CACHE_INT16;
+    return -1;
+}
+
+static uint32_t dtype_size(uint32_t dtype) {
+    return dtype == FIELD_CACHE_FLOAT32 ? sizeof(float) : sizeof(uint16_t);
+}
+
+void field_cache_path(char *dest, size_t size, const char *cache_dir, const char *source) {
+    char buffer[4096], *canonical = realpath(source, NULL);
+    const char *path = canonical ? canonical : source;
+
+    // files of the same name in different directories must not share a cache
+    uint64_t hash = fnv1a(FNV1A_OFFSET_BASIS, path, strlen(path));
+
+    free(canonical);
+    strncpy(buffer, source, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+
+    int status = snprintf(dest, size, "%s/%s-%016llx%s", cache_dir, basename(buffer), (unsigned long long) hash,
+                          FIELD_CACHE_SUFFIX);
+
+    if (status < 0 || (size_t) status >= size) {
+        fprintf(stderr, "Error: Failed to construct path of field cache\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Whether the layout described by a header lies within a file of `size` bytes
+ * @details Products are checked by division, so that corrupt headers can't overflow them.
+ */
+static int layout_fits(const struct FIELD_CACHE_HEADER *header, uint64_t size) {
+    if (header->ni <= 0 || header->nj <= 0 || header->chunk_fields == 0 ||
+        (uint64_t) header->ni > UINT64_MAX / (uint64_t) header->nj)
+        return 0;
+
+    uint64_t values = (uint64_t) header->ni * (uint64_t) header->nj;
+
+    if (values > UINT64_MAX / header->value_size / header->chunk_fields ||
+        values * header->value_size * header->chunk_fields > header->chunk_bytes)
+        return 0;
+
+    uint64_t n_chunks = header->n_fields / header->chunk_fields + (header->n_fields % header->chunk_fields != 0);
+
+    return header->data_offset >= sizeof(struct FIELD_CACHE_HEADER) && header->data_offset <= size &&
+           n_chunks <= (size - header->data_offset) / header->chunk_bytes && header->index_offset <= size &&
+           header->n_fields <= (size - header->index_offset) / sizeof(struct FIELD_CACHE_ENTRY);
+}
+
+int field_cache_open(struct FIELD_CACHE *cache, const char *path, const char *source) {
+    struct stat sb, source_sb;
+
+    memset(cache, 0, sizeof(struct FIELD_CACHE));
+
+    if (stat(source, &source_sb) != 0) {
+        fprintf(stderr, "Error: Could not stat file %s\n", source);
+        exit(EXIT_FAILURE);
+    }
+
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1)
+        return 1;
+
+    if (fstat(fd, &sb) != 0 || (size_t) sb.st_size < sizeof(struct FIELD_CACHE_HEADER)) {
+        close(fd);
+        return 1;
+    }
+
+    void *mapping = mmap(NULL, (size_t) sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not map field cache %s into memory\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    const struct FIELD_CACHE_HEADER *header = (const struct FIELD_CACHE_HEADER *) mapping;
+
+    if (memcmp(header->magic, cache_magic, sizeof(cache_magic)) != 0 || header->version != 2 ||
+        header->byte_order != 0x01020304 || header->dtype > FIELD_CACHE_INT16 ||
+        header->value_size != dtype_size(header->dtype) || !layout_fits(header, (uint64_t) sb.st_size)) {
+        fprintf(stderr, "Warning: Ignoring invalid field cache %s\n", path);
+        munmap(mapping, (size_t) sb.st_size);
+        return 1;
+    }
+
+    if (header->source_size != (uint64_t) source_sb.st_size || header->source_mtime != (int64_t) source_sb.st_mtime) {
+        fprintf(stderr, "Warning: Field cache %s is stale, %s changed since it was built\n", path, source);
+        munmap(mapping, (size_t) sb.st_size);
+        return 1;
+    }
+
+    cache->mapping = mapping;
+    cache->size = (size_t) sb.st_size;
+    cache->header = header;
+    cache->entries = (const struct FIELD_CACHE_ENTRY *) ((const unsigned char *) mapping + header->index_offset);
+
+    return 0;
+}
+
+static const void *field_data(const struct FIELD_CACHE *cache, size_t t) {
+    const struct FIELD_CACHE_HEADER *header = cache->header;
+    uint64_t field_bytes = (uint64_t) header->ni * (uint64_t) header->nj * header->value_size;
+    uint64_t offset = header->data_offset + (t / header->chunk_fields) * header->chunk_bytes +
+                      (t % header->chunk_fields) * field_bytes;
+
+    return (const unsigned char *) cache->mapping + offset;
+}
+
+const float *field_cache_values(const struct FIELD_CACHE *cache, size_t t) {
+    if (cache->header->dtype != FIELD_CACHE_FLOAT32)
+        return NULL;
+
+    return (const float *) field_data(cache, t);
+}
+
+void field_cache_read(const struct FIELD_CACHE *cache, size_t t, float *out) {
+    size_t n = (size_t) cache->header->ni * (size_t) cache->header->nj;
+    const void *data = field_data(cache, t);
+
+    switch (cache->header->dtype) {
+        case FIELD_CACHE_FLOAT16:
+            dequantize_float16((const uint16_t *) data, n, out);
+            break;
+        case FIELD_CACHE_INT16:
+            dequantize_int16((const int16_t *) data, n, cache->entries[t].scale, cache->entries[t].offset, out);
+            break;
+        default:
+            memcpy(out, data, n * sizeof(float));
+    }
+}
+
+void field_cache_close(struct FIELD_CACHE *cache) {
+    if (cache->mapping)
+        munmap(cache->mapping, cache->size);
+    memset(cache, 0, sizeof(struct FIELD_CACHE));
+}
+
+void field_cache_writer_open(struct FIELD_CACHE_WRITER *writer, const char *path, const char *source, int dtype) {
+    struct stat sb;
+
+    memset(writer, 0, sizeof(struct FIELD_CACHE_WRITER));
+
+    if (stat(source, &sb) != 0) {
+        fprintf(stderr, "Error: Could not stat file %s\n", source);
+        exit(EXIT_FAILURE);
+    }
+
+    strncpy(writer->path, path, sizeof(writer->path) - 1);
+
+    // processes building the cache of the same source concurrently each write a file of their own
+    int status = snprintf(writer->tmp, sizeof(writer->tmp), "%s.%ld.tmp", path, (long) getpid());
+
+    if (status < 0 || (size_t) status >= sizeof(writer->tmp)) {
+        fprintf(stderr, "Error: Failed to construct path of field cache\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if ((writer->fd = open(writer->tmp, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1) {
+        fprintf(stderr, "Error: Could not open file %s.\n", writer->tmp);
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(writer->header.magic, cache_magic, sizeof(cache_magic));
+    writer->header.version = 2;
+    writer->header.byte_order = 0x01020304;
+    writer->header.dtype = dtype == FIELD_CACHE_FLOAT16 || dtype == FIELD_CACHE_INT16 ? (uint32_t) dtype :
+                           FIELD_CACHE_FLOAT32;
+    writer->header.value_size = dtype_size(writer->header.dtype);
+    writer->header.data_offset = CACHE_PAGE;
+    writer->header.source_size = (uint64_t) sb.st_size;
+    writer->header.source_mtime = (int64_t) sb.st_mtime;
+
+    pthread_mutex_init(&writer->lock, NULL);
+}
+
+static void write_at(int fd, const void *data, size_t size, uint64_t offset, const char *path) {
+    const unsigned char *p = (const unsigned char *) data;
+
+    while (size > 0) {
+        ssize_t written = pwrite(fd, p, size, (off_t) offset);
+
+        if (written <= 0) {
+            fprintf(stderr, "Error: Could not write field cache %s\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        p += written;
+        offset += (uint64_t) written;
+        size -= (size_t) written;
+    }
+}
+
+void field_cache_writer_put(struct FIELD_CACHE_WRITER *writer, const struct GRIB_FIELD *field) {
+    struct FIELD_CACHE_HEADER *header = &writer->header;
+    const struct GRID *grid = &field->grid;
+    size_t n_values = (size_t) grid->ni * (size_t) grid->nj;
+    uint64_t field_bytes, offset;
+    double scale = 0.0, offset_value = 0.0;
+    const void *data = field->values;
+    void *quantized = NULL;
+
+    // values are converted before taking the lock, so that workers quantize in parallel
+    if (header->dtype != FIELD_CACHE_FLOAT32) {
+        if ((quantized = malloc(n_values * header->value_size)) == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for quantized values\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if (header->dtype == FIELD_CACHE_FLOAT16)
+            quantize_float16(field->values, n_values, (uint16_t *) quantized);
+        else
+            quantize_int16(field->values, n_values, (int16_t *) quantized, &scale, &offset_value);
+
+        data = quantized;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+
+    if (writer->failed) {
+        pthread_mutex_unlock(&writer->lock);
+        free(quantized);
+        return;
+    }
+
+    if (header->ni == 0) {
+        header->ni = grid->ni;
+        header->nj = grid->nj;
+        header->lon_first = grid->lon_first;
+        header->lat_first = grid->lat_first;
+        header->d_lon = grid->d_lon;
+        header->d_lat = grid->d_lat;
+
+        field_bytes = (uint64_t) n_values * header->value_size;
+        header->chunk_fields = field_bytes < CACHE_CHUNK_TARGET ? CACHE_CHUNK_TARGET / field_bytes : 1;
+        header->chunk_bytes = align_to_page(header->chunk_fields * field_bytes);
+    } else {
+        struct GRID cached = {
+            .ni = (long) header->ni, .nj = (long) header->nj, .lon_first = header->lon_first,
+            .lat_first = header->lat_first, .d_lon = header->d_lon, .d_lat = header->d_lat
+        };
+
+        if (!grid_equal(&cached, grid)) {
+            fprintf(stderr, "Warning: Message %zu is on a different grid, %s is not cached\n", field->index,
+                    writer->path);
+            writer->failed = 1;
+            pthread_mutex_unlock(&writer->lock);
+            free(quantized);
+            return;
+        }
+    }
+
+    if (field->index >= writer->capacity) {
+        size_t capacity = writer->capacity ? writer->capacity : 256;
+
+        while (capacity <= field->index)
+            capacity *= 2;
+
+        writer->entries = realloc(writer->entries, capacity * sizeof(struct FIELD_CACHE_ENTRY));
+        writer->present = realloc(writer->present, capacity);
+
+        if (writer->entries == NULL || writer->present == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for field cache index\n");
+            exit(EXIT_FAILURE);
+        }
+
+        memset(writer->present + writer->capacity, 0, capacity - writer->capacity);
+        writer->capacity = capacity;
+    }
+
+    struct FIELD_CACHE_ENTRY *entry = &writer->entries[field->index];
+    memset(entry, 0, sizeof(struct FIELD_CACHE_ENTRY));
+    entry->data_date = field->data_date;
+    entry->data_time = field->data_time;
+    entry->step = field->step;
+    entry->date = field->date;
+    entry->time = field->time;
+    entry->param = field->param;
+    entry->length = field->length;
+    memcpy(entry->short_name, field->short_name, sizeof(entry->short_name));
+    entry->scale = scale;
+    entry->offset = offset_value;
+    writer->present[field->index] = 1;
+
+    if (field->index + 1 > header->n_fields)
+        header->n_fields = field->index + 1;
+
+    field_bytes = (uint64_t) header->ni * (uint64_t) header->nj * header->value_size;
+    offset = header->data_offset + (field->index / header->chunk_fields) * header->chunk_bytes +
+             (field->index % header->chunk_fields) * field_bytes;
+
+    pthread_mutex_unlock(&writer->lock);
+
+    // each field has its own slot, so workers write concurrently
+    write_at(writer->fd, data, field_bytes, offset, writer->tmp);
+    free(quantized);
+}
+
+int field_cache_writer_close(struct FIELD_CACHE_WRITER *writer) {
+    struct FIELD_CACHE_HEADER *header = &writer->header;
+    int discard = writer->failed || header->n_fields == 0;
+
+    for (uint64_t t = 0; !discard && t < header->n_fields; t++)
+        discard = !writer->present[t];
+
+    if (!discard) {
+        uint64_t n_chunks = (header->n_fields + header->chunk_fields - 1) / header->chunk_fields;
+        header->index_offset = header->data_offset + n_chunks * header->chunk_bytes;
+
+        write_at(writer->fd, writer->entries, header->n_fields * sizeof(struct FIELD_CACHE_ENTRY),
+                 header->index_offset, writer->tmp);
+        write_at(writer->fd, header, sizeof(struct FIELD_CACHE_HEADER), 0, writer->tmp);
+    }
+
+    if (close(writer->fd) != 0)
+        discard = 1;
+
+    if (!discard && rename(writer->tmp, writer->path) != 0) {
+        fprintf(stderr, "Warning: Could not move field cache to %s\n", writer->path);
+        discard = 1;
+    }
+
+    if (discard)
+        unlink(writer->tmp);
+
+    free(writer->entries);
+    free(writer->present);
+    pthread_mutex_destroy(&writer->lock);
+
+    return discard;
+}
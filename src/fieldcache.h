@@ -0,0 +1,223 @@
+#ifndef CAMS_FIELDCACHE_H
+#define CAMS_FIELDCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "gributils.h"
+
+#define FIELD_CACHE_SUFFIX ".fields"
+
+/**
+ * @brief Storage type of the values in a field cache
+ * @details Quantized types halve the size of a cache compared to float32. Their maximum error is
+ * - FIELD_CACHE_FLOAT16: IEEE 754 half precision, rounded to nearest. The relative error is at most 2^-11 (0.049 %) for
+ *   magnitudes between 6.1e-5 and 65504, the absolute error at most 2^-25 below. Larger magnitudes become infinite.
+ * - FIELD_CACHE_INT16: linear scaling between the minimum and maximum of each field, stored in its index entry. The
+ *   absolute error is at most half a step, i.e. (max - min) / 131068, plus float rounding of the decoded value.
+ * NaN is preserved by all types.
+ * @author Florian Katerndahl
+ */
+enum FIELD_CACHE_DTYPE {
+    FIELD_CACHE_FLOAT32 = 0,
+    FIELD_CACHE_FLOAT16 = 1,
+    FIELD_CACHE_INT16 = 2
+};
+
+/**
+ * @brief Fixed-size header at the start of a field cache
+ * @details A field cache stores the decoded fields of one GRIB file in time x lat x lon order. Fields are
+ * grouped into chunks of `chunk_fields` consecutive time steps, each chunk starting at a page boundary. The time index,
+ * one `FIELD_CACHE_ENTRY` per field, follows the last chunk. Values are stored in the byte order of the machine.
+ * @author Florian Katerndahl
+ */
+struct FIELD_CACHE_HEADER {
+    char magic[8];          ///< "CAMSFLDS"
+    uint32_t version;       ///< format version
+    uint32_t byte_order;    ///< 0x01020304 in the byte order of the writing machine
+    int64_t ni;             ///< number of columns of all fields
+    int64_t nj;             ///< number of rows of all fields
+    double lon_first;       ///< longitude of the first grid point
+    double lat_first;       ///< latitude of the first grid point
+    double d_lon;           ///< signed increment between columns
+    double d_lat;           ///< signed increment between rows
+    uint64_t n_fields;      ///< number of cached fields, i.e. time steps
+    uint64_t chunk_fields;  ///< number of fields per chunk
+    uint64_t chunk_bytes;   ///< size of a chunk including padding to the page size
+    uint64_t data_offset;   ///< offset of the first chunk
+    uint64_t index_offset;  ///< offset of the time index
+    uint64_t source_size;   ///< size of the GRIB file the cache was built from
+    int64_t source_mtime;   ///< modification time of the GRIB file the cache was built from
+    uint32_t dtype;         ///< storage type of the values, see `FIELD_CACHE_DTYPE`
+    uint32_t value_size;    ///< size of a stored value in bytes
+};
+
+/**
+ * @brief Entry of the time index of a field cache
+ * @author Florian Katerndahl
+ */
+struct FIELD_CACHE_ENTRY {
+    int64_t data_date;      ///< model base date as YYYYMMDD
+    int64_t data_time;      ///< model base time as HHMM
+    int64_t step;           ///< forecast step in hours
+    int64_t date;           ///< validity date as YYYYMMDD
+    int64_t time;           ///< validity time as HHMM
+    int64_t param;          ///< ecCodes paramId
+    uint64_t length;        ///< size of the encoded GRIB message in bytes
+    char short_name[16];    ///< ecCodes shortName
+    double scale;           ///< step between int16 codes, unused for other types
+    double offset;          ///< value of the smallest int16 code, unused for other types
+};
+
+/**
+ * @brief Read-only mapping of a field cache
+ * @author Florian Katerndahl
+ */
+struct FIELD_CACHE {
+    void *mapping;                              ///< mapping of the whole cache file
+    size_t size;                                ///< size of the mapping
+    const struct FIELD_CACHE_HEADER *header;    ///< header at the start of the mapping
+    const struct FIELD_CACHE_ENTRY *entries;    ///< time index within the mapping
+};
+
+/**
+ * @brief State of a field cache while it is written by the decoding workers
+ * @author Florian Katerndahl
+ */
+struct FIELD_CACHE_WRITER {
+    int fd;                                     ///< descriptor of the temporary cache file
+    int failed;                                 ///< set if the fields can't be cached, e.g. because grids differ
+    char path[4096];                            ///< final path of the cache
+    char tmp[4096 + 32];                        ///< path of the temporary cache file, unique to the process
+    struct FIELD_CACHE_HEADER header;           ///< header to write once all fields are known
+    size_t capacity;                            ///< allocated entries
+    struct FIELD_CACHE_ENTRY *entries;          ///< time index
+    unsigned char *present;                     ///< flags of fields already written
+    pthread_mutex_t lock;                       ///< guards all members but `fd`
+};
+
+/**
+ * @brief Construct the path of the cache of a GRIB file, i.e. `<cache_dir>/<basename(source)>-<hash>.fields`
+ * @details The hash is the FNV-1a hash of the canonical path of `source`, so that files of the same name in different
+ * directories get caches of their own.
+ * @param dest Buffer to write the path to
+ * @param size Size of `dest`
+ * @param cache_dir Directory holding caches
+ * @param source Path to GRIB file
+ * @author Florian Katerndahl
+ */
+void field_cache_path(char *dest, size_t size, const char *cache_dir, const char *source);
+
+/**
+ * @brief Map a field cache into memory
+ * @param cache Struct to populate
+ * @param path Path to cache
+ * @param source Path to the GRIB file the cache should have been built from
+ * @return 0 on success, 1 if the cache doesn't exist or is stale, i.e. `source` changed since the cache was built
+ * @author Florian Katerndahl
+ */
+int field_cache_open(struct FIELD_CACHE *cache, const char *path, const char *source);
+
+/**
+ * @brief Get the values of a cached field without copying them
+ * @param cache Mapped cache
+ * @param t Zero-based time step
+ * @return Pointer to ni * nj values within the mapping, NULL if the cache doesn't store float32
+ * @author Florian Katerndahl
+ */
+const float *field_cache_values(const struct FIELD_CACHE *cache, size_t t);
+
+/**
+ * @brief Decode the values of a cached field of any storage type
+ * @param cache Mapped cache
+ * @param t Zero-based time step
+ * @param out Array of at least ni * nj values
+ * @author Florian Katerndahl
+ */
+void field_cache_read(const struct FIELD_CACHE *cache, size_t t, float *out);
+
+/**
+ * @brief Map the name of a storage type to its value
+ * @param name One of "float32", "float16" or "int16"
+ * @return Storage type, -1 if `name` is unknown
+ * @author Florian Katerndahl
+ */
+int field_cache_dtype(const char *name);
+
+/**
+ * @brief Convert values to IEEE 754 half precision, rounding to nearest even
+ * @details Uses F16C instructions if the program is compiled with F16C support, a scalar loop otherwise.
+ * @param values Values to convert
+ * @param n Number of values
+ * @param out Array of at least `n` half precision values
+ * @author Florian Katerndahl
+ */
+void quantize_float16(const float *values, size_t n, uint16_t *out);
+
+/**
+ * @brief Convert IEEE 754 half precision values to float
+ * @param values Values to convert
+ * @param n Number of values
+ * @param out Array of at least `n` values
+ * @author Florian Katerndahl
+ */
+void dequantize_float16(const uint16_t *values, size_t n, float *out);
+
+/**
+ * @brief Scale values linearly to int16 codes between their minimum and maximum; NaN is stored as INT16_MIN
+ * @param values Values to convert
+ * @param n Number of values
+ * @param out Array of at least `n` codes
+ * @param scale Step between codes
+ * @param offset Value of the smallest code
+ * @author Florian Katerndahl
+ */
+void quantize_int16(const float *values, size_t n, int16_t *out, double *scale, double *offset);
+
+/**
+ * @brief Convert int16 codes back to values
+ * @param values Codes to convert
+ * @param n Number of codes
+ * @param scale Step between codes
+ * @param offset Value of the smallest code
+ * @param out Array of at least `n` values
+ * @author Florian Katerndahl
+ */
+void dequantize_int16(const int16_t *values, size_t n, double scale, double offset, float *out);
+
+/**
+ * @brief Unmap a field cache
+ * @param cache Mapped cache
+ * @author Florian Katerndahl
+ */
+void field_cache_close(struct FIELD_CACHE *cache);
+
+/**
+ * @brief Start writing a field cache for a GRIB file
+ * @param writer Struct to initialize
+ * @param path Path of the cache to create
+ * @param source Path to the GRIB file the cache is built from
+ * @param dtype Storage type of the values, see `FIELD_CACHE_DTYPE`
+ * @author Florian Katerndahl
+ */
+void field_cache_writer_open(struct FIELD_CACHE_WRITER *writer, const char *path, const char *source, int dtype);
+
+/**
+ * @brief Write a decoded field to its slot in the cache
+ * @param writer Cache writer
+ * @param field Decoded field; `field->index` determines its time step
+ * @note Safe to call concurrently from all decoding workers.
+ * @author Florian Katerndahl
+ */
+void field_cache_writer_put(struct FIELD_CACHE_WRITER *writer, const struct GRIB_FIELD *field);
+
+/**
+ * @brief Write the time index and header and move the cache to its final path
+ * @param writer Cache writer
+ * @return 0 if the cache was written, 1 if it was discarded or could not be moved to its final path
+ * @author Florian Katerndahl
+ */
+int field_cache_writer_close(struct FIELD_CACHE_WRITER *writer);
+
+#endif //CAMS_FIELDCACHE_H
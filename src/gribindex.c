@@ -0,0 +1,124 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gribindex.h"
+
+static const char index_magic[8] = {'C', 'A', 'M', 'S', 'G', 'I', 'D', 'X'};
+
+void grib_index_path(char *dest, size_t size, const char *source) {
+    int status = snprintf(dest, size, "%s%s", source, GRIB_INDEX_SUFFIX);
+
+    if (status < 0 || (size_t) status >= size) {
+        fprintf(stderr, "Error: Failed to construct path of GRIB index\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+struct GRIB_INDEX_ENTRY *grib_index_read(const char *path, uint64_t source_size, int64_t source_mtime,
+                                         size_t *n_messages) {
+    struct GRIB_INDEX_HEADER header;
+    struct GRIB_INDEX_ENTRY *entries;
+    FILE *fp = fopen(path, "rb");
+
+    *n_messages = 0;
+
+    if (fp == NULL)
+        return NULL;
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, index_magic, sizeof(index_magic)) != 0 ||
+        header.version != 1 || header.byte_order != 0x01020304 || header.n_messages == 0 ||
+        header.n_messages > source_size / 16) {
+        fprintf(stderr, "Warning: Ignoring invalid GRIB index %s\n", path);
+        fclose(fp);
+        return NULL;
+    }
+
+    // a stale index is rebuilt silently, the file was most likely downloaded again
+    if (header.source_size != source_size || header.source_mtime != source_mtime) {
+        fclose(fp);
+        return NULL;
+    }
+
+    if ((entries = malloc(header.n_messages * sizeof(struct GRIB_INDEX_ENTRY))) == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for GRIB index\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (fread(entries, sizeof(struct GRIB_INDEX_ENTRY), header.n_messages, fp) != header.n_messages) {
+        fprintf(stderr, "Warning: Ignoring truncated GRIB index %s\n", path);
+        free(entries);
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+
+    for (uint64_t i = 0; i < header.n_messages; i++) {
+        if (entries[i].offset + entries[i].length > source_size || entries[i].length < 16) {
+            fprintf(stderr, "Warning: Ignoring invalid GRIB index %s\n", path);
+            free(entries);
+            return NULL;
+        }
+    }
+
+    *n_messages = (size_t) header.n_messages;
+
+    return entries;
+}
+
+int grib_index_write(const char *path, uint64_t source_size, int64_t source_mtime,
+                     const struct GRIB_INDEX_ENTRY *entries, size_t n_messages) {
+    char tmp[4096 + 32];
+    struct GRIB_INDEX_HEADER header = {
+        .version = 1, .byte_order = 0x01020304, .n_messages = n_messages, .source_size = source_size,
+        .source_mtime = source_mtime
+    };
+
+    memcpy(header.magic, index_magic, sizeof(index_magic));
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long) getpid());
+
+    FILE *fp = fopen(tmp, "wb");
+
+    if (fp == NULL)
+        return 1;
+
+    int failed = fwrite(&header, sizeof(header), 1, fp) != 1 ||
+                 fwrite(entries, sizeof(struct GRIB_INDEX_ENTRY), n_messages, fp) != n_messages;
+
+    if (fclose(fp) != 0 || failed || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return 1;
+    }
+
+    return 0;
+}
+
+void grib_index_entry(struct GRIB_INDEX_ENTRY *entry, const struct GRIB_FIELD *field, size_t offset) {
+    *entry = (struct GRIB_INDEX_ENTRY) {
+        .offset = offset, .length = field->length, .data_date = field->data_date, .data_time = field->data_time,
+        .step = field->step, .date = field->date, .time = field->time, .param = field->param,
+        .ni = field->grid.ni, .nj = field->grid.nj, .lon_first = field->grid.lon_first,
+        .lat_first = field->grid.lat_first, .d_lon = field->grid.d_lon, .d_lat = field->grid.d_lat
+    };
+    memcpy(entry->short_name, field->short_name, sizeof(entry->short_name));
+}
+
+void grib_index_field(const struct GRIB_INDEX_ENTRY *entry, struct GRIB_FIELD *field) {
+    field->length = (size_t) entry->length;
+    field->data_date = (long) entry->data_date;
+    field->data_time = (long) entry->data_time;
+    field->step = (long) entry->step;
+    field->date = (long) entry->date;
+    field->time = (long) entry->time;
+    field->param = (long) entry->param;
+    memcpy(field->short_name, entry->short_name, sizeof(field->short_name));
+    field->short_name[sizeof(field->short_name) - 1] = '\0';
+    field->grid = (struct GRID) {
+        .ni = (long) entry->ni, .nj = (long) entry->nj, .lon_first = entry->lon_first,
+        .lat_first = entry->lat_first, .d_lon = entry->d_lon, .d_lat = entry->d_lat
+    };
+}
@@ -0,0 +1,103 @@
+#ifndef CAMS_GRIBINDEX_H
+#define CAMS_GRIBINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gributils.h"
+
+#define GRIB_INDEX_SUFFIX ".gidx"
+
+/**
+ * @brief Fixed-size header at the start of a GRIB index
+ * @details A GRIB index lies next to the GRIB file it describes and lists position and header of every message, so
+ * that messages can be selected without reading the file. The entries follow the header, in the order of the messages
+ * within the file. Numbers are stored in the byte order of the machine.
+ * @author Florian Katerndahl
+ */
+struct GRIB_INDEX_HEADER {
+    char magic[8];          ///< "CAMSGIDX"
+    uint32_t version;       ///< format version
+    uint32_t byte_order;    ///< 0x01020304 in the byte order of the writing machine
+    uint64_t n_messages;    ///< number of entries
+    uint64_t source_size;   ///< size of the GRIB file the index was built from
+    int64_t source_mtime;   ///< modification time of the GRIB file the index was built from
+};
+
+/**
+ * @brief Position and header of one GRIB message
+ * @author Florian Katerndahl
+ */
+struct GRIB_INDEX_ENTRY {
+    uint64_t offset;        ///< byte offset of the message within the file
+    uint64_t length;        ///< size of the message in bytes
+    int64_t data_date;      ///< model base date as YYYYMMDD
+    int64_t data_time;      ///< model base time as HHMM
+    int64_t step;           ///< forecast step in hours
+    int64_t date;           ///< validity date as YYYYMMDD
+    int64_t time;           ///< validity time as HHMM
+    int64_t param;          ///< ecCodes paramId
+    char short_name[16];    ///< ecCodes shortName
+    int64_t ni;             ///< number of columns of the grid
+    int64_t nj;             ///< number of rows of the grid
+    double lon_first;       ///< longitude of the first grid point
+    double lat_first;       ///< latitude of the first grid point
+    double d_lon;           ///< signed increment between columns
+    double d_lat;           ///< signed increment between rows
+};
+
+/**
+ * @brief Path of the index of a GRIB file, i.e. the path of the file with `GRIB_INDEX_SUFFIX` appended
+ * @param dest Buffer receiving the path
+ * @param size Size of `dest`
+ * @param source Path of the GRIB file
+ * @author Florian Katerndahl
+ */
+void grib_index_path(char *dest, size_t size, const char *source);
+
+/**
+ * @brief Read the index of a GRIB file if it is up to date
+ * @param path Path of the index
+ * @param source_size Size of the GRIB file
+ * @param source_mtime Modification time of the GRIB file
+ * @param n_messages Set to the number of entries
+ * @return Entries of the index, to be freed by the caller; NULL if there is no index, it is invalid or the GRIB file
+ * changed since it was built
+ * @author Florian Katerndahl
+ */
+struct GRIB_INDEX_ENTRY *grib_index_read(const char *path, uint64_t source_size, int64_t source_mtime,
+                                         size_t *n_messages);
+
+/**
+ * @brief Write the index of a GRIB file
+ * @details The index is written to a temporary file which is renamed once complete, so readers never see a partial
+ * index.
+ * @param path Path of the index
+ * @param source_size Size of the GRIB file
+ * @param source_mtime Modification time of the GRIB file
+ * @param entries One entry per message of the file
+ * @param n_messages Number of entries
+ * @return Zero on success, non-zero if the index could not be written, e.g. because the directory is read-only
+ * @author Florian Katerndahl
+ */
+int grib_index_write(const char *path, uint64_t source_size, int64_t source_mtime,
+                     const struct GRIB_INDEX_ENTRY *entries, size_t n_messages);
+
+/**
+ * @brief Fill an index entry from the header of a decoded field
+ * @param entry Entry to fill
+ * @param field Field with all header members set
+ * @param offset Byte offset of the message within its file
+ * @author Florian Katerndahl
+ */
+void grib_index_entry(struct GRIB_INDEX_ENTRY *entry, const struct GRIB_FIELD *field, size_t offset);
+
+/**
+ * @brief Populate all header members of `field` from an index entry; `file`, `index` and `values` are left untouched
+ * @param entry Index entry
+ * @param field Field to populate
+ * @author Florian Katerndahl
+ */
+void grib_index_field(const struct GRIB_INDEX_ENTRY *entry, struct GRIB_FIELD *field);
+
+#endif //CAMS_GRIBINDEX_H
@@ -1,28 +1,2490 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <eccodes.h>
+#include <gdal/gdal.h>
+#include <gdal/cpl_string.h>
+#include <gdal/ogr_srs_api.h>
 
 #include "gributils.h"
+#include "interpolate.h"
+#include "fieldcache.h"
+#include "gribindex.h"
+#include "gridshm.h"
+#include "netcdfutils.h"
+#include "trace.h"
+#include "warpmap.h"
+#include "hash.h"
+
+/**
+ * @brief Input of a decoding run, i.e. a GRIB file, GRIB data in memory or the field cache of a GRIB file
+ */
+struct DECODE_SOURCE {
+    const unsigned char *bytes;         ///< encoded messages, NULL if fields are read from `cache`
+    size_t length;                      ///< size of `bytes`
+    int mapped;                         ///< set if `bytes` was mapped by the engine and must be unmapped
+    size_t n_messages;                  ///< number of messages, or of fields in `cache`
+    size_t *offsets;                    ///< position of every message within `bytes`
+    size_t *lengths;                    ///< size of every message
+    size_t *numbers;                    ///< position of every message within its file, NULL if all are decoded
+    int filtered;                       ///< set if the filter was applied to the index of the file already
+    struct GRIB_INDEX_ENTRY *index;     ///< headers of all messages while the index of the file is built
+    char *index_path;                   ///< path the index is written to once built
+    int cached;                         ///< set if fields are read from `cache`
+    int identified;                     ///< set if `key` identifies the file, i.e. grids can be shared
+    struct GRID_SHM_KEY key;            ///< identity of the file; the offset is set per message
+    struct FIELD_CACHE cache;
+    struct FIELD_CACHE_WRITER *writer;  ///< if not NULL, all messages are decoded and written to this cache
+};
+
+/**
+ * @brief Messages owned by a worker, given as positions in the concatenation of all sources
+ * @details The owner takes messages from the front, idle workers steal the back half.
+ */
+struct WORK_RANGE {
+    size_t next;
+    size_t end;
+    pthread_mutex_t lock;
+};
+
+/**
+ * @brief State shared by all decoding workers
+ */
+struct DECODE_POOL {
+    struct DECODE_SOURCE *sources;
+    size_t n_sources;
+    size_t *first;                      ///< position of the first message of every source, `n_sources + 1` entries
+    struct WORK_RANGE *ranges;          ///< one range per worker
+    int n_threads;
+    field_filter filter;
+    void *filter_user;
+    pthread_mutex_t filter_lock;        ///< filters are never called concurrently
+    field_consumer consumer;
+    void *user;
+    struct GRID_SHM *shared;
+    pthread_mutex_t stats_lock;
+    struct DECODE_STATS stats;
+};
+
+struct DECODE_WORKER {
+    struct DECODE_POOL *pool;
+    int id;
+    pthread_t thread;
+    double *scratch;                    ///< decoded values as returned by ecCodes
+    float *values;                      ///< values handed to the consumer
+    size_t capacity;                    ///< number of values `scratch` and `values` can hold
+    struct DECODE_STATS stats;
+};
+
+static double wall_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static long get_long_key(const codes_handle *h, const char *key) {
+    long v;
+    int err;
+
+    if ((err = codes_get_long(h, key, &v)) != CODES_SUCCESS) {
+        fprintf(stderr, "Error: Failed to read key '%s' from GRIB message: %s\n", key, codes_get_error_message(err));
+        exit(EXIT_FAILURE);
+    }
+
+    return v;
+}
+
+static double get_double_key(const codes_handle *h, const char *key) {
+    double v;
+    int err;
+
+    if ((err = codes_get_double(h, key, &v)) != CODES_SUCCESS) {
+        fprintf(stderr, "Error: Failed to read key '%s' from GRIB message: %s\n", key, codes_get_error_message(err));
+        exit(EXIT_FAILURE);
+    }
+
+    return v;
+}
+
+/**
+ * @brief Populate all members of `field` except `values` and `index` from the header of a GRIB message. Does not
+ * unpack the data section.
+ */
+static void read_field_header(const codes_handle *h, struct GRIB_FIELD *field) {
+    size_t name_length = sizeof(field->short_name);
+
+    if (codes_get_message_size(h, &field->length) != CODES_SUCCESS) {
+        fprintf(stderr, "Error: Failed to get size of GRIB message\n");
+        exit(EXIT_FAILURE);
+    }
+
+    field->data_date = get_long_key(h, "dataDate");
+    field->data_time = get_long_key(h, "dataTime");
+    field->step = get_long_key(h, "endStep");
+    field->date = get_long_key(h, "validityDate");
+    field->time = get_long_key(h, "validityTime");
+    field->param = get_long_key(h, "paramId");
+
+    if (codes_get_string(h, "shortName", field->short_name, &name_length) != CODES_SUCCESS)
+        strcpy(field->short_name, "unknown");
+
+    field->grid.ni = get_long_key(h, "Ni");
+    field->grid.nj = get_long_key(h, "Nj");
+    field->grid.lon_first = get_double_key(h, "longitudeOfFirstGridPointInDegrees");
+    field->grid.lat_first = get_double_key(h, "latitudeOfFirstGridPointInDegrees");
+    field->grid.d_lon = get_double_key(h, "iDirectionIncrementInDegrees");
+    field->grid.d_lat = get_double_key(h, "jDirectionIncrementInDegrees");
+
+    if (get_long_key(h, "iScansNegatively"))
+        field->grid.d_lon = -field->grid.d_lon;
+    if (!get_long_key(h, "jScansPositively"))
+        field->grid.d_lat = -field->grid.d_lat;
+}
+
+/**
+ * @brief Grow the scratch buffers of a worker to hold at least `n_values` values.
+ */
+static void reserve_values(struct DECODE_WORKER *worker, size_t n_values) {
+    if (n_values <= worker->capacity)
+        return;
+
+    worker->scratch = realloc(worker->scratch, n_values * sizeof(double));
+    worker->values = realloc(worker->values, n_values * sizeof(float));
+
+    if (worker->scratch == NULL || worker->values == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for %zu values\n", n_values);
+        exit(EXIT_FAILURE);
+    }
+
+    worker->capacity = n_values;
+}
+
+/**
+ * @brief Take the next message of a worker's own range or, once it is empty, steal the back half of the largest range
+ * of another worker.
+ * @return 0 if a message was taken, 1 if no work is left
+ */
+static int take_message(struct DECODE_POOL *pool, int id, size_t *position) {
+    struct WORK_RANGE *own = &pool->ranges[id];
+
+    pthread_mutex_lock(&own->lock);
+    if (own->next < own->end) {
+        *position = own->next++;
+        pthread_mutex_unlock(&own->lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    for (;;) {
+        int victim = -1;
+        size_t most = 0;
+
+        for (int k = 1; k < pool->n_threads; k++) {
+            struct WORK_RANGE *range = &pool->ranges[(id + k) % pool->n_threads];
+
+            pthread_mutex_lock(&range->lock);
+            if (range->end - range->next > most) {
+                most = range->end - range->next;
+                victim = (id + k) % pool->n_threads;
+            }
+            pthread_mutex_unlock(&range->lock);
+        }
+
+        // ranges only shrink, so once all are empty no more work can show up
+        if (victim < 0)
+            return 1;
+
+        struct WORK_RANGE *range = &pool->ranges[victim];
+        size_t mid, end;
+
+        pthread_mutex_lock(&range->lock);
+        if (range->next == range->end) {
+            pthread_mutex_unlock(&range->lock);
+            continue;
+        }
+        mid = range->next + (range->end - range->next) / 2;
+        end = range->end;
+        range->end = mid;
+        pthread_mutex_unlock(&range->lock);
+
+        pthread_mutex_lock(&own->lock);
+        own->next = mid + 1;
+        own->end = end;
+        pthread_mutex_unlock(&own->lock);
+
+        *position = mid;
+        return 0;
+    }
+}
+
+/**
+ * @brief Find the source holding the message at `position` in the concatenation of all sources.
+ */
+static size_t source_of(const struct DECODE_POOL *pool, size_t position) {
+    size_t lo = 0, hi = pool->n_sources;
+
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (pool->first[mid] <= position)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+static int accept_field(struct DECODE_POOL *pool, const struct GRIB_FIELD *field) {
+    int keep;
+
+    if (pool->filter == NULL)
+        return 1;
+
+    pthread_mutex_lock(&pool->filter_lock);
+    keep = pool->filter(field, pool->filter_user);
+    pthread_mutex_unlock(&pool->filter_lock);
+
+    return keep;
+}
+
+/**
+ * @brief Populate all members of `field` except `values` from the time index of a field cache.
+ */
+static void cached_field_header(const struct FIELD_CACHE *cache, size_t t, struct GRIB_FIELD *field) {
+    const struct FIELD_CACHE_HEADER *header = cache->header;
+    const struct FIELD_CACHE_ENTRY *entry = &cache->entries[t];
+
+    field->index = t;
+    field->length = (size_t) entry->length;
+    field->data_date = (long) entry->data_date;
+    field->data_time = (long) entry->data_time;
+    field->step = (long) entry->step;
+    field->date = (long) entry->date;
+    field->time = (long) entry->time;
+    field->param = (long) entry->param;
+    memcpy(field->short_name, entry->short_name, sizeof(field->short_name));
+    field->short_name[sizeof(field->short_name) - 1] = '\0';
+    field->grid = (struct GRID) {
+        .ni = (long) header->ni, .nj = (long) header->nj, .lon_first = header->lon_first,
+        .lat_first = header->lat_first, .d_lon = header->d_lon, .d_lat = header->d_lat
+    };
+}
+
+static void decode_cached(struct DECODE_WORKER *worker, const struct DECODE_SOURCE *source, size_t file, size_t t) {
+    struct DECODE_POOL *pool = worker->pool;
+    struct GRIB_FIELD field = {.file = file};
+
+    cached_field_header(&source->cache, t, &field);
+
+    if (!accept_field(pool, &field))
+        return;
+
+    size_t n_values = (size_t) field.grid.ni * (size_t) field.grid.nj;
+
+    // float32 values are handed out in place, the cache is read-only; quantized caches are expanded to float
+    if ((field.values = (float *) field_cache_values(&source->cache, t)) == NULL) {
+        reserve_values(worker, n_values);
+        field_cache_read(&source->cache, t, worker->values);
+        field.values = worker->values;
+    }
+
+    if (pool->consumer)
+        pool->consumer(&field, worker->id, pool->user);
+
+    worker->stats.messages++;
+    worker->stats.bytes += n_values * source->cache.header->value_size;
+    worker->stats.values += n_values;
+}
+
+static void decode_message(struct DECODE_WORKER *worker, const struct DECODE_SOURCE *source, size_t file, size_t i) {
+    struct DECODE_POOL *pool = worker->pool;
+    struct GRIB_FIELD field = {.file = file, .index = source->numbers ? source->numbers[i] : i};
+    size_t n_values;
+    int err;
+
+    // the handle references the message in place, nothing is copied
+    codes_handle *h = codes_handle_new_from_message(NULL, source->bytes + source->offsets[i], source->lengths[i]);
+
+    if (h == NULL) {
+        fprintf(stderr, "Error: Failed to parse GRIB message %zu at byte %zu\n", i, source->offsets[i]);
+        exit(EXIT_FAILURE);
+    }
+
+    read_field_header(h, &field);
+
+    // every worker fills the entries of its own messages
+    if (source->index) {
+        grib_index_entry(&source->index[i], &field, source->offsets[i]);
+        source->index[i].length = source->lengths[i];
+    }
+
+    // while a cache is written, every message is decoded and the filter only decides what is passed on
+    if (source->writer == NULL && !source->filtered && !accept_field(pool, &field)) {
+        codes_handle_delete(h);
+        return;
+    }
+
+    if ((err = codes_get_size(h, "values", &n_values)) != CODES_SUCCESS) {
+        fprintf(stderr, "Error: Failed to get number of values of message %zu: %s\n", i, codes_get_error_message(err));
+        exit(EXIT_FAILURE);
+    }
+
+    struct GRID_SHM_LEASE lease = {0};
+    enum GRID_SHM_RESULT shared = GRID_SHM_BYPASS;
+
+    if (pool->shared && source->identified) {
+        struct GRID_SHM_KEY key = source->key;
+        key.offset = (uint64_t) source->offsets[i];
+        shared = grid_shm_acquire(pool->shared, &key, n_values * sizeof(float), &lease);
+    }
+
+    if (shared == GRID_SHM_HIT) {
+        field.values = lease.values;
+        worker->stats.shared++;
+    } else {
+        // the owner of a shared grid decodes straight into the shared segment
+        float *values = shared == GRID_SHM_OWNER ? lease.values : NULL;
+
+        reserve_values(worker, n_values);
+        if (values == NULL)
+            values = worker->values;
+
+        if ((err = codes_get_double_array(h, "values", worker->scratch, &n_values)) != CODES_SUCCESS) {
+            fprintf(stderr, "Error: Failed to decode values of message %zu: %s\n", i, codes_get_error_message(err));
+            exit(EXIT_FAILURE);
+        }
+
+        if (get_long_key(h, "bitmapPresent")) {
+            double missing = get_double_key(h, "missingValue");
+            for (size_t k = 0; k < n_values; k++)
+                values[k] = worker->scratch[k] == missing ? NAN : (float) worker->scratch[k];
+        } else {
+            for (size_t k = 0; k < n_values; k++)
+                values[k] = (float) worker->scratch[k];
+        }
+
+        if (shared == GRID_SHM_OWNER)
+            grid_shm_publish(pool->shared, &lease);
+
+        field.values = values;
+    }
+
+    codes_handle_delete(h);
+
+    worker->stats.messages++;
+    worker->stats.bytes += field.length;
+    worker->stats.values += n_values;
+
+    if (source->writer)
+        field_cache_writer_put(source->writer, &field);
+
+    // while a cache is written, the filter is only applied now
+    int accepted = source->writer == NULL || accept_field(pool, &field);
+
+    if (accepted && pool->consumer)
+        pool->consumer(&field, worker->id, pool->user);
+
+    if (shared != GRID_SHM_BYPASS)
+        grid_shm_release(pool->shared, &lease);
+}
+
+static void *decode_worker(void *arg) {
+    struct DECODE_WORKER *worker = (struct DECODE_WORKER *) arg;
+    struct DECODE_POOL *pool = worker->pool;
+    size_t position;
+
+    while (take_message(pool, worker->id, &position) == 0) {
+        size_t s = source_of(pool, position);
+        const struct DECODE_SOURCE *source = &pool->sources[s];
+
+        if (source->cached) {
+            TRACE_BEGIN(span, "read_cached_field");
+            decode_cached(worker, source, s, position - pool->first[s]);
+            TRACE_END(span);
+        } else {
+            TRACE_BEGIN(span, "decode_message");
+            decode_message(worker, source, s, position - pool->first[s]);
+            TRACE_END(span);
+        }
+    }
+
+    pthread_mutex_lock(&pool->stats_lock);
+    pool->stats.messages += worker->stats.messages;
+    pool->stats.bytes += worker->stats.bytes;
+    pool->stats.values += worker->stats.values;
+    pool->stats.shared += worker->stats.shared;
+    pthread_mutex_unlock(&pool->stats_lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Decode the messages of all sources with a pool of workers and add the figures of the run to `stats`.
+ * @details The messages of all sources are split into one contiguous range per worker. A worker which finished its
+ * range steals the back half of the largest remaining one, so that a single large source keeps all workers busy.
+ */
+static void decode_sources(struct DECODE_SOURCE *sources, size_t n_sources, const struct DECODE_OPTIONS *options,
+                           field_consumer consumer, void *user, struct DECODE_STATS *stats) {
+    struct DECODE_POOL pool = {
+        .sources = sources, .n_sources = n_sources, .filter = options->filter, .filter_user = options->filter_user,
+        .consumer = consumer, .user = user, .shared = options->shared,
+        .n_threads = options->n_threads > 0 ? options->n_threads : 1
+    };
+    struct DECODE_WORKER *workers;
+
+    TRACE_BEGIN(span, "decode_sources");
+
+    pool.first = malloc((n_sources + 1) * sizeof(size_t));
+    pool.ranges = calloc(pool.n_threads, sizeof(struct WORK_RANGE));
+    workers = calloc(pool.n_threads, sizeof(struct DECODE_WORKER));
+
+    if (pool.first == NULL || pool.ranges == NULL || workers == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for decoding workers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pool.first[0] = 0;
+    for (size_t s = 0; s < n_sources; s++)
+        pool.first[s + 1] = pool.first[s] + sources[s].n_messages;
+
+    size_t total = pool.first[n_sources];
+
+    pthread_mutex_init(&pool.filter_lock, NULL);
+    pthread_mutex_init(&pool.stats_lock, NULL);
+
+    for (int i = 0; i < pool.n_threads; i++) {
+        pool.ranges[i].next = total * (size_t) i / (size_t) pool.n_threads;
+        pool.ranges[i].end = total * (size_t) (i + 1) / (size_t) pool.n_threads;
+        pthread_mutex_init(&pool.ranges[i].lock, NULL);
+    }
+
+    for (int i = 0; i < pool.n_threads; i++) {
+        workers[i] = (struct DECODE_WORKER) {.pool = &pool, .id = i};
+        if (pthread_create(&workers[i].thread, NULL, decode_worker, &workers[i]) != 0) {
+            fprintf(stderr, "Error: Failed to start decoding worker %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < pool.n_threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        free(workers[i].scratch);
+        free(workers[i].values);
+    }
+
+    // idle workers look at all ranges until they exit, so ranges are only released once all workers are joined
+    for (int i = 0; i < pool.n_threads; i++)
+        pthread_mutex_destroy(&pool.ranges[i].lock);
+
+    stats->messages += pool.stats.messages;
+    stats->bytes += pool.stats.bytes;
+    stats->values += pool.stats.values;
+    stats->shared += pool.stats.shared;
+
+    pthread_mutex_destroy(&pool.filter_lock);
+    pthread_mutex_destroy(&pool.stats_lock);
+    free(workers);
+    free(pool.ranges);
+    free(pool.first);
+
+    TRACE_END(span);
+}
+
+/**
+ * @brief Find the next GRIB message in `buffer`, starting at `*offset`.
+ * @details The length is taken from section 0 of the message. GRIB1 messages larger than 8 MB encode their length
+ * differently; for those, ecCodes is asked for the total length.
+ * @return Length of the message in bytes, `*offset` pointing to its first byte. Zero if no further message exists.
+ */
+static size_t next_message(const unsigned char *buffer, size_t length, size_t *offset) {
+    size_t pos = *offset;
+
+    while (pos + 16 <= length) {
+        const unsigned char *p = memchr(buffer + pos, 'G', length - pos - 15);
+
+        if (p == NULL)
+            break;
+
+        pos = (size_t) (p - buffer);
+
+        if (memcmp(p, "GRIB", 4) != 0) {
+            pos++;
+            continue;
+        }
+
+        size_t message_length = 0;
+
+        if (p[7] == 2) {
+            for (int i = 8; i < 16; i++)
+                message_length = (message_length << 8) | p[i];
+        } else if (p[7] == 1) {
+            message_length = ((size_t) p[4] << 16) | ((size_t) p[5] << 8) | p[6];
+            if (message_length & 0x800000) {
+                codes_handle *probe = codes_handle_new_from_message(NULL, p, length - pos);
+                if (probe == NULL || codes_get_message_size(probe, &message_length) != CODES_SUCCESS) {
+                    fprintf(stderr, "Error: Failed to determine length of GRIB message at byte %zu\n", pos);
+                    exit(EXIT_FAILURE);
+                }
+                codes_handle_delete(probe);
+            }
+        } else {
+            fprintf(stderr, "Error: Unsupported GRIB edition %d at byte %zu\n", p[7], pos);
+            exit(EXIT_FAILURE);
+        }
+
+        if (message_length < 16 || message_length > length - pos) {
+            fprintf(stderr, "Error: GRIB message at byte %zu is truncated\n", pos);
+            exit(EXIT_FAILURE);
+        }
+
+        *offset = pos;
+        return message_length;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Record position and length of every message of `source`. Only section 0 of each message is read.
+ */
+static void scan_messages(struct DECODE_SOURCE *source) {
+    size_t offset = 0, message_length, capacity = 0;
+
+    while ((message_length = next_message(source->bytes, source->length, &offset)) != 0) {
+        if (source->n_messages == capacity) {
+            capacity = capacity ? 2 * capacity : 256;
+            source->offsets = realloc(source->offsets, capacity * sizeof(size_t));
+            source->lengths = realloc(source->lengths, capacity * sizeof(size_t));
+
+            if (source->offsets == NULL || source->lengths == NULL) {
+                fprintf(stderr, "Error: Failed to allocate memory for message offsets\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        source->offsets[source->n_messages] = offset;
+        source->lengths[source->n_messages] = message_length;
+        source->n_messages++;
+        offset += message_length;
+    }
+}
+
+/**
+ * @brief Take position and length of the messages of `source` from its index, keeping only those accepted by the
+ * filter unless a field cache is written, which needs all messages.
+ */
+static void select_indexed(struct DECODE_SOURCE *source, const struct GRIB_INDEX_ENTRY *entries, size_t n_entries,
+                           size_t file, const struct DECODE_OPTIONS *options) {
+    int filter = options->filter != NULL && source->writer == NULL;
+
+    source->offsets = malloc(n_entries * sizeof(size_t));
+    source->lengths = malloc(n_entries * sizeof(size_t));
+
+    if (source->offsets == NULL || source->lengths == NULL ||
+        (filter && (source->numbers = malloc(n_entries * sizeof(size_t))) == NULL)) {
+        fprintf(stderr, "Error: Failed to allocate memory for message offsets\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < n_entries; i++) {
+        if (filter) {
+            struct GRIB_FIELD field = {.file = file, .index = i};
+            grib_index_field(&entries[i], &field);
+
+            if (!options->filter(&field, options->filter_user))
+                continue;
+
+            source->numbers[source->n_messages] = i;
+        }
+
+        source->offsets[source->n_messages] = (size_t) entries[i].offset;
+        source->lengths[source->n_messages] = (size_t) entries[i].length;
+        source->n_messages++;
+    }
+
+    source->filtered = filter;
+}
+
+/**
+ * @brief Prepare a GRIB file for decoding: use its field cache if `options->cache_dir` holds an up-to-date one, map
+ * the file and start writing a cache otherwise. With `options->index`, messages are taken from the index of the file,
+ * which is built while decoding if it is missing or stale.
+ */
+static void open_source(struct DECODE_SOURCE *source, const char *fname, size_t file,
+                        const struct DECODE_OPTIONS *options) {
+    char path[4096];
+    struct stat sb;
+
+    memset(source, 0, sizeof(struct DECODE_SOURCE));
+
+    if (options->cache_dir) {
+        field_cache_path(path, sizeof(path), options->cache_dir, fname);
+
+        if (field_cache_open(&source->cache, path, fname) == 0) {
+            if (source->cache.header->dtype == (uint32_t) options->cache_dtype) {
+                source->cached = 1;
+                source->n_messages = (size_t) source->cache.header->n_fields;
+                return;
+            }
+
+            printf("Rebuilding field cache %s with a different storage type\n", path);
+            field_cache_close(&source->cache);
+        }
+    }
+
+    int fd = open(fname, O_RDONLY);
+
+    if (fd == -1 || fstat(fd, &sb) != 0) {
+        fprintf(stderr, "Error: Could not open file %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    if (sb.st_size == 0) {
+        close(fd);
+        return;
+    }
+
+    void *mapping = mmap(NULL, (size_t) sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not map file %s into memory\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    posix_madvise(mapping, (size_t) sb.st_size, POSIX_MADV_SEQUENTIAL);
+
+    source->bytes = (const unsigned char *) mapping;
+    source->length = (size_t) sb.st_size;
+    source->mapped = 1;
+
+    source->identified = 1;
+    source->key = (struct GRID_SHM_KEY) {
+        .device = (uint64_t) sb.st_dev, .inode = (uint64_t) sb.st_ino, .size = (uint64_t) sb.st_size,
+        .mtime = (int64_t) sb.st_mtime
+    };
+
+    if (options->cache_dir) {
+        if ((source->writer = malloc(sizeof(struct FIELD_CACHE_WRITER))) == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for field cache writer\n");
+            exit(EXIT_FAILURE);
+        }
+        field_cache_writer_open(source->writer, path, fname, options->cache_dtype);
+    }
+
+    if (!options->index) {
+        scan_messages(source);
+        return;
+    }
+
+    size_t n_entries;
+    grib_index_path(path, sizeof(path), fname);
+    struct GRIB_INDEX_ENTRY *entries = grib_index_read(path, source->key.size, source->key.mtime, &n_entries);
+
+    if (entries) {
+        select_indexed(source, entries, n_entries, file, options);
+        free(entries);
+
+        // only the selected messages are touched, read-ahead would mostly fetch skipped ones
+        if (source->n_messages < n_entries)
+            posix_madvise(mapping, (size_t) sb.st_size, POSIX_MADV_RANDOM);
+        return;
+    }
+
+    scan_messages(source);
+
+    if (source->n_messages > 0) {
+        source->index = calloc(source->n_messages, sizeof(struct GRIB_INDEX_ENTRY));
+        source->index_path = strdup(path);
+
+        if (source->index == NULL || source->index_path == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for GRIB index\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void close_source(struct DECODE_SOURCE *source) {
+    if (source->cached)
+        field_cache_close(&source->cache);
+
+    if (source->writer) {
+        if (field_cache_writer_close(source->writer) == 0)
+            printf("Cached decoded fields in %s\n", source->writer->path);
+        free(source->writer);
+    }
+
+    // every message had its header read by a worker, so the index is complete
+    if (source->index) {
+        if (grib_index_write(source->index_path, source->key.size, source->key.mtime, source->index,
+                             source->n_messages) == 0)
+            printf("Indexed %zu messages in %s\n", source->n_messages, source->index_path);
+        else
+            fprintf(stderr, "Warning: Could not write GRIB index %s\n", source->index_path);
+        free(source->index);
+        free(source->index_path);
+    }
+
+    if (source->mapped)
+        munmap((void *) source->bytes, source->length);
+
+    free(source->offsets);
+    free(source->lengths);
+    free(source->numbers);
+}
+
+size_t grib_data_from_memory(const void *buffer, size_t length, const struct DECODE_OPTIONS *options,
+                             field_consumer consumer, void *user, struct DECODE_STATS *stats) {
+    struct DECODE_SOURCE source = {.bytes = (const unsigned char *) buffer, .length = length};
+    struct DECODE_STATS run = {0};
+
+    double start = wall_time();
+
+    scan_messages(&source);
+    decode_sources(&source, 1, options, consumer, user, &run);
+    close_source(&source);
+
+    run.seconds = wall_time() - start;
+
+    if (stats)
+        *stats = run;
+
+    return run.messages;
+}
+
+/**
+ * @brief Consumer and filter of the caller, wrapped to report the position of a netCDF file among the inputs.
+ */
+struct NETCDF_INPUT {
+    size_t file;
+    field_consumer consumer;
+    void *user;
+    field_filter filter;
+    void *filter_user;
+};
+
+static int netcdf_input_filter(const struct GRIB_FIELD *field, void *user) {
+    const struct NETCDF_INPUT *input = (const struct NETCDF_INPUT *) user;
+    struct GRIB_FIELD header = *field;
+
+    header.file = input->file;
+
+    return input->filter(&header, input->filter_user);
+}
+
+static void netcdf_input_consumer(const struct GRIB_FIELD *field, int worker, void *user) {
+    const struct NETCDF_INPUT *input = (const struct NETCDF_INPUT *) user;
+    struct GRIB_FIELD copy = *field;
+
+    copy.file = input->file;
+
+    if (input->consumer)
+        input->consumer(&copy, worker, input->user);
+}
+
+size_t grib_data_from_files(const char *const *fnames, size_t n_files, const struct DECODE_OPTIONS *options,
+                            field_consumer consumer, void *user, struct DECODE_STATS *stats) {
+    struct DECODE_SOURCE *sources = calloc(n_files + 1, sizeof(struct DECODE_SOURCE));
+    int *netcdf = calloc(n_files + 1, sizeof(int));
+    struct DECODE_STATS run = {0};
+
+    if (sources == NULL || netcdf == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for input files\n");
+        exit(EXIT_FAILURE);
+    }
+
+    double start = wall_time();
+
+    // netCDF files keep their position among the inputs, but hold no messages for the workers
+    for (size_t f = 0; f < n_files; f++) {
+        if ((netcdf[f] = is_netcdf_file(fnames[f])) == 0)
+            open_source(&sources[f], fnames[f], f, options);
+    }
+
+    decode_sources(sources, n_files, options, consumer, user, &run);
+
+    for (size_t f = 0; f < n_files; f++)
+        close_source(&sources[f]);
+
+    // the netCDF library is not thread-safe, so netCDF files are read one after the other
+    TRACE_BEGIN(netcdf_span, "read_netcdf_files");
+    for (size_t f = 0; f < n_files; f++) {
+        struct NETCDF_INPUT input = {
+            .file = f, .consumer = consumer, .user = user, .filter = options->filter,
+            .filter_user = options->filter_user
+        };
+        struct DECODE_OPTIONS wrapped = *options;
+        struct DECODE_STATS read = {0};
+
+        if (!netcdf[f])
+            continue;
+
+        if (options->filter) {
+            wrapped.filter = netcdf_input_filter;
+            wrapped.filter_user = &input;
+        }
+
+        netcdf_data_from_file(fnames[f], &wrapped, netcdf_input_consumer, &input, &read);
+
+        run.messages += read.messages;
+        run.bytes += read.bytes;
+        run.values += read.values;
+    }
+    TRACE_END(netcdf_span);
+
+    run.seconds = wall_time() - start;
+
+    if (stats)
+        *stats = run;
+
+    free(sources);
+    free(netcdf);
+
+    return run.messages;
+}
+
+size_t grib_data_from_file(const char *fname, const struct DECODE_OPTIONS *options, field_consumer consumer,
+                           void *user, struct DECODE_STATS *stats) {
+    return grib_data_from_files(&fname, 1, options, consumer, user, stats);
+}
+
+void print_decode_stats(const struct DECODE_STATS *stats) {
+    double seconds = stats->seconds > 0.0 ? stats->seconds : 1e-9;
+
+    printf("Decoded %zu messages (%zu values, %.3lf GB) in %.3lf s\n"
+           "Throughput: %.1lf messages/s, %.3lf GB/s\n",
+           stats->messages, stats->values, (double) stats->bytes * 1e-9, stats->seconds,
+           (double) stats->messages / seconds, (double) stats->bytes * 1e-9 / seconds);
+
+    if (stats->shared)
+        printf("Taken from shared memory: %zu messages\n", stats->shared);
+}
+
+/**
+ * @brief Point values extracted from a single message
+ */
+struct TABLE_ROW {
+    size_t file;
+    size_t index;
+    long param;
+    long date;
+    char short_name[16];
+    float *values;
+};
+
+/**
+ * @brief Interpolation weights of all grids encountered while building tables
+ */
+struct WEIGHT_CACHE {
+    const struct POINTS *points;
+    size_t n;
+    struct POINT_WEIGHTS **weights;
+    pthread_mutex_t lock;
+};
+
+/**
+ * @brief State shared by all workers while building daily tables
+ */
+struct DAILY_TABLES {
+    struct WEIGHT_CACHE cache;
+    const size_t *files;        ///< position among all inputs of each file passed to the decoding engine
+    size_t n_rows;
+    size_t capacity;
+    struct TABLE_ROW *rows;
+    pthread_mutex_t lock;
+};
+
+static void weight_cache_init(struct WEIGHT_CACHE *cache, const struct POINTS *points) {
+    cache->points = points;
+    cache->n = 0;
+    cache->weights = NULL;
+    pthread_mutex_init(&cache->lock, NULL);
+}
+
+static void weight_cache_destroy(struct WEIGHT_CACHE *cache) {
+    for (size_t i = 0; i < cache->n; i++) {
+        free_point_weights(cache->weights[i]);
+        free(cache->weights[i]);
+    }
+    free(cache->weights);
+    pthread_mutex_destroy(&cache->lock);
+}
+
+/**
+ * @brief Look up the interpolation weights for `grid`, computing them on first use.
+ * @return Pointer to weights which stay valid until the cache is destroyed
+ */
+static const struct POINT_WEIGHTS *weight_cache_get(struct WEIGHT_CACHE *cache, const struct GRID *grid) {
+    struct POINT_WEIGHTS *weights = NULL;
+
+    pthread_mutex_lock(&cache->lock);
+
+    for (size_t i = 0; i < cache->n; i++) {
+        if (grid_equal(&cache->weights[i]->grid, grid)) {
+            weights = cache->weights[i];
+            break;
+        }
+    }
+
+    if (weights == NULL) {
+        struct POINT_WEIGHTS **grown = realloc(cache->weights, (cache->n + 1) * sizeof(struct POINT_WEIGHTS *));
+        weights = calloc(1, sizeof(struct POINT_WEIGHTS));
+
+        if (grown == NULL || weights == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for interpolation weights\n");
+            exit(EXIT_FAILURE);
+        }
+
+        compute_point_weights(grid, cache->points, weights);
+        cache->weights = grown;
+        cache->weights[cache->n++] = weights;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+    return weights;
+}
+
+static void append_row(struct DAILY_TABLES *tables, struct TABLE_ROW row) {
+    pthread_mutex_lock(&tables->lock);
+
+    if (tables->n_rows == tables->capacity) {
+        tables->capacity = tables->capacity ? 2 * tables->capacity : 64;
+        if ((tables->rows = realloc(tables->rows, tables->capacity * sizeof(struct TABLE_ROW))) == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for table rows\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    tables->rows[tables->n_rows++] = row;
+
+    pthread_mutex_unlock(&tables->lock);
+}
+
+static void daily_tables_consumer(const struct GRIB_FIELD *field, int worker __attribute__((unused)), void *user) {
+    struct DAILY_TABLES *tables = (struct DAILY_TABLES *) user;
+    const struct POINT_WEIGHTS *weights = weight_cache_get(&tables->cache, &field->grid);
+    struct TABLE_ROW row = {
+        .file = tables->files[field->file], .index = field->index, .param = field->param, .date = field->date
+    };
+
+    if ((row.values = malloc(weights->n * sizeof(float))) == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for table row\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(row.short_name, field->short_name, sizeof(row.short_name));
+    gather_points(field->values, weights, row.values);
+
+    append_row(tables, row);
+}
+
+/**
+ * @brief Turn the time steps of a netCDF point series into table rows.
+ */
+static void netcdf_table_rows(const char *fname, size_t file, const struct POINTS *points,
+                              const struct DECODE_OPTIONS *options, struct DAILY_TABLES *tables) {
+    struct POINT_SERIES series;
+
+    netcdf_point_series(fname, points, options, &series, NULL);
+
+    for (size_t s = 0; s < series.n_times; s++) {
+        struct TABLE_ROW row = {
+            .file = file, .index = series.index[s], .param = series.param, .date = series.date[s]
+        };
+
+        if ((row.values = malloc(series.n_points * sizeof(float))) == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for table row\n");
+            exit(EXIT_FAILURE);
+        }
+
+        memcpy(row.short_name, series.short_name, sizeof(row.short_name));
+        memcpy(row.values, series.values + s * series.n_points, series.n_points * sizeof(float));
+
+        append_row(tables, row);
+    }
+
+    free_point_series(&series);
+}
+
+/**
+ * @brief Order rows by parameter, date and position in the input, so that rows of one table are adjacent and
+ * averaged in the same order regardless of which worker decoded them.
+ */
+static int compare_rows(const void *a, const void *b) {
+    const struct TABLE_ROW *x = (const struct TABLE_ROW *) a, *y = (const struct TABLE_ROW *) b;
+
+    if (x->param != y->param) return x->param < y->param ? -1 : 1;
+    if (x->date != y->date) return x->date < y->date ? -1 : 1;
+    if (x->file != y->file) return x->file < y->file ? -1 : 1;
+    if (x->index != y->index) return x->index < y->index ? -1 : 1;
+    return 0;
+}
+
+static void upper_case(char *dest, const char *src, size_t size) {
+    size_t i;
+
+    for (i = 0; src[i] != '\0' && i < size - 1; i++)
+        dest[i] = (char) toupper((unsigned char) src[i]);
+    dest[i] = '\0';
+}
+
+void table_path(char *dest, size_t size, const char *out_dir, const char *short_name, long date) {
+    char name[16];
+
+    upper_case(name, short_name, sizeof(name));
+
+    int status = snprintf(dest, size, "%s/%s_%04ld-%02ld-%02ld.txt", out_dir, name,
+                          date / 10000, (date / 100) % 100, date % 100);
+
+    if (status < 0 || (size_t) status >= size) {
+        fprintf(stderr, "Error: Failed to construct output file name\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Record of a table written by an earlier run
+ */
+struct TABLE_INDEX_ENTRY {
+    long param;
+    long date;
+    size_t n_points;        ///< number of points the table holds
+    uint64_t fingerprint;   ///< fingerprint of the coordinates of those points
+};
+
+/**
+ * @brief Tables written to an output directory, sorted by parameter and date
+ */
+struct TABLE_INDEX {
+    size_t n;
+    size_t capacity;
+    struct TABLE_INDEX_ENTRY *entries;
+};
+
+/**
+ * @brief Filter state of an incremental table build
+ */
+struct TABLE_FILTER {
+    const struct TABLE_INDEX *index;
+    size_t n_points;
+    const uint64_t *fingerprints;
+    size_t skipped;
+};
+
+static int compare_index_entries(const void *a, const void *b) {
+    const struct TABLE_INDEX_ENTRY *x = (const struct TABLE_INDEX_ENTRY *) a, *y = (const struct TABLE_INDEX_ENTRY *) b;
+
+    if (x->param != y->param) return x->param < y->param ? -1 : 1;
+    if (x->date != y->date) return x->date < y->date ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief Compute the FNV-1a fingerprint of the first `i` points for every `i` from 0 to `points->n`.
+ * @return Array of `points->n + 1` fingerprints. The caller is responsible for freeing it.
+ */
+static uint64_t *point_fingerprints(const struct POINTS *points) {
+    uint64_t *fingerprints = malloc((points->n + 1) * sizeof(uint64_t));
+    uint64_t hash = FNV1A_OFFSET_BASIS;
+
+    if (fingerprints == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for point fingerprints\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fingerprints[0] = hash;
+
+    for (size_t p = 0; p < points->n; p++) {
+        char coordinate[64];
+        int length = snprintf(coordinate, sizeof(coordinate), "%.4f %.4f;", points->lon[p], points->lat[p]);
+
+        hash = fnv1a(hash, coordinate, (size_t) length);
+        fingerprints[p + 1] = hash;
+    }
+
+    return fingerprints;
+}
+
+static void table_index_path(char *dest, size_t size, const char *out_dir) {
+    int status = snprintf(dest, size, "%s/%s", out_dir, "daily_tables.index");
+
+    if (status < 0 || (size_t) status >= size) {
+        fprintf(stderr, "Error: Failed to construct path of table index\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void load_table_index(const char *out_dir, struct TABLE_INDEX *index) {
+    char path[4096];
+    struct TABLE_INDEX_ENTRY entry;
+    unsigned long long fingerprint;
+
+    table_index_path(path, sizeof(path), out_dir);
+
+    FILE *f = fopen(path, "rt");
+
+    if (f == NULL)
+        return;
+
+    while (fscanf(f, "%ld %ld %zu %llx", &entry.param, &entry.date, &entry.n_points, &fingerprint) == 4) {
+        if (index->n == index->capacity) {
+            index->capacity = index->capacity ? 2 * index->capacity : 256;
+            index->entries = realloc(index->entries, index->capacity * sizeof(struct TABLE_INDEX_ENTRY));
+
+            if (index->entries == NULL) {
+                fprintf(stderr, "Error: Failed to allocate memory for table index\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        entry.fingerprint = (uint64_t) fingerprint;
+        index->entries[index->n++] = entry;
+    }
+
+    fclose(f);
+
+    qsort(index->entries, index->n, sizeof(struct TABLE_INDEX_ENTRY), compare_index_entries);
+}
+
+static void save_table_index(const char *out_dir, const struct TABLE_INDEX *index) {
+    char path[4096], tmp[4096 + 4];
+
+    table_index_path(path, sizeof(path), out_dir);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *f = fopen(tmp, "wt");
+
+    if (f == NULL) {
+        fprintf(stderr, "Error: Could not open file %s.\n", tmp);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < index->n; i++)
+        fprintf(f, "%ld %ld %zu %016llx\n", index->entries[i].param, index->entries[i].date,
+                index->entries[i].n_points, (unsigned long long) index->entries[i].fingerprint);
+
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        fprintf(stderr, "Error: Could not write table index %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static struct TABLE_INDEX_ENTRY *find_table(const struct TABLE_INDEX *index, long param, long date) {
+    struct TABLE_INDEX_ENTRY key = {.param = param, .date = date};
+
+    return bsearch(&key, index->entries, index->n, sizeof(struct TABLE_INDEX_ENTRY), compare_index_entries);
+}
+
+/**
+ * @brief Skip messages whose table already holds all requested points.
+ */
+static int table_filter(const struct GRIB_FIELD *field, void *user) {
+    struct TABLE_FILTER *filter = (struct TABLE_FILTER *) user;
+    const struct TABLE_INDEX_ENTRY *entry = find_table(filter->index, field->param, field->date);
+
+    if (entry && entry->n_points == filter->n_points && entry->fingerprint == filter->fingerprints[filter->n_points]) {
+        filter->skipped++;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Average the rows `first` to `last` (exclusive) point by point and write the points starting at
+ * `first_point` to a table. The table is appended to if `first_point` is not zero, and overwritten otherwise.
+ */
+static void write_daily_table(const char *out_dir, const struct POINTS *points, size_t first_point,
+                              const struct TABLE_ROW *first, const struct TABLE_ROW *last) {
+    char path[4096];
+
+    table_path(path, sizeof(path), out_dir, first->short_name, first->date);
+
+    FILE *f = fopen(path, first_point ? "at" : "wt");
+
+    if (f == NULL) {
+        fprintf(stderr, "Error: Could not open file %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t p = first_point; p < points->n; p++) {
+        double sum = 0.0;
+        size_t n = 0;
+
+        for (const struct TABLE_ROW *row = first; row != last; row++) {
+            if (!isnan(row->values[p])) {
+                sum += (double) row->values[p];
+                n++;
+            }
+        }
+
+        if (n)
+            fprintf(f, "%.4f %.4f %.6f CAMS\n", points->lon[p], points->lat[p], sum / (double) n);
+        else
+            fprintf(f, "%.4f %.4f %.6f TBD\n", points->lon[p], points->lat[p], 9999.0);
+    }
+
+    if (fclose(f) != 0) {
+        fprintf(stderr, "Error: Could not write table %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void build_daily_tables(const char *const *fnames, size_t n_files, const char *out_dir, const struct POINTS *points,
+                        const struct DECODE_OPTIONS *options) {
+    struct DAILY_TABLES tables = {0};
+    struct TABLE_INDEX index = {0};
+    struct DECODE_OPTIONS filtered = *options;
+    size_t n_tables = 0, n_appended = 0, n_new = 0, n_grib = 0;
+
+    const char **grib = malloc((n_files + 1) * sizeof(char *));
+    size_t *files = malloc((n_files + 1) * sizeof(size_t));
+
+    if (grib == NULL || files == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for input files\n");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t *fingerprints = point_fingerprints(points);
+    struct TABLE_FILTER filter = {.index = &index, .n_points = points->n, .fingerprints = fingerprints};
+
+    load_table_index(out_dir, &index);
+    filtered.filter = table_filter;
+    filtered.filter_user = &filter;
+
+    weight_cache_init(&tables.cache, points);
+    pthread_mutex_init(&tables.lock, NULL);
+    tables.files = files;
+
+    for (size_t f = 0; f < n_files; f++) {
+        if (is_netcdf_file(fnames[f])) {
+            netcdf_table_rows(fnames[f], f, points, &filtered, &tables);
+        } else {
+            grib[n_grib] = fnames[f];
+            files[n_grib++] = f;
+        }
+    }
+
+    // all GRIB files share one pool, so a large file doesn't hold up the others
+    if (n_grib)
+        grib_data_from_files(grib, n_grib, &filtered, daily_tables_consumer, &tables, NULL);
+
+    qsort(tables.rows, tables.n_rows, sizeof(struct TABLE_ROW), compare_rows);
+
+    for (size_t first = 0, last; first < tables.n_rows; first = last) {
+        for (last = first + 1; last < tables.n_rows &&
+                               tables.rows[last].param == tables.rows[first].param &&
+                               tables.rows[last].date == tables.rows[first].date; last++);
+
+        struct TABLE_INDEX_ENTRY *entry = find_table(&index, tables.rows[first].param, tables.rows[first].date);
+        size_t first_point = 0;
+
+        // rows of points known to the table are kept, as long as their coordinates didn't change
+        if (entry && entry->n_points < points->n && entry->fingerprint == fingerprints[entry->n_points]) {
+            first_point = entry->n_points;
+            n_appended++;
+        }
+
+        write_daily_table(out_dir, points, first_point, tables.rows + first, tables.rows + last);
+        n_tables++;
+
+        if (entry == NULL) {
+            if (index.n + n_new == index.capacity) {
+                index.capacity = index.capacity ? 2 * index.capacity : 256;
+                index.entries = realloc(index.entries, index.capacity * sizeof(struct TABLE_INDEX_ENTRY));
+
+                if (index.entries == NULL) {
+                    fprintf(stderr, "Error: Failed to allocate memory for table index\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            // appended behind the sorted entries, so lookups of later groups are unaffected
+            entry = &index.entries[index.n + n_new++];
+            entry->param = tables.rows[first].param;
+            entry->date = tables.rows[first].date;
+        }
+
+        entry->n_points = points->n;
+        entry->fingerprint = fingerprints[points->n];
+    }
+
+    index.n += n_new;
+    qsort(index.entries, index.n, sizeof(struct TABLE_INDEX_ENTRY), compare_index_entries);
+    save_table_index(out_dir, &index);
+
+    printf("Wrote %zu daily tables (%zu appended to) for %zu points from %zu messages, "
+           "skipped %zu messages of complete tables\n",
+           n_tables, n_appended, points->n, tables.n_rows, filter.skipped);
+
+    free(fingerprints);
+    free(index.entries);
+    free(grib);
+    free(files);
+
+    for (size_t i = 0; i < tables.n_rows; i++)
+        free(tables.rows[i].values);
+    free(tables.rows);
+
+    pthread_mutex_destroy(&tables.lock);
+    weight_cache_destroy(&tables.cache);
+}
+
+/**
+ * @brief Interpolate every decoded message and throw the result away.
+ */
+static void benchmark_consumer(const struct GRIB_FIELD *field, int worker, void *user) {
+    struct WEIGHT_CACHE *cache = (struct WEIGHT_CACHE *) user;
+    const struct POINT_WEIGHTS *weights = weight_cache_get(cache, &field->grid);
+    float *values = malloc(weights->n * sizeof(float));
+
+    if (values == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for point values of worker %d\n", worker);
+        exit(EXIT_FAILURE);
+    }
+
+    gather_points(field->values, weights, values);
+    free(values);
+}
+
+void benchmark_point_extraction(const char *const *fnames, size_t n_files, const struct POINTS *points,
+                                const struct DECODE_OPTIONS *options) {
+    struct DECODE_STATS stats;
+    struct WEIGHT_CACHE cache;
+    size_t n_grib = 0;
+
+    const char **grib = malloc((n_files + 1) * sizeof(char *));
+
+    if (grib == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for input files\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t f = 0; f < n_files; f++) {
+        if (!is_netcdf_file(fnames[f])) {
+            grib[n_grib++] = fnames[f];
+            continue;
+        }
+
+        struct POINT_SERIES series;
+
+        netcdf_point_series(fnames[f], points, options, &series, &stats);
+        free_point_series(&series);
+
+        printf("netCDF point extraction from %s: %zu time steps at %zu points, %zu cells read from %.3lf MB of chunks "
+               "in %.3lf s\n", fnames[f], stats.messages, points->n, stats.values, (double) stats.bytes * 1e-6,
+               stats.seconds);
+    }
+
+    if (n_grib) {
+        weight_cache_init(&cache, points);
+        grib_data_from_files(grib, n_grib, options, benchmark_consumer, &cache, &stats);
+        weight_cache_destroy(&cache);
+
+        printf("GRIB point extraction from %zu files: %zu messages at %zu points, %zu values decoded from %.3lf MB "
+               "in %.3lf s\n", n_grib, stats.messages, points->n, stats.values, (double) stats.bytes * 1e-6,
+               stats.seconds);
+    }
+
+    free(grib);
+}
+
+/**
+ * @brief State shared by all workers while exporting GeoTIFFs
+ */
+struct GTIFF_EXPORT {
+    const char *out_dir;
+    char **creation_options;
+    pthread_mutex_t lock;
+    size_t n_files;
+};
+
+static void set_metadata_long(GDALDatasetH dataset, const char *key, long value) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%ld", value);
+    GDALSetMetadataItem(dataset, key, buffer, NULL);
+}
+
+/**
+ * @brief Write north-up values with the header of `field` as Cloud-Optimized GeoTIFF to `path`.
+ */
+static void write_raster(struct GTIFF_EXPORT *export, const struct GRIB_FIELD *field, const float *values, long width,
+                         long height, const double geo_transform[6], const char *projection, const char *path) {
+    GDALDatasetH memory = GDALCreate(GDALGetDriverByName("MEM"), "", (int) width, (int) height, 1, GDT_Float32, NULL);
+
+    if (memory == NULL) {
+        fprintf(stderr, "Error: Failed to create in-memory dataset for %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    GDALRasterBandH band = GDALGetRasterBand(memory, 1);
+
+    GDALSetGeoTransform(memory, (double *) geo_transform);
+    GDALSetProjection(memory, projection);
+    GDALSetRasterNoDataValue(band, NAN);
+    GDALSetDescription(band, field->short_name);
+    set_metadata_long(memory, "GRIB_PARAM_ID", field->param);
+    set_metadata_long(memory, "GRIB_DATA_DATE", field->data_date);
+    set_metadata_long(memory, "GRIB_DATA_TIME", field->data_time);
+    set_metadata_long(memory, "GRIB_STEP", field->step);
+    set_metadata_long(memory, "GRIB_VALIDITY_DATE", field->date);
+    set_metadata_long(memory, "GRIB_VALIDITY_TIME", field->time);
+
+    if (GDALRasterIO(band, GF_Write, 0, 0, (int) width, (int) height, (void *) values, (int) width, (int) height,
+                     GDT_Float32, 0, 0) != CE_None) {
+        fprintf(stderr, "Error: Failed to write values for %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    GDALDatasetH cog = GDALCreateCopy(GDALGetDriverByName("COG"), path, memory, 0, export->creation_options,
+                                      NULL, NULL);
+
+    if (cog == NULL) {
+        fprintf(stderr, "Error: Failed to write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    GDALClose(cog);
+    GDALClose(memory);
+
+    pthread_mutex_lock(&export->lock);
+    export->n_files++;
+    pthread_mutex_unlock(&export->lock);
+}
+
+/**
+ * @brief Write a field as Cloud-Optimized GeoTIFF to `path`.
+ */
+static void write_gtiff(struct GTIFF_EXPORT *export, const struct GRIB_FIELD *field, const char *path) {
+    const struct GRID *grid = &field->grid;
+    float *north_up;
+
+    if ((north_up = malloc((size_t) grid->ni * (size_t) grid->nj * sizeof(float))) == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for GeoTIFF export\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // GeoTIFFs are written north-up and west to east, regardless of the scanning mode of the GRIB message
+    for (long j = 0; j < grid->nj; j++) {
+        long row = grid->d_lat > 0.0 ? grid->nj - 1 - j : j;
+        for (long i = 0; i < grid->ni; i++) {
+            long col = grid->d_lon < 0.0 ? grid->ni - 1 - i : i;
+            north_up[j * grid->ni + i] = field->values[row * grid->ni + col];
+        }
+    }
+
+    double west = grid->d_lon < 0.0 ? grid->lon_first + (double) (grid->ni - 1) * grid->d_lon : grid->lon_first;
+    double north = grid->d_lat > 0.0 ? grid->lat_first + (double) (grid->nj - 1) * grid->d_lat : grid->lat_first;
+    double geo_transform[6] = {
+        west - 0.5 * fabs(grid->d_lon), fabs(grid->d_lon), 0.0,
+        north + 0.5 * fabs(grid->d_lat), 0.0, -fabs(grid->d_lat)
+    };
+
+    write_raster(export, field, north_up, grid->ni, grid->nj, geo_transform, SRS_WKT_WGS84_LAT_LONG, path);
+
+    free(north_up);
+}
+
+static void gtiff_consumer(const struct GRIB_FIELD *field, int worker __attribute__((unused)), void *user) {
+    struct GTIFF_EXPORT *export = (struct GTIFF_EXPORT *) user;
+    char path[4096], name[16];
+
+    upper_case(name, field->short_name, sizeof(name));
+
+    int status = snprintf(path, sizeof(path), "%s/%s_%08ld_%04ld_%03ld.tif", export->out_dir, name, field->date,
+                          field->time, field->step);
+
+    if (status < 0 || (size_t) status >= sizeof(path)) {
+        fprintf(stderr, "Error: Failed to construct output file name\n");
+        exit(EXIT_FAILURE);
+    }
+
+    write_gtiff(export, field, path);
+}
+
+static void gtiff_export_init(struct GTIFF_EXPORT *export, const char *out_dir, int compression_threads) {
+    char threads[16];
+
+    *export = (struct GTIFF_EXPORT) {.out_dir = out_dir, .creation_options = NULL, .n_files = 0};
+
+    GDALAllRegister();
+
+    if (GDALGetDriverByName("COG") == NULL || GDALGetDriverByName("MEM") == NULL) {
+        fprintf(stderr, "Error: GDAL was built without COG or MEM driver\n");
+        exit(EXIT_FAILURE);
+    }
+
+    snprintf(threads, sizeof(threads), "%d", compression_threads > 0 ? compression_threads : 1);
+
+    export->creation_options = CSLSetNameValue(export->creation_options, "COMPRESS", "DEFLATE");
+    export->creation_options = CSLSetNameValue(export->creation_options, "PREDICTOR", "YES");
+    export->creation_options = CSLSetNameValue(export->creation_options, "BLOCKSIZE", "256");
+    export->creation_options = CSLSetNameValue(export->creation_options, "OVERVIEWS", "AUTO");
+    export->creation_options = CSLSetNameValue(export->creation_options, "OVERVIEW_RESAMPLING", "AVERAGE");
+    export->creation_options = CSLSetNameValue(export->creation_options, "BIGTIFF", "IF_SAFER");
+    export->creation_options = CSLSetNameValue(export->creation_options, "NUM_THREADS", threads);
+
+    pthread_mutex_init(&export->lock, NULL);
+}
+
+static void gtiff_export_destroy(struct GTIFF_EXPORT *export) {
+    pthread_mutex_destroy(&export->lock);
+    CSLDestroy(export->creation_options);
+}
+
+size_t export_data_to_gtiff(const char *const *fnames, size_t n_files, const char *out_dir,
+                            const struct DECODE_OPTIONS *options, int compression_threads) {
+    struct GTIFF_EXPORT export;
+    struct DECODE_STATS stats;
+
+    gtiff_export_init(&export, out_dir, compression_threads);
+
+    grib_data_from_files(fnames, n_files, options, gtiff_consumer, &export, &stats);
+
+    printf("Wrote %zu GeoTIFFs in %.3lf s (%.1lf files/h)\n", export.n_files, stats.seconds,
+           stats.seconds > 0.0 ? (double) export.n_files / stats.seconds * 3600.0 : 0.0);
+
+    gtiff_export_destroy(&export);
+
+    return export.n_files;
+}
+
+/**
+ * @brief Warp maps of all tiles on one grid
+ */
+struct WARP_SET {
+    struct GRID grid;
+    struct WARP_MAP *maps;      ///< NULL while a worker loads or computes them
+};
+
+/**
+ * @brief State shared by all workers while exporting datacube tiles
+ */
+struct DATACUBE_EXPORT {
+    struct GTIFF_EXPORT gtiff;
+    struct DATACUBE cube;
+    struct TILE *tiles;
+    size_t n_tiles;
+    long size;                  ///< number of pixels along each edge of a tile
+    const char *warp_dir;
+    size_t n_sets;
+    struct WARP_SET *sets;
+    size_t n_computed;          ///< number of warp maps computed instead of read from `warp_dir`
+    pthread_mutex_t lock;       ///< guards `sets`, `n_sets` and `n_computed`
+    pthread_cond_t published;   ///< broadcast whenever the maps of a set become available
+};
+
+/**
+ * @brief Look up the warp maps of all tiles for `grid`, loading or computing them on first use.
+ * @return Pointer to `n_tiles` maps which stay valid until the export is finished
+ */
+static const struct WARP_MAP *warp_set_get(struct DATACUBE_EXPORT *export, const struct GRID *grid) {
+    struct WARP_MAP *maps;
+    size_t i = 0;
+
+    pthread_mutex_lock(&export->lock);
+
+    while (i < export->n_sets && !grid_equal(&export->sets[i].grid, grid))
+        i++;
+
+    if (i < export->n_sets) {
+        // another worker may still be loading or computing the maps of this grid
+        while ((maps = export->sets[i].maps) == NULL)
+            pthread_cond_wait(&export->published, &export->lock);
+
+        pthread_mutex_unlock(&export->lock);
+
+        return maps;
+    }
+
+    struct WARP_SET *grown = realloc(export->sets, (export->n_sets + 1) * sizeof(struct WARP_SET));
+
+    if (grown == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for warp maps\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // claim the grid, so other workers wait for its maps instead of computing them, too
+    export->sets = grown;
+    export->sets[export->n_sets++] = (struct WARP_SET) {.grid = *grid, .maps = NULL};
+
+    pthread_mutex_unlock(&export->lock);
+
+    // maps are computed without holding the lock, workers on grids which are already mapped carry on meanwhile
+    if ((maps = calloc(export->n_tiles, sizeof(struct WARP_MAP))) == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for warp maps\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t n_computed = warp_maps_for_grid(&export->cube, export->tiles, export->n_tiles, grid, export->warp_dir, maps);
+
+    pthread_mutex_lock(&export->lock);
+    export->sets[i].maps = maps;
+    export->n_computed += n_computed;
+    pthread_cond_broadcast(&export->published);
+    pthread_mutex_unlock(&export->lock);
+
+    return maps;
+}
+
+static void datacube_consumer(const struct GRIB_FIELD *field, int worker __attribute__((unused)), void *user) {
+    struct DATACUBE_EXPORT *export = (struct DATACUBE_EXPORT *) user;
+    const struct WARP_MAP *maps = warp_set_get(export, &field->grid);
+    size_t n = (size_t) export->size * (size_t) export->size;
+    char path[4096], name[16], tile[32];
+    double geo_transform[6];
+    float *values;
+
+    if ((values = malloc(n * sizeof(float))) == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for datacube export\n");
+        exit(EXIT_FAILURE);
+    }
+
+    upper_case(name, field->short_name, sizeof(name));
+
+    for (size_t t = 0; t < export->n_tiles; t++) {
+        size_t p = 0;
+
+        apply_warp_map(field->values, &maps[t], values);
+
+        while (p < n && isnan(values[p]))
+            p++;
+
+        if (p == n)
+            continue;
+
+        tile_name(tile, sizeof(tile), export->tiles[t]);
+
+        int status = snprintf(path, sizeof(path), "%s/%s/%s_%08ld_%04ld_%03ld.tif", export->gtiff.out_dir, tile, name,
+                              field->date, field->time, field->step);
+
+        if (status < 0 || (size_t) status >= sizeof(path)) {
+            fprintf(stderr, "Error: Failed to construct output file name\n");
+            exit(EXIT_FAILURE);
+        }
+
+        tile_geo_transform(&export->cube, export->tiles[t], geo_transform);
+        write_raster(&export->gtiff, field, values, export->size, export->size, geo_transform,
+                     export->cube.projection, path);
+    }
+
+    free(values);
+}
+
+size_t export_datacube_tiles(const char *const *fnames, size_t n_files, const char *out_dir, const char *tile_file,
+                             double resolution, const char *warp_dir, const struct DECODE_OPTIONS *options,
+                             int compression_threads) {
+    struct DATACUBE_EXPORT export = {0};
+    struct DECODE_STATS stats;
+    char path[4096], tile[32];
+
+    read_datacube(out_dir, resolution, &export.cube);
+    export.tiles = read_tiles(tile_file, &export.n_tiles);
+    export.size = lround(export.cube.tile_size / resolution);
+    export.warp_dir = warp_dir;
+
+    for (size_t t = 0; t < export.n_tiles; t++) {
+        tile_name(tile, sizeof(tile), export.tiles[t]);
+        snprintf(path, sizeof(path), "%s/%s", out_dir, tile);
+
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "Error: Could not create tile directory %s\n", path);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    gtiff_export_init(&export.gtiff, out_dir, compression_threads);
+    pthread_mutex_init(&export.lock, NULL);
+    pthread_cond_init(&export.published, NULL);
+
+    grib_data_from_files(fnames, n_files, options, datacube_consumer, &export, &stats);
+
+    printf("Computed %zu and loaded %zu warp maps of %zu tiles on %zu grids\n", export.n_computed,
+           export.n_sets * export.n_tiles - export.n_computed, export.n_tiles, export.n_sets);
+    printf("Wrote %zu GeoTIFFs in %.3lf s (%.1lf files/h)\n", export.gtiff.n_files, stats.seconds,
+           stats.seconds > 0.0 ? (double) export.gtiff.n_files / stats.seconds * 3600.0 : 0.0);
+
+    for (size_t i = 0; i < export.n_sets; i++) {
+        for (size_t t = 0; t < export.n_tiles; t++)
+            free_warp_map(&export.sets[i].maps[t]);
+        free(export.sets[i].maps);
+    }
+
+    free(export.sets);
+    free(export.tiles);
+    free_datacube(&export.cube);
+    pthread_mutex_destroy(&export.lock);
+    pthread_cond_destroy(&export.published);
+    gtiff_export_destroy(&export.gtiff);
+
+    return export.gtiff.n_files;
+}
+
+/**
+ * @brief Parse between `min` and `max` decimal digits, advancing `text` past them.
+ * @return 0 on success, 1 if there are fewer than `min` or more than `max` digits
+ */
+static int parse_digits(const char **text, int min, int max, long *value) {
+    int n = 0;
+
+    for (*value = 0; n < max && isdigit((unsigned char) **text); n++, (*text)++)
+        *value = *value * 10 + (**text - '0');
+
+    return n < min || isdigit((unsigned char) **text);
+}
+
+/**
+ * @brief Parse a date as YYYY-MM-DD or YYYYMMDD followed by a time as HH:MM or HHMM.
+ * @details The whole of `text` but trailing whitespace must be consumed, and month, day, hour and minute must exist.
+ * @return 0 on success, 1 if `text` isn't a valid date and time
+ */
+static int parse_date_time(const char *text, long *date, long *time) {
+    static const int days_in_month[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    const char *start = text;
+    long year, month, day, hour, minute;
+
+    if (parse_digits(&text, 4, 8, &year))
+        return 1;
+
+    if (text - start == 4 && *text == '-') {
+        text++;
+        if (parse_digits(&text, 2, 2, &month) || *text++ != '-' || parse_digits(&text, 2, 2, &day))
+            return 1;
+    } else if (text - start == 8) {
+        month = (year / 100) % 100;
+        day = year % 100;
+        year /= 10000;
+    } else {
+        return 1;
+    }
+
+    if (!isspace((unsigned char) *text))
+        return 1;
+    while (isspace((unsigned char) *text))
+        text++;
+
+    if (parse_digits(&text, 1, 4, &hour))
+        return 1;
+
+    if (*text == ':') {
+        text++;
+        if (parse_digits(&text, 2, 2, &minute))
+            return 1;
+    } else {
+        minute = hour % 100;
+        hour /= 100;
+    }
+
+    while (isspace((unsigned char) *text))
+        text++;
+
+    if (*text != '\0' || month < 1 || month > 12 || day < 1 || day > days_in_month[month - 1] ||
+        (month == 2 && day == 29 && (year % 4 != 0 || (year % 100 == 0 && year % 400 != 0))) || hour > 23 ||
+        minute > 59)
+        return 1;
+
+    *date = year * 10000 + month * 100 + day;
+    *time = hour * 100 + minute;
+
+    return 0;
+}
+
+struct POINT_QUERY *read_queries(const char *fname, size_t *n_queries) {
+    char line[256];
+    size_t capacity = 64, n = 0;
+    struct POINT_QUERY *queries = malloc(capacity * sizeof(struct POINT_QUERY));
+
+    FILE *f = fopen(fname, "rt");
+
+    if (f == NULL) {
+        fprintf(stderr, "Error: Could not open file %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t line_number = 1; fgets(line, sizeof(line), f) != NULL; line_number++) {
+        struct POINT_QUERY query;
+        int offset = 0;
+
+        if (n == capacity) {
+            capacity *= 2;
+            queries = realloc(queries, capacity * sizeof(struct POINT_QUERY));
+        }
+
+        if (queries == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory while parsing line %s\n", line);
+            exit(EXIT_FAILURE);
+        }
+
+        if (strspn(line, " \t\r\n") == strlen(line))
+            continue;
+
+        if (sscanf(line, "%lf %lf %n", &query.lon, &query.lat, &offset) != 2 ||
+            parse_date_time(line + offset, &query.date, &query.time)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            fprintf(stderr, "Error: Invalid query on line %zu of %s: %s\n", line_number, fname, line);
+            exit(EXIT_FAILURE);
+        }
+
+        queries[n++] = query;
+    }
+
+    fclose(f);
+
+    if (n == 0) {
+        fprintf(stderr, "Error: No queries found in %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    *n_queries = n;
+
+    return queries;
+}
+
+/**
+ * @brief Convert a date as YYYYMMDD and a time as HHMM to minutes since 1970-01-01 00:00.
+ */
+static long minutes_since_epoch(long date, long time) {
+    long y = date / 10000, m = (date / 100) % 100, d = date % 100;
+
+    // days since 1970-01-01 in the proleptic Gregorian calendar
+    y -= m <= 2;
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yoe = y - era * 400;
+    long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    long days = era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+
+    return days * 1440 + (time / 100) * 60 + time % 100;
+}
+
+/**
+ * @brief Field available to answer point queries
+ */
+struct QUERY_FIELD {
+    size_t file;            ///< position of the file in the list of inputs
+    size_t index;           ///< position of the field within its file
+    long minutes;           ///< validity time in minutes since 1970-01-01
+    long date;
+    long time;
+    long param;
+    char short_name[16];
+};
+
+/**
+ * @brief Headers collected while scanning the inputs
+ */
+struct QUERY_FIELD_LIST {
+    size_t n;
+    size_t capacity;
+    struct QUERY_FIELD *fields;
+};
+
+/**
+ * @brief Query sorted by time
+ */
+struct SORTED_QUERY {
+    long minutes;
+    size_t query;
+};
+
+/**
+ * @brief Field value needed by an answered query
+ */
+struct QUERY_REQUEST {
+    size_t field;           ///< position of the field in the list of fields sorted by time
+    size_t slot;            ///< position of the query among the answered queries
+    int later;              ///< set if the field is the later one of a pair interpolated in time
+};
+
+/**
+ * @brief State shared by all workers while answering queries
+ * @details The requests of a field are stored contiguously in `lon`, `lat`, `slot` and `later`, starting at
+ * `first[field_slot(base, n_files, field)]`.
+ */
+struct QUERY_STATE {
+    size_t n_files;
+    const size_t *base;         ///< first slot of every input, see `field_slots`
+    size_t *first;
+    size_t *count;
+    const double *lon;
+    const double *lat;
+    const size_t *slot;
+    const int *later;
+    float *earlier_values;      ///< value of the earlier (or only) field per answered query
+    float *later_values;        ///< value of the later field per answered query
+};
+
+/**
+ * @brief Record the header of every message, without decoding any of them.
+ */
+static int list_query_fields(const struct GRIB_FIELD *field, void *user) {
+    struct QUERY_FIELD_LIST *list = (struct QUERY_FIELD_LIST *) user;
+
+    if (list->n == list->capacity) {
+        list->capacity = list->capacity ? 2 * list->capacity : 256;
+        if ((list->fields = realloc(list->fields, list->capacity * sizeof(struct QUERY_FIELD))) == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for field headers\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct QUERY_FIELD *entry = &list->fields[list->n++];
+    entry->file = field->file;
+    entry->index = field->index;
+    entry->minutes = minutes_since_epoch(field->date, field->time);
+    entry->date = field->date;
+    entry->time = field->time;
+    entry->param = field->param;
+    memcpy(entry->short_name, field->short_name, sizeof(entry->short_name));
+
+    return 0;
+}
+
+static int compare_query_fields(const void *a, const void *b) {
+    const struct QUERY_FIELD *x = (const struct QUERY_FIELD *) a, *y = (const struct QUERY_FIELD *) b;
+
+    if (x->minutes != y->minutes) return x->minutes < y->minutes ? -1 : 1;
+    if (x->file != y->file) return x->file < y->file ? -1 : 1;
+    if (x->index != y->index) return x->index < y->index ? -1 : 1;
+    return 0;
+}
+
+static int compare_sorted_queries(const void *a, const void *b) {
+    const struct SORTED_QUERY *x = (const struct SORTED_QUERY *) a, *y = (const struct SORTED_QUERY *) b;
+
+    if (x->minutes != y->minutes) return x->minutes < y->minutes ? -1 : 1;
+    if (x->query != y->query) return x->query < y->query ? -1 : 1;
+    return 0;
+}
+
+static int compare_query_requests(const void *a, const void *b) {
+    const struct QUERY_REQUEST *x = (const struct QUERY_REQUEST *) a, *y = (const struct QUERY_REQUEST *) b;
+
+    if (x->field != y->field) return x->field < y->field ? -1 : 1;
+    if (x->slot != y->slot) return x->slot < y->slot ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief Scan the headers of all inputs and sort the fields of the selected parameter by time.
+ * @return Number of fields in `list->fields`
+ */
+static size_t list_fields_by_time(const char *const *fnames, size_t n_files, const char *short_name,
+                                  const struct DECODE_OPTIONS *options, struct QUERY_FIELD_LIST *list) {
+    struct DECODE_OPTIONS scan = *options;
+    size_t n_fields = 0;
+
+    memset(list, 0, sizeof(struct QUERY_FIELD_LIST));
+    scan.filter = list_query_fields;
+    scan.filter_user = list;
+
+    grib_data_from_files(fnames, n_files, &scan, NULL, NULL, NULL);
+
+    for (size_t i = 0; i < list->n; i++) {
+        if (short_name && strcmp(list->fields[i].short_name, short_name) != 0)
+            continue;
+
+        if (short_name == NULL && list->fields[i].param != list->fields[0].param) {
+            fprintf(stderr, "Error: Inputs hold more than one parameter, select one by its short name\n");
+            exit(EXIT_FAILURE);
+        }
+
+        list->fields[n_fields++] = list->fields[i];
+    }
+
+    qsort(list->fields, n_fields, sizeof(struct QUERY_FIELD), compare_query_fields);
+
+    return n_fields;
+}
+
+/**
+ * @brief Number the messages of all inputs consecutively, so that state kept per message can be held in one array.
+ * @details Only messages up to the last listed field of each file are numbered.
+ * @return Array of `n_files + 1` entries, message `index` of file `file` having slot `base[file] + index`. The last
+ * entry is the number of slots. The caller is responsible for freeing it.
+ */
+static size_t *field_slots(const struct QUERY_FIELD *fields, size_t n_fields, size_t n_files) {
+    size_t *base = calloc(n_files + 1, sizeof(size_t));
+
+    if (base == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for field slots\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < n_fields; i++)
+        if (fields[i].index + 1 > base[fields[i].file + 1])
+            base[fields[i].file + 1] = fields[i].index + 1;
+
+    for (size_t f = 0; f < n_files; f++)
+        base[f + 1] += base[f];
+
+    return base;
+}
+
+/**
+ * @brief Look up the slot of a message, see `field_slots`.
+ * @return Slot of the message, `base[n_files]` if it has none
+ */
+static size_t field_slot(const size_t *base, size_t n_files, const struct GRIB_FIELD *field) {
+    if (field->file >= n_files || base[field->file] + field->index >= base[field->file + 1])
+        return base[n_files];
+
+    return base[field->file] + field->index;
+}
+
+/**
+ * @brief Find the fields to take the value at `minutes` from.
+ * @details Without interpolation in time, `earlier` is set to the nearest field and `later` to the same field. With
+ * interpolation, `earlier` and `later` enclose `minutes`; times before the first or after the last field, and times of
+ * a field, are answered by a single field. `fields` must be sorted by time, and `*cursor` must not decrease between
+ * calls, i.e. the times passed in must be sorted, too.
+ * @return 0 if fields were found within `tolerance`, 1 otherwise
+ */
+static int bracket_fields(const struct QUERY_FIELD *fields, size_t n_fields, size_t *cursor, long minutes, int linear,
+                          long tolerance, size_t *earlier, size_t *later, float *weight) {
+    size_t f = *cursor;
+
+    if (n_fields == 0)
+        return 1;
+
+    while (f + 1 < n_fields && fields[f + 1].minutes <= minutes)
+        f++;
+
+    *cursor = f;
+    *weight = 0.0f;
+
+    if (linear && fields[f].minutes < minutes && f + 1 < n_fields) {
+        *earlier = f;
+        *later = f + 1;
+        *weight = (float) (minutes - fields[f].minutes) / (float) (fields[f + 1].minutes - fields[f].minutes);
+    } else {
+        *earlier = f;
+        if (f + 1 < n_fields && labs(fields[f + 1].minutes - minutes) < labs(fields[f].minutes - minutes))
+            *earlier = f + 1;
+        *later = *earlier;
+    }
+
+    if (tolerance >= 0 && (labs(fields[*earlier].minutes - minutes) > tolerance ||
+                           labs(fields[*later].minutes - minutes) > tolerance))
+        return 1;
+
+    return 0;
+}
+
+static int query_filter(const struct GRIB_FIELD *field, void *user) {
+    const struct QUERY_STATE *state = (const struct QUERY_STATE *) user;
+    size_t slot = field_slot(state->base, state->n_files, field);
+
+    return slot < state->base[state->n_files] && state->count[slot] > 0;
+}
+
+static void query_consumer(const struct GRIB_FIELD *field, int worker __attribute__((unused)), void *user) {
+    const struct QUERY_STATE *state = (const struct QUERY_STATE *) user;
+    size_t slot = field_slot(state->base, state->n_files, field);
+    size_t first = state->first[slot], n = state->count[slot];
+    struct POINTS points = {.n = n, .lon = (double *) state->lon + first, .lat = (double *) state->lat + first};
+    struct POINT_WEIGHTS weights;
+    float *values = malloc(n * sizeof(float));
+
+    if (values == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for query answers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    compute_point_weights(&field->grid, &points, &weights);
+    gather_points(field->values, &weights, values);
+
+    // every field answers its own requests, no synchronization needed
+    for (size_t k = 0; k < n; k++) {
+        if (state->later[first + k])
+            state->later_values[state->slot[first + k]] = values[k];
+        else
+            state->earlier_values[state->slot[first + k]] = values[k];
+    }
+
+    free_point_weights(&weights);
+    free(values);
+}
+
+size_t query_points(const char *const *fnames, size_t n_files, const struct POINT_QUERY *queries, size_t n_queries,
+                    const char *short_name, long tolerance, int linear, const struct DECODE_OPTIONS *options,
+                    struct QUERY_ANSWER *answers) {
+    struct QUERY_FIELD_LIST list;
+    size_t n_answered = 0, n_requests = 0;
+
+    size_t n_fields = list_fields_by_time(fnames, n_files, short_name, options, &list);
+
+    struct SORTED_QUERY *sorted = malloc((n_queries + 1) * sizeof(struct SORTED_QUERY));
+    struct QUERY_REQUEST *requests = malloc((2 * n_queries + 1) * sizeof(struct QUERY_REQUEST));
+    size_t *query = malloc((n_queries + 1) * sizeof(size_t));
+    size_t *earlier = malloc((n_queries + 1) * sizeof(size_t));
+    size_t *later = malloc((n_queries + 1) * sizeof(size_t));
+    float *weight = malloc((n_queries + 1) * sizeof(float));
+    float *earlier_values = malloc((n_queries + 1) * sizeof(float));
+    float *later_values = malloc((n_queries + 1) * sizeof(float));
+    double *lon = malloc((2 * n_queries + 1) * sizeof(double));
+    double *lat = malloc((2 * n_queries + 1) * sizeof(double));
+    size_t *slot = malloc((2 * n_queries + 1) * sizeof(size_t));
+    int *is_later = malloc((2 * n_queries + 1) * sizeof(int));
+
+    if (sorted == NULL || requests == NULL || query == NULL || earlier == NULL || later == NULL || weight == NULL ||
+        earlier_values == NULL || later_values == NULL || lon == NULL || lat == NULL || slot == NULL ||
+        is_later == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for queries\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t q = 0; q < n_queries; q++) {
+        sorted[q] = (struct SORTED_QUERY) {.minutes = minutes_since_epoch(queries[q].date, queries[q].time), .query = q};
+        answers[q] = (struct QUERY_ANSWER) {.value = NAN};
+    }
+
+    qsort(sorted, n_queries, sizeof(struct SORTED_QUERY), compare_sorted_queries);
+
+    // both lists are sorted by time, so the enclosing fields are found by walking them side by side
+    for (size_t q = 0, cursor = 0; q < n_queries; q++) {
+        size_t s = n_answered;
+
+        if (bracket_fields(list.fields, n_fields, &cursor, sorted[q].minutes, linear, tolerance, &earlier[s],
+                           &later[s], &weight[s]))
+            continue;
+
+        query[s] = sorted[q].query;
+        requests[n_requests++] = (struct QUERY_REQUEST) {.field = earlier[s], .slot = s, .later = 0};
+        if (later[s] != earlier[s])
+            requests[n_requests++] = (struct QUERY_REQUEST) {.field = later[s], .slot = s, .later = 1};
+        n_answered++;
+    }
+
+    qsort(requests, n_requests, sizeof(struct QUERY_REQUEST), compare_query_requests);
+
+    for (size_t r = 0; r < n_requests; r++) {
+        const struct POINT_QUERY *q = &queries[query[requests[r].slot]];
+        lon[r] = q->lon;
+        lat[r] = q->lat;
+        slot[r] = requests[r].slot;
+        is_later[r] = requests[r].later;
+    }
+
+    struct QUERY_STATE state = {
+        .n_files = n_files, .base = field_slots(list.fields, n_fields, n_files), .lon = lon, .lat = lat,
+        .slot = slot, .later = is_later, .earlier_values = earlier_values, .later_values = later_values
+    };
+    struct DECODE_OPTIONS selected = *options;
+
+    state.first = calloc(state.base[n_files] + 1, sizeof(size_t));
+    state.count = calloc(state.base[n_files] + 1, sizeof(size_t));
+
+    if (state.first == NULL || state.count == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for queries\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t first = 0, last; first < n_requests; first = last) {
+        for (last = first + 1; last < n_requests && requests[last].field == requests[first].field; last++);
+
+        const struct QUERY_FIELD *field = &list.fields[requests[first].field];
+        size_t s = state.base[field->file] + field->index;
+
+        state.first[s] = first;
+        state.count[s] = last - first;
+    }
+
+    // each field with requests is decoded once, all of its requests are interpolated together
+    if (n_requests) {
+        selected.filter = query_filter;
+        selected.filter_user = &state;
+        grib_data_from_files(fnames, n_files, &selected, query_consumer, &state, NULL);
+    }
+
+    free((size_t *) state.base);
+    free(state.first);
+    free(state.count);
+
+    for (size_t s = 0; s < n_answered; s++)
+        if (later[s] == earlier[s])
+            later_values[s] = earlier_values[s];
+
+    lerp_points(earlier_values, later_values, weight, n_answered, earlier_values);
+
+    for (size_t s = 0; s < n_answered; s++) {
+        const struct QUERY_FIELD *a = &list.fields[earlier[s]], *b = &list.fields[later[s]];
+
+        answers[query[s]] = (struct QUERY_ANSWER) {
+            .value = earlier_values[s], .date = a->date, .time = a->time,
+            .later_date = b->date, .later_time = b->time, .weight = weight[s]
+        };
+    }
+
+    free(list.fields);
+    free(sorted);
+    free(requests);
+    free(query);
+    free(earlier);
+    free(later);
+    free(weight);
+    free(earlier_values);
+    free(later_values);
+    free(lon);
+    free(lat);
+    free(slot);
+    free(is_later);
+
+    return n_answered;
+}
+
+void answer_query_file(const char *const *fnames, size_t n_files, const char *query_file, const char *out_dir,
+                       int linear, const struct DECODE_OPTIONS *options) {
+    char path[4096];
+    size_t n_queries;
+
+    struct POINT_QUERY *queries = read_queries(query_file, &n_queries);
+    struct QUERY_ANSWER *answers = malloc(n_queries * sizeof(struct QUERY_ANSWER));
+
+    if (answers == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for query answers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    double start = wall_time();
+    size_t n_answered = query_points(fnames, n_files, queries, n_queries, NULL, -1, linear, options, answers);
+    double seconds = wall_time() - start;
+
+    int status = snprintf(path, sizeof(path), "%s/%s", out_dir, "point_queries.txt");
+
+    if (status < 0 || (size_t) status >= sizeof(path)) {
+        fprintf(stderr, "Error: Failed to construct output file name\n");
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *f = fopen(path, "wt");
+
+    if (f == NULL) {
+        fprintf(stderr, "Error: Could not open file %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t q = 0; q < n_queries; q++)
+        fprintf(f, "%.4f %.4f %08ld %04ld %.6f %08ld %04ld %08ld %04ld %.4f\n", queries[q].lon, queries[q].lat,
+                queries[q].date, queries[q].time, isnan(answers[q].value) ? 9999.0 : (double) answers[q].value,
+                answers[q].date, answers[q].time, answers[q].later_date, answers[q].later_time,
+                (double) answers[q].weight);
+
+    if (fclose(f) != 0) {
+        fprintf(stderr, "Error: Could not write file %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Answered %zu of %zu queries in %.3lf s\n", n_answered, n_queries, seconds);
+
+    free(queries);
+    free(answers);
+}
+
+/**
+ * @brief Decoded fields kept while interpolating whole grids in time, indexed by slot, see `field_slots`
+ */
+struct TIME_FIELDS {
+    size_t n_files;
+    size_t *base;
+    int *needed;
+    struct GRIB_FIELD *fields;  ///< copies of the needed fields including their values
+};
+
+static int time_fields_filter(const struct GRIB_FIELD *field, void *user) {
+    const struct TIME_FIELDS *kept = (const struct TIME_FIELDS *) user;
+    size_t slot = field_slot(kept->base, kept->n_files, field);
+
+    return slot < kept->base[kept->n_files] && kept->needed[slot];
+}
+
+static void time_fields_consumer(const struct GRIB_FIELD *field, int worker __attribute__((unused)), void *user) {
+    struct TIME_FIELDS *kept = (struct TIME_FIELDS *) user;
+    size_t n_values = (size_t) field->grid.ni * (size_t) field->grid.nj;
+    struct GRIB_FIELD *copy = &kept->fields[field_slot(kept->base, kept->n_files, field)];
+
+    // every message has its own slot, no synchronization needed
+    *copy = *field;
+
+    if ((copy->values = malloc(n_values * sizeof(float))) == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for field %zu\n", field->index);
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(copy->values, field->values, n_values * sizeof(float));
+}
+
+size_t export_gtiff_at_times(const char *const *fnames, size_t n_files, const char *times_file, const char *out_dir,
+                             const struct DECODE_OPTIONS *options, int compression_threads) {
+    struct QUERY_FIELD_LIST list;
+    struct TIME_FIELDS kept = {0};
+    struct DECODE_OPTIONS selected = *options;
+    struct GTIFF_EXPORT export;
+    size_t n_times = 0, capacity = 64;
+    char line[256];
+
+    struct SORTED_QUERY *times = malloc(capacity * sizeof(struct SORTED_QUERY));
+    long *dates = malloc(capacity * sizeof(long)), *clock = malloc(capacity * sizeof(long));
+
+    FILE *f = fopen(times_file, "rt");
+
+    if (f == NULL) {
+        fprintf(stderr, "Error: Could not open file %s\n", times_file);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t line_number = 1; fgets(line, sizeof(line), f) != NULL; line_number++) {
+        if (n_times == capacity) {
+            capacity *= 2;
+            times = realloc(times, capacity * sizeof(struct SORTED_QUERY));
+            dates = realloc(dates, capacity * sizeof(long));
+            clock = realloc(clock, capacity * sizeof(long));
+        }
+
+        if (times == NULL || dates == NULL || clock == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory while parsing line %s\n", line);
+            exit(EXIT_FAILURE);
+        }
+
+        if (strspn(line, " \t\r\n") == strlen(line))
+            continue;
+
+        if (parse_date_time(line, &dates[n_times], &clock[n_times])) {
+            line[strcspn(line, "\r\n")] = '\0';
+            fprintf(stderr, "Error: Invalid acquisition time on line %zu of %s: %s\n", line_number, times_file, line);
+            exit(EXIT_FAILURE);
+        }
+
+        times[n_times] = (struct SORTED_QUERY) {
+            .minutes = minutes_since_epoch(dates[n_times], clock[n_times]), .query = n_times
+        };
+        n_times++;
+    }
+
+    fclose(f);
+
+    if (n_times == 0) {
+        fprintf(stderr, "Error: No acquisition times found in %s\n", times_file);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t n_fields = list_fields_by_time(fnames, n_files, NULL, options, &list);
+
+    if (n_fields == 0) {
+        fprintf(stderr, "Error: Inputs hold no fields\n");
+        exit(EXIT_FAILURE);
+    }
+
+    qsort(times, n_times, sizeof(struct SORTED_QUERY), compare_sorted_queries);
+
+    size_t *earlier = malloc(n_times * sizeof(size_t)), *later = malloc(n_times * sizeof(size_t));
+    float *weight = malloc(n_times * sizeof(float));
+
+    kept.n_files = n_files;
+    kept.base = field_slots(list.fields, n_fields, n_files);
+    kept.needed = calloc(kept.base[n_files], sizeof(int));
+    kept.fields = calloc(kept.base[n_files], sizeof(struct GRIB_FIELD));
+
+    if (earlier == NULL || later == NULL || weight == NULL || kept.needed == NULL || kept.fields == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for interpolation in time\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t n_inside = 0;
+
+    // fields are only interpolated, never extrapolated to times they don't enclose
+    for (size_t t = 0, cursor = 0; t < n_times; t++) {
+        if (times[t].minutes < list.fields[0].minutes || times[t].minutes > list.fields[n_fields - 1].minutes) {
+            fprintf(stderr, "Warning: Skipping acquisition time %08ld %04ld outside of the fields\n",
+                    dates[times[t].query], clock[times[t].query]);
+            continue;
+        }
+
+        times[n_inside] = times[t];
+        bracket_fields(list.fields, n_fields, &cursor, times[t].minutes, 1, -1, &earlier[n_inside], &later[n_inside],
+                       &weight[n_inside]);
+        kept.needed[kept.base[list.fields[earlier[n_inside]].file] + list.fields[earlier[n_inside]].index] = 1;
+        kept.needed[kept.base[list.fields[later[n_inside]].file] + list.fields[later[n_inside]].index] = 1;
+        n_inside++;
+    }
+
+    n_times = n_inside;
+
+    selected.filter = time_fields_filter;
+    selected.filter_user = &kept;
+    grib_data_from_files(fnames, n_files, &selected, time_fields_consumer, &kept, NULL);
+
+    gtiff_export_init(&export, out_dir, compression_threads);
+
+    double start = wall_time();
+
+    for (size_t t = 0; t < n_times; t++) {
+        const struct QUERY_FIELD *e = &list.fields[earlier[t]], *l = &list.fields[later[t]];
+        const struct GRIB_FIELD *a = &kept.fields[kept.base[e->file] + e->index];
+        const struct GRIB_FIELD *b = &kept.fields[kept.base[l->file] + l->index];
+        struct GRIB_FIELD field = *a;
+        size_t n_values = (size_t) a->grid.ni * (size_t) a->grid.nj;
+        char path[4096], name[16];
+
+        if (!grid_equal(&a->grid, &b->grid)) {
+            fprintf(stderr, "Error: Fields enclosing %08ld %04ld are on different grids\n", dates[times[t].query],
+                    clock[times[t].query]);
+            exit(EXIT_FAILURE);
+        }
+
+        if ((field.values = malloc(n_values * sizeof(float))) == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for interpolation in time\n");
+            exit(EXIT_FAILURE);
+        }
+
+        lerp_fields(a->values, b->values, weight[t], n_values, field.values);
+        field.date = dates[times[t].query];
+        field.time = clock[times[t].query];
+
+        upper_case(name, field.short_name, sizeof(name));
+
+        int status = snprintf(path, sizeof(path), "%s/%s_%08ld_%04ld.tif", out_dir, name, field.date, field.time);
+
+        if (status < 0 || (size_t) status >= sizeof(path)) {
+            fprintf(stderr, "Error: Failed to construct output file name\n");
+            exit(EXIT_FAILURE);
+        }
+
+        write_gtiff(&export, &field, path);
+        free(field.values);
+    }
+
+    printf("Wrote %zu GeoTIFFs interpolated in time in %.3lf s\n", export.n_files, wall_time() - start);
+
+    size_t n_written = export.n_files;
+
+    gtiff_export_destroy(&export);
+
+    for (size_t i = 0; i < kept.base[n_files]; i++)
+        free(kept.fields[i].values);
+    free(kept.fields);
+    free(kept.base);
+    free(kept.needed);
+    free(list.fields);
+    free(times);
+    free(dates);
+    free(clock);
+    free(earlier);
+    free(later);
+    free(weight);
 
-void print_usage(void) {
-    printf(
-        "Usage: cams-process <-h|--help> <-v|--version> <-i|--purpose> "
-        "<-t|--daily_tables> <-c|--climatology> <-g|--gtiff> in_file out_dir\n"
-        "\nOptional arguments:\n"
-        "<-h|--help>\tprint this help and exit\n"
-        "<-v|--version>\tprint FORCE version and exit\n"
-        "<-i|--purpose>\tprint program's purpose and exit\n"
-        "<-t|--daily_tables>\tBuild daily tables? Default if not specified: false\n"
-        "<-c|--climatology>\tBuild climatology? Default if not specified: false\n"
-        "<-g|--gtiff>\tConvert each step from in_file to GTiff? Default if not specified: false\n"
-        "\nMandatory positional arguments:\n"
-        "in_file\t\t\tAbsolut path to file to process\n"
-        "out_dir\t\t\tAbsolut path to directory in which results are stored. Needs to exist before program invocation\n"
-        );
-}
-
-void print_purpose(void) {
-    printf("Process downloaded ECMWF data (CAMS EC4) to daily tables, climatology or convert to GTiff\n");
-}
-
-void print_version(void) {
-    printf("FORCE version is: %s\n", FORCE_VERSION);
+    return n_written;
 }
@@ -1,72 +1,381 @@
 #ifndef CAMS_GRIBUTILS_H
 #define CAMS_GRIBUTILS_H
 
-#define FORCE_VERSION "69.420"
+#include <stddef.h>
+
+struct POINTS;
+struct GRID_SHM;
+
+/**
+ * @brief Geometry of a regular latitude/longitude grid as encoded in a GRIB message
+ * @author Florian Katerndahl
+ */
+struct GRID {
+    long ni;                ///< number of points along a parallel, i.e. number of columns
+    long nj;                ///< number of points along a meridian, i.e. number of rows
+    double lon_first;       ///< longitude of the first grid point in decimal degrees
+    double lat_first;       ///< latitude of the first grid point in decimal degrees
+    double d_lon;           ///< signed increment between columns in decimal degrees
+    double d_lat;           ///< signed increment between rows in decimal degrees (negative if scanning north to south)
+};
+
+/**
+ * @brief A single decoded GRIB message
+ * @note `values` is only valid for the duration of the consumer call it is passed to.
+ * @author Florian Katerndahl
+ */
+struct GRIB_FIELD {
+    size_t file;            ///< zero-based position of the source among the inputs of the decoding run
+    size_t index;           ///< zero-based position of the message within its source
+    size_t length;          ///< size of the encoded message in bytes
+    long data_date;         ///< model base date as YYYYMMDD
+    long data_time;         ///< model base time as HHMM
+    long step;              ///< forecast step in hours
+    long date;              ///< validity date as YYYYMMDD
+    long time;              ///< validity time as HHMM
+    long param;             ///< ecCodes paramId
+    char short_name[16];    ///< ecCodes shortName, e.g. "aod469"
+    struct GRID grid;       ///< grid geometry
+    float *values;          ///< ni * nj values in scanning order; missing values are set to NAN
+};
+
+/**
+ * @brief Function called for every decoded field.
+ * @param field Decoded field; owned by the decoding engine
+ * @param worker Zero-based index of the worker thread calling this function, smaller than `n_threads`
+ * @param user Pointer passed through from the caller of the decoding engine
+ * @warning Called concurrently from all worker threads. Data shared between workers must be synchronized by the
+ * consumer.
+ */
+typedef void (*field_consumer)(const struct GRIB_FIELD *field, int worker, void *user);
+
+/**
+ * @brief Function deciding from the header of a message whether it should be decoded.
+ * @param field Field with all header members set; `values` is NULL
+ * @param user Pointer passed through from the caller of the decoding engine
+ * @return Non-zero if the message should be decoded, zero if it should be skipped
+ * @note Called from the decoding workers, or while files are opened if their index is used, but never concurrently.
+ */
+typedef int (*field_filter)(const struct GRIB_FIELD *field, void *user);
+
+/**
+ * @brief Options of the decoding engine
+ * @author Florian Katerndahl
+ */
+struct DECODE_OPTIONS {
+    int n_threads;          ///< number of worker threads decoding messages
+    field_filter filter;    ///< if not NULL, messages for which `filter` returns zero are skipped without decoding
+    void *filter_user;      ///< pointer passed to `filter`
+    const char *cache_dir;  ///< if not NULL, directory in which decoded fields of GRIB files are cached
+    int cache_dtype;        ///< storage type of cached values, see `FIELD_CACHE_DTYPE`; caches of another type are rebuilt
+    struct GRID_SHM *shared;///< if not NULL, decoded grids of GRIB files are shared with other processes through it
+    int index;              ///< if set, GRIB files are read through their index, which is built if missing
+};
+
+/**
+ * @brief Throughput figures of a decoding run
+ * @author Florian Katerndahl
+ */
+struct DECODE_STATS {
+    size_t messages;        ///< number of decoded messages
+    size_t bytes;           ///< number of input bytes handed to the workers, i.e. encoded or cached bytes
+    size_t values;          ///< number of decoded grid values
+    size_t shared;          ///< number of messages whose grid was taken from the shared-memory cache
+    double seconds;         ///< wall clock time of the decoding run
+};
 
 /**
  * @brief Program's CLI options
  * @author Florian Katerndahl
  */
 struct PROCESS_OPTIONS {
-    char *in_file;          ///< blubb
+    char **in_files;        ///< input files, directories expanded to the files they hold
+    size_t n_files;         ///< number of input files
     char *out_dir;          ///< blabb
     int daily_tables;       ///< flag if daily tables should be build
     int climatology;        ///< flag if climatology should be build
     int convert_to_tiff;    ///< flag if each entry in input file should be converted and exported as GTif
+    int benchmark;          ///< flag if the input file should only be decoded and the throughput reported
+    int n_threads;          ///< number of threads used for decoding
+    char *cache_dir;        ///< directory holding caches of decoded fields
+    int cache_dtype;        ///< storage type of cached values
+    size_t shm_budget;      ///< memory budget of the shared-memory cache of decoded grids in bytes, 0 to disable it
+    int remove_shm;         ///< flag if the shared-memory cache of decoded grids should be removed
+    int no_index;           ///< flag if GRIB files should be read without their index
+    char *coordinates;      ///< path to file with WRS-2 center coordinates at which tables are built
+    char *queries;          ///< path to file with point queries to answer
+    int linear_time;        ///< flag if queries should be interpolated linearly in time
+    char *acquisitions;     ///< path to file with acquisition times to which whole fields are interpolated
+    char *tiles;            ///< path to FORCE tile allow-list of the datacube fields are reprojected to
+    double resolution;      ///< edge length of a datacube pixel in projection units
 };
 
 /**
- * @brief Print the program's usage
+ * @brief Walk all messages of a set of GRIB files and decode them in parallel
+ * @details The files are mapped into memory and the position of every message is taken from its section 0. The
+ * messages of all files are then split into one contiguous range per worker of a pool of `options->n_threads`. A
+ * worker parses and decodes the messages of its range one at a time and hands each field to `consumer`; once its
+ * range is exhausted, it steals the back half of the largest range left. Thus, a single large file is decoded by all
+ * workers, while at most `n_threads` messages are held in memory at any time. Fields carry the position of their file
+ * in `fnames` and of the message within the file, so consumers can order their results independently of which worker
+ * decoded a message.
+ *
+ * If `options->cache_dir` is set and holds an up-to-date field cache of a file, its fields are read from the memory
+ * mapped cache instead and no message is decoded. Otherwise, the cache is written while decoding, for which all
+ * messages of the file are decoded regardless of `options->filter`; the filter is still applied before calling
+ * `consumer`.
+ *
+ * If `options->shared` is set, the grids of messages decoded from GRIB files are published to the shared-memory cache,
+ * keyed by the identity of the file and the offset of the message. Grids another process published before are mapped
+ * instead of decoded; if another process is decoding a grid, the worker waits for it. Thus, concurrent processes
+ * working on the same file decode every message once.
+ *
+ * If `options->index` is set, position and header of every message of a GRIB file are taken from its index, see
+ * `GRIB_INDEX_HEADER`, and `options->filter` is applied to the index entries before any message is touched. Messages
+ * the filter rejects are neither parsed nor read from disk, and the filter is not called for them again. A missing or
+ * stale index is built from the headers read while decoding and written next to the file.
+ *
+ * netCDF files are recognized by their signature and read with `netcdf_data_from_file` once all GRIB files are done.
+ * @param fnames Paths to GRIB or netCDF files
+ * @param n_files Number of files
+ * @param options Options of the decoding engine
+ * @param consumer Function called once for every decoded message
+ * @param user Pointer passed to `consumer`
+ * @param stats If not NULL, populated with throughput figures of the run
+ * @return Number of decoded messages
  * @author Florian Katerndahl
  */
-void print_usage(void);
+size_t grib_data_from_files(const char *const *fnames, size_t n_files, const struct DECODE_OPTIONS *options,
+                            field_consumer consumer, void *user, struct DECODE_STATS *stats);
 
 /**
- * @brief Print the program's purpose
+ * @brief Walk all messages of a GRIB file and decode them in parallel
+ * @details Same as `grib_data_from_files` for a single file.
+ * @param fname Path to GRIB or netCDF file
+ * @param options Options of the decoding engine
+ * @param consumer Function called once for every decoded message
+ * @param user Pointer passed to `consumer`
+ * @param stats If not NULL, populated with throughput figures of the run
+ * @return Number of decoded messages
  * @author Florian Katerndahl
  */
-void print_purpose(void);
+size_t grib_data_from_file(const char *fname, const struct DECODE_OPTIONS *options, field_consumer consumer,
+                           void *user, struct DECODE_STATS *stats);
 
 /**
- * @brief Print FORCE's version
+ * @brief Print throughput of a decoding run as messages and gigabytes per second
+ * @param stats Figures collected by the decoding engine
  * @author Florian Katerndahl
  */
-void print_version(void);
+void print_decode_stats(const struct DECODE_STATS *stats);
 
 /**
- * @brief
+ * @brief Walk all messages of GRIB data held in memory and decode them in parallel
+ * @details Same as `grib_data_from_files`, except that messages are read directly from `buffer`. ecCodes handles
+ * reference the bytes in place, i.e. no message is copied to the heap or to temporary files. This allows decoding
+ * data which was just downloaded into memory, or a file which was mapped with `mmap`.
+ * @param buffer Pointer to one or more concatenated GRIB messages; bytes between messages are skipped
+ * @param length Size of `buffer` in bytes
+ * @param options Options of the decoding engine
+ * @param consumer Function called once for every decoded message
+ * @param user Pointer passed to `consumer`
+ * @param stats If not NULL, populated with throughput figures of the run
+ * @return Number of decoded messages
+ * @warning `buffer` must not be modified or freed before this function returns.
  * @author Florian Katerndahl
  */
-void grib_data_from_file(void);
+size_t grib_data_from_memory(const void *buffer, size_t length, const struct DECODE_OPTIONS *options,
+                             field_consumer consumer, void *user, struct DECODE_STATS *stats);
 
 /**
- * @brief
+ * @brief Construct the path of a table for a given parameter and date, e.g. `<out_dir>/AOD469_2003-01-01.txt`
+ * @param dest Buffer to write the path to
+ * @param size Size of `dest`
+ * @param out_dir Output directory
+ * @param short_name ecCodes shortName of the parameter; converted to upper case
+ * @param date Date as YYYYMMDD. Climatology tables use year zero, i.e. MMDD.
  * @author Florian Katerndahl
  */
-void grib_data_from_memory(void);
+void table_path(char *dest, size_t size, const char *out_dir, const char *short_name, long date);
+
+/**
+ * @brief Build one table per day and parameter holding the daily mean value at each point
+ * @details Bilinear interpolation weights are computed once per model grid and applied to every decoded message with
+ * `gather_points`. All messages valid on the same day are averaged. Tables are named `<SHORTNAME>_YYYY-MM-DD.txt`
+ * and list longitude, latitude, value and source of every point in the order of `points`; points without valid
+ * data are set to 9999.
+ *
+ * The tables already written to `out_dir` are recorded in the index file `daily_tables.index`, together with the
+ * number of points and a fingerprint of their coordinates. Messages whose table already holds all points are skipped
+ * based on their header, without decoding. If points were appended to the coordinate file since a table was written,
+ * only the rows of the new points are appended to it. Once written, a table is considered complete, i.e. messages
+ * of the same date arriving in later runs are not averaged into it.
+ *
+ * All GRIB files are decoded in a single run of `grib_data_from_files`. For netCDF files, only the chunks covering the
+ * points and the time steps of missing tables are read with `netcdf_point_series`. Rows of a table are averaged in the
+ * order of the inputs and of the messages within them, so the result doesn't depend on the number of workers.
+ * @param fnames Paths to GRIB or netCDF files
+ * @param n_files Number of files
+ * @param out_dir Directory to write tables to
+ * @param points Locations at which values are extracted
+ * @param options Options of the decoding engine
+ * @author Florian Katerndahl
+ */
+void build_daily_tables(const char *const *fnames, size_t n_files, const char *out_dir, const struct POINTS *points,
+                        const struct DECODE_OPTIONS *options);
+
+/**
+ * @brief Time the extraction of values at a set of points and print throughput figures
+ * @details GRIB files are decoded in full and interpolated with `gather_points`, netCDF files are read with
+ * `netcdf_point_series`. Running it on a GRIB and a netCDF download of the same request compares both paths.
+ * @param fnames Paths to GRIB or netCDF files
+ * @param n_files Number of files
+ * @param points Locations at which values are extracted
+ * @param options Options of the decoding engine
+ * @author Florian Katerndahl
+ */
+void benchmark_point_extraction(const char *const *fnames, size_t n_files, const struct POINTS *points,
+                                const struct DECODE_OPTIONS *options);
+
+/**
+ * @brief Write every message of a set of GRIB files as tiled, compressed Cloud-Optimized GeoTIFF
+ * @details Each decoding worker writes the fields it decoded, i.e. steps are written in parallel. Files are named
+ * `<SHORTNAME>_YYYYMMDD_HHMM_SSS.tif` after validity date, validity time and forecast step. They are written by GDAL's
+ * COG driver with DEFLATE compression and floating point predictor, 256 x 256 pixel tiles and overviews, and carry
+ * the GRIB header keys as metadata. Missing values are written as NaN, which is set as NoData value.
+ * @param fnames Paths to GRIB files
+ * @param n_files Number of files
+ * @param out_dir Directory to write GeoTIFFs to
+ * @param options Options of the decoding engine
+ * @param compression_threads Number of threads GDAL uses to compress the tiles of a single file
+ * @return Number of written files
+ * @author Florian Katerndahl
+ */
+size_t export_data_to_gtiff(const char *const *fnames, size_t n_files, const char *out_dir,
+                            const struct DECODE_OPTIONS *options, int compression_threads);
+
+/**
+ * @brief Reproject every message of a set of GRIB files to the tiles of a FORCE datacube and write them as
+ * Cloud-Optimized GeoTIFFs
+ * @details The datacube is defined by `out_dir/datacube-definition.prj`. For each grid and tile, the source indices
+ * and bilinear weights of all pixels are computed once with `warp_maps_for_grid`, persisted in `warp_dir` and read
+ * from there by later runs. Every step is then resampled with `apply_warp_map`; like `export_data_to_gtiff`, each
+ * decoding worker resamples and writes the fields it decoded. Files are written to `out_dir/X0069_Y0042/` and named
+ * and encoded like those of `export_data_to_gtiff`, but in the projection of the datacube. Tiles entirely outside of
+ * the grid are skipped.
+ * @param fnames Paths to GRIB files
+ * @param n_files Number of files
+ * @param out_dir Root directory of the datacube; missing tile directories are created
+ * @param tile_file Path to FORCE tile allow-list, see `read_tiles`
+ * @param resolution Edge length of a pixel in projection units; the tile size must be a multiple of it
+ * @param warp_dir Directory holding persisted warp maps, NULL to compute them in every run
+ * @param options Options of the decoding engine
+ * @param compression_threads Number of threads GDAL uses to compress the tiles of a single file
+ * @return Number of written files
+ * @author Florian Katerndahl
+ */
+size_t export_datacube_tiles(const char *const *fnames, size_t n_files, const char *out_dir, const char *tile_file,
+                             double resolution, const char *warp_dir, const struct DECODE_OPTIONS *options,
+                             int compression_threads);
+
+/**
+ * @brief Location and time at which a value is requested, e.g. the center and acquisition time of a scene
+ * @author Florian Katerndahl
+ */
+struct POINT_QUERY {
+    double lon;             ///< longitude in decimal degrees
+    double lat;             ///< latitude in decimal degrees
+    long date;              ///< date as YYYYMMDD
+    long time;              ///< time as HHMM (UTC)
+};
+
+/**
+ * @brief Answer to a `POINT_QUERY`
+ * @author Florian Katerndahl
+ */
+struct QUERY_ANSWER {
+    float value;            ///< bilinearly interpolated value; NAN if there is no data for the query
+    long date;              ///< validity date of the (earlier) field the value was taken from as YYYYMMDD, 0 if none
+    long time;              ///< validity time of the (earlier) field the value was taken from as HHMM
+    long later_date;        ///< validity date of the later field if interpolated in time, `date` otherwise
+    long later_time;        ///< validity time of the later field if interpolated in time, `time` otherwise
+    float weight;           ///< weight of the later field, 0 if the value was taken from a single field
+};
 
 /**
- * @brief
+ * @brief Read queries from a text file
+ * @details Every line holds longitude, latitude, date and time of one query, separated by whitespace. Dates are given
+ * as YYYY-MM-DD or YYYYMMDD, times as HH:MM or HHMM. Blank lines are skipped.
+ * @param fname Path to query file
+ * @param n_queries Number of parsed queries
+ * @return Array of queries. The caller is responsible for freeing it.
+ * @note Terminates the program, naming file and line, if a line is not a valid query.
  * @author Florian Katerndahl
  */
-void netcdf_data_from_file(void);
+struct POINT_QUERY *read_queries(const char *fname, size_t *n_queries);
 
 /**
- * @brief
+ * @brief Answer a batch of point queries from a set of GRIB or netCDF files
+ * @details The headers of all files are scanned first in a single run of `grib_data_from_files`. Queries are then sorted by time and assigned the field whose
+ * validity time is nearest; equally distant fields resolve to the earlier one. If `linear` is set, queries are instead
+ * assigned the two fields enclosing them and interpolated linearly in time with `lerp_points`; queries before the first
+ * or after the last field, or at the time of a field, are answered by the nearest field alone. Every field with queries
+ * is decoded exactly once, and all of its queries are interpolated together with `gather_points`. Grid cells are found
+ * arithmetically from the regular grid, i.e. the lookup doesn't depend on the size of the grid. If `options->cache_dir`
+ * is set, fields are read from the decoded-field caches. The fields with queries of all files are decoded in a single
+ * run, too.
+ * @param fnames Paths to GRIB or netCDF files
+ * @param n_files Number of files
+ * @param queries Queries to answer
+ * @param n_queries Number of queries
+ * @param short_name If not NULL, only fields of this parameter are considered. Otherwise, all fields must be of the
+ * same parameter.
+ * @param tolerance Maximum distance in minutes between a query and the fields answering it; negative for no limit
+ * @param linear Interpolate linearly in time between the two fields enclosing a query if set
+ * @param options Options of the decoding engine
+ * @param answers Array of `n_queries` answers, in the order of `queries`
+ * @return Number of queries answered with a field
  * @author Florian Katerndahl
  */
-void netcdf_data_from_memory(void);
+size_t query_points(const char *const *fnames, size_t n_files, const struct POINT_QUERY *queries, size_t n_queries,
+                    const char *short_name, long tolerance, int linear, const struct DECODE_OPTIONS *options,
+                    struct QUERY_ANSWER *answers);
 
 /**
- * @brief
+ * @brief Answer the queries of a query file from a set of GRIB or netCDF files and write them to `out_dir/point_queries.txt`
+ * @details Each line of the output holds longitude, latitude, date and time of a query, the answer, the validity dates
+ * and times of the earlier and later field it was taken from and the weight of the later field. Queries without data
+ * are set to 9999.
+ * @param fnames Paths to GRIB or netCDF files
+ * @param n_files Number of files
+ * @param query_file Path to query file, see `read_queries`
+ * @param out_dir Directory to write the answers to
+ * @param linear Interpolate linearly in time if set, see `query_points`
+ * @param options Options of the decoding engine
  * @author Florian Katerndahl
  */
-void build_tables(void); // both for climatology and daily tables
+void answer_query_file(const char *const *fnames, size_t n_files, const char *query_file, const char *out_dir,
+                       int linear, const struct DECODE_OPTIONS *options);
 
 /**
- * @brief
+ * @brief Interpolate whole fields linearly in time to a list of acquisition times and write them as Cloud-Optimized
+ * GeoTIFFs
+ * @details Acquisition times are read from `times_file`, one date as YYYY-MM-DD or YYYYMMDD and time as HH:MM or HHMM
+ * per line; blank lines are skipped. The two fields enclosing an acquisition time are blended with `lerp_fields`, times
+ * of a field take that field. Times before the first or after the last field are skipped with a warning. Each field is
+ * decoded once, no matter how many acquisition times it contributes to. Files are named `<SHORTNAME>_YYYYMMDD_HHMM.tif` after the acquisition time and
+ * are written like those of `export_data_to_gtiff`.
+ * @param fnames Paths to GRIB or netCDF files holding a single parameter
+ * @param n_files Number of files
+ * @param times_file Path to file with acquisition times
+ * @param out_dir Directory to write GeoTIFFs to
+ * @param options Options of the decoding engine
+ * @param compression_threads Number of threads GDAL uses to compress the tiles of a single file
+ * @return Number of written files
+ * @note Terminates the program, naming file and line, if a line is not a valid date and time.
  * @author Florian Katerndahl
  */
-void export_data_to_gtiff(void);
+size_t export_gtiff_at_times(const char *const *fnames, size_t n_files, const char *times_file, const char *out_dir,
+                             const struct DECODE_OPTIONS *options, int compression_threads);
 
 #endif //CAMS_GRIBUTILS_H
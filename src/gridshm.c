@@ -0,0 +1,499 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gridshm.h"
+
+#define GRID_SHM_MAGIC "CAMSGSHM"
+#define GRID_SHM_VERSION 1
+
+enum {
+    NAME_MAX_SEGMENT = 96
+};
+
+enum {
+    ENTRY_EMPTY = 0,
+    ENTRY_DECODING = 1,
+    ENTRY_READY = 2
+};
+
+struct GRID_SHM_ENTRY {
+    struct GRID_SHM_KEY key;
+    uint32_t state;
+    int32_t owner;                              ///< slot of the process decoding the grid
+    uint64_t id;                                ///< unique id, names the segment of the grid
+    uint64_t bytes;
+    uint64_t last_use;
+    uint8_t refs[GRID_SHM_PROCESSES];           ///< references held by every attached process
+};
+
+/**
+ * @brief Index of all cached grids at the start of the index segment
+ */
+struct GRID_SHM_INDEX {
+    atomic_uint initialized;                    ///< set by the creator once the index can be used
+    char magic[8];
+    uint32_t version;
+    pthread_mutex_t lock;                       ///< process-shared and robust, guards all members below
+    pthread_cond_t published;                   ///< signalled when a grid is published or discarded
+    uint64_t budget;
+    uint64_t used;                              ///< size of all cached and unfinished grids
+    uint64_t clock;                             ///< logical time of the last use of a grid
+    uint64_t next_id;
+    int64_t processes[GRID_SHM_PROCESSES];      ///< pid of every attached process, 0 for free slots
+    struct GRID_SHM_ENTRY entries[GRID_SHM_SLOTS];
+};
+
+static void segment_name(const char *name, uint64_t id, char *dest, size_t size) {
+    snprintf(dest, size, "%s-%llu", name, (unsigned long long) id);
+}
+
+/**
+ * @brief Lock the index; if its previous owner died while holding the lock, the index is taken over as it is.
+ */
+static void lock_index(struct GRID_SHM_INDEX *index) {
+    if (pthread_mutex_lock(&index->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&index->lock);
+}
+
+static int process_alive(int64_t pid) {
+    return kill((pid_t) pid, 0) == 0 || errno != ESRCH;
+}
+
+static int same_key(const struct GRID_SHM_KEY *a, const struct GRID_SHM_KEY *b) {
+    return a->device == b->device && a->inode == b->inode && a->size == b->size && a->mtime == b->mtime &&
+           a->offset == b->offset;
+}
+
+static unsigned int reference_count(const struct GRID_SHM_ENTRY *entry) {
+    unsigned int n = 0;
+
+    for (int p = 0; p < GRID_SHM_PROCESSES; p++)
+        n += entry->refs[p];
+
+    return n;
+}
+
+/**
+ * @brief Remove a grid from the index and unlink its segment. Processes which still map it keep their mapping.
+ */
+static void discard_entry(const struct GRID_SHM *shm, struct GRID_SHM_ENTRY *entry) {
+    char name[NAME_MAX_SEGMENT];
+
+    segment_name(shm->name, entry->id, name, sizeof(name));
+    shm_unlink(name);
+
+    shm->index->used -= entry->bytes;
+    memset(entry, 0, sizeof(struct GRID_SHM_ENTRY));
+}
+
+/**
+ * @brief Release the references and unfinished grids of attached processes which died.
+ */
+static void reap_processes(const struct GRID_SHM *shm) {
+    struct GRID_SHM_INDEX *index = shm->index;
+    int discarded = 0;
+
+    for (int p = 0; p < GRID_SHM_PROCESSES; p++) {
+        if (index->processes[p] == 0 || p == shm->slot || process_alive(index->processes[p]))
+            continue;
+
+        for (size_t e = 0; e < GRID_SHM_SLOTS; e++) {
+            struct GRID_SHM_ENTRY *entry = &index->entries[e];
+
+            entry->refs[p] = 0;
+            if (entry->state == ENTRY_DECODING && entry->owner == p) {
+                discard_entry(shm, entry);
+                discarded = 1;
+            }
+        }
+
+        index->processes[p] = 0;
+    }
+
+    if (discarded)
+        pthread_cond_broadcast(&index->published);
+}
+
+/**
+ * @brief Evict unreferenced grids, least recently used first, until `bytes` more fit into the budget.
+ * @return Zero if there is enough room, non-zero otherwise
+ */
+static int make_room(const struct GRID_SHM *shm, uint64_t bytes) {
+    struct GRID_SHM_INDEX *index = shm->index;
+
+    while (index->used + bytes > index->budget) {
+        struct GRID_SHM_ENTRY *victim = NULL;
+
+        for (size_t e = 0; e < GRID_SHM_SLOTS; e++) {
+            struct GRID_SHM_ENTRY *entry = &index->entries[e];
+            if (entry->state == ENTRY_READY && reference_count(entry) == 0 &&
+                (victim == NULL || entry->last_use < victim->last_use))
+                victim = entry;
+        }
+
+        if (victim == NULL)
+            return 1;
+
+        discard_entry(shm, victim);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Find an empty entry, evicting the least recently used unreferenced grid if the index is full.
+ * @return Position of the entry, -1 if all entries are in use
+ */
+static long free_entry(const struct GRID_SHM *shm) {
+    struct GRID_SHM_INDEX *index = shm->index;
+    long victim = -1;
+
+    for (size_t e = 0; e < GRID_SHM_SLOTS; e++) {
+        const struct GRID_SHM_ENTRY *entry = &index->entries[e];
+
+        if (entry->state == ENTRY_EMPTY)
+            return (long) e;
+        if (entry->state == ENTRY_READY && reference_count(entry) == 0 &&
+            (victim < 0 || entry->last_use < index->entries[victim].last_use))
+            victim = (long) e;
+    }
+
+    if (victim >= 0)
+        discard_entry(shm, &index->entries[victim]);
+
+    return victim;
+}
+
+static float *map_segment(const char *name, size_t bytes, int create) {
+    int fd = create ? shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600) : shm_open(name, O_RDONLY, 0);
+    void *mapping;
+
+    if (fd < 0)
+        return NULL;
+
+    if (create && ftruncate(fd, (off_t) bytes) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    mapping = mmap(NULL, bytes, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    return mapping == MAP_FAILED ? NULL : (float *) mapping;
+}
+
+/**
+ * @brief Initialize a freshly created index segment.
+ */
+static void init_index(struct GRID_SHM_INDEX *index, size_t budget) {
+    pthread_mutexattr_t mutex_attributes;
+    pthread_condattr_t cond_attributes;
+
+    pthread_mutexattr_init(&mutex_attributes);
+    pthread_mutexattr_setpshared(&mutex_attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mutex_attributes, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&index->lock, &mutex_attributes);
+    pthread_mutexattr_destroy(&mutex_attributes);
+
+    pthread_condattr_init(&cond_attributes);
+    pthread_condattr_setpshared(&cond_attributes, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&index->published, &cond_attributes);
+    pthread_condattr_destroy(&cond_attributes);
+
+    memcpy(index->magic, GRID_SHM_MAGIC, sizeof(index->magic));
+    index->version = GRID_SHM_VERSION;
+    index->budget = budget;
+
+    atomic_store(&index->initialized, 1);
+}
+
+/**
+ * @brief Map the index segment, waiting for a concurrently starting process to finish creating it.
+ * @return Mapping of the index, NULL on failure
+ */
+static struct GRID_SHM_INDEX *map_index(const char *name, size_t budget) {
+    const struct timespec pause = {.tv_sec = 0, .tv_nsec = 10000000};
+    struct stat sb;
+    void *mapping;
+    int created = 1;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if (fd < 0 && errno == EEXIST) {
+        created = 0;
+        fd = shm_open(name, O_RDWR, 0);
+    }
+
+    if (fd < 0)
+        return NULL;
+
+    if (created && ftruncate(fd, sizeof(struct GRID_SHM_INDEX)) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    for (int attempt = 0; !created && attempt < 100; attempt++) {
+        if (fstat(fd, &sb) == 0 && (size_t) sb.st_size >= sizeof(struct GRID_SHM_INDEX))
+            break;
+        nanosleep(&pause, NULL);
+    }
+
+    mapping = mmap(NULL, sizeof(struct GRID_SHM_INDEX), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+        return NULL;
+
+    struct GRID_SHM_INDEX *index = (struct GRID_SHM_INDEX *) mapping;
+
+    if (created) {
+        init_index(index, budget);
+        return index;
+    }
+
+    for (int attempt = 0; attempt < 100 && !atomic_load(&index->initialized); attempt++)
+        nanosleep(&pause, NULL);
+
+    if (!atomic_load(&index->initialized) || memcmp(index->magic, GRID_SHM_MAGIC, sizeof(index->magic)) != 0 ||
+        index->version != GRID_SHM_VERSION) {
+        munmap(mapping, sizeof(struct GRID_SHM_INDEX));
+        return NULL;
+    }
+
+    return index;
+}
+
+int grid_shm_open(struct GRID_SHM *shm, const char *name, size_t budget) {
+    memset(shm, 0, sizeof(struct GRID_SHM));
+    shm->slot = -1;
+
+    if (name[0] != '/' || strlen(name) >= sizeof(shm->name)) {
+        fprintf(stderr, "Error: Invalid name of shared-memory cache %s\n", name);
+        return 1;
+    }
+    strcpy(shm->name, name);
+
+    if ((shm->index = map_index(name, budget)) == NULL) {
+        fprintf(stderr, "Error: Failed to attach to shared-memory cache %s\n", name);
+        return 1;
+    }
+
+    lock_index(shm->index);
+    reap_processes(shm);
+    for (int p = 0; p < GRID_SHM_PROCESSES && shm->slot < 0; p++) {
+        if (shm->index->processes[p] == 0) {
+            shm->index->processes[p] = (int64_t) getpid();
+            shm->slot = p;
+        }
+    }
+    pthread_mutex_unlock(&shm->index->lock);
+
+    if (shm->slot < 0) {
+        fprintf(stderr, "Error: Too many processes attached to shared-memory cache %s\n", name);
+        munmap(shm->index, sizeof(struct GRID_SHM_INDEX));
+        shm->index = NULL;
+        return 1;
+    }
+
+    return 0;
+}
+
+enum GRID_SHM_RESULT grid_shm_acquire(struct GRID_SHM *shm, const struct GRID_SHM_KEY *key, size_t bytes,
+                                      struct GRID_SHM_LEASE *lease) {
+    struct GRID_SHM_INDEX *index = shm->index;
+    char name[NAME_MAX_SEGMENT];
+
+    memset(lease, 0, sizeof(struct GRID_SHM_LEASE));
+
+    if (bytes == 0 || bytes > index->budget)
+        return GRID_SHM_BYPASS;
+
+    lock_index(index);
+
+    for (;;) {
+        struct GRID_SHM_ENTRY *entry = NULL;
+        size_t e;
+
+        for (e = 0; e < GRID_SHM_SLOTS; e++) {
+            if (index->entries[e].state != ENTRY_EMPTY && same_key(&index->entries[e].key, key)) {
+                entry = &index->entries[e];
+                break;
+            }
+        }
+
+        if (entry && entry->state == ENTRY_READY) {
+            if (entry->bytes != bytes || entry->refs[shm->slot] == UINT8_MAX)
+                break;
+
+            entry->refs[shm->slot]++;
+            entry->last_use = ++index->clock;
+            *lease = (struct GRID_SHM_LEASE) {.bytes = bytes, .entry = e, .id = entry->id};
+            pthread_mutex_unlock(&index->lock);
+
+            segment_name(shm->name, lease->id, name, sizeof(name));
+            if ((lease->values = map_segment(name, bytes, 0)) != NULL)
+                return GRID_SHM_HIT;
+
+            lock_index(index);
+            if (entry->id == lease->id && entry->refs[shm->slot] > 0)
+                entry->refs[shm->slot]--;
+            break;
+        }
+
+        if (entry) {
+            // another worker of this process decodes the grid, which must not wait for itself
+            if (entry->owner == shm->slot)
+                break;
+
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += 1;
+
+            int rc = pthread_cond_timedwait(&index->published, &index->lock, &deadline);
+            if (rc == EOWNERDEAD)
+                pthread_mutex_consistent(&index->lock);
+            else if (rc == ETIMEDOUT)
+                reap_processes(shm);
+            continue;
+        }
+
+        long slot;
+
+        if (make_room(shm, bytes) != 0) {
+            reap_processes(shm);
+            if (make_room(shm, bytes) != 0)
+                break;
+        }
+
+        if ((slot = free_entry(shm)) < 0)
+            break;
+
+        entry = &index->entries[slot];
+        *entry = (struct GRID_SHM_ENTRY) {
+            .key = *key, .state = ENTRY_DECODING, .owner = shm->slot, .id = ++index->next_id, .bytes = bytes,
+            .last_use = ++index->clock
+        };
+        entry->refs[shm->slot] = 1;
+        index->used += bytes;
+
+        *lease = (struct GRID_SHM_LEASE) {.bytes = bytes, .entry = (size_t) slot, .id = entry->id};
+        pthread_mutex_unlock(&index->lock);
+
+        segment_name(shm->name, lease->id, name, sizeof(name));
+        if ((lease->values = map_segment(name, bytes, 1)) != NULL)
+            return GRID_SHM_OWNER;
+
+        lock_index(index);
+        if (entry->id == lease->id)
+            discard_entry(shm, entry);
+        pthread_cond_broadcast(&index->published);
+        break;
+    }
+
+    pthread_mutex_unlock(&index->lock);
+    memset(lease, 0, sizeof(struct GRID_SHM_LEASE));
+
+    return GRID_SHM_BYPASS;
+}
+
+void grid_shm_publish(struct GRID_SHM *shm, const struct GRID_SHM_LEASE *lease) {
+    struct GRID_SHM_INDEX *index = shm->index;
+    struct GRID_SHM_ENTRY *entry = &index->entries[lease->entry];
+
+    lock_index(index);
+    if (entry->id == lease->id && entry->state == ENTRY_DECODING)
+        entry->state = ENTRY_READY;
+    pthread_cond_broadcast(&index->published);
+    pthread_mutex_unlock(&index->lock);
+}
+
+void grid_shm_release(struct GRID_SHM *shm, struct GRID_SHM_LEASE *lease) {
+    struct GRID_SHM_INDEX *index = shm->index;
+    struct GRID_SHM_ENTRY *entry = &index->entries[lease->entry];
+
+    if (lease->values == NULL)
+        return;
+
+    munmap(lease->values, lease->bytes);
+    lease->values = NULL;
+
+    lock_index(index);
+    if (entry->id == lease->id) {
+        if (entry->refs[shm->slot] > 0)
+            entry->refs[shm->slot]--;
+
+        if (entry->state == ENTRY_DECODING && entry->owner == shm->slot) {
+            discard_entry(shm, entry);
+            pthread_cond_broadcast(&index->published);
+        }
+    }
+    pthread_mutex_unlock(&index->lock);
+}
+
+void grid_shm_close(struct GRID_SHM *shm) {
+    struct GRID_SHM_INDEX *index = shm->index;
+
+    if (index == NULL)
+        return;
+
+    lock_index(index);
+    for (size_t e = 0; e < GRID_SHM_SLOTS; e++) {
+        struct GRID_SHM_ENTRY *entry = &index->entries[e];
+
+        entry->refs[shm->slot] = 0;
+        if (entry->state == ENTRY_DECODING && entry->owner == shm->slot)
+            discard_entry(shm, entry);
+    }
+    index->processes[shm->slot] = 0;
+    pthread_cond_broadcast(&index->published);
+    pthread_mutex_unlock(&index->lock);
+
+    munmap(index, sizeof(struct GRID_SHM_INDEX));
+    shm->index = NULL;
+}
+
+int grid_shm_remove(const char *name) {
+    struct GRID_SHM shm = {.slot = -1};
+
+    if (name[0] != '/' || strlen(name) >= sizeof(shm.name))
+        return 1;
+    strcpy(shm.name, name);
+
+    int fd = shm_open(name, O_RDWR, 0);
+
+    if (fd < 0)
+        return 1;
+
+    void *mapping = mmap(NULL, sizeof(struct GRID_SHM_INDEX), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    // grids are unlinked first, so that no segment is left behind once the index is gone
+    if (mapping != MAP_FAILED) {
+        shm.index = (struct GRID_SHM_INDEX *) mapping;
+
+        if (atomic_load(&shm.index->initialized)) {
+            lock_index(shm.index);
+            for (size_t e = 0; e < GRID_SHM_SLOTS; e++) {
+                if (shm.index->entries[e].state != ENTRY_EMPTY)
+                    discard_entry(&shm, &shm.index->entries[e]);
+            }
+            pthread_mutex_unlock(&shm.index->lock);
+        }
+
+        munmap(mapping, sizeof(struct GRID_SHM_INDEX));
+    }
+
+    return shm_unlink(name) != 0;
+}
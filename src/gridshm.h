@@ -0,0 +1,121 @@
+#ifndef CAMS_GRIDSHM_H
+#define CAMS_GRIDSHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct GRID_SHM_INDEX;
+
+#define GRID_SHM_DEFAULT_NAME "/cams-grids"
+
+enum {
+    GRID_SHM_SLOTS = 4096,      ///< maximum number of grids in the cache
+    GRID_SHM_PROCESSES = 64     ///< maximum number of processes attached to the cache at the same time
+};
+
+/**
+ * @brief Outcome of `grid_shm_acquire`
+ */
+enum GRID_SHM_RESULT {
+    GRID_SHM_BYPASS = 0,        ///< the grid can't be cached, e.g. the budget is exhausted; decode it privately
+    GRID_SHM_HIT = 1,           ///< the grid was decoded before and is mapped read-only
+    GRID_SHM_OWNER = 2          ///< the caller has to decode the grid into the writable mapping and publish it
+};
+
+/**
+ * @brief Identity of a decoded grid, i.e. of the file holding its message and the position of the message
+ * @details Size and modification time are part of the key, so grids of a file which is replaced are never taken for
+ * those of the new one.
+ * @author Florian Katerndahl
+ */
+struct GRID_SHM_KEY {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime;
+    uint64_t offset;            ///< byte offset of the message within the file
+};
+
+/**
+ * @brief Process-local handle of the shared-memory cache
+ * @author Florian Katerndahl
+ */
+struct GRID_SHM {
+    char name[64];                      ///< name of the index segment; grids are stored in `<name>-<id>`
+    struct GRID_SHM_INDEX *index;       ///< mapping of the index segment
+    int slot;                           ///< slot of this process in the index
+};
+
+/**
+ * @brief Reference to a grid held by a worker between `grid_shm_acquire` and `grid_shm_release`
+ * @author Florian Katerndahl
+ */
+struct GRID_SHM_LEASE {
+    float *values;              ///< mapped values; read-only unless the lease was acquired as owner
+    size_t bytes;               ///< size of the mapping
+    size_t entry;               ///< position of the grid in the index
+    uint64_t id;                ///< id of the grid, guards against the entry being reused
+};
+
+/**
+ * @brief Attach to the shared-memory cache of decoded grids, creating it if no process did so before
+ * @details The index of all cached grids lives in the segment `name`, guarded by a process-shared robust mutex. Every
+ * grid is stored in a segment of its own, which other processes map read-only. Grids are reference-counted per
+ * attached process; grids nobody references are evicted least recently used first when a new grid would exceed the
+ * memory budget. References and unfinished grids of processes which died are released by the survivors.
+ * @param shm Handle to initialize
+ * @param name Name of the index segment, starting with a slash
+ * @param budget Maximum size of all cached grids in bytes; only applied by the process creating the cache
+ * @return Zero on success, non-zero if the cache can't be used; decoding then proceeds without it
+ * @author Florian Katerndahl
+ */
+int grid_shm_open(struct GRID_SHM *shm, const char *name, size_t budget);
+
+/**
+ * @brief Look up a grid and reference it
+ * @details If another process is decoding the grid, the call waits until it is published. Otherwise, if the grid is
+ * not cached, the caller becomes its owner and must decode it into `lease->values`, then call `grid_shm_publish`.
+ * @param shm Cache handle
+ * @param key Identity of the grid
+ * @param bytes Size of the decoded grid in bytes
+ * @param lease Populated with the mapping of the grid unless the result is GRID_SHM_BYPASS
+ * @return See `GRID_SHM_RESULT`
+ * @note Safe to call concurrently from all decoding workers.
+ * @author Florian Katerndahl
+ */
+enum GRID_SHM_RESULT grid_shm_acquire(struct GRID_SHM *shm, const struct GRID_SHM_KEY *key, size_t bytes,
+                                      struct GRID_SHM_LEASE *lease);
+
+/**
+ * @brief Make a grid decoded by its owner available to everyone waiting for it
+ * @param shm Cache handle
+ * @param lease Lease acquired as owner
+ * @author Florian Katerndahl
+ */
+void grid_shm_publish(struct GRID_SHM *shm, const struct GRID_SHM_LEASE *lease);
+
+/**
+ * @brief Drop a reference to a grid and unmap it
+ * @details An owner which releases a grid without publishing it discards the grid, e.g. because decoding failed.
+ * @param shm Cache handle
+ * @param lease Lease to release
+ * @author Florian Katerndahl
+ */
+void grid_shm_release(struct GRID_SHM *shm, struct GRID_SHM_LEASE *lease);
+
+/**
+ * @brief Detach from the cache; cached grids stay available to other processes
+ * @param shm Cache handle
+ * @author Florian Katerndahl
+ */
+void grid_shm_close(struct GRID_SHM *shm);
+
+/**
+ * @brief Remove the cache and all grids in it, e.g. to free the memory once all workers are done
+ * @param name Name of the index segment
+ * @return Zero on success, non-zero if there was no cache of that name
+ * @author Florian Katerndahl
+ */
+int grid_shm_remove(const char *name);
+
+#endif //CAMS_GRIDSHM_H
@@ -0,0 +1,30 @@
+#ifndef CAMS_HASH_H
+#define CAMS_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FNV1A_OFFSET_BASIS 0xcbf29ce484222325ULL
+
+/**
+ * @brief Fold `length` bytes into a 64-bit FNV-1a hash
+ * @details Start with `FNV1A_OFFSET_BASIS` and pass the result of one call to the next to hash data made up of several
+ * parts. Used for fingerprints in file names and headers, not for anything security-relevant.
+ * @param hash Hash of the preceding data
+ * @param data Bytes to fold in
+ * @param length Number of bytes
+ * @return Hash including `data`
+ * @author Florian Katerndahl
+ */
+static inline uint64_t fnv1a(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *) data;
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+#endif //CAMS_HASH_H
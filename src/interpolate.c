@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "interpolate.h"
+
+struct POINTS read_points(const char *fname) {
+    char line[256];
+    size_t capacity = 64;
+    struct POINTS points = {0};
+
+    FILE *f = fopen(fname, "rt");
+
+    if (f == NULL) {
+        fprintf(stderr, "Error: Could not open file %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    points.lon = malloc(capacity * sizeof(double));
+    points.lat = malloc(capacity * sizeof(double));
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (points.n == capacity) {
+            capacity *= 2;
+            points.lon = realloc(points.lon, capacity * sizeof(double));
+            points.lat = realloc(points.lat, capacity * sizeof(double));
+        }
+
+        if (points.lon == NULL || points.lat == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory while parsing line %s\n", line);
+            exit(EXIT_FAILURE);
+        }
+
+        if (sscanf(line, "%lf %lf", points.lon + points.n, points.lat + points.n) != 2)
+            break;
+
+        points.n++;
+    }
+
+    fclose(f);
+
+    if (points.n == 0) {
+        fprintf(stderr, "Error: No coordinates found in %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    return points;
+}
+
+void free_points(struct POINTS *points) {
+    free(points->lon);
+    free(points->lat);
+    points->lon = NULL;
+    points->lat = NULL;
+    points->n = 0;
+}
+
+int grid_equal(const struct GRID *a, const struct GRID *b) {
+    return a->ni == b->ni && a->nj == b->nj &&
+           fabs(a->lon_first - b->lon_first) < 1e-6 && fabs(a->lat_first - b->lat_first) < 1e-6 &&
+           fabs(a->d_lon - b->d_lon) < 1e-6 && fabs(a->d_lat - b->d_lat) < 1e-6;
+}
+
+/**
+ * @brief Map a coordinate to its fractional position on a grid axis.
+ * @return 0 if the position is on the axis, 1 if it is outside
+ */
+static int axis_position(double x, long n, int wraps, long *i0, long *i1, float *frac) {
+    // positions within rounding noise of the first or last grid line belong to the axis
+    if (x < 0.0 && x > -1e-6)
+        x = 0.0;
+    if (!wraps && x > (double) (n - 1) && x < (double) (n - 1) + 1e-6)
+        x = (double) (n - 1);
+
+    if (x < 0.0 || (!wraps && x > (double) (n - 1)) || (wraps && x >= (double) n))
+        return 1;
+
+    *i0 = (long) floor(x);
+    *frac = (float) (x - (double) *i0);
+    *i1 = *i0 + 1;
+
+    if (*i1 == n)
+        *i1 = wraps ? 0 : *i0;
+
+    return 0;
+}
+
+void compute_point_weights(const struct GRID *grid, const struct POINTS *points, struct POINT_WEIGHTS *weights) {
+    size_t n = points->n;
+    int wraps = fabs((double) grid->ni * grid->d_lon) >= 360.0 - 1e-6;
+
+    weights->n = n;
+    weights->grid = *grid;
+    weights->index = malloc(4 * n * sizeof(int32_t));
+    weights->weight = malloc(4 * n * sizeof(float));
+
+    if (weights->index == NULL || weights->weight == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for interpolation weights\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if ((double) grid->ni * (double) grid->nj > (double) INT32_MAX) {
+        fprintf(stderr, "Error: Grid with %ld x %ld points is too large for interpolation\n", grid->ni, grid->nj);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t p = 0; p < n; p++) {
+        long i0, i1, j0, j1;
+        float fx, fy;
+
+        // longitudes are measured from the first column, in the direction the grid is scanned
+        double dlon = points->lon[p] - grid->lon_first;
+        if (grid->d_lon < 0.0)
+            dlon = -dlon;
+        dlon = fmod(dlon, 360.0);
+        if (dlon < 0.0)
+            dlon += 360.0;
+        // non-global grids crossing the antimeridian aren't affected, others are shifted back to negative offsets
+        if (!wraps && dlon > fabs((double) (grid->ni - 1) * grid->d_lon) + 1e-6 && dlon > 180.0)
+            dlon -= 360.0;
+
+        double x = dlon / fabs(grid->d_lon);
+        double y = (points->lat[p] - grid->lat_first) / grid->d_lat;
+
+        if (axis_position(x, grid->ni, wraps, &i0, &i1, &fx) || axis_position(y, grid->nj, 0, &j0, &j1, &fy)) {
+            for (int k = 0; k < 4; k++) {
+                weights->index[k * n + p] = 0;
+                weights->weight[k * n + p] = NAN;
+            }
+            continue;
+        }
+
+        weights->index[0 * n + p] = (int32_t) (j0 * grid->ni + i0);
+        weights->index[1 * n + p] = (int32_t) (j0 * grid->ni + i1);
+        weights->index[2 * n + p] = (int32_t) (j1 * grid->ni + i0);
+        weights->index[3 * n + p] = (int32_t) (j1 * grid->ni + i1);
+
+        weights->weight[0 * n + p] = (1.0f - fx) * (1.0f - fy);
+        weights->weight[1 * n + p] = fx * (1.0f - fy);
+        weights->weight[2 * n + p] = (1.0f - fx) * fy;
+        weights->weight[3 * n + p] = fx * fy;
+    }
+}
+
+void free_point_weights(struct POINT_WEIGHTS *weights) {
+    free(weights->index);
+    free(weights->weight);
+    weights->index = NULL;
+    weights->weight = NULL;
+    weights->n = 0;
+}
+
+void gather_points(const float *values, const struct POINT_WEIGHTS *weights, float *out) {
+    size_t n = weights->n;
+    size_t i = 0;
+
+    const int32_t *restrict i0 = weights->index, *restrict i1 = i0 + n, *restrict i2 = i1 + n, *restrict i3 = i2 + n;
+    const float *restrict w0 = weights->weight, *restrict w1 = w0 + n, *restrict w2 = w1 + n, *restrict w3 = w2 + n;
+
+#ifdef __AVX2__
+    for (; i + 8 <= n; i += 8) {
+        __m256 v0 = _mm256_i32gather_ps(values, _mm256_loadu_si256((const __m256i *) (i0 + i)), 4);
+        __m256 v1 = _mm256_i32gather_ps(values, _mm256_loadu_si256((const __m256i *) (i1 + i)), 4);
+        __m256 v2 = _mm256_i32gather_ps(values, _mm256_loadu_si256((const __m256i *) (i2 + i)), 4);
+        __m256 v3 = _mm256_i32gather_ps(values, _mm256_loadu_si256((const __m256i *) (i3 + i)), 4);
+
+        __m256 acc = _mm256_mul_ps(_mm256_loadu_ps(w0 + i), v0);
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(w1 + i), v1));
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(w2 + i), v2));
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(w3 + i), v3));
+
+        _mm256_storeu_ps(out + i, acc);
+    }
+#endif
+
+    for (; i < n; i++)
+        out[i] = w0[i] * values[i0[i]] + w1[i] * values[i1[i]] + w2[i] * values[i2[i]] + w3[i] * values[i3[i]];
+}
+
+void lerp_fields(const float *a, const float *b, float weight, size_t n, float *out) {
+    size_t i = 0;
+
+#ifdef __AVX2__
+    __m256 w = _mm256_set1_ps(weight);
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 va = _mm256_loadu_ps(a + i);
+        __m256 vb = _mm256_loadu_ps(b + i);
+        _mm256_storeu_ps(out + i, _mm256_add_ps(va, _mm256_mul_ps(w, _mm256_sub_ps(vb, va))));
+    }
+#endif
+
+    for (; i < n; i++)
+        out[i] = a[i] + weight * (b[i] - a[i]);
+}
+
+void lerp_points(const float *a, const float *b, const float *weight, size_t n, float *out) {
+    size_t i = 0;
+
+#ifdef __AVX2__
+    for (; i + 8 <= n; i += 8) {
+        __m256 va = _mm256_loadu_ps(a + i);
+        __m256 vb = _mm256_loadu_ps(b + i);
+        __m256 w = _mm256_loadu_ps(weight + i);
+        _mm256_storeu_ps(out + i, _mm256_add_ps(va, _mm256_mul_ps(w, _mm256_sub_ps(vb, va))));
+    }
+#endif
+
+    for (; i < n; i++)
+        out[i] = a[i] + weight[i] * (b[i] - a[i]);
+}
@@ -0,0 +1,112 @@
+#ifndef CAMS_INTERPOLATE_H
+#define CAMS_INTERPOLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gributils.h"
+
+/**
+ * @brief Locations at which values are extracted from decoded grids
+ * @author Florian Katerndahl
+ */
+struct POINTS {
+    size_t n;               ///< number of points
+    double *lon;            ///< longitudes in decimal degrees
+    double *lat;            ///< latitudes in decimal degrees
+};
+
+/**
+ * @brief Bilinear interpolation indices and weights of a set of points on one grid
+ * @details Stored as structure of arrays: corner `k` (0: upper left, 1: upper right, 2: lower left, 3: lower right) of
+ * point `i` is found at `index[k * n + i]` and `weight[k * n + i]`. Points outside of the grid are assigned index 0
+ * and a weight of NAN, which propagates to the interpolated value.
+ * @author Florian Katerndahl
+ */
+struct POINT_WEIGHTS {
+    size_t n;               ///< number of points
+    struct GRID grid;       ///< grid for which the weights were computed
+    int32_t *index;         ///< 4 * n offsets into the values of a field
+    float *weight;          ///< 4 * n bilinear weights
+};
+
+/**
+ * @brief Read the file holding center coordinates of all WRS-2 tiles for which values should be extracted
+ * @param fname Path to coordinate file
+ * @return Points in the order they are listed in `fname`
+ * @note The file should contain two columns separated by white space, and no header. The first column should give the
+ * longitude (X), the second column the latitude (Y) with coordinates in decimal degree
+ * (negative values for West/South). Any other column is ignored.
+ * @author Florian Katerndahl
+ */
+struct POINTS read_points(const char *fname);
+
+/**
+ * @brief Free coordinate arrays of `points`
+ * @param points Pointer to points struct
+ * @author Florian Katerndahl
+ */
+void free_points(struct POINTS *points);
+
+/**
+ * @brief Check if two grids share the same geometry
+ * @return 1 if both grids are identical, 0 otherwise
+ * @author Florian Katerndahl
+ */
+int grid_equal(const struct GRID *a, const struct GRID *b);
+
+/**
+ * @brief Compute bilinear interpolation indices and weights of `points` on `grid`
+ * @details Grids spanning the whole globe wrap around in longitude. Computing the weights is done once per grid, the
+ * result can be applied to any number of fields on that grid with `gather_points`.
+ * @param grid Grid geometry
+ * @param points Locations to interpolate to
+ * @param weights Struct to populate. Must be freed with `free_point_weights`.
+ * @author Florian Katerndahl
+ */
+void compute_point_weights(const struct GRID *grid, const struct POINTS *points, struct POINT_WEIGHTS *weights);
+
+/**
+ * @brief Free arrays of `weights`
+ * @param weights Pointer to weights struct
+ * @author Florian Katerndahl
+ */
+void free_point_weights(struct POINT_WEIGHTS *weights);
+
+/**
+ * @brief Interpolate the values of a field to all points at once
+ * @details Uses AVX2 gather instructions if the program is compiled with AVX2 support, a scalar loop otherwise.
+ * @param values Values of a field on the grid `weights` were computed for
+ * @param weights Interpolation indices and weights
+ * @param out Array of at least `weights->n` values
+ * @author Florian Katerndahl
+ */
+void gather_points(const float *values, const struct POINT_WEIGHTS *weights, float *out);
+
+/**
+ * @brief Interpolate linearly in time between two fields on the same grid, i.e. `out = a + weight * (b - a)`
+ * @details Uses AVX2 instructions if the program is compiled with AVX2 support, a scalar loop otherwise. `out` may be
+ * the same array as `a` or `b`.
+ * @param a Values of the earlier field
+ * @param b Values of the later field
+ * @param weight Weight of the later field between 0 and 1
+ * @param n Number of values
+ * @param out Array of at least `n` values
+ * @author Florian Katerndahl
+ */
+void lerp_fields(const float *a, const float *b, float weight, size_t n, float *out);
+
+/**
+ * @brief Interpolate linearly in time between two batches of point values, each point with its own weight
+ * @details Uses AVX2 instructions if the program is compiled with AVX2 support, a scalar loop otherwise. `out` may be
+ * the same array as `a` or `b`.
+ * @param a Values at the earlier time
+ * @param b Values at the later time
+ * @param weight Weight of the later time per point, between 0 and 1
+ * @param n Number of points
+ * @param out Array of at least `n` values
+ * @author Florian Katerndahl
+ */
+void lerp_points(const float *a, const float *b, const float *weight, size_t n, float *out);
+
+#endif //CAMS_INTERPOLATE_H
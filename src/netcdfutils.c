@@ -0,0 +1,599 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <netcdf.h>
+
+#include "netcdfutils.h"
+#include "interpolate.h"
+
+/**
+ * @brief Data variable of a netCDF file with its grid, time axis and packing
+ */
+struct NC_VARIABLE {
+    int ncid;
+    int varid;
+    char name[NC_MAX_NAME + 1];
+    long param;
+    struct GRID grid;
+    size_t n_times;
+    long *date;
+    long *time;
+    size_t chunk[3];        ///< chunk shape in time, latitude and longitude
+    int chunked;            ///< set if the variable is stored in chunks
+    size_t element_size;    ///< size of a stored value in bytes
+    double scale;
+    double offset;
+    int has_fill;
+    float fill;
+    int has_missing;
+    float missing;
+};
+
+static double wall_time(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static void nc_check(int status, const char *what, const char *label) {
+    if (status != NC_NOERR) {
+        fprintf(stderr, "Error: Failed to %s in %s: %s\n", what, label, nc_strerror(status));
+        exit(EXIT_FAILURE);
+    }
+}
+
+int is_netcdf_file(const char *fname) {
+    unsigned char signature[4] = {0};
+
+    FILE *f = fopen(fname, "rb");
+
+    if (f == NULL) {
+        fprintf(stderr, "Error: Could not open file %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t n = fread(signature, 1, sizeof(signature), f);
+    fclose(f);
+
+    if (n < sizeof(signature))
+        return 0;
+
+    // classic, 64-bit offset and 64-bit data formats
+    if (signature[0] == 'C' && signature[1] == 'D' && signature[2] == 'F' &&
+        (signature[3] == 1 || signature[3] == 2 || signature[3] == 5))
+        return 1;
+
+    // netCDF-4 is stored as HDF5
+    return signature[0] == 0x89 && signature[1] == 'H' && signature[2] == 'D' && signature[3] == 'F';
+}
+
+/**
+ * @brief Convert days since 1970-01-01 to a proleptic Gregorian date as YYYYMMDD.
+ */
+static long civil_from_days(long days) {
+    days += 719468;
+    long era = (days >= 0 ? days : days - 146096) / 146097;
+    long doe = days - era * 146097;
+    long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long mp = (5 * doy + 2) / 153;
+    long d = doy - (153 * mp + 2) / 5 + 1;
+    long m = mp < 10 ? mp + 3 : mp - 9;
+    long y = yoe + era * 400 + (m <= 2);
+
+    return y * 10000 + m * 100 + d;
+}
+
+/**
+ * @brief Convert a proleptic Gregorian date to days since 1970-01-01.
+ */
+static long days_from_civil(long y, long m, long d) {
+    y -= m <= 2;
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yoe = y - era * 400;
+    long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 719468;
+}
+
+static int is_time_dimension(const char *name) {
+    return strcmp(name, "time") == 0 || strcmp(name, "valid_time") == 0;
+}
+
+static int is_latitude_dimension(const char *name) {
+    return strcmp(name, "latitude") == 0 || strcmp(name, "lat") == 0;
+}
+
+static int is_longitude_dimension(const char *name) {
+    return strcmp(name, "longitude") == 0 || strcmp(name, "lon") == 0;
+}
+
+/**
+ * @brief Read a one-dimensional coordinate variable.
+ * @return Array of `n` values. The caller is responsible for freeing it.
+ */
+static double *read_coordinate(int ncid, const char *name, size_t n, const char *label) {
+    int varid;
+    double *values = malloc(n * sizeof(double));
+
+    if (values == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for coordinate %s\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    nc_check(nc_inq_varid(ncid, name, &varid), "find coordinate variable", label);
+    nc_check(nc_get_var_double(ncid, varid, values), "read coordinate variable", label);
+
+    return values;
+}
+
+/**
+ * @brief Derive first value and increment of a regular axis.
+ */
+static void regular_axis(const double *values, size_t n, double *first, double *step, const char *name,
+                         const char *label) {
+    *first = values[0];
+    *step = n > 1 ? (values[n - 1] - values[0]) / (double) (n - 1) : 0.0;
+
+    for (size_t i = 1; i < n; i++) {
+        if (fabs(values[i] - (*first + (double) i * *step)) > 1e-3 * fabs(*step)) {
+            fprintf(stderr, "Error: Axis %s of %s is not regular\n", name, label);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * @brief Convert the time axis to validity dates and times, using its CF `units` attribute.
+ */
+static void read_time_axis(int ncid, const char *name, struct NC_VARIABLE *var, const char *label) {
+    char units[NC_MAX_NAME + 1] = {0}, unit[32];
+    size_t length;
+    int varid, year, month, day, hour = 0, minute = 0;
+    double second = 0.0, factor;
+
+    double *offsets = read_coordinate(ncid, name, var->n_times, label);
+
+    nc_check(nc_inq_varid(ncid, name, &varid), "find time variable", label);
+    nc_check(nc_inq_attlen(ncid, varid, "units", &length), "find units of time", label);
+
+    if (length > NC_MAX_NAME) {
+        fprintf(stderr, "Error: Units of time in %s are too long\n", label);
+        exit(EXIT_FAILURE);
+    }
+
+    nc_check(nc_get_att_text(ncid, varid, "units", units), "read units of time", label);
+
+    if (sscanf(units, "%31s since %d-%d-%d %d:%d:%lf", unit, &year, &month, &day, &hour, &minute, &second) < 4) {
+        fprintf(stderr, "Error: Unsupported units of time \"%s\" in %s\n", units, label);
+        exit(EXIT_FAILURE);
+    }
+
+    if (strcmp(unit, "seconds") == 0)
+        factor = 1.0;
+    else if (strcmp(unit, "minutes") == 0)
+        factor = 60.0;
+    else if (strcmp(unit, "hours") == 0)
+        factor = 3600.0;
+    else if (strcmp(unit, "days") == 0)
+        factor = 86400.0;
+    else {
+        fprintf(stderr, "Error: Unsupported units of time \"%s\" in %s\n", units, label);
+        exit(EXIT_FAILURE);
+    }
+
+    var->date = malloc(var->n_times * sizeof(long));
+    var->time = malloc(var->n_times * sizeof(long));
+
+    if (var->date == NULL || var->time == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for time axis\n");
+        exit(EXIT_FAILURE);
+    }
+
+    double epoch = (double) days_from_civil(year, month, day) * 86400.0 + hour * 3600.0 + minute * 60.0 + second;
+
+    for (size_t t = 0; t < var->n_times; t++) {
+        // rounded to full minutes, validity times are given as HHMM
+        long seconds = (long) floor((epoch + offsets[t] * factor) / 60.0 + 0.5) * 60;
+        long days = (long) floor((double) seconds / 86400.0);
+        long of_day = seconds - days * 86400;
+
+        var->date[t] = civil_from_days(days);
+        var->time[t] = of_day / 3600 * 100 + of_day % 3600 / 60;
+    }
+
+    free(offsets);
+}
+
+static int get_double_attribute(int ncid, int varid, const char *name, double *value) {
+    size_t length;
+
+    if (nc_inq_attlen(ncid, varid, name, &length) != NC_NOERR || length != 1)
+        return 0;
+
+    return nc_get_att_double(ncid, varid, name, value) == NC_NOERR;
+}
+
+/**
+ * @brief Find the first variable with time, latitude and longitude dimensions and read its metadata.
+ */
+static void open_variable(int ncid, const char *label, struct NC_VARIABLE *var) {
+    int n_vars, n_dims, n_atts, dimids[NC_MAX_VAR_DIMS], storage;
+    char names[3][NC_MAX_NAME + 1];
+    size_t lengths[3];
+    nc_type type;
+    double value;
+    long param;
+
+    memset(var, 0, sizeof(struct NC_VARIABLE));
+    var->ncid = ncid;
+    var->varid = -1;
+
+    nc_check(nc_inq_nvars(ncid, &n_vars), "list variables", label);
+
+    for (int v = 0; v < n_vars && var->varid == -1; v++) {
+        nc_check(nc_inq_var(ncid, v, var->name, &type, &n_dims, dimids, &n_atts), "inquire variable", label);
+
+        if (n_dims != 3)
+            continue;
+
+        for (int d = 0; d < 3; d++)
+            nc_check(nc_inq_dim(ncid, dimids[d], names[d], &lengths[d]), "inquire dimension", label);
+
+        if (is_time_dimension(names[0]) && is_latitude_dimension(names[1]) && is_longitude_dimension(names[2]))
+            var->varid = v;
+    }
+
+    if (var->varid == -1) {
+        fprintf(stderr, "Error: %s holds no variable with dimensions time, latitude and longitude\n", label);
+        exit(EXIT_FAILURE);
+    }
+
+    var->n_times = lengths[0];
+
+    double *lat = read_coordinate(ncid, names[1], lengths[1], label);
+    double *lon = read_coordinate(ncid, names[2], lengths[2], label);
+
+    var->grid.nj = (long) lengths[1];
+    var->grid.ni = (long) lengths[2];
+    regular_axis(lat, lengths[1], &var->grid.lat_first, &var->grid.d_lat, names[1], label);
+    regular_axis(lon, lengths[2], &var->grid.lon_first, &var->grid.d_lon, names[2], label);
+
+    free(lat);
+    free(lon);
+
+    read_time_axis(ncid, names[0], var, label);
+
+    nc_check(nc_inq_type(ncid, type, NULL, &var->element_size), "inquire type", label);
+
+    var->scale = get_double_attribute(ncid, var->varid, "scale_factor", &value) ? value : 1.0;
+    var->offset = get_double_attribute(ncid, var->varid, "add_offset", &value) ? value : 0.0;
+
+    // fill and missing values are compared with the stored, i.e. still packed, values
+    if ((var->has_fill = get_double_attribute(ncid, var->varid, "_FillValue", &value)))
+        var->fill = (float) value;
+    if ((var->has_missing = get_double_attribute(ncid, var->varid, "missing_value", &value)))
+        var->missing = (float) value;
+
+    var->param = nc_get_att_long(ncid, var->varid, "GRIB_paramId", &param) == NC_NOERR ? param : 0;
+
+    if (nc_inq_var_chunking(ncid, var->varid, &storage, var->chunk) == NC_NOERR && storage == NC_CHUNKED) {
+        var->chunked = 1;
+    } else {
+        // contiguous variables are laid out row by row; a whole row is cheap to read across all time steps
+        var->chunk[0] = var->n_times;
+        var->chunk[1] = 1;
+        var->chunk[2] = lengths[2];
+    }
+}
+
+static void close_variable(struct NC_VARIABLE *var) {
+    free(var->date);
+    free(var->time);
+    var->date = NULL;
+    var->time = NULL;
+}
+
+static void unpack(const struct NC_VARIABLE *var, float *values, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if ((var->has_fill && values[i] == var->fill) || (var->has_missing && values[i] == var->missing))
+            values[i] = NAN;
+        else
+            values[i] = (float) ((double) values[i] * var->scale + var->offset);
+    }
+}
+
+static void field_header(const struct NC_VARIABLE *var, size_t t, struct GRIB_FIELD *field) {
+    memset(field, 0, sizeof(struct GRIB_FIELD));
+    field->index = t;
+    field->data_date = var->date[t];
+    field->data_time = var->time[t];
+    field->date = var->date[t];
+    field->time = var->time[t];
+    field->param = var->param;
+    field->grid = var->grid;
+    strncpy(field->short_name, var->name, sizeof(field->short_name) - 1);
+}
+
+static size_t netcdf_fields(int ncid, const char *label, const struct DECODE_OPTIONS *options,
+                            field_consumer consumer, void *user, struct DECODE_STATS *stats) {
+    struct NC_VARIABLE var;
+    struct DECODE_STATS local = {0};
+    struct GRIB_FIELD field;
+
+    double start = wall_time();
+
+    open_variable(ncid, label, &var);
+
+    size_t n_values = (size_t) var.grid.ni * (size_t) var.grid.nj;
+    float *values = malloc(n_values * sizeof(float));
+
+    if (values == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for field\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t t = 0; t < var.n_times; t++) {
+        size_t offset[3] = {t, 0, 0}, count[3] = {1, (size_t) var.grid.nj, (size_t) var.grid.ni};
+
+        field_header(&var, t, &field);
+
+        if (options->filter && !options->filter(&field, options->filter_user))
+            continue;
+
+        nc_check(nc_get_vara_float(ncid, var.varid, offset, count, values), "read field", label);
+        unpack(&var, values, n_values);
+        field.values = values;
+
+        if (consumer)
+            consumer(&field, 0, user);
+
+        local.messages++;
+        local.bytes += n_values * var.element_size;
+        local.values += n_values;
+    }
+
+    local.seconds = wall_time() - start;
+
+    if (stats)
+        *stats = local;
+
+    free(values);
+    close_variable(&var);
+
+    return local.messages;
+}
+
+size_t netcdf_data_from_file(const char *fname, const struct DECODE_OPTIONS *options, field_consumer consumer,
+                             void *user, struct DECODE_STATS *stats) {
+    int ncid;
+
+    nc_check(nc_open(fname, NC_NOWRITE, &ncid), "open file", fname);
+
+    size_t n_fields = netcdf_fields(ncid, fname, options, consumer, user, stats);
+
+    nc_close(ncid);
+
+    return n_fields;
+}
+
+size_t netcdf_data_from_memory(const void *buffer, size_t length, const struct DECODE_OPTIONS *options,
+                               field_consumer consumer, void *user, struct DECODE_STATS *stats) {
+    int ncid;
+
+    // opened read-only, the buffer is never written to
+    nc_check(nc_open_mem("memory", NC_NOWRITE, length, (void *) buffer, &ncid), "open buffer", "memory");
+
+    size_t n_fields = netcdf_fields(ncid, "memory", options, consumer, user, stats);
+
+    nc_close(ncid);
+
+    return n_fields;
+}
+
+/**
+ * @brief Grid cell needed for interpolation, together with the chunk it is stored in
+ */
+struct NC_CELL {
+    size_t chunk;
+    int32_t index;
+};
+
+static int compare_cells(const void *a, const void *b) {
+    const struct NC_CELL *x = (const struct NC_CELL *) a, *y = (const struct NC_CELL *) b;
+
+    if (x->chunk != y->chunk) return x->chunk < y->chunk ? -1 : 1;
+    if (x->index != y->index) return x->index < y->index ? -1 : 1;
+    return 0;
+}
+
+static int compare_indices(const void *a, const void *b) {
+    int32_t x = *(const int32_t *) a, y = *(const int32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+size_t netcdf_point_series(const char *fname, const struct POINTS *points, const struct DECODE_OPTIONS *options,
+                           struct POINT_SERIES *series, struct DECODE_STATS *stats) {
+    struct NC_VARIABLE var;
+    struct POINT_WEIGHTS weights;
+    struct DECODE_STATS local = {0};
+    struct GRIB_FIELD field;
+    size_t n = points->n, n_selected = 0, n_cells = 0;
+    int ncid;
+
+    double start = wall_time();
+
+    nc_check(nc_open(fname, NC_NOWRITE, &ncid), "open file", fname);
+    open_variable(ncid, fname, &var);
+    compute_point_weights(&var.grid, points, &weights);
+
+    size_t *selected = malloc((var.n_times + 1) * sizeof(size_t));
+    struct NC_CELL *cells = malloc(4 * n * sizeof(struct NC_CELL));
+    int32_t *indices = malloc(4 * n * sizeof(int32_t));
+    int32_t *slots = malloc(4 * n * sizeof(int32_t));
+
+    if (selected == NULL || cells == NULL || indices == NULL || slots == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for point extraction\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t t = 0; t < var.n_times; t++) {
+        field_header(&var, t, &field);
+        if (options->filter == NULL || options->filter(&field, options->filter_user))
+            selected[n_selected++] = t;
+    }
+
+    // unique cells touched by any point, sorted by their position in the grid
+    for (size_t k = 0; k < 4 * n; k++)
+        if (!isnan(weights.weight[k]))
+            indices[n_cells++] = weights.index[k];
+
+    qsort(indices, n_cells, sizeof(int32_t), compare_indices);
+
+    size_t n_unique = 0;
+    for (size_t c = 0; c < n_cells; c++)
+        if (n_unique == 0 || indices[n_unique - 1] != indices[c])
+            indices[n_unique++] = indices[c];
+    n_cells = n_unique;
+
+    for (size_t k = 0; k < 4 * n; k++) {
+        int32_t *found = isnan(weights.weight[k]) ? NULL :
+                         bsearch(&weights.index[k], indices, n_cells, sizeof(int32_t), compare_indices);
+        slots[k] = found ? (int32_t) (found - indices) : -1;
+    }
+
+    size_t ni = (size_t) var.grid.ni;
+    size_t chunk_columns = (ni + var.chunk[2] - 1) / var.chunk[2];
+
+    for (size_t c = 0; c < n_cells; c++) {
+        size_t j = (size_t) indices[c] / ni, i = (size_t) indices[c] % ni;
+        cells[c] = (struct NC_CELL) {.chunk = j / var.chunk[1] * chunk_columns + i / var.chunk[2], .index = indices[c]};
+    }
+
+    qsort(cells, n_cells, sizeof(struct NC_CELL), compare_cells);
+
+    float *cell_values = malloc((n_selected * n_cells + 1) * sizeof(float));
+    float *buffer = NULL;
+    size_t buffer_size = 0;
+
+    if (cell_values == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for point extraction\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t first = 0, last; first < n_cells; first = last) {
+        size_t j_min = SIZE_MAX, j_max = 0, i_min = SIZE_MAX, i_max = 0;
+
+        for (last = first; last < n_cells && cells[last].chunk == cells[first].chunk; last++) {
+            size_t j = (size_t) cells[last].index / ni, i = (size_t) cells[last].index % ni;
+            if (j < j_min) j_min = j;
+            if (j > j_max) j_max = j;
+            if (i < i_min) i_min = i;
+            if (i > i_max) i_max = i;
+        }
+
+        size_t rows = j_max - j_min + 1, columns = i_max - i_min + 1;
+
+        // runs of consecutive selected time steps stored in the same chunk are read with a single request
+        for (size_t s0 = 0, s1; s0 < n_selected; s0 = s1) {
+            for (s1 = s0 + 1; s1 < n_selected && selected[s1] == selected[s1 - 1] + 1 &&
+                              selected[s1] / var.chunk[0] == selected[s0] / var.chunk[0]; s1++);
+
+            size_t offset[3] = {selected[s0], j_min, i_min}, count[3] = {s1 - s0, rows, columns};
+            size_t n_read = count[0] * rows * columns;
+
+            if (n_read > buffer_size) {
+                buffer_size = n_read;
+                if ((buffer = realloc(buffer, buffer_size * sizeof(float))) == NULL) {
+                    fprintf(stderr, "Error: Failed to allocate memory for point extraction\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            nc_check(nc_get_vara_float(ncid, var.varid, offset, count, buffer), "read hyperslab", fname);
+            unpack(&var, buffer, n_read);
+
+            for (size_t c = first; c < last; c++) {
+                size_t j = (size_t) cells[c].index / ni - j_min, i = (size_t) cells[c].index % ni - i_min;
+                int32_t *slot = bsearch(&cells[c].index, indices, n_cells, sizeof(int32_t), compare_indices);
+
+                for (size_t s = s0; s < s1; s++)
+                    cell_values[s * n_cells + (size_t) (slot - indices)] =
+                        buffer[((s - s0) * rows + j) * columns + i];
+            }
+
+            local.bytes += var.chunked ? var.chunk[0] * var.chunk[1] * var.chunk[2] * var.element_size :
+                           n_read * var.element_size;
+            local.values += n_read;
+        }
+    }
+
+    memset(series, 0, sizeof(struct POINT_SERIES));
+    series->n_points = n;
+    series->n_times = n_selected;
+    series->param = var.param;
+    strncpy(series->short_name, var.name, sizeof(series->short_name) - 1);
+    series->index = malloc((n_selected + 1) * sizeof(size_t));
+    series->date = malloc((n_selected + 1) * sizeof(long));
+    series->time = malloc((n_selected + 1) * sizeof(long));
+    series->values = malloc((n_selected * n + 1) * sizeof(float));
+
+    if (series->index == NULL || series->date == NULL || series->time == NULL || series->values == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for point series\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t s = 0; s < n_selected; s++) {
+        const float *values = cell_values + s * n_cells;
+        float *out = series->values + s * n;
+
+        series->index[s] = selected[s];
+        series->date[s] = var.date[selected[s]];
+        series->time[s] = var.time[selected[s]];
+
+        for (size_t p = 0; p < n; p++) {
+            float value = 0.0f;
+
+            for (size_t k = 0; k < 4; k++) {
+                int32_t slot = slots[k * n + p];
+                value = slot < 0 ? NAN : value + weights.weight[k * n + p] * values[slot];
+            }
+
+            out[p] = value;
+        }
+    }
+
+    local.messages = n_selected;
+    local.seconds = wall_time() - start;
+
+    if (stats)
+        *stats = local;
+
+    free(buffer);
+    free(cell_values);
+    free(slots);
+    free(indices);
+    free(cells);
+    free(selected);
+    free_point_weights(&weights);
+    close_variable(&var);
+    nc_close(ncid);
+
+    return n_selected;
+}
+
+void free_point_series(struct POINT_SERIES *series) {
+    free(series->index);
+    free(series->date);
+    free(series->time);
+    free(series->values);
+    memset(series, 0, sizeof(struct POINT_SERIES));
+}
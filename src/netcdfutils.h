@@ -0,0 +1,88 @@
+#ifndef CAMS_NETCDFUTILS_H
+#define CAMS_NETCDFUTILS_H
+
+#include <stddef.h>
+
+#include "gributils.h"
+
+/**
+ * @brief Values of a single variable at a set of points for a number of time steps
+ * @author Florian Katerndahl
+ */
+struct POINT_SERIES {
+    size_t n_points;        ///< number of points
+    size_t n_times;         ///< number of time steps
+    long param;             ///< value of the variable's `GRIB_paramId` attribute, 0 if missing
+    char short_name[16];    ///< name of the variable
+    size_t *index;          ///< zero-based position of each time step in the file
+    long *date;             ///< validity date of each time step as YYYYMMDD
+    long *time;             ///< validity time of each time step as HHMM
+    float *values;          ///< bilinearly interpolated values, time step by time step; NAN outside of the grid
+};
+
+/**
+ * @brief Check if a file is in one of the netCDF formats, i.e. classic, 64-bit offset, 64-bit data or netCDF-4
+ * @param fname Path to file
+ * @return 1 if `fname` starts with the signature of a netCDF file, 0 otherwise
+ * @author Florian Katerndahl
+ */
+int is_netcdf_file(const char *fname);
+
+/**
+ * @brief Read all fields of a netCDF file as downloaded from the ADS and pass them to `consumer`
+ * @details The file must hold a variable with the dimensions time (or valid_time), latitude and longitude on a
+ * regular grid. Packed values are unpacked with `scale_factor` and `add_offset`; fill and missing values are set to
+ * NAN. Fields are read one time step at a time on the calling thread, since the netCDF library is not thread-safe.
+ * `consumer` is always called with worker 0.
+ * @param fname Path to netCDF file
+ * @param options Options of the decoding engine; only `filter` is used
+ * @param consumer Function called once for every time step
+ * @param user Pointer passed to `consumer`
+ * @param stats If not NULL, populated with throughput figures of the run
+ * @return Number of fields read
+ * @author Florian Katerndahl
+ */
+size_t netcdf_data_from_file(const char *fname, const struct DECODE_OPTIONS *options, field_consumer consumer,
+                             void *user, struct DECODE_STATS *stats);
+
+/**
+ * @brief Read all fields of a netCDF file held in memory and pass them to `consumer`
+ * @details See `netcdf_data_from_file`.
+ * @param buffer Contents of a netCDF file
+ * @param length Size of `buffer` in bytes
+ * @param options Options of the decoding engine; only `filter` is used
+ * @param consumer Function called once for every time step
+ * @param user Pointer passed to `consumer`
+ * @param stats If not NULL, populated with throughput figures of the run
+ * @return Number of fields read
+ * @warning `buffer` must not be modified or freed before this function returns.
+ * @author Florian Katerndahl
+ */
+size_t netcdf_data_from_memory(const void *buffer, size_t length, const struct DECODE_OPTIONS *options,
+                               field_consumer consumer, void *user, struct DECODE_STATS *stats);
+
+/**
+ * @brief Extract the values at a set of points from a netCDF file, reading only the chunks which cover them
+ * @details Time steps are selected by passing their headers to `options->filter`; `values` of those headers are NULL.
+ * The grid cells needed for bilinear interpolation are grouped by the chunk they are stored in, and each group is read
+ * with one hyperslab request per run of selected time steps within a chunk. Files without chunking are read row by row.
+ * In `stats`, `messages` counts time steps, `bytes` the size of all chunks touched and `values` the cells read.
+ * @param fname Path to netCDF file
+ * @param points Locations to extract
+ * @param options Options of the decoding engine; only `filter` is used
+ * @param series Struct to populate; free with `free_point_series`
+ * @param stats If not NULL, populated with throughput figures of the run
+ * @return Number of time steps extracted
+ * @author Florian Katerndahl
+ */
+size_t netcdf_point_series(const char *fname, const struct POINTS *points, const struct DECODE_OPTIONS *options,
+                           struct POINT_SERIES *series, struct DECODE_STATS *stats);
+
+/**
+ * @brief Free all memory held by `series`
+ * @param series Point series
+ * @author Florian Katerndahl
+ */
+void free_point_series(struct POINT_SERIES *series);
+
+#endif //CAMS_NETCDFUTILS_H
@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "statusparser.h"
+
+enum {
+    EXPECT_OBJECT,          ///< before the top-level object
+    EXPECT_KEY_OR_END,      ///< after the opening brace
+    EXPECT_KEY,             ///< after a comma
+    EXPECT_COLON,
+    EXPECT_VALUE,
+    EXPECT_SEPARATOR,       ///< after a value, i.e. a comma or the closing brace
+    FINISHED                ///< after the top-level object, only white space may follow
+};
+
+enum {
+    FIELD_OTHER,
+    FIELD_STATE,
+    FIELD_LOCATION,
+    FIELD_CONTENT_LENGTH
+};
+
+void status_parser_init(struct STATUS_PARSER *parser) {
+    memset(parser, 0, sizeof(struct STATUS_PARSER));
+    parser->phase = EXPECT_OBJECT;
+}
+
+static void begin_capture(struct STATUS_PARSER *parser, char *buffer, size_t size, size_t *length) {
+    parser->capture = buffer;
+    parser->capture_size = size;
+    parser->capture_length = length;
+    parser->overflow = 0;
+
+    if (buffer) {
+        buffer[0] = '\0';
+        *length = 0;
+    }
+}
+
+static void append(struct STATUS_PARSER *parser, char c) {
+    if (parser->capture == NULL)
+        return;
+
+    if (*parser->capture_length + 1 >= parser->capture_size) {
+        parser->overflow = 1;
+        return;
+    }
+
+    parser->capture[(*parser->capture_length)++] = c;
+    parser->capture[*parser->capture_length] = '\0';
+}
+
+static int lookup_field(const struct STATUS_PARSER *parser) {
+    if (parser->overflow)
+        return FIELD_OTHER;
+    if (strcmp(parser->key, "state") == 0)
+        return FIELD_STATE;
+    if (strcmp(parser->key, "location") == 0)
+        return FIELD_LOCATION;
+    if (strcmp(parser->key, "content_length") == 0)
+        return FIELD_CONTENT_LENGTH;
+    return FIELD_OTHER;
+}
+
+/**
+ * @brief Handle the end of a string within the top-level object, i.e. a member name or a value.
+ */
+static void end_string(struct STATUS_PARSER *parser) {
+    if (parser->is_key) {
+        parser->field = lookup_field(parser);
+        parser->phase = EXPECT_COLON;
+        return;
+    }
+
+    switch (parser->field) {
+        case FIELD_STATE:
+            parser->has_state = !parser->overflow;
+            break;
+        case FIELD_LOCATION:
+            parser->has_location = !parser->overflow;
+            break;
+        case FIELD_CONTENT_LENGTH:
+            // jansson reports a string where an integer is expected, so leave that to it
+            parser->error = 1;
+            break;
+        default:
+            break;
+    }
+
+    parser->error |= parser->field != FIELD_OTHER && parser->overflow;
+}
+
+/**
+ * @brief Handle the end of a number or literal within the top-level object.
+ */
+static void end_scalar(struct STATUS_PARSER *parser) {
+    if (parser->field != FIELD_CONTENT_LENGTH)
+        return;
+
+    // only plain non-negative integers which fit into size_t are taken, everything else is left to jansson
+    if (parser->overflow || parser->number_length == 0 || parser->number_length > 18 ||
+        strspn(parser->number, "0123456789") != parser->number_length) {
+        parser->error = 1;
+        return;
+    }
+
+    parser->content_length = (size_t) strtoull(parser->number, NULL, 10);
+    parser->has_content_length = 1;
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int is_scalar_char(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '+' ||
+           c == '.';
+}
+
+void status_parser_feed(struct STATUS_PARSER *parser, const char *bytes, size_t length) {
+    for (size_t i = 0; i < length && !parser->error; i++) {
+        char c = bytes[i];
+
+        if (parser->in_string) {
+            if (parser->escape) {
+                parser->escape = 0;
+                switch (c) {
+                    case '"':
+                    case '\\':
+                    case '/':
+                        break;
+                    case 'b':
+                        c = '\b';
+                        break;
+                    case 'f':
+                        c = '\f';
+                        break;
+                    case 'n':
+                        c = '\n';
+                        break;
+                    case 'r':
+                        c = '\r';
+                        break;
+                    case 't':
+                        c = '\t';
+                        break;
+                    default:
+                        // \u escapes are not decoded; wanted values fall back to jansson, names are not wanted
+                        parser->overflow = 1;
+                        parser->capture = NULL;
+                        continue;
+                }
+                append(parser, c);
+            } else if (c == '\\') {
+                parser->escape = 1;
+            } else if (c == '"') {
+                parser->in_string = 0;
+                if (parser->depth == 1)
+                    end_string(parser);
+            } else {
+                append(parser, c);
+            }
+            continue;
+        }
+
+        if (parser->in_scalar) {
+            if (is_scalar_char(c)) {
+                append(parser, c);
+                continue;
+            }
+            parser->in_scalar = 0;
+            end_scalar(parser);
+            if (parser->error)
+                break;
+        }
+
+        if (is_space(c))
+            continue;
+
+        // nested values are skipped, only strings have to be recognized so that brackets within them are ignored
+        if (parser->depth > 1) {
+            if (c == '"') {
+                parser->in_string = 1;
+                parser->capture = NULL;
+            } else if (c == '{' || c == '[') {
+                parser->depth++;
+            } else if (c == '}' || c == ']') {
+                parser->depth--;
+            }
+            continue;
+        }
+
+        switch (parser->phase) {
+            case EXPECT_OBJECT:
+                if (c != '{') {
+                    parser->error = 1;
+                    break;
+                }
+                parser->depth = 1;
+                parser->phase = EXPECT_KEY_OR_END;
+                break;
+            case EXPECT_KEY_OR_END:
+            case EXPECT_KEY:
+                if (c == '}' && parser->phase == EXPECT_KEY_OR_END) {
+                    parser->depth = 0;
+                    parser->phase = FINISHED;
+                } else if (c == '"') {
+                    parser->in_string = 1;
+                    parser->is_key = 1;
+                    begin_capture(parser, parser->key, sizeof(parser->key), &parser->key_length);
+                } else {
+                    parser->error = 1;
+                }
+                break;
+            case EXPECT_COLON:
+                if (c != ':')
+                    parser->error = 1;
+                parser->phase = EXPECT_VALUE;
+                break;
+            case EXPECT_VALUE:
+                // the value is consumed by the string, scalar or nesting states above before a separator is expected
+                parser->phase = EXPECT_SEPARATOR;
+                parser->is_key = 0;
+                if (c == '"') {
+                    parser->in_string = 1;
+                    if (parser->field == FIELD_STATE)
+                        begin_capture(parser, parser->state, sizeof(parser->state), &parser->state_length);
+                    else if (parser->field == FIELD_LOCATION)
+                        begin_capture(parser, parser->location, sizeof(parser->location), &parser->location_length);
+                    else
+                        begin_capture(parser, NULL, 0, NULL);
+                } else if (c == '{' || c == '[') {
+                    parser->error = parser->field != FIELD_OTHER;
+                    parser->depth = 2;
+                } else if (is_scalar_char(c)) {
+                    parser->error = parser->field == FIELD_STATE || parser->field == FIELD_LOCATION;
+                    parser->in_scalar = 1;
+                    if (parser->field == FIELD_CONTENT_LENGTH)
+                        begin_capture(parser, parser->number, sizeof(parser->number), &parser->number_length);
+                    else
+                        begin_capture(parser, NULL, 0, NULL);
+                    append(parser, c);
+                } else {
+                    parser->error = 1;
+                }
+                break;
+            case EXPECT_SEPARATOR:
+                if (c == ',') {
+                    parser->phase = EXPECT_KEY;
+                } else if (c == '}') {
+                    parser->depth = 0;
+                    parser->phase = FINISHED;
+                } else {
+                    parser->error = 1;
+                }
+                break;
+            default:
+                parser->error = 1;
+                break;
+        }
+    }
+}
+
+int status_parser_finished(const struct STATUS_PARSER *parser) {
+    return parser->phase == FINISHED && !parser->error && !parser->in_string && !parser->in_scalar;
+}
@@ -0,0 +1,72 @@
+#ifndef CAMS_STATUSPARSER_H
+#define CAMS_STATUSPARSER_H
+
+#include <stddef.h>
+
+enum {
+    STATUS_KEY_SIZE = 32,
+    STATUS_STATE_SIZE = 32,
+    STATUS_LOCATION_SIZE = 4096,
+    STATUS_NUMBER_SIZE = 32
+};
+
+/**
+ * @brief Incremental parser extracting `state`, `location` and `content_length` from a task status response
+ * @details Bytes are fed as they arrive, no tree is built and nothing is allocated. Only members of the top-level
+ * object are inspected; nested values are skipped by tracking strings and brackets. Whenever the response is not
+ * understood, e.g. a wanted member has an unexpected type, a string uses `\u` escapes or exceeds its buffer, or the
+ * document is incomplete, `error` is set and the response has to be parsed with jansson instead.
+ * @author Florian Katerndahl
+ */
+struct STATUS_PARSER {
+    int phase;                              ///< position within the top-level object
+    int depth;                              ///< nesting depth; 1 within the top-level object
+    int in_string;                          ///< set while inside a string
+    int in_scalar;                          ///< set while inside a number or literal
+    int escape;                             ///< set if the previous character of a string was a backslash
+    int is_key;                             ///< set if the current string is a member name
+    int field;                              ///< member the current value belongs to
+    int overflow;                           ///< set if the current token exceeded its buffer
+    char *capture;                          ///< buffer the current token is copied to, NULL if it is skipped
+    size_t capture_size;
+    size_t *capture_length;
+    char key[STATUS_KEY_SIZE];
+    size_t key_length;
+    char number[STATUS_NUMBER_SIZE];
+    size_t number_length;
+    int has_state;
+    char state[STATUS_STATE_SIZE];          ///< value of `state`
+    size_t state_length;
+    int has_location;
+    char location[STATUS_LOCATION_SIZE];    ///< value of `location`
+    size_t location_length;
+    int has_content_length;
+    size_t content_length;                  ///< value of `content_length`
+    int error;                              ///< set if the response has to be parsed with jansson
+};
+
+/**
+ * @brief Prepare a parser for a new response
+ * @param parser Parser to initialize
+ * @author Florian Katerndahl
+ */
+void status_parser_init(struct STATUS_PARSER *parser);
+
+/**
+ * @brief Parse the next bytes of a response
+ * @param parser Parser
+ * @param bytes Bytes as received, not null-terminated
+ * @param length Number of bytes
+ * @author Florian Katerndahl
+ */
+void status_parser_feed(struct STATUS_PARSER *parser, const char *bytes, size_t length);
+
+/**
+ * @brief Check if the whole response was parsed successfully
+ * @param parser Parser which was fed the complete response
+ * @return 1 if the top-level object was closed and no error occurred, 0 otherwise
+ * @author Florian Katerndahl
+ */
+int status_parser_finished(const struct STATUS_PARSER *parser);
+
+#endif //CAMS_STATUSPARSER_H
@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define TRACE_CHUNK_EVENTS 4096
+#define TRACE_DEFAULT_FILE "cams-trace.%p.json"
+
+struct TRACE_EVENT {
+    const char *name;
+    int64_t start;
+    int64_t duration;
+};
+
+/**
+ * @brief Fixed number of events; a thread links a new chunk once its current one is full
+ */
+struct TRACE_CHUNK {
+    struct TRACE_EVENT events[TRACE_CHUNK_EVENTS];
+    atomic_size_t n;                        ///< number of events published to readers
+    struct TRACE_CHUNK *_Atomic next;
+};
+
+/**
+ * @brief Events recorded by one thread
+ */
+struct TRACE_BUFFER {
+    int tid;                                ///< number of the thread in the order of registration
+    struct TRACE_CHUNK *head;               ///< first chunk, where readers start
+    struct TRACE_CHUNK *tail;               ///< chunk the owning thread appends to
+    struct TRACE_BUFFER *next;              ///< next buffer in the list of all buffers
+};
+
+static struct TRACE_BUFFER *_Atomic buffers = NULL;
+static atomic_int n_buffers = 0;
+static atomic_flag exit_handler = ATOMIC_FLAG_INIT;
+static _Thread_local struct TRACE_BUFFER *local = NULL;
+
+static int64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + (int64_t) ts.tv_nsec;
+}
+
+static struct TRACE_CHUNK *new_chunk(void) {
+    struct TRACE_CHUNK *chunk = malloc(sizeof(struct TRACE_CHUNK));
+
+    if (chunk == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for trace events\n");
+        exit(EXIT_FAILURE);
+    }
+
+    atomic_init(&chunk->n, 0);
+    atomic_init(&chunk->next, NULL);
+
+    return chunk;
+}
+
+/**
+ * @brief Expand `%p` in `pattern` to the process id and `%%` to a single percent sign.
+ * @return 0 on success, 1 if the path does not fit into `dest`
+ */
+static int expand_trace_path(char *dest, size_t size, const char *pattern) {
+    size_t n = 0;
+
+    for (const char *c = pattern; *c; c++) {
+        int status;
+
+        if (c[0] == '%' && c[1] == 'p') {
+            status = snprintf(dest + n, size - n, "%ld", (long) getpid());
+            c++;
+        } else {
+            status = snprintf(dest + n, size - n, "%c", *c);
+            c += c[0] == '%' && c[1] == '%';
+        }
+
+        if (status < 0 || (size_t) status >= size - n)
+            return 1;
+        n += (size_t) status;
+    }
+
+    return 0;
+}
+
+static void write_at_exit(void) {
+    const char *pattern = getenv("CAMS_TRACE_FILE");
+    char fname[4096];
+
+    // every process of a pipeline writes a trace of its own
+    if (pattern == NULL)
+        pattern = TRACE_DEFAULT_FILE;
+
+    if (expand_trace_path(fname, sizeof(fname), pattern) || trace_write(fname))
+        fprintf(stderr, "Error: Failed to write trace to %s\n", pattern);
+}
+
+/**
+ * @brief Register a buffer for the calling thread by pushing it onto the list of all buffers.
+ */
+static struct TRACE_BUFFER *register_buffer(void) {
+    struct TRACE_BUFFER *buffer = malloc(sizeof(struct TRACE_BUFFER));
+
+    if (buffer == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for trace buffer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    buffer->tid = atomic_fetch_add(&n_buffers, 1) + 1;
+    buffer->head = buffer->tail = new_chunk();
+    buffer->next = atomic_load(&buffers);
+    while (!atomic_compare_exchange_weak(&buffers, &buffer->next, buffer));
+
+    if (!atomic_flag_test_and_set(&exit_handler))
+        atexit(write_at_exit);
+
+    return buffer;
+}
+
+struct TRACE_SPAN trace_begin(const char *name) {
+    return (struct TRACE_SPAN) {.name = name, .start = trace_now()};
+}
+
+void trace_end(const struct TRACE_SPAN *span) {
+    int64_t end = trace_now();
+
+    if (local == NULL)
+        local = register_buffer();
+
+    struct TRACE_CHUNK *chunk = local->tail;
+    size_t n = atomic_load_explicit(&chunk->n, memory_order_relaxed);
+
+    if (n == TRACE_CHUNK_EVENTS) {
+        struct TRACE_CHUNK *next = new_chunk();
+        atomic_store_explicit(&chunk->next, next, memory_order_release);
+        local->tail = chunk = next;
+        n = 0;
+    }
+
+    chunk->events[n] = (struct TRACE_EVENT) {.name = span->name, .start = span->start, .duration = end - span->start};
+    atomic_store_explicit(&chunk->n, n + 1, memory_order_release);
+}
+
+int trace_write(const char *fname) {
+    FILE *f = fopen(fname, "wt");
+    long pid = (long) getpid();
+    int first = 1;
+
+    if (f == NULL)
+        return 1;
+
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+
+    for (struct TRACE_BUFFER *b = atomic_load(&buffers); b != NULL; b = b->next) {
+        for (struct TRACE_CHUNK *c = b->head; c != NULL; c = atomic_load_explicit(&c->next, memory_order_acquire)) {
+            size_t n = atomic_load_explicit(&c->n, memory_order_acquire);
+
+            for (size_t i = 0; i < n; i++) {
+                const struct TRACE_EVENT *e = &c->events[i];
+                fprintf(f, "%s\n{\"name\": \"%s\", \"cat\": \"cams\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                           "\"pid\": %ld, \"tid\": %d}", first ? "" : ",", e->name, (double) e->start / 1e3,
+                        (double) e->duration / 1e3, pid, b->tid);
+                first = 0;
+            }
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+
+    return fclose(f) != 0;
+}
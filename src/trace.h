@@ -0,0 +1,58 @@
+#ifndef CAMS_TRACE_H
+#define CAMS_TRACE_H
+
+#include <stdint.h>
+
+/**
+ * @brief Span of work which is currently being traced
+ * @author Florian Katerndahl
+ */
+struct TRACE_SPAN {
+    const char *name;       ///< name shown on the timeline; must outlive the program, i.e. be a string literal
+    int64_t start;          ///< start as nanoseconds of the monotonic clock
+};
+
+/*
+ * Tracing is compiled in with -DCAMS_TRACE (`make TRACE=1`), otherwise the macros expand to nothing. A span is opened
+ * with `TRACE_BEGIN(span, "name");` and closed with `TRACE_END(span);` in the same scope. Spans are written as Chrome
+ * trace JSON to the file named by the environment variable CAMS_TRACE_FILE, `cams-trace.%p.json` by default, when the
+ * program exits; `%p` is replaced by the process id, so concurrent processes don't overwrite each other's trace. The
+ * file can be opened with chrome://tracing or https://ui.perfetto.dev.
+ */
+#ifdef CAMS_TRACE
+#define TRACE_BEGIN(span, name) struct TRACE_SPAN span = trace_begin(name)
+#define TRACE_END(span) trace_end(&(span))
+#else
+#define TRACE_BEGIN(span, name) ((void) 0)
+#define TRACE_END(span) ((void) 0)
+#endif // CAMS_TRACE
+
+/**
+ * @brief Open a span, use `TRACE_BEGIN` instead
+ * @param name Name of the span, must be a string literal
+ * @return Span to pass to `trace_end`
+ * @author Florian Katerndahl
+ */
+struct TRACE_SPAN trace_begin(const char *name);
+
+/**
+ * @brief Close a span and record it in the buffer of the calling thread, use `TRACE_END` instead
+ * @details Every thread appends to its own buffer without locking. A buffer is registered on the first span a thread
+ * records, which also registers writing all buffers at exit.
+ * @param span Span returned by `trace_begin` on the same thread
+ * @author Florian Katerndahl
+ */
+void trace_end(const struct TRACE_SPAN *span);
+
+/**
+ * @brief Write all spans recorded so far as Chrome trace JSON
+ * @details Spans become complete ("X") events with microsecond timestamps. Threads are numbered in the order in which
+ * they recorded their first span.
+ * @param fname Path of the trace file
+ * @return Zero on success, non-zero if the file could not be written
+ * @warning Spans recorded concurrently by other threads may be missing from the file.
+ * @author Florian Katerndahl
+ */
+int trace_write(const char *fname);
+
+#endif //CAMS_TRACE_H
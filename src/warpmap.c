@@ -0,0 +1,376 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <gdal/ogr_srs_api.h>
+
+#include "warpmap.h"
+#include "hash.h"
+
+static const char warp_magic[8] = {'C', 'A', 'M', 'S', 'W', 'A', 'R', 'P'};
+
+/**
+ * @brief Remove the line break at the end of a line read with getline.
+ */
+static void chomp(char *line) {
+    size_t length = strlen(line);
+
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+        line[--length] = '\0';
+}
+
+void read_datacube(const char *directory, double resolution, struct DATACUBE *cube) {
+    char path[4096];
+    char *line = NULL;
+    size_t capacity = 0;
+    double *numbers[6] = {
+        &cube->origin_lon, &cube->origin_lat, &cube->origin_x, &cube->origin_y, &cube->tile_size, &cube->block_size
+    };
+
+    memset(cube, 0, sizeof(struct DATACUBE));
+    snprintf(path, sizeof(path), "%s/%s", directory, DATACUBE_DEFINITION);
+
+    FILE *f = fopen(path, "rt");
+
+    if (f == NULL) {
+        fprintf(stderr, "Error: Could not open datacube definition %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    if (getline(&line, &capacity, f) < 0) {
+        fprintf(stderr, "Error: Datacube definition %s is empty\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    chomp(line);
+    cube->projection = line;
+    line = NULL;
+
+    for (int i = 0; i < 6; i++) {
+        if (getline(&line, &capacity, f) < 0 || sscanf(line, "%lf", numbers[i]) != 1) {
+            fprintf(stderr, "Error: Datacube definition %s is incomplete\n", path);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    free(line);
+    fclose(f);
+
+    cube->resolution = resolution;
+
+    // tiles are made of whole pixels, so that the pixels of neighbouring tiles line up
+    double pixels = cube->tile_size / resolution;
+
+    if (resolution <= 0.0 || fabs(pixels - round(pixels)) > 1e-6 || pixels < 1.0) {
+        fprintf(stderr, "Error: Tile size %lf of the datacube is not a multiple of the resolution %lf\n",
+                cube->tile_size, resolution);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void free_datacube(struct DATACUBE *cube) {
+    free(cube->projection);
+    cube->projection = NULL;
+}
+
+struct TILE *read_tiles(const char *fname, size_t *n_tiles) {
+    char line[256];
+    size_t capacity = 64;
+    struct TILE *tiles = malloc(capacity * sizeof(struct TILE));
+
+    FILE *f = fopen(fname, "rt");
+
+    if (f == NULL) {
+        fprintf(stderr, "Error: Could not open file %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    *n_tiles = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        struct TILE tile;
+
+        if (sscanf(line, "X%d_Y%d", &tile.x, &tile.y) != 2)
+            continue;
+
+        if (*n_tiles == capacity) {
+            capacity *= 2;
+            tiles = realloc(tiles, capacity * sizeof(struct TILE));
+        }
+
+        if (tiles == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for tiles\n");
+            exit(EXIT_FAILURE);
+        }
+
+        tiles[(*n_tiles)++] = tile;
+    }
+
+    fclose(f);
+
+    if (*n_tiles == 0) {
+        fprintf(stderr, "Error: No tiles found in %s\n", fname);
+        exit(EXIT_FAILURE);
+    }
+
+    return tiles;
+}
+
+void tile_name(char *dest, size_t size, struct TILE tile) {
+    snprintf(dest, size, "X%04d_Y%04d", tile.x, tile.y);
+}
+
+void tile_geo_transform(const struct DATACUBE *cube, struct TILE tile, double geo_transform[6]) {
+    geo_transform[0] = cube->origin_x + (double) tile.x * cube->tile_size;
+    geo_transform[1] = cube->resolution;
+    geo_transform[2] = 0.0;
+    geo_transform[3] = cube->origin_y - (double) tile.y * cube->tile_size;
+    geo_transform[4] = 0.0;
+    geo_transform[5] = -cube->resolution;
+}
+
+/**
+ * @brief Fingerprint of everything a warp map depends on besides the tile and the grid geometry.
+ */
+static uint64_t datacube_fingerprint(const struct DATACUBE *cube) {
+    uint64_t hash = FNV1A_OFFSET_BASIS;
+
+    hash = fnv1a(hash, cube->projection, strlen(cube->projection));
+    hash = fnv1a(hash, &cube->origin_x, sizeof(double));
+    hash = fnv1a(hash, &cube->origin_y, sizeof(double));
+    hash = fnv1a(hash, &cube->tile_size, sizeof(double));
+    hash = fnv1a(hash, &cube->resolution, sizeof(double));
+
+    return hash;
+}
+
+static struct WARP_MAP_HEADER warp_map_header(const struct DATACUBE *cube, struct TILE tile, long size,
+                                              const struct GRID *grid) {
+    struct WARP_MAP_HEADER header = {
+        .version = 1, .byte_order = 0x01020304, .datacube = datacube_fingerprint(cube), .tile_x = tile.x,
+        .tile_y = tile.y, .size = size, .ni = grid->ni, .nj = grid->nj, .lon_first = grid->lon_first,
+        .lat_first = grid->lat_first, .d_lon = grid->d_lon, .d_lat = grid->d_lat
+    };
+
+    memcpy(header.magic, warp_magic, sizeof(warp_magic));
+
+    return header;
+}
+
+static void warp_map_path(char *dest, size_t size, const char *directory, const struct WARP_MAP_HEADER *header) {
+    char name[32];
+    uint64_t hash = fnv1a(FNV1A_OFFSET_BASIS, header, sizeof(struct WARP_MAP_HEADER));
+
+    tile_name(name, sizeof(name), (struct TILE) {.x = header->tile_x, .y = header->tile_y});
+
+    int status = snprintf(dest, size, "%s/WARP_%s_%016llx%s", directory, name, (unsigned long long) hash,
+                          WARP_MAP_SUFFIX);
+
+    if (status < 0 || (size_t) status >= size) {
+        fprintf(stderr, "Error: Failed to construct path of warp map\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void allocate_warp_map(struct WARP_MAP *map, struct TILE tile, long size, const struct GRID *grid) {
+    size_t n = (size_t) size * (size_t) size;
+
+    map->tile = tile;
+    map->size = size;
+    map->weights.n = n;
+    map->weights.grid = *grid;
+    map->weights.index = malloc(4 * n * sizeof(int32_t));
+    map->weights.weight = malloc(4 * n * sizeof(float));
+
+    if (map->weights.index == NULL || map->weights.weight == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for warp map\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Read a persisted warp map whose header equals `expected`.
+ * @return Zero on success, non-zero if there is no such map
+ */
+static int load_warp_map(const char *path, const struct WARP_MAP_HEADER *expected, const struct GRID *grid,
+                         struct WARP_MAP *map) {
+    struct WARP_MAP_HEADER header;
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL)
+        return 1;
+
+    // the name only holds a hash of the header, so the header itself decides
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(&header, expected, sizeof(header)) != 0) {
+        fclose(f);
+        return 1;
+    }
+
+    allocate_warp_map(map, (struct TILE) {.x = header.tile_x, .y = header.tile_y}, (long) header.size, grid);
+
+    size_t n = 4 * map->weights.n;
+
+    if (fread(map->weights.index, sizeof(int32_t), n, f) != n || fread(map->weights.weight, sizeof(float), n, f) != n) {
+        fprintf(stderr, "Warning: Ignoring truncated warp map %s\n", path);
+        free_warp_map(map);
+        fclose(f);
+        return 1;
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+/**
+ * @brief Persist a warp map, writing to a temporary file first so that concurrent readers never see a partial map.
+ */
+static void save_warp_map(const char *path, const struct WARP_MAP_HEADER *header, const struct WARP_MAP *map) {
+    char tmp[4096 + 32];
+    size_t n = 4 * map->weights.n;
+
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long) getpid());
+
+    FILE *f = fopen(tmp, "wb");
+
+    if (f == NULL) {
+        fprintf(stderr, "Warning: Could not write warp map %s\n", path);
+        return;
+    }
+
+    int failed = fwrite(header, sizeof(struct WARP_MAP_HEADER), 1, f) != 1 ||
+                 fwrite(map->weights.index, sizeof(int32_t), n, f) != n ||
+                 fwrite(map->weights.weight, sizeof(float), n, f) != n;
+
+    if (fclose(f) != 0 || failed || rename(tmp, path) != 0) {
+        fprintf(stderr, "Warning: Could not write warp map %s\n", path);
+        unlink(tmp);
+    }
+}
+
+/**
+ * @brief Transformation from the datacube projection to geographic coordinates, longitude first.
+ */
+static OGRCoordinateTransformationH datacube_transformation(const struct DATACUBE *cube) {
+    OGRSpatialReferenceH source = OSRNewSpatialReference(NULL), target = OSRNewSpatialReference(NULL);
+    char *wkt = cube->projection;
+
+    if (OSRImportFromWkt(source, &wkt) != OGRERR_NONE || OSRImportFromEPSG(target, 4326) != OGRERR_NONE) {
+        fprintf(stderr, "Error: Failed to parse projection of the datacube\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // coordinates are passed as x/y, i.e. longitude first, whatever the authority says
+    OSRSetAxisMappingStrategy(source, OAMS_TRADITIONAL_GIS_ORDER);
+    OSRSetAxisMappingStrategy(target, OAMS_TRADITIONAL_GIS_ORDER);
+
+    OGRCoordinateTransformationH transform = OCTNewCoordinateTransformation(source, target);
+
+    if (transform == NULL) {
+        fprintf(stderr, "Error: Failed to set up transformation from the datacube projection to WGS 84\n");
+        exit(EXIT_FAILURE);
+    }
+
+    OSRDestroySpatialReference(source);
+    OSRDestroySpatialReference(target);
+
+    return transform;
+}
+
+/**
+ * @brief Geographic coordinates of the pixel centers of a tile. Pixels which can't be transformed get a latitude far
+ * outside of any grid.
+ */
+static void pixel_centers(const struct DATACUBE *cube, struct TILE tile, long size,
+                          OGRCoordinateTransformationH transform, struct POINTS *points) {
+    size_t n = (size_t) size * (size_t) size;
+    double geo_transform[6];
+
+    points->n = n;
+    points->lon = malloc(n * sizeof(double));
+    points->lat = malloc(n * sizeof(double));
+
+    int *success = malloc(n * sizeof(int));
+    double *z = calloc(n, sizeof(double));
+
+    if (points->lon == NULL || points->lat == NULL || success == NULL || z == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for pixel coordinates\n");
+        exit(EXIT_FAILURE);
+    }
+
+    tile_geo_transform(cube, tile, geo_transform);
+
+    for (long j = 0; j < size; j++) {
+        for (long i = 0; i < size; i++) {
+            size_t p = (size_t) j * (size_t) size + (size_t) i;
+            points->lon[p] = geo_transform[0] + ((double) i + 0.5) * geo_transform[1];
+            points->lat[p] = geo_transform[3] + ((double) j + 0.5) * geo_transform[5];
+        }
+    }
+
+    OCTTransformEx(transform, (int) n, points->lon, points->lat, z, success);
+
+    for (size_t p = 0; p < n; p++) {
+        if (!success[p])
+            points->lat[p] = 1e9;
+    }
+
+    free(success);
+    free(z);
+}
+
+size_t warp_maps_for_grid(const struct DATACUBE *cube, const struct TILE *tiles, size_t n_tiles,
+                          const struct GRID *grid, const char *directory, struct WARP_MAP *maps) {
+    char path[4096];
+    long size = lround(cube->tile_size / cube->resolution);
+    size_t n_computed = 0;
+    OGRCoordinateTransformationH transform = NULL;
+
+    // indices of all four corners of a tile must fit into int32, as must the number of points OGR transforms at once
+    if ((double) size * (double) size * 4.0 > (double) INT32_MAX) {
+        fprintf(stderr, "Error: Tiles of %ld x %ld pixels are too large for warp maps\n", size, size);
+        exit(EXIT_FAILURE);
+    }
+
+    // tiles are mapped one at a time, so memory is bounded by the size of a tile, not by the length of the list
+    for (size_t t = 0; t < n_tiles; t++) {
+        struct WARP_MAP_HEADER header = warp_map_header(cube, tiles[t], size, grid);
+        struct POINTS points;
+
+        if (directory) {
+            warp_map_path(path, sizeof(path), directory, &header);
+            if (load_warp_map(path, &header, grid, &maps[t]) == 0)
+                continue;
+        }
+
+        if (transform == NULL)
+            transform = datacube_transformation(cube);
+
+        pixel_centers(cube, tiles[t], size, transform, &points);
+        maps[t].tile = tiles[t];
+        maps[t].size = size;
+        compute_point_weights(grid, &points, &maps[t].weights);
+        free_points(&points);
+        n_computed++;
+
+        if (directory)
+            save_warp_map(path, &header, &maps[t]);
+    }
+
+    if (transform)
+        OCTDestroyCoordinateTransformation(transform);
+
+    return n_computed;
+}
+
+void free_warp_map(struct WARP_MAP *map) {
+    free_point_weights(&map->weights);
+}
+
+void apply_warp_map(const float *values, const struct WARP_MAP *map, float *out) {
+    gather_points(values, &map->weights, out);
+}
@@ -0,0 +1,154 @@
+#ifndef CAMS_WARPMAP_H
+#define CAMS_WARPMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gributils.h"
+#include "interpolate.h"
+
+#define DATACUBE_DEFINITION "datacube-definition.prj"
+#define WARP_MAP_SUFFIX ".warp"
+
+/**
+ * @brief Projection and tiling of a FORCE datacube
+ * @author Florian Katerndahl
+ */
+struct DATACUBE {
+    char *projection;       ///< WKT of the datacube projection
+    double origin_lon;      ///< longitude of the upper left corner of tile X0000_Y0000
+    double origin_lat;      ///< latitude of the upper left corner of tile X0000_Y0000
+    double origin_x;        ///< projected x coordinate of the upper left corner of tile X0000_Y0000
+    double origin_y;        ///< projected y coordinate of the upper left corner of tile X0000_Y0000
+    double tile_size;       ///< edge length of a tile in projection units
+    double block_size;      ///< height of a processing block in projection units
+    double resolution;      ///< edge length of an output pixel in projection units, chosen by the caller
+};
+
+/**
+ * @brief Position of a tile in the datacube grid, i.e. tile `X<x>_Y<y>`
+ * @author Florian Katerndahl
+ */
+struct TILE {
+    int x;
+    int y;
+};
+
+/**
+ * @brief Source indices and bilinear weights of every pixel of a datacube tile on one grid
+ * @details Pixels are ordered north-up, row by row. Pixels whose center lies outside of the grid get a weight of NAN,
+ * see `POINT_WEIGHTS`.
+ * @author Florian Katerndahl
+ */
+struct WARP_MAP {
+    struct TILE tile;
+    long size;                      ///< number of pixels along each edge of the tile
+    struct POINT_WEIGHTS weights;   ///< one point per pixel
+};
+
+/**
+ * @brief Fixed-size header at the start of a persisted warp map, followed by the indices and weights
+ * @details Numbers are stored in the byte order of the machine.
+ * @author Florian Katerndahl
+ */
+struct WARP_MAP_HEADER {
+    char magic[8];          ///< "CAMSWARP"
+    uint32_t version;       ///< format version
+    uint32_t byte_order;    ///< 0x01020304 in the byte order of the writing machine
+    uint64_t datacube;      ///< fingerprint of projection, origin, tile size and resolution of the datacube
+    int32_t tile_x;
+    int32_t tile_y;
+    int64_t size;           ///< number of pixels along each edge of the tile
+    int64_t ni;             ///< number of columns of the grid
+    int64_t nj;             ///< number of rows of the grid
+    double lon_first;       ///< longitude of the first grid point
+    double lat_first;       ///< latitude of the first grid point
+    double d_lon;           ///< signed increment between columns
+    double d_lat;           ///< signed increment between rows
+};
+
+/**
+ * @brief Read the definition of a FORCE datacube
+ * @details The file `DATACUBE_DEFINITION` in `directory` holds, one per line, the projection as WKT, longitude and
+ * latitude of the origin, projected x and y of the origin, the tile size and the block size.
+ * @param directory Root directory of the datacube
+ * @param resolution Edge length of an output pixel in projection units; the tile size must be a multiple of it
+ * @param cube Struct to populate. Must be freed with `free_datacube`.
+ * @note Terminates the program if the definition can't be read.
+ * @author Florian Katerndahl
+ */
+void read_datacube(const char *directory, double resolution, struct DATACUBE *cube);
+
+/**
+ * @brief Free the projection of `cube`
+ * @param cube Pointer to datacube struct
+ * @author Florian Katerndahl
+ */
+void free_datacube(struct DATACUBE *cube);
+
+/**
+ * @brief Read a FORCE tile allow-list
+ * @details Every line naming a tile as `X0069_Y0042` is taken, anything else, e.g. the number of tiles FORCE writes
+ * into the first line, is skipped.
+ * @param fname Path to the tile list
+ * @param n_tiles Set to the number of tiles
+ * @return Tiles in the order they are listed
+ * @note Terminates the program if the file holds no tiles.
+ * @author Florian Katerndahl
+ */
+struct TILE *read_tiles(const char *fname, size_t *n_tiles);
+
+/**
+ * @brief Name of a tile directory in the datacube, e.g. `X0069_Y0042`
+ * @param dest Buffer receiving the name
+ * @param size Size of `dest`
+ * @param tile Tile
+ * @author Florian Katerndahl
+ */
+void tile_name(char *dest, size_t size, struct TILE tile);
+
+/**
+ * @brief GDAL geotransform of a tile at the resolution of the datacube
+ * @param cube Datacube
+ * @param tile Tile
+ * @param geo_transform Array of six values to populate
+ * @author Florian Katerndahl
+ */
+void tile_geo_transform(const struct DATACUBE *cube, struct TILE tile, double geo_transform[6]);
+
+/**
+ * @brief Load the warp maps of a set of tiles on `grid` from `directory`, computing and persisting those which are
+ * missing or were computed for another datacube
+ * @details Missing tiles are mapped one at a time: their pixel centers are transformed to geographic coordinates with
+ * one OGR transformation shared by all tiles, then turned into bilinear weights by `compute_point_weights`. Maps are
+ * written to `directory/WARP_X0069_Y0042_<fingerprint>.warp`, the fingerprint covering datacube and grid.
+ * @param cube Datacube
+ * @param tiles Tiles to map
+ * @param n_tiles Number of tiles
+ * @param grid Grid geometry
+ * @param directory Directory holding persisted warp maps, NULL to neither read nor write them
+ * @param maps Array of `n_tiles` maps to populate. Each must be freed with `free_warp_map`.
+ * @return Number of maps which had to be computed
+ * @author Florian Katerndahl
+ */
+size_t warp_maps_for_grid(const struct DATACUBE *cube, const struct TILE *tiles, size_t n_tiles,
+                          const struct GRID *grid, const char *directory, struct WARP_MAP *maps);
+
+/**
+ * @brief Free the weights of a warp map
+ * @param map Pointer to warp map
+ * @author Florian Katerndahl
+ */
+void free_warp_map(struct WARP_MAP *map);
+
+/**
+ * @brief Resample the values of a field to all pixels of a tile
+ * @details Uses the vectorized gather of `gather_points`.
+ * @param values Values of a field on the grid the map was computed for
+ * @param map Warp map of the tile
+ * @param out Array of at least `map->size * map->size` values, north-up
+ * @author Florian Katerndahl
+ */
+void apply_warp_map(const float *values, const struct WARP_MAP *map, float *out);
+
+#endif //CAMS_WARPMAP_H
@@ -0,0 +1,193 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "src/fieldcache.h"
+
+#define N_VALUES 4099   ///< not a multiple of 8, so vectorized conversions also run their scalar tail
+
+static int failures = 0;
+
+/**
+ * @brief Report a value whose round trip exceeds the documented error bound.
+ */
+static void fail(const char *test, size_t i, float value, float decoded, double error, double bound) {
+    if (failures++ < 20)
+        fprintf(stderr, "FAIL %s: value %zu = %.9g decoded as %.9g, error %.3g exceeds %.3g\n", test, i,
+                (double) value, (double) decoded, error, bound);
+}
+
+/**
+ * @brief Deterministic uniform random number in [0, 1)
+ */
+static double uniform(uint64_t *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (double) (*state >> 11) * 0x1.0p-53;
+}
+
+/**
+ * @brief Round trip through float16 and check the bounds of `FIELD_CACHE_FLOAT16` for every value.
+ */
+static void check_float16(const char *test, const float *values, size_t n) {
+    uint16_t *half = malloc(n * sizeof(uint16_t));
+    float *decoded = malloc(n * sizeof(float));
+
+    if (half == NULL || decoded == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    quantize_float16(values, n, half);
+    dequantize_float16(half, n, decoded);
+
+    for (size_t i = 0; i < n; i++) {
+        double value = (double) values[i], magnitude = fabs(value), error = fabs((double) decoded[i] - value);
+        uint16_t single;
+        float single_decoded;
+
+        // vectorized and scalar conversion must agree bit for bit
+        quantize_float16(values + i, 1, &single);
+        dequantize_float16(&single, 1, &single_decoded);
+
+        if (single != half[i] || memcmp(&single_decoded, &decoded[i], sizeof(float)) != 0) {
+            if (failures++ < 20)
+                fprintf(stderr, "FAIL %s: value %zu = %.9g converted to 0x%04x alone but 0x%04x in bulk\n", test, i,
+                        (double) values[i], single, half[i]);
+        }
+
+        if (isnan(value)) {
+            if (!isnan(decoded[i]))
+                fail(test, i, values[i], decoded[i], INFINITY, 0.0);
+        } else if (magnitude >= 65520.0) {
+            if (!isinf(decoded[i]) || signbit(decoded[i]) != signbit(values[i]))
+                fail(test, i, values[i], decoded[i], INFINITY, 0.0);
+        } else if (magnitude >= 0x1.0p-14) {
+            if (error > magnitude * 0x1.0p-11)
+                fail(test, i, values[i], decoded[i], error, magnitude * 0x1.0p-11);
+        } else if (error > 0x1.0p-25 || signbit(decoded[i]) != signbit(values[i])) {
+            fail(test, i, values[i], decoded[i], error, 0x1.0p-25);
+        }
+    }
+
+    free(half);
+    free(decoded);
+}
+
+/**
+ * @brief Round trip through int16 and check the bound of `FIELD_CACHE_INT16` for every value.
+ */
+static void check_int16(const char *test, const float *values, size_t n) {
+    int16_t *codes = malloc(n * sizeof(int16_t));
+    float *decoded = malloc(n * sizeof(float));
+    double scale, offset, min = INFINITY, max = -INFINITY;
+
+    if (codes == NULL || decoded == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if ((double) values[i] < min) min = (double) values[i];
+        if ((double) values[i] > max) max = (double) values[i];
+    }
+
+    quantize_int16(values, n, codes, &scale, &offset);
+    dequantize_int16(codes, n, scale, offset, decoded);
+
+    for (size_t i = 0; i < n; i++) {
+        double value = (double) values[i], error = fabs((double) decoded[i] - value);
+        // half a step plus rounding the decoded value to float
+        double bound = (min < max ? (max - min) / 131068.0 : 0.0) + fabs(value) * 0x1.0p-24;
+
+        if (isnan(value)) {
+            if (!isnan(decoded[i]))
+                fail(test, i, values[i], decoded[i], INFINITY, 0.0);
+        } else if (isnan(decoded[i]) || error > bound) {
+            fail(test, i, values[i], decoded[i], error, bound);
+        }
+    }
+
+    free(codes);
+    free(decoded);
+}
+
+static void check_both(const char *test, const float *values, size_t n) {
+    char name[64];
+
+    snprintf(name, sizeof(name), "%s/float16", test);
+    check_float16(name, values, n);
+    snprintf(name, sizeof(name), "%s/int16", test);
+    check_int16(name, values, n);
+}
+
+int main(void) {
+    static float values[N_VALUES];
+    uint64_t state = 20030101;
+
+    // aerosol optical depths span about 0 to 5, with most of the mass near 0.1
+    for (size_t i = 0; i < N_VALUES; i++)
+        values[i] = (float) (5.0 * pow(uniform(&state), 3.0));
+    check_both("aod", values, N_VALUES);
+
+    // AOD-range fields with missing values
+    for (size_t i = 0; i < N_VALUES; i += 7)
+        values[i] = NAN;
+    check_both("aod_nan", values, N_VALUES);
+
+    for (size_t i = 0; i < N_VALUES; i++)
+        values[i] = 0.0f;
+    check_both("zeros", values, N_VALUES);
+
+    for (size_t i = 0; i < N_VALUES; i++)
+        values[i] = 0.3125f;
+    check_both("constant", values, N_VALUES);
+
+    for (size_t i = 0; i < N_VALUES; i++)
+        values[i] = NAN;
+    check_both("all_nan", values, N_VALUES);
+
+    // float32 subnormals and half precision subnormals, including the rounding boundary at 2^-25
+    for (size_t i = 0; i < N_VALUES; i++) {
+        double magnitude = i % 3 == 0 ? 1e-40 * uniform(&state) : 0x1.0p-14 * uniform(&state);
+        values[i] = (float) (i % 2 ? -magnitude : magnitude);
+    }
+    values[0] = 0x1.0p-25f;
+    values[1] = nextafterf(0x1.0p-25f, 1.0f);
+    values[2] = -0.0f;
+    values[3] = 0x1.0p-14f;
+    values[4] = nextafterf(0x1.0p-14f, 0.0f);
+    check_float16("subnormal", values, N_VALUES);
+
+    // magnitudes around and past the largest half precision value
+    for (size_t i = 0; i < N_VALUES; i++) {
+        double magnitude = 60000.0 + 10000.0 * uniform(&state);
+        values[i] = (float) (i % 2 ? -magnitude : magnitude);
+    }
+    values[0] = 65504.0f;
+    values[1] = 65519.0f;
+    values[2] = 65520.0f;
+    values[3] = -65520.0f;
+    values[4] = 1e30f;
+    values[5] = INFINITY;
+    values[6] = -INFINITY;
+    check_float16("overflow", values, N_VALUES);
+    check_int16("large", values + 7, N_VALUES - 7);
+
+    // every finite half precision magnitude range from 2^-14 to 2^15
+    for (size_t i = 0; i < N_VALUES; i++)
+        values[i] = (float) ldexp(1.0 + uniform(&state), (int) (i % 30) - 14);
+    check_float16("normal", values, N_VALUES);
+
+    if (failures) {
+        fprintf(stderr, "%d values exceed the documented error bounds\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    printf("All quantization round trips are within the documented error bounds\n");
+
+    return EXIT_SUCCESS;
+}